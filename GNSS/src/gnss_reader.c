@@ -1,4 +1,6 @@
 #include "gnss_reader.h"
+#include "timebase.h"
+#include "telemetry.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,6 +16,8 @@
 #define FIFO_PATH "/tmp/gnss_control_fifo"
 #define UI_FIFO_PATH "/tmp/gnss_ui_fifo"  // 新增UI通信管道路径
 #define RECORD_INTERVAL 10  // 记录间隔，单位为秒
+// 串口每 0.5 秒读一次，语句到达后最多等待一个周期，再加上传输时间
+#define GNSS_TIME_UNCERTAINTY_NS 1000000000ull
 
 // 全局GNSS数据，用于线程间共享
 static GnssData current_gnss_data;
@@ -27,6 +31,12 @@ char* format_time(time_t time_value) {
     return buffer;
 }
 
+// NMEA 的 ddmm.mmmm 转为度，南纬、西经为负
+static double nmea_degrees(double ddmm, char dir) {
+    double degrees = (int)(ddmm / 100) + (ddmm - (int)(ddmm / 100) * 100) / 60.0;
+    return (dir == 'S' || dir == 'W') ? -degrees : degrees;
+}
+
 // 修改GNSS初始化和数据收集函数
 
 void* gnss_reading_thread(void* arg) {
@@ -38,7 +48,13 @@ void* gnss_reading_thread(void* arg) {
     char json_filename[256];
     FILE *json_file = NULL;
     int is_first_entry = 1;
+    int telemetry_id = telemetry_open();
+    uint32_t telemetry_seq = 0;
     
+    if (!control->json_enabled) {
+        printf("GNSS JSON disabled, fixes are recorded by VideoProcess only\n");
+    }
+
     // 确保目录存在
     system("mkdir -p /mnt/sdcard");
     
@@ -59,7 +75,7 @@ void* gnss_reading_thread(void* arg) {
              t->tm_hour, t->tm_min, t->tm_sec);
     
     // 立即写入一个有效的JSON结构，即使没有数据
-    json_file = fopen(json_filename, "w");
+    json_file = control->json_enabled ? fopen(json_filename, "w") : NULL;
     if (json_file) {
         fprintf(json_file, "[\n");
         // 立即写入一条初始记录，确保文件不为空
@@ -80,13 +96,13 @@ void* gnss_reading_thread(void* arg) {
         fclose(json_file);
         printf("Created GNSS JSON file with initial data: %s\n", json_filename);
         is_first_entry = 0;
-    } else {
+    } else if (control->json_enabled) {
         perror("Failed to create GNSS JSON file");
         // 尝试在/tmp创建文件
         snprintf(json_filename, sizeof(json_filename), "/tmp/gnss_%04d%02d%02d_%02d%02d%02d.json",
                 t->tm_year + 1900, t->tm_mon + 1, t->tm_mday, 
                 t->tm_hour, t->tm_min, t->tm_sec);
-        json_file = fopen(json_filename, "w");
+        json_file = control->json_enabled ? fopen(json_filename, "w") : NULL;
         if (json_file) {
             fprintf(json_file, "[\n");
             fprintf(json_file, 
@@ -125,7 +141,7 @@ void* gnss_reading_thread(void* arg) {
             // 直接记录一条没有数据的记录
             now = time(NULL);
             if (difftime(now, last_record_time) >= 10) {
-                json_file = fopen(json_filename, "a");
+                json_file = control->json_enabled ? fopen(json_filename, "a") : NULL;
                 if (json_file) {
                     fprintf(json_file, ",\n");
                     fprintf(json_file, 
@@ -161,6 +177,7 @@ void* gnss_reading_thread(void* arg) {
         // 当运行标志为1时，持续读取数据
         while (is_gnss_running(control)) {
             ssize_t bytes_read = read(serial_fd, buffer, BUFFER_SIZE - 1);
+            uint64_t read_ns = timebase_now_ns();
             if (bytes_read > 0) {
                 buffer[bytes_read] = '\0';
                 
@@ -168,11 +185,38 @@ void* gnss_reading_thread(void* arg) {
                 if (parse_nmea(buffer, &gnss_data)) {
                     now = time(NULL);
                     gnss_data.record_time = now;
+                    gnss_data.mono_ns = read_ns;
+
+                    // 定位时间给出 UTC，系统时钟未设置时由它发布偏移；
+                    // 未定位时接收机的时间可能来自自身时钟，不发布
+                    uint64_t utc_ns;
+                    if (gnss_fix_valid(&gnss_data) && gnss_utc_ns(&gnss_data, &utc_ns)) {
+                        timebase_publish((int64_t)(utc_ns - read_ns), TIMEBASE_SOURCE_GNSS,
+                                         GNSS_TIME_UNCERTAINTY_NS);
+                    }
+
+                    // 每个有效定位都发给 VideoProcess 写入录像（不阻塞，无人接收时丢弃）；
+                    // 质量为 0 的 GGA 没有位置
+                    if (gnss_data.fix_quality > 0) {
+                        TelemetryGnss fix;
+                        memset(&fix, 0, sizeof(fix));
+                        fix.mono_ns = read_ns;
+                        fix.seq = telemetry_seq++;
+                        fix.latitude = nmea_degrees(gnss_data.latitude, gnss_data.lat_dir);
+                        fix.longitude = nmea_degrees(gnss_data.longitude, gnss_data.lon_dir);
+                        fix.altitude = (float)gnss_data.altitude;
+                        fix.satellites = (uint16_t)gnss_data.satellites;
+                        if (gnss_utc_ns(&gnss_data, &utc_ns)) {
+                            fix.utc_ns = utc_ns;
+                            fix.flags |= TELEMETRY_GNSS_UTC_VALID;
+                        }
+                        telemetry_send(telemetry_id, TELEMETRY_GNSS, &fix);
+                    }
                     
                     // 检查是否达到记录间隔（10秒）
                     if (difftime(now, last_record_time) >= 10) {
                         // 追加到JSON文件
-                        json_file = fopen(json_filename, "a");
+                        json_file = control->json_enabled ? fopen(json_filename, "a") : NULL;
                         if (json_file) {
                             if (!is_first_entry) {
                                 fprintf(json_file, ",\n");
@@ -187,13 +231,16 @@ void* gnss_reading_thread(void* arg) {
                                     "    \"altitude\": %.1f,\n"
                                     "    \"satellites\": %d,\n"
                                     "    \"record_time\": \"%s\",\n"
-                                    "    \"status\": \"active\"\n"
+                                    "    \"mono_ns\": %llu,\n"
+                                    "    \"status\": \"%s\"\n"
                                     "  }",
                                     gnss_data.timestamp,
                                     gnss_data.latitude, gnss_data.longitude,
                                     gnss_data.altitude,
                                     gnss_data.satellites,
-                                    format_time(gnss_data.record_time));
+                                    format_time(gnss_data.record_time),
+                                    (unsigned long long)gnss_data.mono_ns,
+                                    gnss_data.fix_quality > 0 ? "active" : "no_fix");
                             fclose(json_file);
                             last_record_time = now;
                             
@@ -207,7 +254,7 @@ void* gnss_reading_thread(void* arg) {
                                 write(fifo_fd, sat_str, strlen(sat_str));
                                 close(fifo_fd);
                             }
-                        } else {
+                        } else if (control->json_enabled) {
                             perror("Failed to open GNSS JSON file for appending");
                         }
                     }
@@ -222,7 +269,7 @@ void* gnss_reading_thread(void* arg) {
         close(serial_fd);
         
         // 正确完成JSON文件
-        json_file = fopen(json_filename, "a");
+        json_file = control->json_enabled ? fopen(json_filename, "a") : NULL;
         if (json_file) {
             fprintf(json_file, "\n]\n"); // 结束JSON数组
             fclose(json_file);
@@ -238,7 +285,7 @@ void* gnss_reading_thread(void* arg) {
                      t->tm_hour, t->tm_min, t->tm_sec);
             
             // 创建新文件并添加初始记录
-            json_file = fopen(json_filename, "w");
+            json_file = control->json_enabled ? fopen(json_filename, "w") : NULL;
             if (json_file) {
                 fprintf(json_file, "[\n");
                 fprintf(json_file, 
@@ -389,51 +436,93 @@ int is_gnss_running(GnssControl* control) {
     return status;
 }
 
+// 取 NMEA 语句的第 n 个字段（0 为语句名），保留空字段
+static int nmea_field(const char* line, int n, char* out, size_t size) {
+    const char* p = line;
+    for (int i = 0; i < n; i++) {
+        p = strchr(p, ',');
+        if (!p) return 0;
+        p++;
+    }
+    size_t len = strcspn(p, ",*");
+    if (len == 0 || len >= size) return 0;
+    memcpy(out, p, len);
+    out[len] = '\0';
+    return 1;
+}
+
 // 解析NMEA数据（实现重点关注GGA语句）
 int parse_nmea(const char* buffer, GnssData* data) {
-    char *line, *saveptr, *token;
+    char *line, *saveptr;
     char temp[BUFFER_SIZE];
+    int found = 0;
     
     // 拷贝缓冲区以便使用strtok_r
     strncpy(temp, buffer, BUFFER_SIZE - 1);
+    temp[BUFFER_SIZE - 1] = '\0';
     
     // 按行处理NMEA数据
     line = strtok_r(temp, "\r\n", &saveptr);
     while (line != NULL) {
+        // RMC 语句带日期（第 9 个字段 ddmmyy），GGA 只有时分秒
+        if (strncmp(line, "$GPRMC", 6) == 0 || strncmp(line, "$GNRMC", 6) == 0) {
+            char date[8], status[2];
+            if (nmea_field(line, 9, date, sizeof(date)) && strlen(date) == 6) {
+                memcpy(data->date, date, sizeof(data->date));
+            }
+            data->rmc_status = nmea_field(line, 2, status, sizeof(status)) ? status[0] : 'V';
+        }
         // 检查是否是GGA语句 (定位数据)
+        // 未定位时接收机留空坐标等字段，按位置取字段，不能用 strtok_r 合并分隔符
         if (strncmp(line, "$GPGGA", 6) == 0 || strncmp(line, "$GNGGA", 6) == 0) {
-            int i = 0;
-            char *token_saveptr;
-            token = strtok_r(line, ",", &token_saveptr);
-            
-            while (token != NULL) {
-                i++;
-                switch (i) {
-                    case 2: // 时间
-                        snprintf(data->timestamp, sizeof(data->timestamp), "%s", token);
-                        break;
-                    case 3: // 纬度
-                        data->latitude = atof(token);
-                        break;
-                    case 5: // 经度
-                        data->longitude = atof(token);
-                        break;
-                    case 8: // 卫星数
-                        data->satellites = atoi(token);
-                        break;
-                    case 10: // 海拔高度
-                        data->altitude = atof(token);
-                        break;
-                }
-                token = strtok_r(NULL, ",", &token_saveptr);
+            char field[32];
+            nmea_field(line, 1, data->timestamp, sizeof(data->timestamp)); // 时间
+            data->fix_quality = nmea_field(line, 6, field, sizeof(field)) ? atoi(field) : 0;
+            data->satellites = nmea_field(line, 7, field, sizeof(field)) ? atoi(field) : 0;
+            // 未定位时保留上一次的位置
+            if (data->fix_quality > 0) {
+                data->latitude = nmea_field(line, 2, field, sizeof(field)) ? atof(field) : 0.0;
+                data->lat_dir = nmea_field(line, 3, field, sizeof(field)) ? field[0] : 0;
+                data->longitude = nmea_field(line, 4, field, sizeof(field)) ? atof(field) : 0.0;
+                data->lon_dir = nmea_field(line, 5, field, sizeof(field)) ? field[0] : 0;
+                data->altitude = nmea_field(line, 9, field, sizeof(field)) ? atof(field) : 0.0;
             }
-            return 1; // 成功解析
+            found = 1; // 成功解析，继续查找同批的 RMC 日期
         }
         
         line = strtok_r(NULL, "\r\n", &saveptr);
     }
     
-    return 0; // 没有找到有效数据
+    return found;
+}
+
+// 接收机已定位：GGA 质量非 0 且 RMC 状态为 'A'
+int gnss_fix_valid(const GnssData* data) {
+    return data->fix_quality > 0 && data->rmc_status == 'A';
+}
+
+// GGA 时间（hhmmss.ss）加 RMC 日期得到定位的 UTC 时间
+int gnss_utc_ns(const GnssData* data, uint64_t* utc_ns) {
+    int hh, mm, day, mon, year;
+    double ss;
+    if (strlen(data->date) != 6 || sscanf(data->date, "%2d%2d%2d", &day, &mon, &year) != 3 ||
+        sscanf(data->timestamp, "%2d%2d%lf", &hh, &mm, &ss) != 3 || mon < 1 || mon > 12) {
+        return 0;
+    }
+    struct tm t;
+    memset(&t, 0, sizeof(t));
+    t.tm_year = year + 100;
+    t.tm_mon = mon - 1;
+    t.tm_mday = day;
+    t.tm_hour = hh;
+    t.tm_min = mm;
+    t.tm_sec = (int)ss;
+    time_t seconds = timegm(&t);
+    if (seconds == (time_t)-1) {
+        return 0;
+    }
+    *utc_ns = (uint64_t)seconds * 1000000000ull + (uint64_t)((ss - (int)ss) * 1e9);
+    return 1;
 }
 
 // 保存为JSON格式 - 使用简洁英文标签
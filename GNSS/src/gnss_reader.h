@@ -3,6 +3,7 @@
 
 #include <pthread.h>
 #include <time.h>
+#include <stdint.h>
 
 // 数据结构定义
 typedef struct {
@@ -12,11 +13,18 @@ typedef struct {
     int satellites;
     double altitude;
     time_t record_time;  // 添加记录时间
+    char date[8];        // RMC 日期 ddmmyy（UTC），未收到时为空
+    char lat_dir;        // 'N' 或 'S'（latitude/longitude 为 NMEA 原始的 ddmm.mmmm）
+    char lon_dir;        // 'E' 或 'W'
+    uint64_t mono_ns;    // 读到该定位的时间（CLOCK_MONOTONIC，与视频、IMU 同一时间基准）
+    int fix_quality;     // GGA 定位质量，0 为未定位
+    char rmc_status;     // RMC 状态，'A' 有效，'V' 无效，未收到时为 0
 } GnssData;
 
 // 控制结构体
 typedef struct {
     int running;            // 运行标志
+    int json_enabled;       // 写 JSON 文件（--no-json 时定位只经遥测队列写入录像）
     pthread_mutex_t mutex;  // 互斥锁保护状态
 } GnssControl;
 
@@ -25,6 +33,8 @@ void* gnss_reading_thread(void* arg);
 void* command_listener_thread(void* arg);
 void* ui_update_thread(void* arg);  // 新增UI更新线程
 int parse_nmea(const char* buffer, GnssData* data);
+int gnss_utc_ns(const GnssData* data, uint64_t* utc_ns);  // GGA 时间 + RMC 日期，成功返回 1
+int gnss_fix_valid(const GnssData* data);  // GGA 已定位且 RMC 状态为 'A' 时返回 1
 void save_to_json(const GnssData* data, const char* filepath);
 void start_gnss_collection(GnssControl* control);
 void stop_gnss_collection(GnssControl* control);
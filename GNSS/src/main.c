@@ -7,10 +7,46 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <signal.h>
+#include <string.h>
 #include "gnss_reader.h"
+#include "timebase.h"
 
 GnssControl g_control;
 
+// --self-test：检查 NMEA 解析，未定位的 GGA 留空字段时各字段不能错位
+static int self_test(void) {
+    struct {
+        const char *nmea;
+        int quality, satellites, valid;
+        double latitude, altitude;
+    } cases[] = {
+        { "$GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,230394,003.1,W*6A\r\n"
+          "$GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,*47\r\n",
+          1, 8, 1, 4807.038, 545.4 },
+        { "$GPRMC,123520,V,,,,,,,230394,,,N*53\r\n"
+          "$GPGGA,123520,,,,,0,00,99.99,,,,,,*48\r\n",
+          0, 0, 0, 4807.038, 545.4 },     // 保留上一次的位置
+        { "$GNGGA,,,,,,0,03,,,,,,,*7A\r\n",
+          0, 3, 0, 4807.038, 545.4 },
+    };
+    GnssData data;
+    int failed = 0;
+    memset(&data, 0, sizeof(data));
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        int ok = parse_nmea(cases[i].nmea, &data) &&
+                 data.fix_quality == cases[i].quality &&
+                 data.satellites == cases[i].satellites &&
+                 gnss_fix_valid(&data) == cases[i].valid &&
+                 data.latitude == cases[i].latitude &&
+                 data.altitude == cases[i].altitude;
+        printf("NMEA case %zu: %s (quality %d, satellites %d, lat %.3f%c, alt %.1f)\n",
+               i, ok ? "ok" : "FAILED", data.fix_quality, data.satellites,
+               data.latitude, data.lat_dir ? data.lat_dir : '-', data.altitude);
+        failed |= !ok;
+    }
+    return failed;
+}
+
 // 信号处理函数
 void signal_handler(int sig) {
     if (sig == SIGTERM || sig == SIGINT) {
@@ -19,12 +55,23 @@ void signal_handler(int sig) {
     }
 }
 
-int main() {
+int main(int argc, char *argv[]) {
     pthread_t gnss_thread, cmd_thread, ui_thread;
     int ret;
     
     // 初始化控制结构
     g_control.running = 0;  // 初始状态为停止
+    g_control.json_enabled = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-json") == 0) {
+            g_control.json_enabled = 0;
+        } else if (strcmp(argv[i], "--self-test") == 0) {
+            return self_test();
+        } else {
+            fprintf(stderr, "Usage: %s [--no-json | --self-test]\n", argv[0]);
+            return 1;
+        }
+    }
     pthread_mutex_init(&g_control.mutex, NULL);
     
     // 注册信号处理
@@ -32,6 +79,10 @@ int main() {
     signal(SIGINT, signal_handler);
     
     printf("Starting GNSS data collector...\n");
+
+    // 定位带 UTC 时间：系统时钟未设置时由 GNSS 发布单调时钟到 UTC 的偏移
+    timebase_open();
+    timebase_publish_system();
     
     // 创建命令监听线程
     ret = pthread_create(&cmd_thread, NULL, command_listener_thread, &g_control);
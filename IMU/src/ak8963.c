@@ -6,30 +6,91 @@
 #include "imu_logger.h"
 #include "i2c_utils.h"
 
-static int ak_fd = -1;
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define AK_WIA      0x00
+#define AK_ST1      0x02
+#define AK_CNTL1    0x0A
+#define AK_ASAX     0x10
+
+static uint8_t ak_addr = 0x0D;
+static i2c_bus *ak_bus = NULL;
+static int ak_aux = 0;          // 经 MPU6500 辅助 I2C 主机访问
+static uint8_t ak_last[6];      // 上一次的 HXL..HZH，用于判断是否为新测量
+
+// Register access, directly or through the MPU6500's SLV4
+static int ak_write(uint8_t reg, uint8_t value) {
+    return ak_aux ? mpu6500_aux_write(ak_bus, ak_addr, reg, value)
+                  : i2c_bus_write(ak_bus, ak_addr, reg, value);
+}
+
+static int ak_read(uint8_t reg, uint8_t *buf, size_t len) {
+    if (!ak_aux) {
+        return i2c_bus_read(ak_bus, ak_addr, reg, buf, len);
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (mpu6500_aux_read(ak_bus, ak_addr, (uint8_t)(reg + i), &buf[i]) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int ak_configure(void);
 
 // AK8963初始化
 // 改进磁力计初始化
 
-int ak8963_init(const char *device, int addr) {
-    printf("[IMU] Initializing AK8963 on %s, address 0x%02X\n", device, addr);
-    
-    ak_fd = i2c_init(device, addr);
-    if (ak_fd < 0) {
-        printf("[IMU] Failed to open I2C device for AK8963\n");
+int ak8963_init(i2c_bus *bus, int addr) {
+    printf("[IMU] Initializing AK8963 at address 0x%02X\n", addr);
+    ak_addr = (uint8_t)addr;
+    ak_bus = bus;
+    ak_aux = 0;
+
+    if (!bus) {
+        printf("[IMU] No I2C bus for AK8963\n");
+        return 0;
+    }
+    return ak_configure();
+}
+
+// The AK8963 hangs off the MPU6500's auxiliary bus: its SLV4 configures it,
+// then SLV0 copies ST1..ST2 into EXT_SENS_DATA on every sample, so one burst
+// from ACCEL_XOUT_H returns all nine axes
+int ak8963_init_aux(i2c_bus *bus, int addr) {
+    printf("[IMU] Initializing AK8963 at address 0x%02X through the MPU6500 I2C master\n", addr);
+    ak_addr = (uint8_t)addr;
+    ak_bus = bus;
+    ak_aux = 1;
+
+    uint8_t wia = 0;
+    if (!bus || !mpu6500_aux_master_init(bus)) {
+        return 0;
+    }
+    if (ak_read(AK_WIA, &wia, 1) != 0 || wia != 0x48) {
+        printf("[IMU] No AK8963 on the MPU6500 auxiliary bus (WIA 0x%02X)\n", wia);
+        mpu6500_aux_master_stop(bus);
+        return 0;
+    }
+    if (!ak_configure() || mpu6500_aux_slave0(bus, ak_addr, AK_ST1, AK8963_READ_LEN) != 0) {
+        mpu6500_aux_master_stop(bus);
         return 0;
     }
-    printf("[IMU] I2C device opened successfully for AK8963\n");
+    return 1;
+}
 
+static int ak_configure(void) {
     // 重置设备
-    if (i2c_write_reg(ak_fd, 0x0A, 0x00) != 0) { // Power-down mode
+    if (ak_write(AK_CNTL1, 0x00) != 0) { // Power-down mode
         printf("[IMU] Failed to reset AK8963\n");
         return 0;
     }
     usleep(100000);  // 100ms delay
     
     // 进入Fuse ROM访问模式以读取校准数据
-    if (i2c_write_reg(ak_fd, 0x0A, 0x0F) != 0) { // Fuse ROM access mode
+    if (ak_write(AK_CNTL1, 0x0F) != 0) { // Fuse ROM access mode
         printf("[IMU] Failed to enter Fuse ROM access mode\n");
         return 0;
     }
@@ -37,7 +98,7 @@ int ak8963_init(const char *device, int addr) {
     
     // 读取校准数据
     uint8_t adjust[3];
-    if (i2c_read_reg(ak_fd, 0x10, adjust, 3) != 3) {
+    if (ak_read(AK_ASAX, adjust, 3) != 0) {
         printf("[IMU] Failed to read sensitivity adjustment values\n");
         return 0;
     }
@@ -45,14 +106,14 @@ int ak8963_init(const char *device, int addr) {
           adjust[0], adjust[1], adjust[2]);
     
     // 退出Fuse ROM访问模式
-    if (i2c_write_reg(ak_fd, 0x0A, 0x00) != 0) {
+    if (ak_write(AK_CNTL1, 0x00) != 0) {
         printf("[IMU] Failed to exit Fuse ROM access mode\n");
         return 0;
     }
     usleep(100000);  // 100ms delay
     
     // 配置连续测量模式
-    if (i2c_write_reg(ak_fd, 0x0A, 0x16) != 0) { // 100Hz with 16-bit resolution
+    if (ak_write(AK_CNTL1, 0x16) != 0) { // 100Hz with 16-bit resolution
         printf("[IMU] Failed to set continuous measurement mode\n");
         return 0;
     }
@@ -61,22 +122,22 @@ int ak8963_init(const char *device, int addr) {
     return 1;
 }
 
-// Read magnetometer data with debug info
-int read_ak8963_data(imu_raw_data *data) {
-    uint8_t buf[7];
-    
-    if (i2c_read_reg(ak_fd, 0x03, buf, sizeof(buf)) != sizeof(buf)) {
-        // Only show detailed error every 1000 attempts to avoid log spam
-        static int error_count = 0;
-        if ((++error_count % 1000) == 0) {
-            printf("[IMU] Failed to read from AK8963 (attempt #%d)\n", error_count);
-        }
-        return 0;
-    }
+// ST1, HXL..HZH and ST2; reading ST2 releases the data registers for the next measurement
+void ak8963_read_op(i2c_read_op *op, uint8_t *buf) {
+    *op = (i2c_read_op){ ak_addr, AK_ST1, AK8963_READ_LEN, buf };
+}
+
+// Same layout whether read directly or from EXT_SENS_DATA. A sample is fresh
+// when ST1.DRDY is set or the data changed: a polled reader can miss the one
+// aux-master read that saw DRDY, but the values still move on.
+void ak8963_convert(const uint8_t *buf, imu_raw_data *data) {
+    const uint8_t *hxl = buf + 1;
 
     // Magnetometer data conversion
-    data->mag[0] = (int16_t)(buf[1]<<8 | buf[0]) * 0.15; // X axis
-    data->mag[1] = (int16_t)(buf[3]<<8 | buf[2]) * 0.15; // Y axis
-    data->mag[2] = (int16_t)(buf[5]<<8 | buf[4]) * 0.15; // Z axis
-    return 1;
-}
\ No newline at end of file
+    data->mag[0] = (int16_t)(hxl[1]<<8 | hxl[0]) * 0.15; // X axis
+    data->mag[1] = (int16_t)(hxl[3]<<8 | hxl[2]) * 0.15; // Y axis
+    data->mag[2] = (int16_t)(hxl[5]<<8 | hxl[4]) * 0.15; // Z axis
+
+    data->mag_fresh = (buf[0] & 0x01) || memcmp(hxl, ak_last, sizeof(ak_last)) != 0;
+    memcpy(ak_last, hxl, sizeof(ak_last));
+}
@@ -0,0 +1,721 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/IMU/src/bench.c
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "bench.h"
+#include "imu_logger.h"
+#include "imu_ring.h"
+#include "i2c_mock.h"
+#include "imu_fifo.h"
+#include "imu_binlog.h"
+
+static uint64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* ---------- ring: simulated high-rate producer against the logging drain ---------- */
+
+typedef struct {
+    imu_ring *ring;
+    int rate;
+    int seconds;
+    volatile int done;          // producer finished
+    uint64_t produced;
+    // Consumer
+    uint64_t consumed;
+    uint64_t out_of_order;
+    uint64_t wakeups;
+    size_t max_batch;           // samples found in one wakeup
+    uint64_t cpu_ns;
+} RingSoak;
+
+// Paced by absolute deadlines so a late wakeup does not lower the rate
+static void* soak_producer(void *arg) {
+    RingSoak *soak = (RingSoak *)arg;
+    uint64_t period = 1000000000ull / soak->rate;
+    uint64_t total = (uint64_t)soak->rate * soak->seconds;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    imu_sample sample;
+    memset(&sample, 0, sizeof(sample));
+    for (uint64_t seq = 0; seq < total; seq++) {
+        next.tv_nsec += period;
+        while (next.tv_nsec >= 1000000000) {
+            next.tv_nsec -= 1000000000;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+        // The sequence number rides in a field the drain does not inspect
+        clock_gettime(CLOCK_MONOTONIC, &sample.raw.ts);
+        sample.raw.accel[0] = (float)seq;
+        sample.fused.ts = sample.raw.ts;
+        imu_ring_push(soak->ring, &sample);
+        soak->produced++;
+    }
+    __atomic_store_n(&soak->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Same cadence and batch as logging_thread; a CSV line is formatted per
+// sample as a stand-in for the file and queue work
+static void* soak_consumer(void *arg) {
+    RingSoak *soak = (RingSoak *)arg;
+    static imu_sample batch[LOG_BATCH];
+    char line[128];
+    uint64_t expect = 0;
+    uint64_t cpu0 = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+
+    for (;;) {
+        int finished = __atomic_load_n(&soak->done, __ATOMIC_ACQUIRE);
+        size_t total = 0, n;
+        while ((n = imu_ring_pop(soak->ring, batch, LOG_BATCH)) > 0) {
+            for (size_t i = 0; i < n; i++) {
+                uint64_t seq = (uint64_t)batch[i].raw.accel[0];
+                if (seq != expect) {
+                    soak->out_of_order++;
+                }
+                expect = seq + 1;
+                snprintf(line, sizeof(line), "%lld.%09ld,%.2f,%.2f,%.2f\n",
+                         (long long)batch[i].fused.ts.tv_sec, batch[i].fused.ts.tv_nsec,
+                         batch[i].fused.roll, batch[i].fused.pitch, batch[i].fused.yaw);
+            }
+            total += n;
+        }
+        soak->consumed += total;
+        if (total > soak->max_batch) {
+            soak->max_batch = total;
+        }
+        soak->wakeups++;
+        // Everything pushed before `done` has been drained
+        if (finished) {
+            break;
+        }
+        usleep(LOG_PERIOD_US);
+    }
+    soak->cpu_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID) - cpu0;
+    return NULL;
+}
+
+// IMU_BENCH_RATE (Hz, default 1000), IMU_BENCH_SECONDS (default 60).
+// A simulated sensor pushes at the given rate while a consumer drains the
+// ring the way logging_thread does; no sample may be dropped or reordered.
+static int bench_ring(void) {
+    const char *rate_env = getenv("IMU_BENCH_RATE");
+    const char *seconds_env = getenv("IMU_BENCH_SECONDS");
+    RingSoak soak;
+    memset(&soak, 0, sizeof(soak));
+    soak.rate = rate_env ? atoi(rate_env) : 1000;
+    soak.seconds = seconds_env ? atoi(seconds_env) : 60;
+    if (soak.rate <= 0) soak.rate = 1000;
+    if (soak.seconds <= 0) soak.seconds = 60;
+
+    soak.ring = (imu_ring *)aligned_alloc(64, sizeof(imu_ring));
+    if (!soak.ring) {
+        return -1;
+    }
+    imu_ring_init(soak.ring);
+
+    printf("IMU ring soak: %d Hz producer for %d s, %d slots, drain every %d us in batches of %d\n",
+           soak.rate, soak.seconds, IMU_RING_SIZE, LOG_PERIOD_US, LOG_BATCH);
+    pthread_t producer, consumer;
+    uint64_t t0 = clock_ns(CLOCK_MONOTONIC);
+    pthread_create(&consumer, NULL, soak_consumer, &soak);
+    pthread_create(&producer, NULL, soak_producer, &soak);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+    double wall_s = (clock_ns(CLOCK_MONOTONIC) - t0) / 1e9;
+
+    uint64_t dropped = imu_ring_dropped(soak.ring);
+    printf("  produced %llu  consumed %llu  dropped %llu  out of order %llu\n",
+           (unsigned long long)soak.produced, (unsigned long long)soak.consumed,
+           (unsigned long long)dropped, (unsigned long long)soak.out_of_order);
+    printf("  %llu wakeups, at most %zu samples per wakeup, ring high water %u of %d\n",
+           (unsigned long long)soak.wakeups, soak.max_batch, soak.ring->high_water, IMU_RING_SIZE);
+    printf("  consumer CPU %.1f ms in %.1f s (%.3f%% of a core, %.2f us per sample)\n",
+           soak.cpu_ns / 1e6, wall_s, soak.cpu_ns / 1e7 / wall_s,
+           soak.consumed ? soak.cpu_ns / 1e3 / soak.consumed : 0.0);
+
+    int ret = 0;
+    if (dropped || soak.out_of_order || soak.consumed != soak.produced) {
+        printf("  FAIL: samples lost or reordered\n");
+        ret = 1;
+    }
+    free(soak.ring);
+    return ret;
+}
+
+/* ---------- i2c: bus traffic per 9-axis sample across read paths ---------- */
+
+typedef struct {
+    const char *name;
+    i2c_bus_stats stats;
+    int samples;
+    int fresh;          // samples flagged with a new magnetometer measurement
+    int mismatches;
+    double seconds;
+} I2cRun;
+
+typedef struct {
+    float accel[3];
+    float gyro[3];
+    float mag[3];
+    int check;          // emulated sensors: every sample must decode to the above
+} I2cMotion;
+
+static int close_to(float a, float b, float lsb) {
+    return a - b <= lsb && b - a <= lsb;
+}
+
+static void i2c_check(I2cRun *run, const I2cMotion *motion, const imu_raw_data *raw) {
+    const float accel_lsb = 8.0f * 9.81f / 32768.0f;
+    const float gyro_lsb = 2000.0f / 32768.0f * (float)(M_PI / 180.0);
+    const float mag_lsb = 0.15f;
+
+    run->samples++;
+    run->fresh += raw->mag_fresh != 0;
+    if (!motion->check) {
+        return;
+    }
+    for (int k = 0; k < 3; k++) {
+        if (!close_to(raw->accel[k], motion->accel[k], accel_lsb) ||
+            !close_to(raw->gyro[k], motion->gyro[k], gyro_lsb) ||
+            !close_to(raw->mag[k], motion->mag[k], mag_lsb)) {
+            run->mismatches++;
+            return;
+        }
+    }
+}
+
+static void i2c_report(const I2cRun *run) {
+    double n = run->samples ? run->samples : 1;
+    printf("  %-9s  %5.2f syscalls  %5.2f transactions  %5.2f messages  %5.1f bytes  bus %6.1f us  wall %5.1f us  per sample",
+           run->name, run->stats.syscalls / n, run->stats.transactions / n, run->stats.messages / n,
+           run->stats.bytes / n, run->stats.bus_ns / n / 1e3, run->stats.wall_ns / n / 1e3);
+    if (run->seconds > 0) {
+        printf("  (%d read, fresh mag %.0f/s, %llu errors, %d mismatched)\n", run->samples,
+               run->fresh / run->seconds, (unsigned long long)run->stats.errors, run->mismatches);
+    } else {
+        printf("  (%d read, %llu errors, %d mismatched)\n", run->samples,
+               (unsigned long long)run->stats.errors, run->mismatches);
+    }
+}
+
+static void i2c_run_polled(i2c_bus *bus, I2cRun *run, const I2cMotion *motion, int samples) {
+    imu_raw_data raw;
+    i2c_bus_reset_stats(bus);
+    for (int i = 0; i < samples; i++) {
+        if (read_9axis_data(bus, &raw)) {
+            i2c_check(run, motion, &raw);
+        }
+    }
+    i2c_bus_get_stats(bus, &run->stats);
+}
+
+static int i2c_run_fifo(i2c_bus *bus, I2cRun *run, const I2cMotion *motion, int seconds) {
+    imu_fifo fifo;
+    imu_raw_data batch[IMU_FIFO_MAX_SAMPLES];
+    if (imu_fifo_open(&fifo, bus, IMU_FIFO_RATE, NULL) != 0) {
+        return -1;
+    }
+    i2c_bus_reset_stats(bus);
+    uint64_t t0 = clock_ns(CLOCK_MONOTONIC);
+    uint64_t end = t0 + (uint64_t)seconds * 1000000000ull;
+    while (clock_ns(CLOCK_MONOTONIC) < end) {
+        int n = imu_fifo_read(&fifo, batch, IMU_FIFO_MAX_SAMPLES);
+        for (int i = 0; i < n; i++) {
+            i2c_check(run, motion, &batch[i]);
+        }
+    }
+    run->seconds = (clock_ns(CLOCK_MONOTONIC) - t0) / 1e9;
+    i2c_bus_get_stats(bus, &run->stats);
+    imu_fifo_close(&fifo);
+    return 0;
+}
+
+// IMU_BENCH_DEVICE (e.g. /dev/i2c-1) reads the real sensors, otherwise the
+// emulated ones (i2c_mock.h); IMU_BENCH_SAMPLES (default 1000) reads per
+// polled path, IMU_BENCH_SECONDS (default 2) per FIFO path.
+//  split     the old pattern: register address and data as separate
+//            write()/read() transactions per sensor
+//  combined  read_9axis_data: both sensors in one repeated-start transfer
+//  aux       the AK8963 behind the MPU6500's I2C master: one 22-byte burst
+//  fifo      FIFO bursts, magnetometer read once per burst
+//  fifo+aux  FIFO records carrying EXT_SENS_DATA
+// Bus time is modelled from the bytes on the wire at I2C_BUS_HZ; wall time
+// is what the transfers took, which only means something on real hardware.
+// On the emulated sensors every sample must decode to the motion they were
+// given, and the FIFO paths must flag about 100 fresh magnetometer samples a
+// second (its continuous mode 2).
+static int bench_i2c(void) {
+    const char *device = getenv("IMU_BENCH_DEVICE");
+    const char *samples_env = getenv("IMU_BENCH_SAMPLES");
+    const char *seconds_env = getenv("IMU_BENCH_SECONDS");
+    int samples = samples_env ? atoi(samples_env) : 1000;
+    int seconds = seconds_env ? atoi(seconds_env) : 2;
+    if (samples <= 0) samples = 1000;
+    if (seconds <= 0) seconds = 2;
+
+    i2c_mock *mock = NULL;
+    i2c_bus *bus = device ? i2c_bus_open(device) : i2c_mock_open(&mock);
+    if (!bus) {
+        return -1;
+    }
+    I2cMotion motion = {{1.2f, -0.8f, 9.6f}, {0.5f, -0.25f, 1.0f}, {21.3f, -4.5f, -38.7f}, mock != NULL};
+    if (mock) {
+        i2c_mock_set_motion(mock, motion.accel, motion.gyro, motion.mag);
+    }
+    if (!mpu6500_init(bus, 0x68) || !ak8963_init(bus, 0x0D)) {
+        i2c_bus_close(bus);
+        return -1;
+    }
+
+    printf("IMU I2C: 9-axis samples on %s, %d Hz bus\n", device ? device : "emulated MPU6500/AK8963", I2C_BUS_HZ);
+    I2cRun runs[5] = {{.name = "split"}, {.name = "combined"}, {.name = "aux"}, {.name = "fifo"}, {.name = "fifo+aux"}};
+    int nruns = 5;
+
+    i2c_bus_set_combined(bus, 0);
+    i2c_run_polled(bus, &runs[0], &motion, samples);
+    i2c_bus_set_combined(bus, 1);
+    i2c_run_polled(bus, &runs[1], &motion, samples);
+    if (i2c_run_fifo(bus, &runs[3], &motion, seconds) != 0) {
+        i2c_bus_close(bus);
+        return -1;
+    }
+    // The FIFO paths leave the chip sampling at 1 kHz; so does the aux master
+    if (ak8963_init_aux(bus, 0x0D)) {
+        usleep(20000);  // first measurement in continuous mode
+        i2c_run_polled(bus, &runs[2], &motion, samples);
+        i2c_run_fifo(bus, &runs[4], &motion, seconds);
+    } else {
+        printf("  no AK8963 on the MPU6500 auxiliary bus, aux paths skipped\n");
+        nruns = 2;
+    }
+
+    int ret = 0;
+    for (int r = 0; r < 5; r++) {
+        if (nruns == 2 && (r == 2 || r == 4)) {
+            continue;
+        }
+        i2c_report(&runs[r]);
+        int expected = runs[r].seconds > 0 ? runs[r].samples > 0 : runs[r].samples == samples;
+        if (!expected || runs[r].mismatches || runs[r].stats.errors) {
+            ret = 1;
+        }
+        if (mock && runs[r].seconds > 0) {
+            double fresh_hz = runs[r].fresh / runs[r].seconds;
+            if (fresh_hz < 90 || fresh_hz > 110) {
+                ret = 1;
+            }
+        }
+    }
+
+    double split = (double)runs[0].stats.transactions / runs[0].samples;
+    for (int r = 1; r < 5; r++) {
+        if ((nruns == 2 && (r == 2 || r == 4)) || !runs[r].samples) {
+            continue;
+        }
+        double n = runs[r].samples;
+        printf("  %-9s  %.1fx fewer transactions than split, %.1f%% less bus time\n", runs[r].name,
+               split / (runs[r].stats.transactions / n),
+               100.0 * (1.0 - (runs[r].stats.bus_ns / n) / ((double)runs[0].stats.bus_ns / runs[0].samples)));
+    }
+    if (ret) {
+        printf("  FAIL: reads failed, decoded wrong or magnetometer freshness off\n");
+    }
+    i2c_bus_close(bus);
+    return ret;
+}
+
+/* ---------- fifo: usleep-paced reads vs FIFO bursts, sample interval jitter ---------- */
+
+typedef struct {
+    uint64_t *ts;
+    size_t count;
+    size_t capacity;
+} TsSeries;
+
+static void series_add(TsSeries *series, const struct timespec *ts) {
+    if (series->count < series->capacity) {
+        series->ts[series->count++] = (uint64_t)ts->tv_sec * 1000000000ull + ts->tv_nsec;
+    }
+}
+
+// Effective rate, then a histogram of how far each interval is from the mean
+static void series_report(const char *name, const TsSeries *series, double intended_hz) {
+    if (series->count < 2) {
+        printf("  %-5s  too few samples\n", name);
+        return;
+    }
+    static const double edges_us[] = {1, 10, 100, 1000, 5000};
+    uint64_t buckets[6] = {0};
+    uint64_t backwards = 0;
+    double mean = (double)(series->ts[series->count - 1] - series->ts[0]) / (series->count - 1);
+    double worst = 0;
+    for (size_t i = 1; i < series->count; i++) {
+        double interval = (double)series->ts[i] - (double)series->ts[i - 1];
+        double dev = interval > mean ? interval - mean : mean - interval;
+        int b = 0;
+        while (b < 5 && dev / 1e3 >= edges_us[b]) b++;
+        buckets[b]++;
+        backwards += interval <= 0;
+        if (dev > worst) worst = dev;
+    }
+    double n = (double)(series->count - 1);
+    printf("  %-5s  %zu samples, %.1f Hz (intended %.0f), mean interval %.1f us, worst deviation %.1f us, %llu not increasing\n",
+           name, series->count, 1e9 / mean, intended_hz, mean / 1e3, worst / 1e3, (unsigned long long)backwards);
+    printf("         |interval - mean|  <1us %5.1f%%  <10us %5.1f%%  <100us %5.1f%%  <1ms %5.1f%%  <5ms %5.1f%%  >=5ms %5.1f%%\n",
+           100 * buckets[0] / n, 100 * buckets[1] / n, 100 * buckets[2] / n,
+           100 * buckets[3] / n, 100 * buckets[4] / n, 100 * buckets[5] / n);
+}
+
+// IMU_BENCH_SECONDS per mode (default 5), IMU_BENCH_RATE FIFO rate (default
+// 1000 Hz). IMU_BENCH_DEVICE (e.g. /dev/i2c-1) uses the real sensors and
+// IMU_BENCH_DRDY_GPIO (gpiochipN:line) their data-ready line; otherwise the
+// emulated MPU6500, whose sample clock runs IMU_BENCH_SKEW_PPM (default
+// 20000) fast, is polled. "poll" is the old loop: read, then usleep(5000);
+// "fifo" is the sensor thread's --fifo mode. On the emulated chip the FIFO
+// timestamps must run at its true rate within 0.1% and never resync.
+static int bench_fifo(void) {
+    const char *device = getenv("IMU_BENCH_DEVICE");
+    const char *gpio = getenv("IMU_BENCH_DRDY_GPIO");
+    const char *seconds_env = getenv("IMU_BENCH_SECONDS");
+    const char *rate_env = getenv("IMU_BENCH_RATE");
+    const char *skew_env = getenv("IMU_BENCH_SKEW_PPM");
+    int seconds = seconds_env ? atoi(seconds_env) : 5;
+    int rate = rate_env ? atoi(rate_env) : IMU_FIFO_RATE;
+    int skew_ppm = skew_env ? atoi(skew_env) : 20000;
+    if (seconds <= 0) seconds = 5;
+    if (rate <= 0 || rate > 1000) rate = IMU_FIFO_RATE;
+    rate = 1000 / (1000 / rate);    // what SMPLRT_DIV can do
+
+    i2c_mock *mock = NULL;
+    i2c_bus *bus = device ? i2c_bus_open(device) : i2c_mock_open(&mock);
+    if (!bus) {
+        return -1;
+    }
+    if (mock) {
+        i2c_mock_set_clock_skew(mock, skew_ppm);
+    }
+    if (!mpu6500_init(bus, 0x68) || !ak8963_init(bus, 0x0D)) {
+        i2c_bus_close(bus);
+        return -1;
+    }
+
+    TsSeries series;
+    series.capacity = (size_t)seconds * rate * 2 + IMU_FIFO_MAX_SAMPLES;
+    series.ts = (uint64_t *)malloc(series.capacity * sizeof(uint64_t));
+    if (!series.ts) {
+        i2c_bus_close(bus);
+        return -1;
+    }
+    printf("IMU acquisition: %d s per mode on %s\n", seconds, device ? device : "emulated MPU6500");
+    if (mock) {
+        printf("  emulated sample clock %+d ppm: true FIFO rate %.1f Hz\n", skew_ppm, rate * (1 + skew_ppm * 1e-6));
+    }
+    i2c_bus_stats stats;
+    int ret = 0;
+
+    // Old mode
+    imu_raw_data raw;
+    series.count = 0;
+    i2c_bus_reset_stats(bus);
+    uint64_t cpu0 = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    uint64_t end = clock_ns(CLOCK_MONOTONIC) + (uint64_t)seconds * 1000000000ull;
+    while (clock_ns(CLOCK_MONOTONIC) < end) {
+        if (read_9axis_data(bus, &raw)) {
+            series_add(&series, &raw.ts);
+        }
+        usleep(5000);
+    }
+    i2c_bus_get_stats(bus, &stats);
+    series_report("poll", &series, 200);
+    printf("         %.2f transfers per sample, CPU %.1f ms/s\n",
+           series.count ? (double)stats.syscalls / series.count : 0.0,
+           (clock_ns(CLOCK_THREAD_CPUTIME_ID) - cpu0) / 1e6 / seconds);
+
+    // FIFO mode
+    imu_fifo fifo;
+    imu_raw_data batch[IMU_FIFO_MAX_SAMPLES];
+    if (imu_fifo_open(&fifo, bus, rate, gpio) != 0) {
+        free(series.ts);
+        i2c_bus_close(bus);
+        return -1;
+    }
+    series.count = 0;
+    double error_sum = 0, error_max = 0;
+    i2c_bus_reset_stats(bus);
+    cpu0 = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    end = clock_ns(CLOCK_MONOTONIC) + (uint64_t)seconds * 1000000000ull;
+    while (clock_ns(CLOCK_MONOTONIC) < end) {
+        int n = imu_fifo_read(&fifo, batch, IMU_FIFO_MAX_SAMPLES);
+        for (int i = 0; i < n; i++) {
+            series_add(&series, &batch[i].ts);
+        }
+        if (n > 0) {
+            double e = fifo.clock.last_error_ns < 0 ? -fifo.clock.last_error_ns : fifo.clock.last_error_ns;
+            error_sum += e;
+            if (e > error_max) error_max = e;
+        }
+    }
+    i2c_bus_get_stats(bus, &stats);
+    series_report("fifo", &series, rate);
+    printf("         %.2f transfers per sample, %.1f samples per burst, CPU %.1f ms/s\n",
+           series.count ? (double)stats.syscalls / series.count : 0.0,
+           fifo.bursts ? (double)fifo.samples / fifo.bursts : 0.0,
+           (clock_ns(CLOCK_THREAD_CPUTIME_ID) - cpu0) / 1e6 / seconds);
+    printf("         clock: period %.2f us (nominal %.2f), anchor error mean %.1f us max %.1f us, %llu resyncs, %llu overflows\n",
+           fifo.clock.period_ns / 1e3, fifo.clock.nominal_ns / 1e3,
+           fifo.bursts ? error_sum / fifo.bursts / 1e3 : 0.0, error_max / 1e3,
+           (unsigned long long)fifo.clock.resyncs, (unsigned long long)fifo.overflows);
+
+    if (mock && series.count >= 2) {
+        double true_hz = rate * (1 + skew_ppm * 1e-6);
+        double got_hz = 1e9 * (series.count - 1) / (double)(series.ts[series.count - 1] - series.ts[0]);
+        if (got_hz < true_hz * 0.999 || got_hz > true_hz * 1.001 || fifo.clock.resyncs || fifo.overflows) {
+            printf("  FAIL: FIFO timestamps do not follow the sensor clock\n");
+            ret = 1;
+        }
+    }
+    imu_fifo_close(&fifo);
+    free(series.ts);
+    i2c_bus_close(bus);
+    return ret;
+}
+
+/* ---------- log: CSV against the binary log ---------- */
+
+// Simulated sample seq at `rate`: a slow swing plus some noise, so CSV
+// lines have realistic widths and the binary values exercise the range
+static void log_sample(uint64_t seq, int rate, uint64_t t0, imu_raw_data *raw, fused_data *fused) {
+    double t = (double)seq / rate;
+    uint64_t ns = t0 + seq * (1000000000ull / rate);
+    memset(raw, 0, sizeof(*raw));
+    raw->ts.tv_sec = ns / 1000000000ull;
+    raw->ts.tv_nsec = ns % 1000000000ull;
+    for (int i = 0; i < 3; i++) {
+        double noise = (double)((seq * 2654435761u + i * 40503u) % 1000) / 1000.0 - 0.5;
+        raw->accel[i] = (i == 2 ? 9.81 : 0.0) + 2.0 * sin(t * (0.3 + i)) + 0.05 * noise;
+        raw->gyro[i] = 1.5 * cos(t * (0.2 + i)) + 0.01 * noise;
+        raw->mag[i] = 40.0 * sin(t * 0.01 + i) + 0.3 * noise;
+    }
+    raw->mag_fresh = seq % (rate / 100 > 0 ? rate / 100 : 1) == 0;
+    fused->roll = 0.5 * sin(t * 0.3);
+    fused->pitch = 0.3 * cos(t * 0.2);
+    fused->yaw = M_PI * sin(t * 0.01) * 0.99;
+    fused->ts = raw->ts;
+}
+
+static long long file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (long long)st.st_size : -1;
+}
+
+// Reads the whole log back, returns the number of samples; `verify` checks
+// each one against the generator within one LSB
+static uint64_t log_read_back(const char *path, int rate, uint64_t t0, int verify,
+                              imu_binlog_reader *reader, uint64_t *mismatches) {
+    imu_raw_data raw, want_raw;
+    fused_data fused, want_fused;
+    *mismatches = 0;
+    if (imu_binlog_reader_open(reader, path) != 0) {
+        return 0;
+    }
+    const imu_bin_header *h = &reader->header;
+    uint64_t period = 1000000000ull / rate;
+    while (imu_binlog_read(reader, &raw, &fused, NULL) == 1) {
+        if (!verify) {
+            continue;
+        }
+        uint64_t ns = (uint64_t)raw.ts.tv_sec * 1000000000ull + raw.ts.tv_nsec;
+        log_sample((ns - t0) / period, rate, t0, &want_raw, &want_fused);
+        int ok = ns == (uint64_t)want_raw.ts.tv_sec * 1000000000ull + want_raw.ts.tv_nsec &&
+                 raw.mag_fresh == want_raw.mag_fresh &&
+                 close_to(fused.roll, want_fused.roll, h->angle_scale) &&
+                 close_to(fused.pitch, want_fused.pitch, h->angle_scale) &&
+                 close_to(fused.yaw, want_fused.yaw, h->angle_scale);
+        for (int i = 0; i < 3; i++) {
+            ok = ok && close_to(raw.accel[i], want_raw.accel[i], h->accel_scale) &&
+                 close_to(raw.gyro[i], want_raw.gyro[i], h->gyro_scale) &&
+                 close_to(raw.mag[i], want_raw.mag[i], h->mag_scale);
+        }
+        if (!ok) {
+            (*mismatches)++;
+        }
+    }
+    imu_binlog_reader_close(reader);
+    return reader->samples;
+}
+
+// IMU_BENCH_RATE (Hz, default 1000), IMU_BENCH_SECONDS of simulated
+// recording (default 3600), IMU_BENCH_DIR for the files (default /tmp).
+// The same samples go through write_to_csv and the binary log, batched and
+// flushed per LOG_PERIOD_US as logging_thread does but without waiting, so
+// an hour of recording takes seconds; the binary writer is only waited for
+// when its buffers are all in use. Reports CPU and bytes per hour. The
+// binary log must read back complete and within one LSB, and after a
+// record is overwritten and the tail torn, lose no more than the samples
+// up to the next sync marker.
+static int bench_log(void) {
+    const char *rate_env = getenv("IMU_BENCH_RATE");
+    const char *seconds_env = getenv("IMU_BENCH_SECONDS");
+    const char *dir_env = getenv("IMU_BENCH_DIR");
+    int rate = rate_env ? atoi(rate_env) : 1000;
+    int seconds = seconds_env ? atoi(seconds_env) : 3600;
+    if (rate <= 0 || rate > 10000) rate = 1000;
+    if (seconds <= 0) seconds = 3600;
+    const char *dir = dir_env ? dir_env : "/tmp";
+    char csv_path[256], bin_path[256];
+    snprintf(csv_path, sizeof(csv_path), "%s/imu_bench.csv", dir);
+    snprintf(bin_path, sizeof(bin_path), "%s/imu_bench" IMU_BIN_EXTENSION, dir);
+
+    uint64_t total = (uint64_t)rate * seconds;
+    int batch = rate / (1000000 / LOG_PERIOD_US);
+    if (batch < 1) batch = 1;
+    uint64_t t0 = clock_ns(CLOCK_MONOTONIC);
+    double hours = seconds / 3600.0;
+    imu_raw_data raw;
+    fused_data fused;
+    int ret = 0;
+
+    printf("IMU log: %llu samples (%d s at %d Hz), flushed every %d samples, files in %s\n",
+           (unsigned long long)total, seconds, rate, batch, dir);
+    printf("  %-7s %12s %8s %12s %10s %10s\n", "format", "MB/hour", "B/sample", "CPU s/hour", "CPU %", "writes");
+
+    // CSV: write_to_csv logs progress to stdout every 100 records
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    if (saved_stdout < 0 || devnull < 0) {
+        return -1;
+    }
+    dup2(devnull, STDOUT_FILENO);
+    close(devnull);
+    uint64_t cpu0 = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    int opened = open_csv_file(csv_path) == 0;
+    uint64_t flushes = 0;
+    for (uint64_t seq = 0; opened && seq < total; seq++) {
+        log_sample(seq, rate, t0, &raw, &fused);
+        write_to_csv(&fused);
+        if ((seq + 1) % batch == 0) {
+            flush_csv_file();
+            flushes++;
+        }
+    }
+    close_csv_file();
+    uint64_t csv_cpu = clock_ns(CLOCK_THREAD_CPUTIME_ID) - cpu0;
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    if (!opened) {
+        fprintf(stderr, "Cannot create %s\n", csv_path);
+        return -1;
+    }
+    long long csv_bytes = file_size(csv_path);
+    printf("  %-7s %12.1f %8.1f %12.2f %10.3f %10llu (flushes)\n", "csv",
+           csv_bytes / 1e6 / hours, (double)csv_bytes / total, csv_cpu / 1e9 / hours,
+           csv_cpu / 1e7 / seconds, (unsigned long long)flushes);
+    unlink(csv_path);
+
+    // Binary: the appender's CPU plus the writer thread's
+    imu_binlog_stats stats;
+    cpu0 = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    imu_binlog *log = imu_binlog_open(bin_path, rate);
+    if (!log) {
+        perror("Cannot create binary log");
+        return -1;
+    }
+    for (uint64_t seq = 0; seq < total; seq++) {
+        log_sample(seq, rate, t0, &raw, &fused);
+        imu_binlog_append(log, &raw, &fused);
+        if ((seq + 1) % batch == 0) {
+            imu_binlog_tick(log);
+            // Running far faster than real time, so give the writer time
+            // rather than have the appender drop (sleeping costs no CPU)
+            for (;;) {
+                imu_binlog_get_stats(log, &stats);
+                if (stats.pending < IMU_BIN_BUFFERS - 1) {
+                    break;
+                }
+                usleep(100);
+            }
+        }
+    }
+    fflush(stdout);
+    imu_binlog_close(log, &stats);
+    uint64_t bin_cpu = clock_ns(CLOCK_THREAD_CPUTIME_ID) - cpu0 + stats.writer_cpu_ns;
+    long long bin_bytes = file_size(bin_path);
+    printf("  %-7s %12.1f %8.1f %12.2f %10.3f %10llu (+%llu fdatasync)\n", "binary",
+           bin_bytes / 1e6 / hours, (double)bin_bytes / total, bin_cpu / 1e9 / hours,
+           bin_cpu / 1e7 / seconds, (unsigned long long)stats.writes, (unsigned long long)stats.fsyncs);
+    printf("  binary carries raw accel/gyro/mag as well; %llu samples dropped by the writer\n",
+           (unsigned long long)stats.dropped);
+
+    // Read back, then damage the file the way a crash or bad sector would
+    imu_binlog_reader reader;
+    uint64_t mismatches;
+    cpu0 = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    uint64_t read = log_read_back(bin_path, rate, t0, 0, &reader, &mismatches);
+    uint64_t read_cpu = clock_ns(CLOCK_THREAD_CPUTIME_ID) - cpu0;
+    read = log_read_back(bin_path, rate, t0, 1, &reader, &mismatches);
+    printf("  read back: %llu samples, %llu sync markers, %llu outside one LSB, decode %.0f ns/sample\n",
+           (unsigned long long)read, (unsigned long long)reader.syncs,
+           (unsigned long long)mismatches, read ? (double)read_cpu / read : 0.0);
+    if (stats.dropped || read != total || mismatches || reader.corrupt || reader.missing) {
+        printf("  FAIL: binary log does not read back as written\n");
+        ret = 1;
+    }
+
+    int fd = open(bin_path, O_RDWR);
+    if (fd >= 0 && bin_bytes > (long long)sizeof(imu_bin_header) + 64) {
+        uint8_t junk[32];
+        memset(junk, 0xA5, sizeof(junk));
+        off_t middle = sizeof(imu_bin_header) + (bin_bytes - sizeof(imu_bin_header)) / 2 / 32 * 32;
+        if (pwrite(fd, junk, sizeof(junk), middle) != (ssize_t)sizeof(junk) ||
+            ftruncate(fd, bin_bytes - 20) != 0) {
+            ret = 1;
+        }
+        close(fd);
+        read = log_read_back(bin_path, rate, t0, 1, &reader, &mismatches);
+        uint64_t lost = stats.samples - read;
+        printf("  damaged (1 record overwritten, tail torn): %llu samples lost, %llu corrupt records, %llu outside one LSB\n",
+               (unsigned long long)lost, (unsigned long long)reader.corrupt, (unsigned long long)mismatches);
+        if (lost < 2 || lost > IMU_BIN_SYNC_RECORDS + 1 || reader.corrupt != 1 || mismatches) {
+            printf("  FAIL: damage not contained to one sync interval\n");
+            ret = 1;
+        }
+    }
+    unlink(bin_path);
+    return ret;
+}
+
+int run_benchmark(const char *name) {
+    if (name && strcmp(name, "ring") == 0) {
+        return bench_ring();
+    }
+    if (name && strcmp(name, "i2c") == 0) {
+        return bench_i2c();
+    }
+    if (name && strcmp(name, "fifo") == 0) {
+        return bench_fifo();
+    }
+    if (name && strcmp(name, "log") == 0) {
+        return bench_log();
+    }
+    fprintf(stderr, "Unknown benchmark: %s\n", name ? name : "(null)");
+    fprintf(stderr, "Available: ring, i2c, fifo, log\n");
+    return -1;
+}
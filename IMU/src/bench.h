@@ -0,0 +1,11 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/IMU/src/bench.h
+ */
+#ifndef IMU_BENCH_H
+#define IMU_BENCH_H
+
+// Run a named benchmark ("imu_logger --bench <name>"), returns exit code
+int run_benchmark(const char *name);
+
+#endif
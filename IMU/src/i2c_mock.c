@@ -0,0 +1,426 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/IMU/src/i2c_mock.c
+ */
+/* ---------- src/i2c_mock.c ---------- */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include "i2c_mock.h"
+
+// MPU6500 registers
+#define MPU_SMPLRT_DIV      0x19
+#define MPU_CONFIG          0x1A
+#define MPU_GYRO_CONFIG     0x1B
+#define MPU_ACCEL_CONFIG    0x1C
+#define MPU_FIFO_EN         0x23
+#define MPU_I2C_SLV0_ADDR   0x25
+#define MPU_I2C_SLV0_REG    0x26
+#define MPU_I2C_SLV0_CTRL   0x27
+#define MPU_I2C_SLV4_ADDR   0x31
+#define MPU_I2C_SLV4_REG    0x32
+#define MPU_I2C_SLV4_DO     0x33
+#define MPU_I2C_SLV4_CTRL   0x34
+#define MPU_I2C_SLV4_DI     0x35
+#define MPU_I2C_MST_STATUS  0x36
+#define MPU_INT_STATUS      0x3A
+#define MPU_ACCEL_XOUT_H    0x3B
+#define MPU_GYRO_ZOUT_L     0x48
+#define MPU_EXT_SENS_DATA   0x49
+#define MPU_EXT_SENS_END    0x60
+#define MPU_USER_CTRL       0x6A
+#define MPU_PWR_MGMT_1      0x6B
+#define MPU_FIFO_COUNTH     0x72
+#define MPU_FIFO_COUNTL     0x73
+#define MPU_FIFO_R_W        0x74
+#define MPU_WHO_AM_I        0x75
+#define MPU_FIFO_BYTES      512
+
+// AK8963 registers
+#define AK_WIA              0x00
+#define AK_ST1              0x02
+#define AK_HXL              0x03
+#define AK_ST2              0x09
+#define AK_CNTL1            0x0A
+#define AK_ASAX             0x10
+#define AK_ASAZ             0x12
+
+#define GRAVITY             9.81f
+
+#define IS_AK8963(addr) (((addr) & 0x7F) == 0x0C || ((addr) & 0x7F) == 0x0D)
+
+struct i2c_mock {
+    uint8_t mpu[128];
+    uint8_t mpu_ptr;
+    uint8_t fifo[MPU_FIFO_BYTES];
+    int fifo_head;          // oldest byte
+    int fifo_len;
+    uint64_t tick_next_ns;  // next sample (latch, aux slave read, FIFO write)
+    int skew_ppm;           // sample clock error of the emulated chip
+    uint8_t ak[32];
+    uint8_t ak_ptr;
+    int ak_drdy;
+    int ak_dor;
+    uint64_t ak_next_ns;    // next measurement in continuous mode
+    float accel[3];         // m/s²
+    float gyro[3];          // rad/s
+    float mag[3];           // uT
+};
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int16_t quantize(float value, float lsb) {
+    long raw = lrintf(value / lsb);
+    if (raw > INT16_MAX) raw = INT16_MAX;
+    if (raw < INT16_MIN) raw = INT16_MIN;
+    return (int16_t)raw;
+}
+
+static void put_be16(uint8_t *p, int16_t v) {
+    p[0] = (uint8_t)((uint16_t)v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static void put_le16(uint8_t *p, int16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)((uint16_t)v >> 8);
+}
+
+static void ak_read(i2c_mock *m, uint64_t t, uint8_t *buf, int len);
+static void ak_write(i2c_mock *m, const uint8_t *buf, int len);
+
+/* ---------- MPU6500 ---------- */
+
+static void mpu_reset(i2c_mock *m) {
+    memset(m->mpu, 0, sizeof(m->mpu));
+    m->fifo_head = 0;
+    m->fifo_len = 0;
+    m->mpu[MPU_PWR_MGMT_1] = 0x01;
+    m->mpu[MPU_WHO_AM_I] = 0x70;
+}
+
+// Burst reads see one consistent sample, as from the chip's shadow registers
+static void mpu_latch(i2c_mock *m) {
+    if (m->mpu[MPU_PWR_MGMT_1] & 0x40) {
+        return;     // SLEEP: outputs hold their last value
+    }
+    int afs = (m->mpu[MPU_ACCEL_CONFIG] >> 3) & 3;
+    int gfs = (m->mpu[MPU_GYRO_CONFIG] >> 3) & 3;
+    float accel_lsb = (2 << afs) * GRAVITY / 32768.0f;
+    float gyro_lsb = (250 << gfs) / 32768.0f * (float)(M_PI / 180.0);
+
+    uint8_t *out = &m->mpu[MPU_ACCEL_XOUT_H];
+    for (int i = 0; i < 3; i++) {
+        put_be16(out + 2 * i, quantize(m->accel[i], accel_lsb));
+        put_be16(out + 8 + 2 * i, quantize(m->gyro[i], gyro_lsb));
+    }
+    put_be16(out + 6, quantize(25.0f - 21.0f, 1.0f / 333.87f));    // 25 °C
+}
+
+static void fifo_push(i2c_mock *m, uint8_t byte) {
+    if (m->fifo_len == MPU_FIFO_BYTES) {
+        m->mpu[MPU_INT_STATUS] |= 0x10;     // FIFO_OFLOW_INT
+        if (m->mpu[MPU_CONFIG] & 0x40) {
+            return;     // FIFO_MODE: further writes are lost
+        }
+        m->fifo_head = (m->fifo_head + 1) % MPU_FIFO_BYTES;
+        m->fifo_len--;
+    }
+    m->fifo[(m->fifo_head + m->fifo_len) % MPU_FIFO_BYTES] = byte;
+    m->fifo_len++;
+}
+
+static uint64_t mpu_sample_period_ns(const i2c_mock *m) {
+    int dlpf = m->mpu[MPU_CONFIG] & 7;
+    double internal_hz = (dlpf == 0 || dlpf == 7) ? 8000.0 : 1000.0;
+    return (uint64_t)(1e9 * (1 + m->mpu[MPU_SMPLRT_DIV]) / internal_hz / (1.0 + m->skew_ppm * 1e-6));
+}
+
+// SLV0 copies its slave's registers into EXT_SENS_DATA on every sample
+static void aux_slave0(i2c_mock *m, uint64_t t) {
+    uint8_t addr = m->mpu[MPU_I2C_SLV0_ADDR];
+    uint8_t ctrl = m->mpu[MPU_I2C_SLV0_CTRL];
+    if (!(m->mpu[MPU_USER_CTRL] & 0x20) || !(ctrl & 0x80) || !(addr & 0x80) || !IS_AK8963(addr)) {
+        return;
+    }
+    int len = ctrl & 0x0F;
+    m->ak_ptr = m->mpu[MPU_I2C_SLV0_REG];
+    ak_read(m, t, &m->mpu[MPU_EXT_SENS_DATA], len);
+}
+
+// SLV4 runs one byte transfer each time SLV4_CTRL.EN is written
+static void aux_slave4(i2c_mock *m) {
+    uint8_t addr = m->mpu[MPU_I2C_SLV4_ADDR];
+    m->mpu[MPU_I2C_SLV4_CTRL] &= ~0x80;
+    if (!(m->mpu[MPU_USER_CTRL] & 0x20) || !IS_AK8963(addr)) {
+        m->mpu[MPU_I2C_MST_STATUS] |= 0x50;    // I2C_SLV4_DONE, I2C_SLV4_NACK
+        return;
+    }
+    if (addr & 0x80) {
+        m->ak_ptr = m->mpu[MPU_I2C_SLV4_REG];
+        ak_read(m, monotonic_ns(), &m->mpu[MPU_I2C_SLV4_DI], 1);
+    } else {
+        uint8_t data[2] = { m->mpu[MPU_I2C_SLV4_REG], m->mpu[MPU_I2C_SLV4_DO] };
+        ak_write(m, data, 2);
+    }
+    m->mpu[MPU_I2C_MST_STATUS] |= 0x40;        // I2C_SLV4_DONE
+}
+
+// One sample: latch the outputs, run the aux slave, append to the FIFO in register order
+static void mpu_tick(i2c_mock *m, uint64_t t) {
+    mpu_latch(m);
+    aux_slave0(m, t);
+    m->mpu[MPU_INT_STATUS] |= 0x01;     // RAW_DATA_RDY_INT
+
+    uint8_t enabled = m->mpu[MPU_FIFO_EN];
+    if (!(m->mpu[MPU_USER_CTRL] & 0x40)) {
+        return;
+    }
+    const uint8_t *out = &m->mpu[MPU_ACCEL_XOUT_H];
+    if (enabled & 0x08) for (int i = 0; i < 6; i++) fifo_push(m, out[i]);
+    if (enabled & 0x80) for (int i = 6; i < 8; i++) fifo_push(m, out[i]);
+    for (int axis = 0; axis < 3; axis++) {
+        if (enabled & (0x40 >> axis)) {
+            fifo_push(m, out[8 + 2 * axis]);
+            fifo_push(m, out[9 + 2 * axis]);
+        }
+    }
+    if (enabled & 0x01) {
+        for (int i = 0; i < (m->mpu[MPU_I2C_SLV0_CTRL] & 0x0F); i++) {
+            fifo_push(m, out[MPU_EXT_SENS_DATA - MPU_ACCEL_XOUT_H + i]);
+        }
+    }
+}
+
+// Run every sample the chip would have taken by now
+static void mpu_update(i2c_mock *m) {
+    uint64_t period = mpu_sample_period_ns(m);
+    uint64_t now = monotonic_ns();
+    if (now < m->tick_next_ns) {
+        return;
+    }
+    uint64_t due = (now - m->tick_next_ns) / period + 1;
+    if (due > 64) {
+        // Older samples could not show any more: the FIFO holds fewer
+        m->tick_next_ns += (due - 64) * period;
+        due = 64;
+    }
+    for (uint64_t n = 0; n < due; n++) {
+        mpu_tick(m, m->tick_next_ns);
+        m->tick_next_ns += period;
+    }
+}
+
+static void mpu_write(i2c_mock *m, const uint8_t *buf, int len) {
+    m->mpu_ptr = buf[0] & 0x7F;
+    for (int i = 1; i < len; i++) {
+        uint8_t reg = m->mpu_ptr;
+        m->mpu_ptr = (m->mpu_ptr + 1) & 0x7F;
+        if (reg == MPU_WHO_AM_I || reg == MPU_INT_STATUS || reg == MPU_FIFO_COUNTH ||
+            reg == MPU_FIFO_COUNTL || reg == MPU_I2C_MST_STATUS || reg == MPU_I2C_SLV4_DI ||
+            (reg >= MPU_ACCEL_XOUT_H && reg <= MPU_EXT_SENS_END)) {
+            continue;   // read-only
+        }
+        if (reg == MPU_I2C_SLV4_CTRL) {
+            m->mpu[reg] = buf[i];
+            if (buf[i] & 0x80) {
+                aux_slave4(m);
+            }
+            continue;
+        }
+        if (reg == MPU_FIFO_R_W) {
+            m->mpu_ptr = MPU_FIFO_R_W;
+            fifo_push(m, buf[i]);
+            continue;
+        }
+        if (reg == MPU_USER_CTRL) {
+            if (buf[i] & 0x04) {
+                m->fifo_len = 0;        // FIFO_RST, self-clearing
+                m->fifo_head = 0;
+            }
+            m->mpu[reg] = buf[i] & ~0x07;
+            continue;
+        }
+        if (reg == MPU_PWR_MGMT_1 && (buf[i] & 0x80)) {
+            mpu_reset(m);
+            continue;
+        }
+        m->mpu[reg] = buf[i];
+    }
+}
+
+static void mpu_read(i2c_mock *m, uint8_t *buf, int len) {
+    for (int i = 0; i < len; i++) {
+        uint8_t reg = m->mpu_ptr;
+        if (reg == MPU_FIFO_R_W) {
+            // The pointer stays on FIFO_R_W; an empty FIFO reads 0xFF
+            buf[i] = m->fifo_len ? m->fifo[m->fifo_head] : 0xFF;
+            if (m->fifo_len) {
+                m->fifo_head = (m->fifo_head + 1) % MPU_FIFO_BYTES;
+                m->fifo_len--;
+            }
+            continue;
+        }
+        if (reg == MPU_FIFO_COUNTH) {
+            buf[i] = (uint8_t)(m->fifo_len >> 8);
+        } else if (reg == MPU_FIFO_COUNTL) {
+            buf[i] = (uint8_t)m->fifo_len;
+        } else {
+            buf[i] = m->mpu[reg];
+        }
+        if (reg == MPU_INT_STATUS || reg == MPU_I2C_MST_STATUS) {
+            m->mpu[reg] = 0;    // cleared by reading it
+        }
+        m->mpu_ptr = (m->mpu_ptr + 1) & 0x7F;
+    }
+}
+
+/* ---------- AK8963 ---------- */
+
+static void ak_reset(i2c_mock *m) {
+    memset(m->ak, 0, sizeof(m->ak));
+    m->ak[AK_WIA] = 0x48;
+    m->ak[0x01] = 0x9A;         // INFO
+    m->ak_drdy = 0;
+    m->ak_dor = 0;
+}
+
+static void ak_measure(i2c_mock *m) {
+    float lsb = (m->ak[AK_CNTL1] & 0x10) ? 0.15f : 0.6f;
+    for (int i = 0; i < 3; i++) {
+        put_le16(&m->ak[AK_HXL + 2 * i], quantize(m->mag[i], lsb));
+    }
+    m->ak[AK_ST2] = m->ak[AK_CNTL1] & 0x10;    // BITM
+    m->ak_dor |= m->ak_drdy;    // previous sample was never read out
+    m->ak_drdy = 1;
+}
+
+// Continuous modes 1 (8 Hz) and 2 (100 Hz) measure on their own clock
+static void ak_update(i2c_mock *m, uint64_t now) {
+    int mode = m->ak[AK_CNTL1] & 0x0F;
+    if (mode != 0x02 && mode != 0x06) {
+        return;
+    }
+    uint64_t period = mode == 0x02 ? 125000000ull : 10000000ull;
+    if (now < m->ak_next_ns) {
+        return;
+    }
+    ak_measure(m);
+    m->ak_next_ns += period;
+    if (m->ak_next_ns <= now) {
+        m->ak_next_ns = now + period;
+    }
+}
+
+static void ak_write(i2c_mock *m, const uint8_t *buf, int len) {
+    m->ak_ptr = buf[0] & 0x1F;
+    for (int i = 1; i < len; i++) {
+        uint8_t reg = m->ak_ptr++;
+        if (reg == AK_CNTL1) {
+            m->ak[AK_CNTL1] = buf[i] & 0x1F;
+            int mode = buf[i] & 0x0F;
+            if (mode == 0x01) {
+                ak_measure(m);  // single measurement
+            } else if (mode == 0x02 || mode == 0x06) {
+                m->ak_next_ns = monotonic_ns();
+            }
+        } else if (reg == 0x0B && (buf[i] & 0x01)) {
+            ak_reset(m);        // CNTL2 SRST
+        }
+    }
+}
+
+// A read at time t, from the host or from the MPU6500's aux master
+static void ak_read(i2c_mock *m, uint64_t t, uint8_t *buf, int len) {
+    ak_update(m, t);
+    int fuse = (m->ak[AK_CNTL1] & 0x0F) == 0x0F;
+    for (int i = 0; i < len; i++) {
+        uint8_t reg = m->ak_ptr++;
+        if (reg == AK_ST1) {
+            buf[i] = (uint8_t)(m->ak_drdy | (m->ak_dor << 1));
+        } else if (reg >= AK_ASAX && reg <= AK_ASAZ) {
+            buf[i] = fuse ? 0xB0 : 0x00;
+        } else if (reg < sizeof(m->ak)) {
+            buf[i] = m->ak[reg];
+        } else {
+            buf[i] = 0;
+        }
+        if (reg == AK_ST2) {
+            m->ak_drdy = 0;     // reading ST2 ends the data read
+            m->ak_dor = 0;
+        }
+    }
+}
+
+/* ---------- backend ---------- */
+
+static int mock_transfer(void *ctx, struct i2c_msg *msgs, int count) {
+    i2c_mock *m = (i2c_mock *)ctx;
+    for (int i = 0; i < count; i++) {
+        struct i2c_msg *msg = &msgs[i];
+        int read = msg->flags & I2C_M_RD;
+        if (msg->addr == 0x68 || msg->addr == 0x69) {
+            mpu_update(m);
+            if (read) {
+                mpu_read(m, msg->buf, msg->len);
+            } else if (msg->len > 0) {
+                mpu_write(m, msg->buf, msg->len);
+            }
+        } else if (IS_AK8963(msg->addr)) {
+            if (read) {
+                ak_read(m, monotonic_ns(), msg->buf, msg->len);
+            } else if (msg->len > 0) {
+                ak_write(m, msg->buf, msg->len);
+            }
+        } else {
+            errno = ENXIO;      // no ACK for the address
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void mock_close(void *ctx) {
+    free(ctx);
+}
+
+static const i2c_backend mock_backend = { mock_transfer, mock_close };
+
+i2c_bus* i2c_mock_open(i2c_mock **mock) {
+    i2c_mock *m = (i2c_mock *)calloc(1, sizeof(i2c_mock));
+    if (!m) {
+        return NULL;
+    }
+    mpu_reset(m);
+    ak_reset(m);
+    // Level and still, in a typical mid-latitude field
+    m->accel[2] = GRAVITY;
+    m->mag[0] = 20.0f;
+    m->mag[2] = -40.0f;
+
+    i2c_bus *bus = i2c_bus_open_backend(&mock_backend, m);
+    if (!bus) {
+        free(m);
+        return NULL;
+    }
+    if (mock) {
+        *mock = m;
+    }
+    return bus;
+}
+
+void i2c_mock_set_motion(i2c_mock *mock, const float accel[3], const float gyro[3], const float mag[3]) {
+    memcpy(mock->accel, accel, sizeof(mock->accel));
+    memcpy(mock->gyro, gyro, sizeof(mock->gyro));
+    memcpy(mock->mag, mag, sizeof(mock->mag));
+}
+
+void i2c_mock_set_clock_skew(i2c_mock *mock, int ppm) {
+    mock->skew_ppm = ppm;
+}
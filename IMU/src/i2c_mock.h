@@ -0,0 +1,30 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/IMU/src/i2c_mock.h
+ */
+#ifndef I2C_MOCK_H
+#define I2C_MOCK_H
+
+#include "i2c_utils.h"
+
+/*
+ * 内存中的 I2C 总线后端，模拟 MPU6500（0x68/0x69）和 AK8963（0x0C/0x0D）
+ * 的寄存器表：WHO_AM_I/WIA、量程配置、连续读地址自增、MPU6500 的
+ * FIFO（按 SMPLRT_DIV/CONFIG 定出的采样率实时写入，FIFO_MODE 溢出处理）、
+ * MPU6500 辅助 I2C 主机（SLV0 每个样本读入 EXT_SENS_DATA，SLV4 单字节读写，
+ * 从机为模拟的 AK8963）、AK8963 的 ST1.DRDY/ST2 握手和 Fuse ROM。测量值由 i2c_mock_set_motion 设定，
+ * 按当前量程量化后给出。其他地址不应答（ENXIO）。
+ */
+
+typedef struct i2c_mock i2c_mock;
+
+// 打开挂接模拟设备的总线，*mock 随总线关闭释放；失败返回 NULL
+i2c_bus* i2c_mock_open(i2c_mock **mock);
+
+// 设定传感器看到的运动：加速度 (m/s²)、角速度 (rad/s)、磁场 (μT)
+void i2c_mock_set_motion(i2c_mock *mock, const float accel[3], const float gyro[3], const float mag[3]);
+
+// 模拟芯片采样时钟的误差（ppm，正值为偏快），用于测试时间戳重建
+void i2c_mock_set_clock_skew(i2c_mock *mock, int ppm);
+
+#endif
@@ -4,55 +4,157 @@
 #include <sys/ioctl.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <errno.h>
-#include "imu_logger.h"
+#include <time.h>
+#include "i2c_utils.h"
 
-// 初始化I2C设备
-// Initialize I2C device
-int i2c_init(const char *device, int addr) {
+// Bus idle time between a STOP and the next START (fast mode tBUF)
+#define I2C_BUS_FREE_NS 1300
+
+struct i2c_bus {
+    const i2c_backend *backend;
+    void *ctx;
+    int combined;
+    i2c_bus_stats stats;
+};
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* ---------- /dev/i2c-N backend ---------- */
+
+static int dev_transfer(void *ctx, struct i2c_msg *msgs, int count) {
+    struct i2c_rdwr_ioctl_data data = { msgs, (uint32_t)count };
+    return ioctl((int)(intptr_t)ctx, I2C_RDWR, &data) == count ? 0 : -1;
+}
+
+static void dev_close(void *ctx) {
+    close((int)(intptr_t)ctx);
+}
+
+static const i2c_backend dev_backend = { dev_transfer, dev_close };
+
+// Open the I2C adapter; devices are addressed per message, no I2C_SLAVE
+i2c_bus* i2c_bus_open(const char *device) {
     printf("[IMU-I2C] Opening device: %s\n", device);
     int fd = open(device, O_RDWR);
     if (fd < 0) {
         perror("[IMU-I2C] Failed to open I2C device");
-        return -1;
+        return NULL;
     }
-    
-    printf("[IMU-I2C] Setting I2C slave address: 0x%02X\n", addr);
-    if (ioctl(fd, I2C_SLAVE, addr) < 0) {
-        perror("[IMU-I2C] Failed to set I2C slave address");
+    unsigned long funcs = 0;
+    if (ioctl(fd, I2C_FUNCS, &funcs) < 0 || !(funcs & I2C_FUNC_I2C)) {
+        fprintf(stderr, "[IMU-I2C] Adapter does not support I2C_RDWR transfers\n");
         close(fd);
-        return -1;
+        return NULL;
+    }
+    i2c_bus *bus = i2c_bus_open_backend(&dev_backend, (void *)(intptr_t)fd);
+    if (!bus) {
+        close(fd);
+    }
+    return bus;
+}
+
+/* ---------- common ---------- */
+
+i2c_bus* i2c_bus_open_backend(const i2c_backend *backend, void *ctx) {
+    i2c_bus *bus = (i2c_bus *)calloc(1, sizeof(i2c_bus));
+    if (!bus) {
+        return NULL;
+    }
+    bus->backend = backend;
+    bus->ctx = ctx;
+    bus->combined = 1;
+    return bus;
+}
+
+void i2c_bus_close(i2c_bus *bus) {
+    if (!bus) {
+        return;
+    }
+    if (bus->backend->close) {
+        bus->backend->close(bus->ctx);
     }
-    printf("[IMU-I2C] I2C device initialized successfully\n");
-    return fd;
+    free(bus);
 }
 
-// Read I2C register
-int i2c_read_reg(int fd, uint8_t reg, uint8_t *buf, size_t len) {
-    if (write(fd, &reg, 1) != 1) {
+void i2c_bus_set_combined(i2c_bus *bus, int combined) {
+    bus->combined = combined;
+}
+
+// One backend call: START, messages joined by repeated starts, STOP
+static int transfer(i2c_bus *bus, struct i2c_msg *msgs, int count) {
+    uint64_t bits = 2;      // START and STOP
+    for (int i = 0; i < count; i++) {
+        bits += (i > 0) + 9u * (1u + msgs[i].len);  // repeated start, address and data bytes with ACK
+        bus->stats.bytes += 1u + msgs[i].len;
+    }
+    bus->stats.bus_ns += bits * 1000000000ull / I2C_BUS_HZ + I2C_BUS_FREE_NS;
+    bus->stats.syscalls++;
+    bus->stats.transactions++;
+    bus->stats.messages += count;
+
+    uint64_t t0 = monotonic_ns();
+    int ret = bus->backend->transfer(bus->ctx, msgs, count);
+    bus->stats.wall_ns += monotonic_ns() - t0;
+    if (ret != 0) {
         static int error_count = 0;
-        if ((++error_count % 1000) == 0) {
-            perror("[IMU-I2C] Failed to write register address");
+        bus->stats.errors++;
+        if ((++error_count % 1000) == 1) {
+            printf("[IMU-I2C] Transfer to 0x%02X failed: %s\n", msgs[0].addr, strerror(errno));
         }
+    }
+    return ret;
+}
+
+int i2c_bus_read_batch(i2c_bus *bus, const i2c_read_op *ops, int count) {
+    struct i2c_msg msgs[I2C_BUS_MAX_MSGS];
+    uint8_t regs[I2C_BUS_MAX_MSGS / 2];
+    if (count <= 0 || count > I2C_BUS_MAX_MSGS / 2) {
         return -1;
     }
-    int ret = read(fd, buf, len);
-    if (ret != len) {
-        static int error_count = 0;
-        if ((++error_count % 1000) == 0) {
-            printf("[IMU-I2C] Failed to read from register 0x%02X (read %d bytes, expected %zu)\n", 
-                  reg, ret, len);
+
+    for (int i = 0; i < count; i++) {
+        regs[i] = ops[i].reg;
+        msgs[2 * i] = (struct i2c_msg){ ops[i].addr, 0, 1, &regs[i] };
+        msgs[2 * i + 1] = (struct i2c_msg){ ops[i].addr, I2C_M_RD, ops[i].len, ops[i].buf };
+    }
+    if (bus->combined) {
+        return transfer(bus, msgs, 2 * count);
+    }
+    // Old style: register address and data as separate transactions
+    for (int i = 0; i < 2 * count; i++) {
+        if (transfer(bus, &msgs[i], 1) != 0) {
+            return -1;
         }
     }
-    return ret;
+    return 0;
+}
+
+int i2c_bus_read(i2c_bus *bus, uint8_t addr, uint8_t reg, uint8_t *buf, size_t len) {
+    i2c_read_op op = { addr, reg, (uint16_t)len, buf };
+    return i2c_bus_read_batch(bus, &op, 1);
 }
 
-// Write I2C register
-int i2c_write_reg(int fd, uint8_t reg, uint8_t value) {
+int i2c_bus_write(i2c_bus *bus, uint8_t addr, uint8_t reg, uint8_t value) {
     uint8_t data[2] = {reg, value};
-    if (write(fd, data, sizeof(data)) != sizeof(data)) {
+    struct i2c_msg msg = { addr, 0, sizeof(data), data };
+    if (transfer(bus, &msg, 1) != 0) {
         perror("[IMU-I2C] Failed to write register");
         return -1;
     }
     return 0;
-}
\ No newline at end of file
+}
+
+void i2c_bus_get_stats(const i2c_bus *bus, i2c_bus_stats *stats) {
+    *stats = bus->stats;
+}
+
+void i2c_bus_reset_stats(i2c_bus *bus) {
+    memset(&bus->stats, 0, sizeof(bus->stats));
+}
@@ -7,14 +7,62 @@
 #define I2C_UTILS_H
 
 #include <stdint.h>
+#include <stddef.h>
+#include <linux/i2c.h>
 
-// I2C设备初始化
-int i2c_init(const char *device, int addr);
+/*
+ * I2C 总线层：寄存器读为“写寄存器地址 + 重复起始读数据”的一次 I2C_RDWR
+ * 传输，多个设备的读取可合并为一次 ioctl（一个总线事务，只有一个 STOP）。
+ * 后端可替换：/dev/i2c-N，或内存中模拟的 MPU6500/AK8963 寄存器表
+ * （i2c_mock.h），便于无硬件测试。
+ */
+
+#define I2C_BUS_HZ          400000  // 设备树 i2c1 clock-frequency
+#define I2C_BUS_MAX_MSGS    42      // I2C_RDWR_IOCTL_MAX_MSGS
+
+// 一次寄存器读取：从 addr 设备的 reg 起连续读 len 字节
+typedef struct {
+    uint8_t addr;
+    uint8_t reg;
+    uint16_t len;
+    uint8_t *buf;
+} i2c_read_op;
+
+// 后端：transfer 按 I2C_RDWR 语义执行一组消息（消息间重复起始，最后一个 STOP），成功返回 0
+typedef struct {
+    int (*transfer)(void *ctx, struct i2c_msg *msgs, int count);
+    void (*close)(void *ctx);
+} i2c_backend;
+
+typedef struct {
+    uint64_t syscalls;      // 传输调用次数（真实总线上每次一个 ioctl）
+    uint64_t transactions;  // 总线事务（START ... STOP）
+    uint64_t messages;
+    uint64_t bytes;         // 线上字节，含地址字节
+    uint64_t bus_ns;        // 按 I2C_BUS_HZ 估算的总线占用时间
+    uint64_t wall_ns;       // 传输调用实际耗时
+    uint64_t errors;
+} i2c_bus_stats;
+
+typedef struct i2c_bus i2c_bus;
+
+// 打开 /dev/i2c-N，失败返回 NULL
+i2c_bus* i2c_bus_open(const char *device);
+// 使用自定义后端
+i2c_bus* i2c_bus_open_backend(const i2c_backend *backend, void *ctx);
+void i2c_bus_close(i2c_bus *bus);
+
+// 0：每条消息单独传输（旧的 write() + read() 方式），仅用于对比测试
+void i2c_bus_set_combined(i2c_bus *bus, int combined);
 
-// 读取寄存器数据
-int i2c_read_reg(int fd, uint8_t reg, uint8_t *buf, size_t len);
+// 读取寄存器，成功返回 0
+int i2c_bus_read(i2c_bus *bus, uint8_t addr, uint8_t reg, uint8_t *buf, size_t len);
+// 多个寄存器读取合并为一次传输，成功返回 0
+int i2c_bus_read_batch(i2c_bus *bus, const i2c_read_op *ops, int count);
+// 写入寄存器，成功返回 0
+int i2c_bus_write(i2c_bus *bus, uint8_t addr, uint8_t reg, uint8_t value);
 
-// 写入寄存器数据
-int i2c_write_reg(int fd, uint8_t reg, uint8_t value);
+void i2c_bus_get_stats(const i2c_bus *bus, i2c_bus_stats *stats);
+void i2c_bus_reset_stats(i2c_bus *bus);
 
-#endif 
\ No newline at end of file
+#endif 
@@ -0,0 +1,425 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/IMU/src/imu_binlog.c
+ */
+/* ---------- src/imu_binlog.c ---------- */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include "imu_binlog.h"
+#include "timebase.h"
+
+#define BIN_RECORD_SIZE 32
+#define BIN_ACCEL_SCALE (8.0 * 9.81 / 32768.0)              // MPU6500 ±8 g 的 LSB
+#define BIN_GYRO_SCALE (2000.0 / 32768.0 * M_PI / 180.0)    // MPU6500 ±2000 dps 的 LSB
+#define BIN_MAG_SCALE 0.15                                  // AK8963 16 位输出的 LSB
+#define BIN_ANGLE_SCALE (M_PI / 32767.0)
+
+_Static_assert(sizeof(imu_bin_header) == 64, "imu_bin_header layout");
+_Static_assert(sizeof(imu_bin_sample) == BIN_RECORD_SIZE, "imu_bin_sample layout");
+_Static_assert(sizeof(imu_bin_sync) == BIN_RECORD_SIZE, "imu_bin_sync layout");
+_Static_assert(IMU_BIN_BUFFER_SIZE % BIN_RECORD_SIZE == 0, "buffers hold whole records");
+
+struct imu_binlog {
+    int fd;
+    char path[256];
+    pthread_t thread;
+
+    // Buffer hand-off between the appender and the writer thread
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint8_t *buffers[IMU_BIN_BUFFERS];
+    size_t lengths[IMU_BIN_BUFFERS];
+    int queue[IMU_BIN_BUFFERS];         // full buffers, oldest first
+    int queue_head;
+    int queue_count;
+    int free_list[IMU_BIN_BUFFERS];
+    int free_count;
+    int writing;                        // the writer holds a buffer
+    int stopping;
+
+    // Appender state, touched only by the logging thread
+    int cur;                            // buffer being filled, -1 for none
+    size_t fill;
+    uint64_t cur_started_ns;            // when cur got its first record
+    uint64_t base_ns;                   // mono_ns of the last sync marker
+    int since_sync;
+    uint32_t seq;
+
+    imu_binlog_stats stats;             // writer fields under lock
+};
+
+static uint64_t ts_to_ns(const struct timespec *ts) {
+    return (uint64_t)ts->tv_sec * 1000000000ull + ts->tv_nsec;
+}
+
+static uint32_t crc32(const uint8_t *data, size_t len) {
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static int16_t quantize(float value, double scale) {
+    long q = lrint(value / scale);
+    if (q > INT16_MAX) return INT16_MAX;
+    if (q < INT16_MIN) return INT16_MIN;
+    return (int16_t)q;
+}
+
+// The same UTC the CSV log uses: the shared timebase, else the system clock
+static int64_t current_utc_offset(uint64_t mono_ns) {
+    int64_t offset;
+    if (timebase_utc_offset(&offset, NULL) != TIMEBASE_SOURCE_NONE) {
+        return offset;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (int64_t)(ts_to_ns(&now) - mono_ns);
+}
+
+static int write_all(int fd, const uint8_t *buf, size_t len, uint64_t *writes) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        (*writes)++;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static void* writer_thread(void *arg) {
+    imu_binlog *log = (imu_binlog *)arg;
+    uint64_t last_fsync = timebase_now_ns();
+
+    pthread_mutex_lock(&log->lock);
+    for (;;) {
+        while (log->queue_count == 0 && !log->stopping) {
+            pthread_cond_wait(&log->cond, &log->lock);
+        }
+        if (log->queue_count == 0) {
+            break;      // stopping and drained
+        }
+        int b = log->queue[log->queue_head];
+        log->queue_head = (log->queue_head + 1) % IMU_BIN_BUFFERS;
+        log->queue_count--;
+        log->writing = 1;
+        pthread_mutex_unlock(&log->lock);
+
+        // The card is only touched here, outside the lock
+        uint64_t writes = 0;
+        int failed = write_all(log->fd, log->buffers[b], log->lengths[b], &writes) != 0;
+        if (failed) {
+            perror("[IMU] Binary log write failed");
+        }
+        int synced = 0;
+        uint64_t now = timebase_now_ns();
+        if (now - last_fsync >= IMU_BIN_FSYNC_MS * 1000000ull) {
+            fdatasync(log->fd);
+            last_fsync = now;
+            synced = 1;
+        }
+
+        pthread_mutex_lock(&log->lock);
+        log->stats.writes += writes;
+        log->stats.fsyncs += synced;
+        if (failed) {
+            log->stats.errors++;
+        } else {
+            log->stats.bytes += log->lengths[b];
+        }
+        log->free_list[log->free_count++] = b;
+        log->writing = 0;
+    }
+    pthread_mutex_unlock(&log->lock);
+
+    struct timespec cpu;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+    log->stats.writer_cpu_ns = ts_to_ns(&cpu);
+    return NULL;
+}
+
+imu_binlog* imu_binlog_open(const char *path, int sample_rate_hz) {
+    imu_binlog *log = (imu_binlog *)calloc(1, sizeof(imu_binlog));
+    if (!log) {
+        return NULL;
+    }
+    snprintf(log->path, sizeof(log->path), "%s", path);
+    log->cur = -1;
+    for (int i = 0; i < IMU_BIN_BUFFERS; i++) {
+        log->buffers[i] = (uint8_t *)malloc(IMU_BIN_BUFFER_SIZE);
+        if (!log->buffers[i]) {
+            goto fail;
+        }
+        log->free_list[log->free_count++] = i;
+    }
+
+    log->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (log->fd < 0) {
+        goto fail;
+    }
+
+    imu_bin_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = IMU_BIN_MAGIC;
+    header.version = IMU_BIN_VERSION;
+    header.record_size = BIN_RECORD_SIZE;
+    header.sample_rate_hz = sample_rate_hz > 0 ? sample_rate_hz : 0;
+    header.sync_interval = IMU_BIN_SYNC_RECORDS;
+    header.accel_scale = BIN_ACCEL_SCALE;
+    header.gyro_scale = BIN_GYRO_SCALE;
+    header.mag_scale = BIN_MAG_SCALE;
+    header.angle_scale = BIN_ANGLE_SCALE;
+    header.start_mono_ns = timebase_now_ns();
+    header.utc_offset_ns = current_utc_offset(header.start_mono_ns);
+    if (write_all(log->fd, (const uint8_t *)&header, sizeof(header), &log->stats.writes) != 0) {
+        close(log->fd);
+        goto fail;
+    }
+    log->stats.bytes = sizeof(header);
+
+    pthread_mutex_init(&log->lock, NULL);
+    pthread_cond_init(&log->cond, NULL);
+    if (pthread_create(&log->thread, NULL, writer_thread, log) != 0) {
+        close(log->fd);
+        pthread_mutex_destroy(&log->lock);
+        pthread_cond_destroy(&log->cond);
+        goto fail;
+    }
+    return log;
+
+fail:
+    for (int i = 0; i < IMU_BIN_BUFFERS; i++) {
+        free(log->buffers[i]);
+    }
+    free(log);
+    return NULL;
+}
+
+static int take_buffer(imu_binlog *log) {
+    pthread_mutex_lock(&log->lock);
+    if (log->free_count > 0) {
+        log->cur = log->free_list[--log->free_count];
+        log->fill = 0;
+    }
+    pthread_mutex_unlock(&log->lock);
+    return log->cur >= 0;
+}
+
+static void hand_off(imu_binlog *log) {
+    if (log->cur < 0 || log->fill == 0) {
+        return;
+    }
+    pthread_mutex_lock(&log->lock);
+    log->lengths[log->cur] = log->fill;
+    log->queue[(log->queue_head + log->queue_count) % IMU_BIN_BUFFERS] = log->cur;
+    log->queue_count++;
+    pthread_cond_signal(&log->cond);
+    pthread_mutex_unlock(&log->lock);
+    log->cur = -1;
+}
+
+static void put_sync(imu_binlog *log, uint64_t mono_ns) {
+    imu_bin_sync sync;
+    memset(&sync, 0, sizeof(sync));
+    sync.type = IMU_BIN_SYNC;
+    sync.magic = IMU_BIN_SYNC_MAGIC;
+    sync.mono_ns = mono_ns;
+    sync.utc_offset_ns = current_utc_offset(mono_ns);
+    sync.seq = log->seq;
+    sync.crc = crc32((const uint8_t *)&sync, offsetof(imu_bin_sync, crc));
+    memcpy(log->buffers[log->cur] + log->fill, &sync, sizeof(sync));
+    log->fill += sizeof(sync);
+    log->base_ns = mono_ns;
+    log->since_sync = 0;
+}
+
+void imu_binlog_append(imu_binlog *log, const imu_raw_data *raw, const fused_data *fused) {
+    uint64_t mono_ns = ts_to_ns(&fused->ts);
+    int need_sync = log->cur < 0 || log->fill == 0 || log->since_sync >= IMU_BIN_SYNC_RECORDS ||
+                    mono_ns < log->base_ns || mono_ns - log->base_ns > UINT32_MAX;
+
+    // Every buffer starts with a marker, so one that is dropped or lost
+    // never leaves the next without a time base
+    if (log->cur >= 0 && log->fill + (need_sync ? 2 : 1) * BIN_RECORD_SIZE > IMU_BIN_BUFFER_SIZE) {
+        hand_off(log);
+    }
+    if (log->cur < 0) {
+        if (!take_buffer(log)) {
+            log->stats.dropped++;
+            log->seq++;
+            return;
+        }
+        need_sync = 1;
+    }
+    if (log->fill == 0) {
+        log->cur_started_ns = timebase_now_ns();
+    }
+    if (need_sync) {
+        put_sync(log, mono_ns);
+    }
+
+    imu_bin_sample sample;
+    memset(&sample, 0, sizeof(sample));
+    sample.type = IMU_BIN_SAMPLE;
+    sample.flags = raw->mag_fresh ? IMU_BIN_MAG_FRESH : 0;
+    sample.angle[0] = quantize(fused->roll, BIN_ANGLE_SCALE);
+    sample.angle[1] = quantize(fused->pitch, BIN_ANGLE_SCALE);
+    sample.angle[2] = quantize(fused->yaw, BIN_ANGLE_SCALE);
+    sample.dt_ns = (uint32_t)(mono_ns - log->base_ns);
+    for (int i = 0; i < 3; i++) {
+        sample.accel[i] = quantize(raw->accel[i], BIN_ACCEL_SCALE);
+        sample.gyro[i] = quantize(raw->gyro[i], BIN_GYRO_SCALE);
+        sample.mag[i] = quantize(raw->mag[i], BIN_MAG_SCALE);
+    }
+    memcpy(log->buffers[log->cur] + log->fill, &sample, sizeof(sample));
+    log->fill += sizeof(sample);
+    log->since_sync++;
+    log->seq++;
+    log->stats.samples++;
+}
+
+void imu_binlog_tick(imu_binlog *log) {
+    if (log->cur >= 0 && log->fill > 0 &&
+        timebase_now_ns() - log->cur_started_ns >= IMU_BIN_FLUSH_MS * 1000000ull) {
+        hand_off(log);
+    }
+}
+
+void imu_binlog_get_stats(imu_binlog *log, imu_binlog_stats *stats) {
+    pthread_mutex_lock(&log->lock);
+    *stats = log->stats;
+    stats->pending = log->queue_count + log->writing;
+    pthread_mutex_unlock(&log->lock);
+}
+
+void imu_binlog_close(imu_binlog *log, imu_binlog_stats *stats) {
+    if (!log) {
+        return;
+    }
+    hand_off(log);
+    pthread_mutex_lock(&log->lock);
+    log->stopping = 1;
+    pthread_cond_signal(&log->cond);
+    pthread_mutex_unlock(&log->lock);
+    pthread_join(log->thread, NULL);
+
+    fdatasync(log->fd);
+    close(log->fd);
+    log->stats.fsyncs++;
+    if (stats) {
+        *stats = log->stats;
+    }
+    printf("[IMU] Binary log closed: %s (%llu samples, %llu dropped)\n", log->path,
+           (unsigned long long)log->stats.samples, (unsigned long long)log->stats.dropped);
+
+    pthread_mutex_destroy(&log->lock);
+    pthread_cond_destroy(&log->cond);
+    for (int i = 0; i < IMU_BIN_BUFFERS; i++) {
+        free(log->buffers[i]);
+    }
+    free(log);
+}
+
+/* ---------- reading ---------- */
+
+int imu_binlog_reader_open(imu_binlog_reader *reader, const char *path) {
+    memset(reader, 0, sizeof(*reader));
+    reader->file = fopen(path, "rb");
+    if (!reader->file) {
+        return -1;
+    }
+    if (fread(&reader->header, sizeof(reader->header), 1, reader->file) != 1 ||
+        reader->header.magic != IMU_BIN_MAGIC || reader->header.version != IMU_BIN_VERSION ||
+        reader->header.record_size != BIN_RECORD_SIZE) {
+        fclose(reader->file);
+        reader->file = NULL;
+        errno = EINVAL;
+        return -1;
+    }
+    reader->utc_offset_ns = reader->header.utc_offset_ns;
+    return 0;
+}
+
+// Records are never split across writes, so the file stays record-aligned
+// and a bad record only costs the samples up to the next valid marker
+int imu_binlog_read(imu_binlog_reader *reader, imu_raw_data *raw, fused_data *fused, int64_t *utc_offset_ns) {
+    uint8_t record[BIN_RECORD_SIZE];
+
+    while (fread(record, sizeof(record), 1, reader->file) == 1) {
+        if (record[0] == IMU_BIN_SYNC) {
+            imu_bin_sync sync;
+            memcpy(&sync, record, sizeof(sync));
+            if (sync.magic == IMU_BIN_SYNC_MAGIC &&
+                sync.crc == crc32(record, offsetof(imu_bin_sync, crc))) {
+                if (reader->syncs > 0 && sync.seq > reader->expected_seq) {
+                    reader->missing += sync.seq - reader->expected_seq;
+                }
+                reader->expected_seq = sync.seq;
+                reader->base_ns = sync.mono_ns;
+                reader->utc_offset_ns = sync.utc_offset_ns;
+                reader->synced = 1;
+                reader->syncs++;
+                continue;
+            }
+        } else if (record[0] == IMU_BIN_SAMPLE) {
+            imu_bin_sample sample;
+            memcpy(&sample, record, sizeof(sample));
+            if ((sample.flags & ~IMU_BIN_MAG_FRESH) == 0 && sample.reserved == 0) {
+                reader->expected_seq++;
+                if (!reader->synced) {
+                    reader->unsynced++;
+                    continue;
+                }
+                const imu_bin_header *h = &reader->header;
+                uint64_t mono_ns = reader->base_ns + sample.dt_ns;
+                memset(raw, 0, sizeof(*raw));
+                memset(fused, 0, sizeof(*fused));
+                for (int i = 0; i < 3; i++) {
+                    raw->accel[i] = sample.accel[i] * h->accel_scale;
+                    raw->gyro[i] = sample.gyro[i] * h->gyro_scale;
+                    raw->mag[i] = sample.mag[i] * h->mag_scale;
+                }
+                raw->mag_fresh = (sample.flags & IMU_BIN_MAG_FRESH) != 0;
+                raw->ts.tv_sec = mono_ns / 1000000000ull;
+                raw->ts.tv_nsec = mono_ns % 1000000000ull;
+                fused->roll = sample.angle[0] * h->angle_scale;
+                fused->pitch = sample.angle[1] * h->angle_scale;
+                fused->yaw = sample.angle[2] * h->angle_scale;
+                fused->ts = raw->ts;
+                if (utc_offset_ns) {
+                    *utc_offset_ns = reader->utc_offset_ns;
+                }
+                reader->samples++;
+                return 1;
+            }
+        }
+        // Not a valid record: distrust the time base until the next marker
+        reader->corrupt++;
+        reader->synced = 0;
+    }
+    return 0;
+}
+
+void imu_binlog_reader_close(imu_binlog_reader *reader) {
+    if (reader->file) {
+        fclose(reader->file);
+        reader->file = NULL;
+    }
+}
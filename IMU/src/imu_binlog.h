@@ -0,0 +1,128 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/IMU/src/imu_binlog.h
+ */
+#ifndef IMU_BINLOG_H
+#define IMU_BINLOG_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "imu_logger.h"
+
+/*
+ * Binary IMU log (imu_*.imb), the compact alternative to the CSV log.
+ *
+ * An imu_bin_header, then fixed-size 32-byte records: samples, and sync
+ * markers that carry the absolute CLOCK_MONOTONIC time the following
+ * samples are offsets from. A marker starts every writer buffer and comes
+ * at least every IMU_BIN_SYNC_RECORDS samples, so after a crash a reader
+ * loses at most the torn tail, and corrupt records only until the next
+ * marker. Values are int16 with the scale factors from the header;
+ * everything is little-endian as written by the device.
+ *
+ * Samples are encoded into large buffers that a writer thread writes out
+ * whole and fdatasyncs periodically. The logging thread never blocks on
+ * the card: when every buffer is waiting to be written, samples are
+ * dropped and counted.
+ */
+
+#define IMU_BIN_MAGIC 0x31424D49u           // "IMB1"
+#define IMU_BIN_VERSION 1
+#define IMU_BIN_EXTENSION ".imb"
+#define IMU_BIN_SYNC_MAGIC 0x434E5953u      // "SYNC"
+#define IMU_BIN_SYNC_RECORDS 256            // 同步标记之间最多的样本数
+#define IMU_BIN_BUFFER_SIZE (64 * 1024)     // 写线程每次写入的字节数
+#define IMU_BIN_BUFFERS 4
+#define IMU_BIN_FLUSH_MS 1000               // 未满的缓冲区最多等待这么久再写出
+#define IMU_BIN_FSYNC_MS 5000               // fdatasync 间隔
+
+enum {
+    IMU_BIN_SAMPLE = 1,
+    IMU_BIN_SYNC = 2,
+};
+
+#define IMU_BIN_MAG_FRESH 0x01              // 样本标志：磁力计为新测量
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;       // 32
+    uint32_t sample_rate_hz;    // 名义采样率，0 为未知
+    uint32_t sync_interval;     // IMU_BIN_SYNC_RECORDS
+    float accel_scale;          // m/s² / LSB
+    float gyro_scale;           // rad/s / LSB
+    float mag_scale;            // μT / LSB
+    float angle_scale;          // rad / LSB
+    uint64_t start_mono_ns;     // 创建文件时的 CLOCK_MONOTONIC
+    int64_t utc_offset_ns;      // UTC - CLOCK_MONOTONIC，创建时的值，同步标记中随时更新
+    uint8_t reserved[16];
+} imu_bin_header;
+
+typedef struct {
+    uint8_t type;               // IMU_BIN_SAMPLE
+    uint8_t flags;              // IMU_BIN_MAG_FRESH
+    int16_t angle[3];           // roll, pitch, yaw
+    uint32_t dt_ns;             // 距上一个同步标记的时间
+    int16_t accel[3];
+    int16_t gyro[3];
+    int16_t mag[3];
+    uint16_t reserved;
+} imu_bin_sample;
+
+typedef struct {
+    uint8_t type;               // IMU_BIN_SYNC
+    uint8_t reserved[3];
+    uint32_t magic;             // IMU_BIN_SYNC_MAGIC
+    uint64_t mono_ns;           // 后续样本 dt_ns 的基准
+    int64_t utc_offset_ns;      // UTC - CLOCK_MONOTONIC，0 为未知
+    uint32_t seq;               // 此前写入的样本数（含丢弃的），用于发现缺口
+    uint32_t crc;               // 前 28 字节的 CRC32
+} imu_bin_sync;
+
+typedef struct {
+    uint64_t samples;           // 写入缓冲区的样本数
+    uint64_t dropped;           // 缓冲区全部待写而丢弃的样本数
+    uint64_t bytes;             // 已写入文件的字节数（含文件头）
+    uint64_t writes;            // write() 调用次数
+    uint64_t fsyncs;
+    uint64_t errors;            // 写入失败的缓冲区数
+    int pending;                // 交给写线程尚未写完的缓冲区数
+    uint64_t writer_cpu_ns;     // 写线程 CPU 时间（关闭后有效）
+} imu_binlog_stats;
+
+typedef struct imu_binlog imu_binlog;
+
+// 创建文件并启动写线程，失败返回 NULL
+imu_binlog* imu_binlog_open(const char *path, int sample_rate_hz);
+// 编码一个样本（不阻塞）；append、tick、get_stats 只由日志线程调用
+void imu_binlog_append(imu_binlog *log, const imu_raw_data *raw, const fused_data *fused);
+// 日志线程每次唤醒调用：缓冲区超过 IMU_BIN_FLUSH_MS 未写出时交给写线程
+void imu_binlog_tick(imu_binlog *log);
+// 写出全部数据、fdatasync 并关闭
+void imu_binlog_close(imu_binlog *log, imu_binlog_stats *stats);
+void imu_binlog_get_stats(imu_binlog *log, imu_binlog_stats *stats);
+
+/* ---------- reading (imu_export) ---------- */
+
+typedef struct {
+    FILE *file;
+    imu_bin_header header;
+    int synced;                 // 已遇到有效同步标记，样本可信
+    uint64_t base_ns;
+    int64_t utc_offset_ns;
+    uint32_t expected_seq;
+    // 统计
+    uint64_t samples;
+    uint64_t syncs;
+    uint64_t corrupt;           // 无效记录数
+    uint64_t unsynced;          // 因前面有损坏而跳过的样本数
+    uint64_t missing;           // 同步标记序号显示缺失的样本数（写入时丢弃或损坏）
+} imu_binlog_reader;
+
+// 成功返回 0
+int imu_binlog_reader_open(imu_binlog_reader *reader, const char *path);
+// 读出下一个样本，utc_offset_ns 为其所在段的 UTC 偏移（0 为未知）；返回 1，文件结束返回 0
+int imu_binlog_read(imu_binlog_reader *reader, imu_raw_data *raw, fused_data *fused, int64_t *utc_offset_ns);
+void imu_binlog_reader_close(imu_binlog_reader *reader);
+
+#endif
@@ -0,0 +1,124 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/IMU/src/imu_export.c
+ */
+/* ---------- src/imu_export.c ---------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "imu_binlog.h"
+
+// imu_export [--json] <imu_*.imb> [output]
+//
+// Streams a binary IMU log as CSV (default) or a JSON array, to stdout
+// unless an output file is given. The first five CSV columns match the
+// CSV the logger writes itself, so the web viewer reads either one.
+
+#define DEG(rad) ((rad) * 180.0 / M_PI)
+
+static void write_csv_row(FILE *out, uint64_t utc_ns, uint64_t mono_ns,
+                          const imu_raw_data *raw, const fused_data *fused) {
+    fprintf(out, "%llu.%09llu,%.2f,%.2f,%.2f,%llu,%.4f,%.4f,%.4f,%.5f,%.5f,%.5f,%.2f,%.2f,%.2f,%d\n",
+            (unsigned long long)(utc_ns / 1000000000ull), (unsigned long long)(utc_ns % 1000000000ull),
+            DEG(fused->roll), DEG(fused->pitch), DEG(fused->yaw),
+            (unsigned long long)mono_ns,
+            raw->accel[0], raw->accel[1], raw->accel[2],
+            raw->gyro[0], raw->gyro[1], raw->gyro[2],
+            raw->mag[0], raw->mag[1], raw->mag[2],
+            raw->mag_fresh);
+}
+
+static void write_json_row(FILE *out, int first, uint64_t utc_ns, uint64_t mono_ns,
+                           const imu_raw_data *raw, const fused_data *fused) {
+    fprintf(out, "%s{\"utc\":%llu.%09llu,\"mono_ns\":%llu,"
+            "\"roll\":%.2f,\"pitch\":%.2f,\"yaw\":%.2f,"
+            "\"accel\":[%.4f,%.4f,%.4f],\"gyro\":[%.5f,%.5f,%.5f],"
+            "\"mag\":[%.2f,%.2f,%.2f],\"mag_fresh\":%s}",
+            first ? "" : ",\n",
+            (unsigned long long)(utc_ns / 1000000000ull), (unsigned long long)(utc_ns % 1000000000ull),
+            (unsigned long long)mono_ns,
+            DEG(fused->roll), DEG(fused->pitch), DEG(fused->yaw),
+            raw->accel[0], raw->accel[1], raw->accel[2],
+            raw->gyro[0], raw->gyro[1], raw->gyro[2],
+            raw->mag[0], raw->mag[1], raw->mag[2],
+            raw->mag_fresh ? "true" : "false");
+}
+
+int main(int argc, char *argv[]) {
+    int json = 0;
+    const char *input = NULL;
+    const char *output = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            json = 1;
+        } else if (!input) {
+            input = argv[i];
+        } else if (!output) {
+            output = argv[i];
+        } else {
+            input = NULL;
+            break;
+        }
+    }
+    if (!input) {
+        fprintf(stderr, "Usage: %s [--json] <imu_*.imb> [output]\n", argv[0]);
+        return 1;
+    }
+
+    imu_binlog_reader reader;
+    if (imu_binlog_reader_open(&reader, input) != 0) {
+        perror("[IMU] Cannot open binary log");
+        return 1;
+    }
+    FILE *out = output ? fopen(output, "w") : stdout;
+    if (!out) {
+        perror("[IMU] Cannot create output file");
+        imu_binlog_reader_close(&reader);
+        return 1;
+    }
+    static char out_buffer[1 << 16];
+    setvbuf(out, out_buffer, _IOFBF, sizeof(out_buffer));
+
+    if (json) {
+        fprintf(out, "[\n");
+    } else {
+        fprintf(out, "Timestamp,Roll(deg),Pitch(deg),Yaw(deg),Monotonic(ns),"
+                     "AccelX(m/s2),AccelY(m/s2),AccelZ(m/s2),"
+                     "GyroX(rad/s),GyroY(rad/s),GyroZ(rad/s),"
+                     "MagX(uT),MagY(uT),MagZ(uT),MagFresh\n");
+    }
+
+    imu_raw_data raw;
+    fused_data fused;
+    int64_t utc_offset_ns;
+    while (imu_binlog_read(&reader, &raw, &fused, &utc_offset_ns) == 1) {
+        uint64_t mono_ns = (uint64_t)fused.ts.tv_sec * 1000000000ull + fused.ts.tv_nsec;
+        uint64_t utc_ns = mono_ns + utc_offset_ns;
+        if (json) {
+            write_json_row(out, reader.samples == 1, utc_ns, mono_ns, &raw, &fused);
+        } else {
+            write_csv_row(out, utc_ns, mono_ns, &raw, &fused);
+        }
+    }
+    if (json) {
+        fprintf(out, "\n]\n");
+    }
+
+    int failed = ferror(out) != 0;
+    if (out != stdout) {
+        failed |= fclose(out) != 0;
+    } else {
+        failed |= fflush(out) != 0;
+    }
+    fprintf(stderr, "[IMU] %s: %llu samples, %llu sync markers, %llu missing, %llu corrupt records, %llu samples skipped\n",
+            input, (unsigned long long)reader.samples, (unsigned long long)reader.syncs,
+            (unsigned long long)reader.missing, (unsigned long long)reader.corrupt,
+            (unsigned long long)reader.unsynced);
+    imu_binlog_reader_close(&reader);
+    if (failed) {
+        perror("[IMU] Export write failed");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,293 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/IMU/src/imu_fifo.c
+ */
+/* ---------- src/imu_fifo.c ---------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+#include "imu_fifo.h"
+
+
+// The period is measured over a long baseline of anchors, which averages out
+// their noise (a polled anchor is only good to half a period); the phase
+// follows the anchors with a small gain, each correction limited to half a
+// period.
+#define CLOCK_PHASE_GAIN 0.05
+#define CLOCK_STARTUP_GAIN 0.5
+#define CLOCK_BASELINE_MIN 200          // samples before the period is measured
+#define CLOCK_BASELINE_MAX 60000        // then restart the baseline to follow drift
+#define CLOCK_RESYNC_PERIODS 5      // anchor this far off: start over
+
+static uint64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* ---------- timestamp reconstruction ---------- */
+
+void imu_fifo_clock_init(imu_fifo_clock *clock, double nominal_ns) {
+    memset(clock, 0, sizeof(*clock));
+    clock->nominal_ns = nominal_ns;
+    clock->period_ns = nominal_ns;
+}
+
+void imu_fifo_clock_update(imu_fifo_clock *clock, int n, double anchor_ns, uint64_t *ts) {
+    if (n <= 0) {
+        return;
+    }
+    double newest = clock->next_ns + (n - 1) * clock->period_ns;
+    double error = anchor_ns - newest;
+    clock->last_error_ns = clock->locked ? error : 0;
+
+    if (!clock->locked || error > CLOCK_RESYNC_PERIODS * clock->period_ns ||
+        error < -CLOCK_RESYNC_PERIODS * clock->period_ns) {
+        // First burst, or samples were lost (FIFO overflow, stalled reader)
+        if (clock->locked) {
+            clock->resyncs++;
+        }
+        clock->locked = 1;
+        clock->next_ns = anchor_ns - (n - 1) * clock->period_ns;
+        clock->base_ns = anchor_ns;
+        clock->base_samples = 0;
+        error = 0;
+    } else {
+        clock->base_samples += n;
+    }
+
+    for (int i = 0; i < n; i++) {
+        ts[i] = (uint64_t)(clock->next_ns + i * clock->period_ns);
+    }
+    if (error > clock->period_ns / 2) error = clock->period_ns / 2;
+    if (error < -clock->period_ns / 2) error = -clock->period_ns / 2;
+    // Corrections apply from the next sample on, so timestamps never step back.
+    // Until the period is measured it may be a few percent off: follow harder.
+    double gain = clock->base_samples < CLOCK_BASELINE_MIN ? CLOCK_STARTUP_GAIN : CLOCK_PHASE_GAIN;
+    clock->next_ns += n * clock->period_ns + gain * error;
+
+    if (clock->base_samples >= CLOCK_BASELINE_MIN) {
+        double period = (anchor_ns - clock->base_ns) / clock->base_samples;
+        // The MPU6500 sample clock is within a few percent of nominal
+        if (period > clock->nominal_ns * 0.9 && period < clock->nominal_ns * 1.1) {
+            clock->period_ns = period;
+        }
+    }
+    if (clock->base_samples >= CLOCK_BASELINE_MAX) {
+        clock->base_ns = clock->next_ns - clock->period_ns;
+        clock->base_samples = 0;
+    }
+}
+
+/* ---------- data-ready GPIO ---------- */
+
+// "gpiochip3:12" -> rising-edge events on line 12 of /dev/gpiochip3
+static int gpio_open(const char *spec) {
+    char chip[64];
+    const char *colon = strchr(spec, ':');
+    if (!colon || colon == spec || (size_t)(colon - spec) >= sizeof(chip) - 5) {
+        fprintf(stderr, "[IMU] Bad data-ready GPIO \"%s\", expected gpiochipN:line\n", spec);
+        return -1;
+    }
+    snprintf(chip, sizeof(chip), "/dev/%.*s", (int)(colon - spec), spec);
+
+    int chip_fd = open(chip, O_RDONLY);
+    if (chip_fd < 0) {
+        perror("[IMU] Failed to open GPIO chip");
+        return -1;
+    }
+    struct gpioevent_request req;
+    memset(&req, 0, sizeof(req));
+    req.lineoffset = (uint32_t)atoi(colon + 1);
+    req.handleflags = GPIOHANDLE_REQUEST_INPUT;
+    req.eventflags = GPIOEVENT_REQUEST_RISING_EDGE;
+    snprintf(req.consumer_label, sizeof(req.consumer_label), "imu-drdy");
+    int ret = ioctl(chip_fd, GPIO_GET_LINEEVENT_IOCTL, &req);
+    close(chip_fd);
+    if (ret < 0) {
+        perror("[IMU] Failed to request data-ready GPIO line");
+        return -1;
+    }
+    fcntl(req.fd, F_SETFL, fcntl(req.fd, F_GETFL) | O_NONBLOCK);
+    return req.fd;
+}
+
+// Take all queued edges; 1 if any arrived within timeout_ms
+static int gpio_wait(imu_fifo *fifo, int timeout_ms) {
+    struct pollfd pfd = { fifo->gpio_fd, POLLIN, 0 };
+    if (poll(&pfd, 1, timeout_ms) <= 0) {
+        return 0;
+    }
+    struct gpioevent_data events[16];
+    ssize_t len;
+    int got = 0;
+    while ((len = read(fifo->gpio_fd, events, sizeof(events))) > 0) {
+        int n = (int)(len / sizeof(events[0]));
+        uint64_t ts = events[n - 1].timestamp;
+        // Kernels before 5.7 stamp line events with CLOCK_REALTIME
+        if (fifo->gpio_realtime) {
+            ts -= clock_ns(CLOCK_REALTIME) - clock_ns(CLOCK_MONOTONIC);
+        }
+        fifo->last_edge_ns = ts;
+        fifo->pending_edges += n;
+        got = 1;
+    }
+    return got;
+}
+
+/* ---------- acquisition ---------- */
+
+int imu_fifo_open(imu_fifo *fifo, i2c_bus *bus, int rate_hz, const char *gpio) {
+    memset(fifo, 0, sizeof(*fifo));
+    fifo->bus = bus;
+    fifo->rate_hz = rate_hz;
+    fifo->watermark = IMU_FIFO_WATERMARK * rate_hz / IMU_FIFO_RATE;
+    if (fifo->watermark < 1) fifo->watermark = 1;
+    fifo->gpio_fd = gpio ? gpio_open(gpio) : -1;
+    if (gpio && fifo->gpio_fd < 0) {
+        printf("[IMU] Data-ready GPIO unavailable, polling the FIFO instead\n");
+    }
+
+    if (!bus || !mpu6500_fifo_init(bus, rate_hz, fifo->gpio_fd >= 0)) {
+        imu_fifo_close(fifo);
+        return -1;
+    }
+    imu_fifo_clock_init(&fifo->clock, 1e9 / rate_hz);
+    fifo->next_poll_ns = clock_ns(CLOCK_MONOTONIC);
+
+    if (fifo->gpio_fd >= 0) {
+        // Tell the edge timestamp clock from the first edge
+        if (gpio_wait(fifo, 100)) {
+            uint64_t now = clock_ns(CLOCK_MONOTONIC);
+            fifo->gpio_realtime = fifo->last_edge_ns > now + 1000000000ull;
+            if (fifo->gpio_realtime) {
+                fifo->last_edge_ns -= clock_ns(CLOCK_REALTIME) - now;
+            }
+        } else {
+            printf("[IMU] No data-ready edges from the MPU6500, polling the FIFO instead\n");
+            close(fifo->gpio_fd);
+            fifo->gpio_fd = -1;
+        }
+        fifo->pending_edges = 0;
+        mpu6500_fifo_reset(bus);
+    }
+    printf("[IMU] FIFO acquisition at %d Hz, %d samples per burst, %s\n", rate_hz, fifo->watermark,
+           fifo->gpio_fd >= 0 ? "woken by data-ready edges" : "polled");
+    return 0;
+}
+
+void imu_fifo_close(imu_fifo *fifo) {
+    if (fifo->gpio_fd >= 0) {
+        close(fifo->gpio_fd);
+        fifo->gpio_fd = -1;
+    }
+}
+
+// Wait for the next burst; the anchor is when its newest sample became ready
+static void wait_for_burst(imu_fifo *fifo, double *anchor_ns, int *edges) {
+    if (fifo->gpio_fd >= 0) {
+        while (fifo->pending_edges < fifo->watermark) {
+            if (!gpio_wait(fifo, 100)) {
+                break;      // edges stopped: fall through and read what is there
+            }
+        }
+        *edges = fifo->pending_edges;
+        *anchor_ns = (double)fifo->last_edge_ns;
+        return;
+    }
+
+    // Absolute deadlines, so the burst size does not creep
+    uint64_t period = 1000000000ull / fifo->rate_hz;
+    uint64_t now = clock_ns(CLOCK_MONOTONIC);
+    fifo->next_poll_ns += fifo->watermark * period;
+    if (fifo->next_poll_ns < now) {
+        fifo->next_poll_ns = now;
+    }
+    struct timespec next = { (time_t)(fifo->next_poll_ns / 1000000000ull), (long)(fifo->next_poll_ns % 1000000000ull) };
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    *edges = 0;
+    *anchor_ns = 0;     // set around the FIFO_COUNT read
+}
+
+int imu_fifo_read(imu_fifo *fifo, imu_raw_data *out, int max) {
+    uint8_t count_buf[2];
+    uint8_t ak_buf[AK8963_READ_LEN];
+    i2c_read_op ops[2];
+    double anchor_ns;
+    int edges;
+
+    wait_for_burst(fifo, &anchor_ns, &edges);
+
+    // FIFO level, and the magnetometer in the same transfer unless it is in the records
+    int direct_mag = mpu6500_ext_len() == 0;
+    mpu6500_fifo_count_op(&ops[0], count_buf);
+    ak8963_read_op(&ops[1], ak_buf);
+    uint64_t t0 = clock_ns(CLOCK_MONOTONIC);
+    if (i2c_bus_read_batch(fifo->bus, ops, direct_mag ? 2 : 1) != 0) {
+        return -1;
+    }
+    if (edges == 0) {
+        // Polled: the newest queued sample arrived in the period before the count was latched
+        anchor_ns = (t0 + clock_ns(CLOCK_MONOTONIC)) / 2.0 - fifo->clock.period_ns / 2.0;
+    }
+    if (direct_mag) {
+        ak8963_convert(ak_buf, &fifo->mag);
+    }
+
+    int record = MPU6500_READ_LEN + mpu6500_ext_len();
+    int count = mpu6500_fifo_count(count_buf);
+    if (count > MPU6500_FIFO_SIZE / record * record) {
+        // Full: FIFO_MODE stopped writing, possibly mid-record
+        fifo->overflows++;
+        fifo->pending_edges = 0;
+        if (fifo->overflows % 100 == 1) {
+            printf("[IMU] MPU6500 FIFO overflow (%llu so far), resetting\n", (unsigned long long)fifo->overflows);
+        }
+        mpu6500_fifo_reset(fifo->bus);
+        return 0;
+    }
+
+    int n = count / record;
+    if (edges > 0 && edges < n) {
+        n = edges;      // records after the last edge wait for their own
+    }
+    if (n > max) {
+        // The anchor belongs to the newest record; the rest stay queued
+        anchor_ns -= (n - max) * fifo->clock.period_ns;
+        n = max;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    if (mpu6500_fifo_read(fifo->bus, fifo->data, (size_t)n * record) != 0) {
+        return -1;
+    }
+    if (edges > 0) {
+        fifo->pending_edges = fifo->pending_edges > n ? fifo->pending_edges - n : 0;
+    }
+
+    uint64_t ts[IMU_FIFO_MAX_SAMPLES];
+    imu_fifo_clock_update(&fifo->clock, n, anchor_ns, ts);
+    for (int i = 0; i < n; i++) {
+        const uint8_t *rec = &fifo->data[i * record];
+        mpu6500_convert(rec, &out[i]);
+        if (direct_mag) {
+            // One magnetometer read per burst, fresh at most for its first sample
+            memcpy(out[i].mag, fifo->mag.mag, sizeof(out[i].mag));
+            out[i].mag_fresh = i == 0 && fifo->mag.mag_fresh;
+        } else {
+            ak8963_convert(rec + MPU6500_READ_LEN, &out[i]);
+        }
+        out[i].ts.tv_sec = (time_t)(ts[i] / 1000000000ull);
+        out[i].ts.tv_nsec = (long)(ts[i] % 1000000000ull);
+    }
+    fifo->bursts++;
+    fifo->samples += n;
+    return n;
+}
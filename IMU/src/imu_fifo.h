@@ -0,0 +1,71 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/IMU/src/imu_fifo.h
+ */
+#ifndef IMU_FIFO_H
+#define IMU_FIFO_H
+
+#include <stdint.h>
+#include "imu_logger.h"
+
+/*
+ * FIFO-driven MPU6500 acquisition. The sensor queues samples at its own
+ * ODR; we read them in bursts and give each one a reconstructed timestamp
+ * instead of the time the read happened to run.
+ *
+ * A burst is triggered either by data-ready edges on a GPIO line (the
+ * MPU6500 INT pin, via the gpio character device) or, without one, by
+ * polling FIFO_COUNT every `watermark` sample periods.
+ *
+ * Timestamps come from a tracking loop over the sensor's sample clock. Each
+ * burst places its newest sample at an anchor: the last data-ready edge,
+ * or half a period before the FIFO_COUNT read when polling. The period is
+ * measured across many bursts and the phase nudged towards each anchor, so
+ * samples are one estimated period apart and the oscillator's few-percent
+ * error is learned rather than folded into the timestamps.
+ */
+
+#define IMU_FIFO_RATE 1000          // 默认 FIFO 采样率 (Hz)
+#define IMU_FIFO_WATERMARK 10       // 每次突发读取的目标样本数（10 ms @ 1 kHz）
+#define IMU_FIFO_MAX_SAMPLES (MPU6500_FIFO_SIZE / MPU6500_READ_LEN)   // 一次突发最多的样本数（记录不含磁力计时）
+
+typedef struct {
+    double period_ns;       // 估计的传感器采样周期
+    double next_ns;         // 下一个样本的预测时间
+    double nominal_ns;
+    double base_ns;         // 测量周期的基线起点（某个样本的时间）
+    uint64_t base_samples;  // 基线起点之后的样本数
+    int locked;
+    double last_error_ns;   // 最近一次锚点与预测值之差
+    uint64_t resyncs;
+} imu_fifo_clock;
+
+typedef struct {
+    i2c_bus *bus;
+    int rate_hz;
+    int watermark;
+    int gpio_fd;            // 数据就绪边沿事件，-1 为轮询
+    int gpio_realtime;      // 旧内核的边沿时间戳为 CLOCK_REALTIME
+    int pending_edges;      // 上次读取以来的边沿数
+    uint64_t last_edge_ns;
+    uint64_t next_poll_ns;
+    imu_raw_data mag;       // 最近一次磁力计数据（100 Hz，未经辅助 I2C 主机时每次突发读取一次）
+    imu_fifo_clock clock;
+    uint8_t data[MPU6500_FIFO_SIZE];
+    // 统计
+    uint64_t bursts;
+    uint64_t samples;
+    uint64_t overflows;
+} imu_fifo;
+
+void imu_fifo_clock_init(imu_fifo_clock *clock, double nominal_ns);
+// n 个新样本，最新一个在 anchor_ns 附近就绪；ts 输出每个样本的时间 (ns)
+void imu_fifo_clock_update(imu_fifo_clock *clock, int n, double anchor_ns, uint64_t *ts);
+
+// gpio 为 "gpiochipN:line" 时使用数据就绪中断，NULL 时轮询；成功返回 0
+int imu_fifo_open(imu_fifo *fifo, i2c_bus *bus, int rate_hz, const char *gpio);
+// 阻塞到一次突发读取，最多 max 个样本（含时间戳和最近的磁力计数据）；返回样本数，出错返回 -1
+int imu_fifo_read(imu_fifo *fifo, imu_raw_data *out, int max);
+void imu_fifo_close(imu_fifo *fifo);
+
+#endif
@@ -5,30 +5,23 @@
 #ifndef IMU_LOGGER_H
 #define IMU_LOGGER_H
 
-#include <sys/msg.h>
 #include <pthread.h>
 #include <time.h>
 #include "i2c_utils.h" 
 
-#define MSG_KEY 0x1234      // 消息队列键值
-#define BUFFER_SIZE 1024     // 环形缓冲区大小
-#define MAX_MSG_SIZE 64     // 最大消息大小
-
-// System V消息结构体
-typedef struct {
-    long mtype;             // 必须作为第一个成员
-    float roll;             // 横滚角（弧度）
-    float pitch;            // 俯仰角
-    float yaw;              // 偏航角
-    struct timespec ts;     // 时间戳
-} imu_msg;
+#define LOG_PERIOD_US 10000  // 日志线程唤醒周期（微秒）
+#define LOG_BATCH 64         // 日志线程每次从环形缓冲区取出的样本数上限
+#define MPU6500_READ_LEN 14  // ACCEL_XOUT_H..GYRO_ZOUT_L
+#define AK8963_READ_LEN 8    // ST1, HXL..HZH, ST2
+#define MPU6500_FIFO_SIZE 512   // FIFO 字节数，每条记录 MPU6500_READ_LEN 字节
 
 // 传感器原始数据结构
 typedef struct {
     float accel[3];         // 加速度计 (m/s²)
     float gyro[3];          // 陀螺仪 (rad/s)
     float mag[3];           // 磁力计 (μT)
-    struct timespec ts;     // 时间戳
+    int mag_fresh;          // 磁力计为本样本新测得的数据（100 Hz），否则沿用上一次测量
+    struct timespec ts;     // 采样时间（CLOCK_MONOTONIC）
 } imu_raw_data;
 
 // 融合后的姿态数据
@@ -39,28 +32,37 @@ typedef struct {
     struct timespec ts;
 } fused_data;
 
-// 环形缓冲区结构
-typedef struct {
-    imu_raw_data raw[BUFFER_SIZE];
-    fused_data filtered[BUFFER_SIZE];
-    int head;
-    int count;
-    pthread_mutex_t mutex;
-} imu_data_buffer;
-
 // 函数声明
-int mpu6500_init(const char *device, int addr);
-int ak8963_init(const char *device, int addr);
+int mpu6500_init(i2c_bus *bus, int addr);
+int ak8963_init(i2c_bus *bus, int addr);
+int ak8963_init_aux(i2c_bus *bus, int addr);     // 经 MPU6500 辅助 I2C 主机读取，数据随 MPU6500 一次读出
 int create_msg_queue(void);
-void send_to_msg_queue(int msqid, const imu_msg *msg);
+void send_to_msg_queue(int msqid, const imu_raw_data *raw, const fused_data *fused);  // 遥测队列（见 telemetry.h），不阻塞
 void* sensor_read_thread(void *arg);
 void* logging_thread(void *arg);
 void* command_listener_thread(void *arg);
-int read_mpu6500_data(imu_raw_data *data);
-int read_ak8963_data(imu_raw_data *data);
+void mpu6500_read_op(i2c_read_op *op, uint8_t *buf);   // buf 为 MPU6500_READ_LEN 字节
+void mpu6500_convert(const uint8_t *buf, imu_raw_data *data);
+int mpu6500_ext_len(void);                        // mpu6500_read_op 在 MPU6500_READ_LEN 之后多读的 EXT_SENS_DATA 字节数
+int mpu6500_aux_master_init(i2c_bus *bus);
+void mpu6500_aux_master_stop(i2c_bus *bus);
+int mpu6500_aux_write(i2c_bus *bus, int addr, uint8_t reg, uint8_t value);
+int mpu6500_aux_read(i2c_bus *bus, int addr, uint8_t reg, uint8_t *value);
+int mpu6500_aux_slave0(i2c_bus *bus, int addr, uint8_t reg, int len);
+int mpu6500_fifo_init(i2c_bus *bus, int rate_hz, int drdy_int);   // 1000/rate_hz 须为整数
+void mpu6500_fifo_count_op(i2c_read_op *op, uint8_t *buf);         // buf 为 2 字节
+int mpu6500_fifo_count(const uint8_t *buf);                        // FIFO 中的字节数
+int mpu6500_fifo_read(i2c_bus *bus, uint8_t *buf, size_t len);
+int mpu6500_fifo_reset(i2c_bus *bus);
+void ak8963_read_op(i2c_read_op *op, uint8_t *buf);    // buf 为 AK8963_READ_LEN 字节
+void ak8963_convert(const uint8_t *buf, imu_raw_data *data);
+int read_9axis_data(i2c_bus *bus, imu_raw_data *data);  // 两个传感器合并为一次 I2C 传输，成功返回 1
 void complementary_filter(const imu_raw_data *raw, fused_data *out);
-void write_to_csv(const fused_data *data);
+void write_to_csv(const fused_data *data);     // 不刷新，见 flush_csv_file
+void flush_csv_file(void);
 void close_csv_file(void);
 void create_csv_file(void);
+int open_csv_file(const char *path);           // 指定路径，成功返回 0
+void close_bin_log(void);                      // --bin-log：imu_*.imb（imu_binlog.h）代替 CSV
 
 #endif
\ No newline at end of file
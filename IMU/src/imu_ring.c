@@ -0,0 +1,56 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/IMU/src/imu_ring.c
+ */
+#include <string.h>
+#include "imu_ring.h"
+
+#define LOAD_ACQ(p)      __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define LOAD_RLX(p)      __atomic_load_n((p), __ATOMIC_RELAXED)
+#define STORE_REL(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+void imu_ring_init(imu_ring *ring) {
+    memset(ring, 0, sizeof(*ring));
+}
+
+int imu_ring_push(imu_ring *ring, const imu_sample *sample) {
+    uint32_t head = ring->head;
+    if (head - ring->tail_cache >= IMU_RING_SIZE) {
+        ring->tail_cache = LOAD_ACQ(&ring->tail);
+        if (head - ring->tail_cache >= IMU_RING_SIZE) {
+            __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+            return -1;
+        }
+    }
+    ring->slots[head & IMU_RING_MASK] = *sample;
+    // Publishes the slot contents along with the new head
+    STORE_REL(&ring->head, head + 1);
+    return 0;
+}
+
+size_t imu_ring_pop(imu_ring *ring, imu_sample *out, size_t max) {
+    uint32_t tail = ring->tail;
+    uint32_t avail = ring->head_cache - tail;
+    if (avail < max) {
+        ring->head_cache = LOAD_ACQ(&ring->head);
+        avail = ring->head_cache - tail;
+    }
+    if (avail > ring->high_water) {
+        ring->high_water = avail;
+    }
+    size_t n = avail < max ? avail : max;
+
+    // At most two runs: up to the end of the array, then from its start
+    size_t first = IMU_RING_SIZE - (tail & IMU_RING_MASK);
+    if (first > n) first = n;
+    memcpy(out, &ring->slots[tail & IMU_RING_MASK], first * sizeof(imu_sample));
+    memcpy(out + first, &ring->slots[0], (n - first) * sizeof(imu_sample));
+
+    // Hands the slots back only after they were copied
+    STORE_REL(&ring->tail, tail + (uint32_t)n);
+    return n;
+}
+
+uint64_t imu_ring_dropped(const imu_ring *ring) {
+    return LOAD_RLX(&ring->dropped);
+}
@@ -0,0 +1,54 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/IMU/src/imu_ring.h
+ */
+#ifndef IMU_RING_H
+#define IMU_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "imu_logger.h"
+
+/*
+ * Lock-free single-producer/single-consumer sample ring between the sensor
+ * read thread and the logging thread.
+ *
+ * head and tail are free-running counters on their own cache lines; only
+ * the producer writes head and only the consumer writes tail. Each side
+ * keeps a private copy of the other's counter and reloads it only when the
+ * ring looks full (producer) or empty (consumer), so in the steady state
+ * neither side touches the other's cache line per sample.
+ */
+
+#define IMU_RING_SIZE 1024          // 2 的幂，1 kHz 下约 1 秒
+#define IMU_RING_MASK (IMU_RING_SIZE - 1)
+
+typedef struct {
+    imu_raw_data raw;
+    fused_data fused;
+} imu_sample;
+
+typedef struct {
+    // Producer side
+    uint32_t head __attribute__((aligned(64)));
+    uint32_t tail_cache;
+    uint64_t dropped;               // samples refused because the ring was full
+    // Consumer side
+    uint32_t tail __attribute__((aligned(64)));
+    uint32_t head_cache;
+    uint32_t high_water;            // most samples found in one drain
+    imu_sample slots[IMU_RING_SIZE] __attribute__((aligned(64)));
+} imu_ring;
+
+void imu_ring_init(imu_ring *ring);
+
+// Producer: 0, or -1 when full (the sample is dropped and counted)
+int imu_ring_push(imu_ring *ring, const imu_sample *sample);
+
+// Consumer: copy up to max samples, oldest first; returns how many
+size_t imu_ring_pop(imu_ring *ring, imu_sample *out, size_t max);
+
+// Either side: samples dropped so far
+uint64_t imu_ring_dropped(const imu_ring *ring);
+
+#endif
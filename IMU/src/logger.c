@@ -8,6 +8,10 @@
 #include <string.h>
 #include <errno.h>
 #include "imu_logger.h"
+#include "imu_ring.h"
+#include "imu_binlog.h"
+#include "timebase.h"
+#include "telemetry.h"
 #define _GNU_SOURCE     // Enable GNU extensions
 #include <math.h>       // Math library
 #include <stdlib.h>     // Exit and EXIT_FAILURE
@@ -16,36 +20,50 @@
 
 // External global variables
 extern volatile int g_imu_recording;
-extern imu_data_buffer g_buffer;
+extern volatile int g_log_running;
+extern int g_csv_enabled;
+extern int g_bin_log;
+extern int g_fifo_rate;
+extern imu_ring g_ring;
 
 // Global file variables
 static FILE *csv_file = NULL;
 static time_t file_start_time = 0;
 static char current_filename[256] = {0};
 static int record_count = 0; // Count records for periodic logging
+static imu_binlog *bin_log = NULL;
+static time_t bin_start_time = 0;
+static int bin_log_closed = 0;
+// Held by the logging thread across each batch so that close_bin_log
+// never closes the log mid-append
+static pthread_mutex_t bin_log_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t telemetry_seq = 0;
+static unsigned long telemetry_dropped = 0;
 
-// Create message queue
+// Open the telemetry queue. It is shared with GNSS and VideoProcess, so it
+// is no longer deleted and recreated here; VideoProcess skips stale samples.
 int create_msg_queue(void) {
-    int msqid;
-    
-    // Try to create new queue
-    if ((msqid = msgget(MSG_KEY, IPC_CREAT | IPC_EXCL | 0666)) == -1) {
-        if (errno == EEXIST) { // Queue already exists
-            msqid = msgget(MSG_KEY, 0);
-            msgctl(msqid, IPC_RMID, NULL); // Delete old queue
-            msqid = msgget(MSG_KEY, IPC_CREAT | 0666);
-        } else {
-            perror("[IMU] msgget failed");
-            return -1;
-        }
+    int msqid = telemetry_open();
+    if (msqid == -1) {
+        perror("[IMU] msgget failed");
     }
     return msqid;
 }
 
-// Send message to queue
-void send_to_msg_queue(int msqid, const imu_msg *msg) {
-    if (msgsnd(msqid, msg, sizeof(imu_msg) - sizeof(long), 0) == -1) {
-        perror("[IMU] msgsnd failed");
+// Send one sample to VideoProcess. Never blocks: without a reader the queue
+// fills up and samples are dropped (the sequence number shows the gap).
+void send_to_msg_queue(int msqid, const imu_raw_data *raw, const fused_data *fused) {
+    TelemetryImu sample;
+    memset(&sample, 0, sizeof(sample));
+    sample.mono_ns = (uint64_t)fused->ts.tv_sec * 1000000000ull + fused->ts.tv_nsec;
+    sample.seq = telemetry_seq++;
+    sample.roll = fused->roll;
+    sample.pitch = fused->pitch;
+    sample.yaw = fused->yaw;
+    memcpy(sample.gyro, raw->gyro, sizeof(sample.gyro));
+    memcpy(sample.accel, raw->accel, sizeof(sample.accel));
+    if (telemetry_send(msqid, TELEMETRY_IMU, &sample) != 0 && ++telemetry_dropped % 1000 == 1) {
+        printf("[IMU] Telemetry queue full or missing, %lu samples dropped\n", telemetry_dropped);
     }
 }
 
@@ -58,6 +76,29 @@ static void ensure_directory_exists(const char *path) {
     printf("[IMU] Ensuring directory exists: %s\n", path);
 }
 
+// Replace the open CSV file with a new one at path, returns 0 on success
+int open_csv_file(const char *path) {
+    // Close existing file
+    if (csv_file) {
+        fclose(csv_file);
+        csv_file = NULL;
+    }
+    if (path != current_filename) {
+        snprintf(current_filename, sizeof(current_filename), "%s", path);
+    }
+
+    csv_file = fopen(current_filename, "w");
+    if (!csv_file) {
+        return -1;
+    }
+    fprintf(csv_file, "Timestamp,Roll(deg),Pitch(deg),Yaw(deg),Monotonic(ns)\n");
+    // Immediately add initial data line
+    fprintf(csv_file, "%ld.000000000,0.00,0.00,0.00,0\n", time(NULL));
+    fflush(csv_file);
+    file_start_time = time(NULL);
+    return 0;
+}
+
 // Create new CSV file
 void create_csv_file() {
     // Ensure SD card directory exists
@@ -77,19 +118,7 @@ void create_csv_file() {
     // Multiple attempts to create file
     int retry = 0;
     while (retry < 3) {
-        // Close existing file
-        if (csv_file) {
-            fclose(csv_file);
-            csv_file = NULL;
-        }
-        
-        csv_file = fopen(current_filename, "w");
-        if (csv_file) {
-            fprintf(csv_file, "Timestamp,Roll(deg),Pitch(deg),Yaw(deg)\n");
-            // Immediately add initial data line
-            fprintf(csv_file, "%ld.000000000,0.00,0.00,0.00\n", time(NULL));
-            fflush(csv_file);
-            file_start_time = t;
+        if (open_csv_file(current_filename) == 0) {
             printf("[IMU] Successfully created CSV file: %s\n", current_filename);
             return;
         } else {
@@ -105,12 +134,7 @@ void create_csv_file() {
            tm->tm_year+1900, tm->tm_mon+1, tm->tm_mday,
            tm->tm_hour, tm->tm_min, tm->tm_sec);
     
-    csv_file = fopen(current_filename, "w");
-    if (csv_file) {
-        fprintf(csv_file, "Timestamp,Roll(deg),Pitch(deg),Yaw(deg)\n");
-        fprintf(csv_file, "%ld.000000000,0.00,0.00,0.00\n", time(NULL));
-        fflush(csv_file);
-        file_start_time = t;
+    if (open_csv_file(current_filename) == 0) {
         printf("[IMU] Created backup CSV file: %s\n", current_filename);
     } else {
         printf("[IMU] CRITICAL ERROR: Cannot create CSV file anywhere!\n");
@@ -133,13 +157,21 @@ void write_to_csv(const fused_data *data) {
         if (!csv_file) return;
     }
 
-    // Write data
-    fprintf(csv_file, "%ld.%09ld,%.2f,%.2f,%.2f\n", 
-          data->ts.tv_sec, data->ts.tv_nsec,
+    // Write data: UTC through the shared timebase (the system clock until
+    // one is published), then the raw monotonic stamp for exact matching
+    uint64_t mono_ns = (uint64_t)data->ts.tv_sec * 1000000000ull + data->ts.tv_nsec;
+    uint64_t utc_ns = timebase_to_utc_ns(mono_ns);
+    if (utc_ns == 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        utc_ns = (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+    }
+    fprintf(csv_file, "%llu.%09llu,%.2f,%.2f,%.2f,%llu\n", 
+          (unsigned long long)(utc_ns / 1000000000ull), (unsigned long long)(utc_ns % 1000000000ull),
           data->roll * 180/M_PI, 
           data->pitch * 180/M_PI,
-          data->yaw * 180/M_PI);
-    fflush(csv_file);
+          data->yaw * 180/M_PI,
+          (unsigned long long)mono_ns);
     
     // Log periodically to reduce log volume
     if (++record_count % 100 == 0) {
@@ -147,6 +179,13 @@ void write_to_csv(const fused_data *data) {
     }
 }
 
+// Push a batch of records to the card
+void flush_csv_file(void) {
+    if (csv_file) {
+        fflush(csv_file);
+    }
+}
+
 // Close log file
 void close_csv_file(void) {
     if (csv_file != NULL) {
@@ -156,25 +195,85 @@ void close_csv_file(void) {
     }
 }
 
+// Create a new binary log next to where the CSV would go (bin_log_lock held)
+static void create_bin_log(void) {
+    ensure_directory_exists("/mnt/sdcard");
+    if (bin_log) {
+        imu_binlog_close(bin_log, NULL);
+        bin_log = NULL;
+    }
+
+    time_t t = time(NULL);
+    struct tm *tm = localtime(&t);
+    int rate = g_fifo_rate > 0 ? g_fifo_rate : 200;
+    const char *dirs[] = { "/mnt/sdcard", "/tmp" };
+    char filename[256];
+    for (int i = 0; i < 2 && !bin_log; i++) {
+        snprintf(filename, sizeof(filename),
+               "%s/imu_%04d%02d%02d_%02d%02d%02d" IMU_BIN_EXTENSION, dirs[i],
+               tm->tm_year+1900, tm->tm_mon+1, tm->tm_mday,
+               tm->tm_hour, tm->tm_min, tm->tm_sec);
+        bin_log = imu_binlog_open(filename, rate);
+        if (!bin_log) {
+            perror("[IMU] Failed to create binary log");
+        }
+    }
+    if (bin_log) {
+        bin_start_time = t;
+        printf("[IMU] Binary log created: %s (imu_export converts it to CSV)\n", filename);
+    } else {
+        printf("[IMU] CRITICAL ERROR: Cannot create binary log anywhere!\n");
+    }
+}
+
+// Raw and fused values together; the writer thread does the file I/O
+static void write_to_bin_log(const imu_raw_data *raw, const fused_data *fused) {
+    if (bin_log_closed) {
+        return;
+    }
+    if (!bin_log || time(NULL) - bin_start_time >= 86400) {
+        create_bin_log();
+        if (!bin_log) return;
+    }
+    imu_binlog_append(bin_log, raw, fused);
+}
+
+// Write out and close for good
+void close_bin_log(void) {
+    pthread_mutex_lock(&bin_log_lock);
+    bin_log_closed = 1;
+    if (bin_log) {
+        imu_binlog_close(bin_log, NULL);
+        bin_log = NULL;
+    }
+    pthread_mutex_unlock(&bin_log_lock);
+}
+
 // Logging thread
 void* logging_thread(void *arg) {
     int msqid = *(int*)arg;
-    imu_msg msg;
     int prev_recording_state = 0;
     int empty_data_count = 0;
+    static imu_sample batch[LOG_BATCH];
 
     printf("[IMU] Logging thread started\n");
 
-    // Create CSV file at startup
-    create_csv_file();
+    // Create the log file at startup
+    if (g_csv_enabled && g_bin_log) {
+        pthread_mutex_lock(&bin_log_lock);
+        create_bin_log();
+        pthread_mutex_unlock(&bin_log_lock);
+    } else if (g_csv_enabled) {
+        create_csv_file();
+    }
     
     // If file creation failed, try an emergency file
-    if (!csv_file) {
+    if (g_csv_enabled && !g_bin_log && !csv_file) {
         printf("[IMU] Attempting to write emergency file...\n");
         csv_file = fopen("/tmp/imu_emergency.csv", "w");
         if (csv_file) {
-            fprintf(csv_file, "Timestamp,Roll(deg),Pitch(deg),Yaw(deg)\n");
-            fprintf(csv_file, "%ld.000000000,0.00,0.00,0.00\n", time(NULL));
+            fprintf(csv_file, "Timestamp,Roll(deg),Pitch(deg),Yaw(deg),Monotonic(ns)\n");
+            fprintf(csv_file, "%ld.000000000,0.00,0.00,0.00,0\n", time(NULL));
             fflush(csv_file);
             printf("[IMU] Emergency file created successfully\n");
         } else {
@@ -185,6 +284,9 @@ void* logging_thread(void *arg) {
     printf("[IMU] Entering logging main loop\n");
     
     while (1) {
+        // Cleared once the read thread has stopped: this drain is the last
+        int last = !g_log_running;
+
         // Detect recording state changes
         if (g_imu_recording && !prev_recording_state) {
             printf("[IMU] Recording state changed: INACTIVE -> ACTIVE\n");
@@ -193,33 +295,31 @@ void* logging_thread(void *arg) {
         }
         prev_recording_state = g_imu_recording;
         
-        // Process data
-        pthread_mutex_lock(&g_buffer.mutex);
-        
-        if (g_buffer.count > 0) {
-            // Reset empty data counter when we get data
-            empty_data_count = 0;
-            
-            // Get data from buffer
-            fused_data data = g_buffer.filtered[g_buffer.head];
-            
-            // Fill message structure
-            msg.mtype = 1; // Message type
-            msg.roll = data.roll;
-            msg.pitch = data.pitch;
-            msg.yaw = data.yaw;
-            msg.ts = data.ts;
-
-            // Check if in recording state
-            if (g_imu_recording) {
-                // Write to file and send message
-                write_to_csv(&data);
-                send_to_msg_queue(msqid, &msg);
+        // Drain everything the read thread queued since the last wakeup
+        size_t total = 0, n;
+        pthread_mutex_lock(&bin_log_lock);
+        while ((n = imu_ring_pop(&g_ring, batch, LOG_BATCH)) > 0) {
+            for (size_t i = 0; i < n; i++) {
+                // VideoProcess keeps a pre-record of these, so they go out
+                // whether or not anything is recording
+                send_to_msg_queue(msqid, &batch[i].raw, &batch[i].fused);
+
+                // Check if in recording state
+                if (g_imu_recording && g_csv_enabled) {
+                    if (g_bin_log) {
+                        write_to_bin_log(&batch[i].raw, &batch[i].fused);
+                    } else {
+                        write_to_csv(&batch[i].fused);
+                    }
+                }
             }
+            total += n;
+        }
 
-            // Update buffer index
-            g_buffer.head = (g_buffer.head + 1) % BUFFER_SIZE;
-            g_buffer.count--;
+        if (total > 0) {
+            // Reset empty data counter when we get data
+            empty_data_count = 0;
+            flush_csv_file();
         } else {
             // Periodically log if we're not getting any data
             empty_data_count++;
@@ -229,16 +329,22 @@ void* logging_thread(void *arg) {
                 // Create dummy data if recording is active and we haven't received data
                 if (g_imu_recording && csv_file) {
                     time_t now = time(NULL);
-                    fprintf(csv_file, "%ld.000000000,0.00,0.00,0.00\n", now);
+                    fprintf(csv_file, "%ld.000000000,0.00,0.00,0.00,0\n", now);
                     fflush(csv_file);
                     printf("[IMU] Added dummy data point while waiting for sensor\n");
                 }
             }
         }
+        if (bin_log) {
+            imu_binlog_tick(bin_log);
+        }
+        pthread_mutex_unlock(&bin_log_lock);
+        if (last) {
+            break;
+        }
         
-        pthread_mutex_unlock(&g_buffer.mutex);
-        
-        usleep(10000); // 10ms sleep
+        usleep(LOG_PERIOD_US);
     }
+    printf("[IMU] Logging thread stopped\n");
     return NULL;
 }
\ No newline at end of file
@@ -11,32 +11,27 @@
 #include <string.h>
 #include <signal.h>
 #include "imu_logger.h"
+#include "imu_ring.h"
+#include "i2c_mock.h"
+#include "imu_fifo.h"
+#include "bench.h"
+#include "timebase.h"
 
 // Control FIFO path
 #define IMU_FIFO_PATH "/tmp/imu_control_fifo"
 
 // Global control flags
 volatile int g_imu_recording = 0;
-imu_data_buffer g_buffer = {0};
+int g_csv_enabled = 1;  // --no-csv：样本只经遥测队列写入录像
+int g_bin_log = 0;      // --bin-log：记录写入二进制日志 imu_*.imb（含原始 9 轴数据），用 imu_export 转为 CSV/JSON
+imu_ring g_ring;
+i2c_bus *g_bus = NULL;  // MPU6500 与 AK8963 共用的 I2C 总线
+int g_fifo_rate = 0;    // --fifo[=Hz]：FIFO 突发采集（imu_fifo.h），0 为每 5 ms 轮询一次
+const char *g_drdy_gpio = NULL;  // --drdy-gpio gpiochipN:line：MPU6500 INT 引脚，省略则轮询 FIFO
 int g_msqid = -1;
 pthread_t g_read_thread, g_log_thread;
-
-// Handle exit signals
-static void handle_signal(int sig) {
-    if (sig == SIGTERM || sig == SIGINT) {
-        printf("[IMU] Process received termination signal, exiting...\n");
-        
-        // Clean up resources
-        close_csv_file();
-        
-        if (g_msqid != -1) {
-            msgctl(g_msqid, IPC_RMID, NULL);
-        }
-        pthread_mutex_destroy(&g_buffer.mutex);
-        
-        exit(0);
-    }
-}
+volatile int g_read_running = 1;    // 退出时清零：采集线程停止
+volatile int g_log_running = 1;     // 采集线程退出后清零：日志线程最后取空一次环形缓冲区后停止
 
 // Command listener thread
 void* command_listener_thread(void *arg) {
@@ -83,14 +78,45 @@ void* command_listener_thread(void *arg) {
     return NULL;
 }
 
-int main() {
+int main(int argc, char *argv[]) {
     pthread_t cmd_thread;
-    
-    // Register signal handlers
-    signal(SIGTERM, handle_signal);
-    signal(SIGINT, handle_signal);
+
+    // 基准测试模式：imu_logger --bench <name>，不访问传感器
+    if (argc >= 3 && strcmp(argv[1], "--bench") == 0) {
+        return run_benchmark(argv[2]);
+    }
+
+    int mock_i2c = 0;   // --mock-i2c：使用模拟传感器（i2c_mock.h），无需硬件
+    int aux_mag = 0;    // --aux-mag：AK8963 接在 MPU6500 辅助 I2C 总线上，9 轴一次突发读出
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-csv") == 0) {
+            g_csv_enabled = 0;
+        } else if (strcmp(argv[i], "--bin-log") == 0) {
+            g_bin_log = 1;
+        } else if (strcmp(argv[i], "--mock-i2c") == 0) {
+            mock_i2c = 1;
+        } else if (strcmp(argv[i], "--aux-mag") == 0) {
+            aux_mag = 1;
+        } else if (strcmp(argv[i], "--fifo") == 0) {
+            g_fifo_rate = IMU_FIFO_RATE;
+        } else if (strncmp(argv[i], "--fifo=", 7) == 0 && atoi(argv[i] + 7) > 0) {
+            g_fifo_rate = atoi(argv[i] + 7);
+        } else if (strcmp(argv[i], "--drdy-gpio") == 0 && i + 1 < argc) {
+            g_drdy_gpio = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--no-csv | --bin-log] [--mock-i2c] [--aux-mag] [--fifo[=Hz] [--drdy-gpio gpiochipN:line]] | --bench <name>\n", argv[0]);
+            return 1;
+        }
+    }
     
     printf("[IMU] Process started\n");
+
+    // Samples are stamped with CLOCK_MONOTONIC; publish its UTC offset in
+    // case VideoProcess has not yet
+    timebase_open();
+    if (timebase_publish_system() != 0) {
+        printf("[IMU] System clock not set, UTC offset left to GNSS\n");
+    }
     
     // Ensure directory exists
     system("mkdir -p /mnt/sdcard");
@@ -113,51 +139,62 @@ int main() {
     }
     
     // Immediately create CSV file regardless of sensor status
-    time_t now = time(NULL);
-    struct tm *tm = localtime(&now);
-    char filename[256];
-    
-    snprintf(filename, sizeof(filename), 
-           "/mnt/sdcard/imu_%04d%02d%02d_%02d%02d%02d.csv",
-           tm->tm_year+1900, tm->tm_mon+1, tm->tm_mday,
-           tm->tm_hour, tm->tm_min, tm->tm_sec);
+    if (!g_csv_enabled) {
+        printf("[IMU] CSV disabled, samples are recorded by VideoProcess only\n");
+    } else if (g_bin_log) {
+        printf("[IMU] Binary log enabled, created by the logging thread\n");
+    } else {
+        time_t now = time(NULL);
+        struct tm *tm = localtime(&now);
+        char filename[256];
     
-    FILE *csv_file = fopen(filename, "w");
-    if (!csv_file) {
-        perror("[IMU] Failed to create CSV file");
-        // Try creating in /tmp
         snprintf(filename, sizeof(filename), 
-               "/tmp/imu_%04d%02d%02d_%02d%02d%02d.csv",
+               "/mnt/sdcard/imu_%04d%02d%02d_%02d%02d%02d.csv",
                tm->tm_year+1900, tm->tm_mon+1, tm->tm_mday,
                tm->tm_hour, tm->tm_min, tm->tm_sec);
-        
-        csv_file = fopen(filename, "w");
+    
+        FILE *csv_file = fopen(filename, "w");
         if (!csv_file) {
-            perror("[IMU] Failed to create backup CSV file");
+            perror("[IMU] Failed to create CSV file");
+            // Try creating in /tmp
+            snprintf(filename, sizeof(filename), 
+                   "/tmp/imu_%04d%02d%02d_%02d%02d%02d.csv",
+                   tm->tm_year+1900, tm->tm_mon+1, tm->tm_mday,
+                   tm->tm_hour, tm->tm_min, tm->tm_sec);
+        
+            csv_file = fopen(filename, "w");
+            if (!csv_file) {
+                perror("[IMU] Failed to create backup CSV file");
+            } else {
+                fprintf(csv_file, "Timestamp,Roll(deg),Pitch(deg),Yaw(deg),Monotonic(ns)\n");
+                fprintf(csv_file, "%ld.000000000,0.00,0.00,0.00,0\n", time(NULL));
+                fclose(csv_file);
+                printf("[IMU] Backup CSV file created: %s\n", filename);
+            }
         } else {
-            fprintf(csv_file, "Timestamp,Roll(deg),Pitch(deg),Yaw(deg)\n");
-            fprintf(csv_file, "%ld.000000000,0.00,0.00,0.00\n", time(NULL));
+            fprintf(csv_file, "Timestamp,Roll(deg),Pitch(deg),Yaw(deg),Monotonic(ns)\n");
+            fprintf(csv_file, "%ld.000000000,0.00,0.00,0.00,0\n", time(NULL));
             fclose(csv_file);
-            printf("[IMU] Backup CSV file created: %s\n", filename);
+            printf("[IMU] CSV file created: %s\n", filename);
         }
-    } else {
-        fprintf(csv_file, "Timestamp,Roll(deg),Pitch(deg),Yaw(deg)\n");
-        fprintf(csv_file, "%ld.000000000,0.00,0.00,0.00\n", time(NULL));
-        fclose(csv_file);
-        printf("[IMU] CSV file created: %s\n", filename);
     }
     
     // Initialize sensors
     printf("[IMU] Initializing sensors...\n");
     int sensor_ok = 1;
-    if (!mpu6500_init("/dev/i2c-1", 0x68)) {
+    g_bus = mock_i2c ? i2c_mock_open(NULL) : i2c_bus_open("/dev/i2c-1");
+    if (!mpu6500_init(g_bus, 0x68)) {
         fprintf(stderr, "[IMU] MPU6500 initialization failed\n");
         sensor_ok = 0;
     } else {
         printf("[IMU] MPU6500 initialized successfully\n");
     }
     
-    if (!ak8963_init("/dev/i2c-1", 0x0D)) {
+    int ak_ok = aux_mag && ak8963_init_aux(g_bus, 0x0D);
+    if (aux_mag && !ak_ok) {
+        printf("[IMU] Falling back to reading the AK8963 directly\n");
+    }
+    if (!ak_ok && !ak8963_init(g_bus, 0x0D)) {
         fprintf(stderr, "[IMU] AK8963 initialization failed\n");
         sensor_ok = 0;
     } else {
@@ -176,17 +213,22 @@ int main() {
         printf("[IMU] Message queue created\n");
     }
 
-    // Initialize mutex
-    if (pthread_mutex_init(&g_buffer.mutex, NULL) != 0) {
-        perror("[IMU] Mutex initialization failed");
-        // Continue anyway
-    } else {
-        printf("[IMU] Mutex initialized\n");
-    }
+    // Sample ring between the read and logging threads (lock-free)
+    imu_ring_init(&g_ring);
+
+    // From here on SIGTERM/SIGINT are taken by sigwait below, in every
+    // thread: the logs are closed only after the threads have stopped.
+    // Until now they terminate as before; there is nothing to flush yet.
+    sigset_t exit_signals;
+    sigemptyset(&exit_signals);
+    sigaddset(&exit_signals, SIGTERM);
+    sigaddset(&exit_signals, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &exit_signals, NULL);
 
     // Create data collection thread
     printf("[IMU] Starting sensor read thread\n");
-    if (pthread_create(&g_read_thread, NULL, sensor_read_thread, &g_buffer) != 0) {
+    int read_started = pthread_create(&g_read_thread, NULL, sensor_read_thread, &g_ring) == 0;
+    if (!read_started) {
         perror("[IMU] Sensor read thread creation failed");
         // Continue anyway
     } else {
@@ -195,7 +237,8 @@ int main() {
 
     // Create logging thread - this thread will create CSV file at startup
     printf("[IMU] Starting logging thread\n");
-    if (pthread_create(&g_log_thread, NULL, logging_thread, &g_msqid) != 0) {
+    int log_started = pthread_create(&g_log_thread, NULL, logging_thread, &g_msqid) == 0;
+    if (!log_started) {
         perror("[IMU] Logging thread creation failed");
         // Continue anyway
     } else {
@@ -214,15 +257,28 @@ int main() {
         printf("[IMU] Command listener thread started\n");
     }
 
-    // Wait for command thread to end (it never will unless terminated by signal)
-    printf("[IMU] Main thread waiting for command thread\n");
-    pthread_join(cmd_thread, NULL);
-    
-    // This code should never execute
+    // Run until SIGTERM/SIGINT
+    printf("[IMU] Main thread waiting for termination signal\n");
+    int sig = 0;
+    sigwait(&exit_signals, &sig);
+    printf("[IMU] Process received termination signal, exiting...\n");
+    // A second signal terminates at once if the shutdown hangs
+    pthread_sigmask(SIG_UNBLOCK, &exit_signals, NULL);
+
+    // Stop sampling, let the logging thread take what is left in the ring,
+    // then close the logs nobody writes to any more
+    g_read_running = 0;
+    if (read_started) {
+        pthread_join(g_read_thread, NULL);
+    }
+    g_log_running = 0;
+    if (log_started) {
+        pthread_join(g_log_thread, NULL);
+    }
+    close_bin_log();
     close_csv_file();
-    msgctl(g_msqid, IPC_RMID, NULL);
-    pthread_mutex_destroy(&g_buffer.mutex);
-    
+
+    // The telemetry queue is shared with GNSS and VideoProcess: leave it
     printf("[IMU] Process exited normally\n");
     return 0;
 }
\ No newline at end of file
@@ -7,19 +7,56 @@
 #include "i2c_utils.h"
 #define _GNU_SOURCE     // 启用GNU扩展
 #include <math.h>       // 包含数学库
+#include <stdio.h>
+#include <unistd.h>
 
-static int mpu_fd = -1;
+#define MPU_SMPLRT_DIV      0x19
+#define MPU_CONFIG          0x1A
+#define MPU_FIFO_EN         0x23
+#define MPU_I2C_MST_CTRL    0x24
+#define MPU_I2C_SLV0_ADDR   0x25
+#define MPU_I2C_SLV0_REG    0x26
+#define MPU_I2C_SLV0_CTRL   0x27
+#define MPU_I2C_SLV4_ADDR   0x31
+#define MPU_I2C_SLV4_REG    0x32
+#define MPU_I2C_SLV4_DO     0x33
+#define MPU_I2C_SLV4_CTRL   0x34
+#define MPU_I2C_SLV4_DI     0x35
+#define MPU_I2C_MST_STATUS  0x36
+#define MPU_INT_PIN_CFG     0x37
+#define MPU_INT_ENABLE      0x38
+#define MPU_ACCEL_XOUT_H    0x3B
+#define MPU_USER_CTRL       0x6A
+#define MPU_FIFO_COUNTH     0x72
+#define MPU_FIFO_R_W        0x74
+#define MPU_WHO_AM_I        0x75
+#define MPU_ACCEL_RANGE_G   8.0     // 与初始化序列中的 ACCEL_CONFIG 一致
+#define MPU_GYRO_RANGE_DPS  2000.0  // 与初始化序列中的 GYRO_CONFIG 一致
+
+static uint8_t mpu_addr = 0x68;
+static uint8_t mpu_user_ctrl = 0x00;    // USER_CTRL 当前值，FIFO 与 I2C 主机共用
+static int mpu_ext_len = 0;             // SLV0 读入 EXT_SENS_DATA 的字节数，0 为未启用
+
+// Set and clear USER_CTRL bits without disturbing the others
+static int user_ctrl(i2c_bus *bus, uint8_t set, uint8_t clear) {
+    mpu_user_ctrl = (uint8_t)((mpu_user_ctrl | set) & ~clear);
+    return i2c_bus_write(bus, mpu_addr, MPU_USER_CTRL, mpu_user_ctrl);
+}
 
 // MPU6500初始化
-int mpu6500_init(const char *device, int addr) {
-    printf("[IMU] Initializing MPU6500 on %s, address 0x%02X\n", device, addr);
-    
-    mpu_fd = i2c_init(device, addr);
-    if (mpu_fd < 0) {
-        printf("[IMU] Failed to open I2C device for MPU6500\n");
+int mpu6500_init(i2c_bus *bus, int addr) {
+    printf("[IMU] Initializing MPU6500 at address 0x%02X\n", addr);
+    mpu_addr = (uint8_t)addr;
+
+    if (!bus) {
+        printf("[IMU] No I2C bus for MPU6500\n");
         return 0;
     }
-    printf("[IMU] I2C device opened successfully for MPU6500\n");
+
+    uint8_t who = 0;
+    if (i2c_bus_read(bus, mpu_addr, MPU_WHO_AM_I, &who, 1) == 0) {
+        printf("[IMU] MPU6500 WHO_AM_I: 0x%02X\n", who);
+    }
 
     // Initialization sequence
     uint8_t init_seq[] = {
@@ -34,7 +71,7 @@ int mpu6500_init(const char *device, int addr) {
         printf("[IMU] Writing to MPU6500: register 0x%02X, value 0x%02X\n", 
                init_seq[i], init_seq[i+1]);
                
-        if (i2c_write_reg(mpu_fd, init_seq[i], init_seq[i+1]) != 0) {
+        if (i2c_bus_write(bus, mpu_addr, init_seq[i], init_seq[i+1]) != 0) {
             printf("[IMU] Failed to write to MPU6500 register 0x%02X\n", init_seq[i]);
             return 0;
         }
@@ -43,29 +80,147 @@ int mpu6500_init(const char *device, int addr) {
     return 1;
 }
 
-// Read MPU6500 data with debug info
-int read_mpu6500_data(imu_raw_data *data) {
-    uint8_t buf[14];
-    
-    if (i2c_read_reg(mpu_fd, 0x3B, buf, sizeof(buf)) != sizeof(buf)) {
-        // Only show detailed error every 1000 attempts to avoid log spam
-        static int error_count = 0;
-        if ((++error_count % 1000) == 0) {
-            printf("[IMU] Failed to read from MPU6500 (attempt #%d)\n", error_count);
+// Accel, temperature and gyro in one burst from ACCEL_XOUT_H; EXT_SENS_DATA
+// follows GYRO_ZOUT_L, so an aux slave's bytes come with them
+void mpu6500_read_op(i2c_read_op *op, uint8_t *buf) {
+    *op = (i2c_read_op){ mpu_addr, MPU_ACCEL_XOUT_H, (uint16_t)(MPU6500_READ_LEN + mpu_ext_len), buf };
+}
+
+int mpu6500_ext_len(void) {
+    return mpu_ext_len;
+}
+
+void mpu6500_convert(const uint8_t *buf, imu_raw_data *data) {
+    // Accelerometer data processing
+    data->accel[0] = (int16_t)(buf[0]<<8 | buf[1])  * (MPU_ACCEL_RANGE_G/32768.0) * 9.81;
+    data->accel[1] = (int16_t)(buf[2]<<8 | buf[3])  * (MPU_ACCEL_RANGE_G/32768.0) * 9.81;
+    data->accel[2] = (int16_t)(buf[4]<<8 | buf[5])  * (MPU_ACCEL_RANGE_G/32768.0) * 9.81;
+
+    // Gyroscope data processing
+    data->gyro[0] = (int16_t)(buf[8]<<8 | buf[9])  * (MPU_GYRO_RANGE_DPS/32768.0) * (M_PI/180.0);
+    data->gyro[1] = (int16_t)(buf[10]<<8 | buf[11]) * (MPU_GYRO_RANGE_DPS/32768.0) * (M_PI/180.0);
+    data->gyro[2] = (int16_t)(buf[12]<<8 | buf[13]) * (MPU_GYRO_RANGE_DPS/32768.0) * (M_PI/180.0);
+}
+
+// FIFO acquisition: accel, temp and gyro (and EXT_SENS_DATA when an aux
+// slave is set up) enter the FIFO at rate_hz in the same layout as the
+// ACCEL_XOUT_H burst, so each record converts like a mpu6500_read_op read.
+// With drdy_int the INT pin pulses per sample.
+int mpu6500_fifo_init(i2c_bus *bus, int rate_hz, int drdy_int) {
+    if (rate_hz < 4 || rate_hz > 1000) {
+        rate_hz = 1000;
+    }
+    uint8_t fifo_seq[] = {
+        MPU_FIFO_EN, 0x00,
+        MPU_CONFIG, 0x41,                           // FIFO_MODE: stop when full (keeps records aligned), DLPF 184 Hz, 1 kHz internal rate
+        MPU_SMPLRT_DIV, (uint8_t)(1000 / rate_hz - 1),
+        MPU_INT_PIN_CFG, 0x00,                      // active high, 50 us pulse
+        MPU_INT_ENABLE, (uint8_t)(drdy_int ? 0x01 : 0x00),  // RAW_RDY_EN
+    };
+
+    if (user_ctrl(bus, 0, 0x40) != 0) {             // FIFO off while reconfiguring
+        return 0;
+    }
+    printf("[IMU] Enabling MPU6500 FIFO at %d Hz (%s)\n", 1000 / (1000 / rate_hz),
+           drdy_int ? "data-ready interrupt" : "polled");
+    for (size_t i = 0; i < sizeof(fifo_seq); i += 2) {
+        if (i2c_bus_write(bus, mpu_addr, fifo_seq[i], fifo_seq[i+1]) != 0) {
+            printf("[IMU] Failed to write to MPU6500 register 0x%02X\n", fifo_seq[i]);
+            return 0;
         }
+    }
+    // TEMP, XG, YG, ZG, ACCEL, and SLV0's EXT_SENS_DATA after them
+    if (user_ctrl(bus, 0x04, 0) != 0 ||             // FIFO_RST
+        i2c_bus_write(bus, mpu_addr, MPU_FIFO_EN, (uint8_t)(0xF8 | (mpu_ext_len ? 0x01 : 0x00))) != 0 ||
+        user_ctrl(bus, 0x40, 0x04) != 0) {          // FIFO_EN
+        printf("[IMU] Failed to enable MPU6500 FIFO\n");
         return 0;
     }
+    return 1;
+}
 
-    // Accelerometer data processing
-    data->accel[0] = (int16_t)(buf[0]<<8 | buf[1])  * (16.0/32768.0) * 9.81;
-    data->accel[1] = (int16_t)(buf[2]<<8 | buf[3])  * (16.0/32768.0) * 9.81;
-    data->accel[2] = (int16_t)(buf[4]<<8 | buf[5])  * (16.0/32768.0) * 9.81;
+// FIFO_COUNTH/L: bytes waiting in the FIFO, big-endian, see mpu6500_fifo_count
+void mpu6500_fifo_count_op(i2c_read_op *op, uint8_t *buf) {
+    *op = (i2c_read_op){ mpu_addr, MPU_FIFO_COUNTH, 2, buf };
+}
 
-    // Gyroscope data processing
-    data->gyro[0] = (int16_t)(buf[8]<<8 | buf[9])  * (2000.0/32768.0) * (M_PI/180.0);
-    data->gyro[1] = (int16_t)(buf[10]<<8 | buf[11]) * (2000.0/32768.0) * (M_PI/180.0);
-    data->gyro[2] = (int16_t)(buf[12]<<8 | buf[13]) * (2000.0/32768.0) * (M_PI/180.0);
+int mpu6500_fifo_count(const uint8_t *buf) {
+    return ((buf[0] & 0x1F) << 8) | buf[1];
+}
+
+// Burst from FIFO_R_W; the register pointer stays on it, so len bytes come out in order
+int mpu6500_fifo_read(i2c_bus *bus, uint8_t *buf, size_t len) {
+    return i2c_bus_read(bus, mpu_addr, MPU_FIFO_R_W, buf, len);
+}
+
+// Drop everything queued, e.g. after the FIFO filled up
+int mpu6500_fifo_reset(i2c_bus *bus) {
+    int ret = user_ctrl(bus, 0x04, 0);
+    mpu_user_ctrl &= ~0x04;     // FIFO_RST clears itself
+    return ret;
+}
+
+/* ---------- auxiliary I2C master ---------- */
 
-    clock_gettime(CLOCK_REALTIME, &data->ts);
+// The MPU6500 masters its auxiliary bus at 400 kHz. WAIT_FOR_ES holds data
+// ready until the slave reads have landed in EXT_SENS_DATA, so a sample
+// never pairs new accel/gyro with a half-updated magnetometer.
+int mpu6500_aux_master_init(i2c_bus *bus) {
+    if (i2c_bus_write(bus, mpu_addr, MPU_INT_PIN_CFG, 0x00) != 0 ||      // BYPASS_EN off
+        i2c_bus_write(bus, mpu_addr, MPU_I2C_MST_CTRL, 0x4D) != 0 ||     // WAIT_FOR_ES, 400 kHz
+        user_ctrl(bus, 0x20, 0) != 0) {                                  // I2C_MST_EN
+        printf("[IMU] Failed to enable the MPU6500 I2C master\n");
+        return 0;
+    }
     return 1;
-}
\ No newline at end of file
+}
+
+void mpu6500_aux_master_stop(i2c_bus *bus) {
+    i2c_bus_write(bus, mpu_addr, MPU_I2C_SLV0_CTRL, 0x00);
+    user_ctrl(bus, 0, 0x20);
+    mpu_ext_len = 0;
+}
+
+// One byte through SLV4, which runs once per write of SLV4_CTRL
+static int aux_slv4(i2c_bus *bus, uint8_t addr, uint8_t reg, uint8_t out, uint8_t *in) {
+    uint8_t status = 0;
+    if (i2c_bus_write(bus, mpu_addr, MPU_I2C_SLV4_ADDR, addr) != 0 ||
+        i2c_bus_write(bus, mpu_addr, MPU_I2C_SLV4_REG, reg) != 0 ||
+        (!in && i2c_bus_write(bus, mpu_addr, MPU_I2C_SLV4_DO, out) != 0) ||
+        i2c_bus_write(bus, mpu_addr, MPU_I2C_SLV4_CTRL, 0x80) != 0) {
+        return -1;
+    }
+    for (int tries = 0; tries < 20; tries++) {
+        if (i2c_bus_read(bus, mpu_addr, MPU_I2C_MST_STATUS, &status, 1) != 0) {
+            return -1;
+        }
+        if (status & 0x10) {
+            return -1;      // I2C_SLV4_NACK
+        }
+        if (status & 0x40) {
+            return in ? i2c_bus_read(bus, mpu_addr, MPU_I2C_SLV4_DI, in, 1) : 0;   // I2C_SLV4_DONE
+        }
+        usleep(500);
+    }
+    return -1;
+}
+
+int mpu6500_aux_write(i2c_bus *bus, int addr, uint8_t reg, uint8_t value) {
+    return aux_slv4(bus, (uint8_t)addr, reg, value, NULL);
+}
+
+int mpu6500_aux_read(i2c_bus *bus, int addr, uint8_t reg, uint8_t *value) {
+    return aux_slv4(bus, (uint8_t)(0x80 | addr), reg, 0, value);
+}
+
+// SLV0 reads len bytes from reg on every sample into EXT_SENS_DATA_00
+int mpu6500_aux_slave0(i2c_bus *bus, int addr, uint8_t reg, int len) {
+    if (len <= 0 || len > 15 ||
+        i2c_bus_write(bus, mpu_addr, MPU_I2C_SLV0_ADDR, (uint8_t)(0x80 | addr)) != 0 ||
+        i2c_bus_write(bus, mpu_addr, MPU_I2C_SLV0_REG, reg) != 0 ||
+        i2c_bus_write(bus, mpu_addr, MPU_I2C_SLV0_CTRL, (uint8_t)(0x80 | len)) != 0) {
+        return -1;
+    }
+    mpu_ext_len = len;
+    return 0;
+}
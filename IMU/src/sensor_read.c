@@ -3,40 +3,115 @@
  * @FilePath: /TSPi_Action/IMU/src/sensor_read.c
  */
 /* ---------- src/sensor_read.c ---------- */
+#include <stdio.h>
 #include <unistd.h>
 #include <math.h>
 #include <linux/i2c-dev.h>
 #include "imu_logger.h"
+#include "imu_ring.h"
+#include "imu_fifo.h"
 #include <stdlib.h>    // 定义 exit 和 EXIT_FAILURE
 #include <unistd.h>    // 定义 usleep
 
+extern i2c_bus *g_bus;
+extern volatile int g_read_running;
+extern int g_fifo_rate;
+extern const char *g_drdy_gpio;
+
+// 一次 I2C_RDWR 传输读取 MPU6500 和 AK8963（重复起始，单个 STOP）；
+// 磁力计挂在 MPU6500 辅助总线上时只需一次突发读取
+int read_9axis_data(i2c_bus *bus, imu_raw_data *data) {
+    uint8_t mpu_buf[MPU6500_READ_LEN + AK8963_READ_LEN];
+    uint8_t ak_buf[AK8963_READ_LEN];
+    i2c_read_op ops[2];
+    int count = 1;
+
+    if (!bus) {
+        return 0;
+    }
+    mpu6500_read_op(&ops[0], mpu_buf);
+    if (mpu6500_ext_len() == 0) {
+        ak8963_read_op(&ops[1], ak_buf);
+        count = 2;
+    }
+    if (i2c_bus_read_batch(bus, ops, count) != 0) {
+        return 0;
+    }
+    mpu6500_convert(mpu_buf, data);
+    ak8963_convert(count == 2 ? ak_buf : mpu_buf + MPU6500_READ_LEN, data);
+
+    // Common timebase with video and GNSS (timebase.h)
+    clock_gettime(CLOCK_MONOTONIC, &data->ts);
+    return 1;
+}
+
+// Filter a sample and hand it to the logging thread
+static void publish_sample(imu_ring *ring, const imu_raw_data *raw) {
+    imu_sample sample;
+    sample.raw = *raw;
+    complementary_filter(raw, &sample.fused);
+    if (imu_ring_push(ring, &sample) != 0 && imu_ring_dropped(ring) % 1000 == 1) {
+        printf("[IMU] Buffer full, %llu samples dropped\n", (unsigned long long)imu_ring_dropped(ring));
+    }
+}
+
+// FIFO 采集：按传感器自身的 ODR 采样，突发读取并重建时间戳（imu_fifo.h）
+static int fifo_read_loop(imu_ring *ring) {
+    imu_fifo fifo;
+    imu_raw_data batch[IMU_FIFO_MAX_SAMPLES];
+    uint64_t success_count = 0;
+    int fail_count = 0;
+
+    if (imu_fifo_open(&fifo, g_bus, g_fifo_rate, g_drdy_gpio) != 0) {
+        printf("[IMU] FIFO acquisition unavailable, falling back to polled reads\n");
+        return -1;
+    }
+    while (g_read_running) {
+        int n = imu_fifo_read(&fifo, batch, IMU_FIFO_MAX_SAMPLES);
+        if (n < 0) {
+            fail_count++;
+            if (fail_count % 100 == 0) {
+                printf("[IMU] Failed to read sensor FIFO (%d consecutive failures)\n", fail_count);
+            }
+            usleep(100000);
+            continue;
+        }
+        fail_count = 0;
+        for (int i = 0; i < n; i++) {
+            publish_sample(ring, &batch[i]);
+        }
+        if (success_count / 10000 != (success_count + n) / 10000) {
+            printf("[IMU] Successfully reading sensor FIFO (%llu samples, %llu overflows, %llu clock resyncs)\n",
+                   (unsigned long long)(success_count + n), (unsigned long long)fifo.overflows,
+                   (unsigned long long)fifo.clock.resyncs);
+        }
+        success_count += n;
+    }
+    imu_fifo_close(&fifo);
+    return 0;
+}
+
 // MPU6500数据采集
 // Add debug messages to sensor read thread
 
 void* sensor_read_thread(void *arg) {
-    imu_data_buffer *buffer = (imu_data_buffer*)arg;
+    imu_ring *ring = (imu_ring*)arg;
     imu_raw_data raw;
     int success_count = 0;
     int fail_count = 0;
     
     printf("[IMU] Sensor read thread started\n");
-    
-    while (1) {
-        // Read MPU6500 data
-        if (!read_mpu6500_data(&raw)) {
-            fail_count++;
-            if (fail_count % 100 == 0) {
-                printf("[IMU] Failed to read MPU6500 data (%d consecutive failures)\n", fail_count);
-            }
-            usleep(100000);
-            continue;
-        }
 
-        // Read AK8963 data
-        if (!read_ak8963_data(&raw)) {
+    if (g_fifo_rate > 0 && fifo_read_loop(ring) == 0) {
+        return NULL;
+    }
+    
+    while (g_read_running) {
+        // Read MPU6500 and AK8963 data
+        if (!read_9axis_data(g_bus, &raw)) {
             fail_count++;
             if (fail_count % 100 == 0) {
-                printf("[IMU] Failed to read AK8963 data (%d consecutive failures)\n", fail_count);
+                printf("[IMU] Failed to read sensor data (%d consecutive failures)\n", fail_count);
             }
             usleep(100000);
             continue;
@@ -49,19 +124,8 @@ void* sensor_read_thread(void *arg) {
             printf("[IMU] Successfully reading sensor data (%d readings so far)\n", success_count);
         }
 
-        pthread_mutex_lock(&buffer->mutex);
-        if (buffer->count < BUFFER_SIZE) {
-            int tail = (buffer->head + buffer->count) % BUFFER_SIZE;
-            buffer->raw[tail] = raw;
-            
-            // Apply complementary filter
-            complementary_filter(&raw, &buffer->filtered[tail]);
-            
-            buffer->count++;
-        } else {
-            printf("[IMU] Buffer full, dropping sample\n");
-        }
-        pthread_mutex_unlock(&buffer->mutex);
+        // Apply complementary filter, then hand the sample to the logging thread
+        publish_sample(ring, &raw);
         
         usleep(5000); // 200Hz sampling rate
     }
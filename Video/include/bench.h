@@ -0,0 +1,11 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/include/bench.h
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+// Run a named benchmark ("VideoProcess --bench <name>"), returns exit code
+int run_benchmark(const char *name);
+
+#endif // BENCH_H
@@ -5,16 +5,92 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <stddef.h>
+
+// 默认配置文件，可用 VideoProcess --config <path> 指定其他文件
+#define CONFIG_FILE_DEFAULT "/etc/video_process.conf"
+
 typedef struct {
     int record_width ;      // 录制宽度
     int record_height;     // 录制高度
     int record_framerate;  // 录制帧率
-    int preview_width;     // 预览宽度
+    int preview_width;     // 预览宽度（由屏幕尺寸和旋转计算得出）
     int preview_height;    // 预览高度
+    char record_dir[128];  // 录制文件目录
+    int prerecord_seconds; // 预录时长（秒），0 表示仅保留当前 GOP
+    int prerecord_max_bytes; // 预录缓冲区内存上限（字节）
+    int segment_seconds;   // 分段时长（秒），0 表示不按时长分段
+    int segment_max_mb;    // 分段大小上限（MB），0 表示不限
+    int storage_chunk_kb;  // 单次写入块大小（KB），按块对齐
+    int storage_queue_chunks; // 写线程队列块数，写满后才阻塞上游
+    int storage_prealloc_mb;  // 预分配步长（MB），0 表示不预分配
+    int storage_sync_ms;   // fdatasync 周期（毫秒），0 表示仅在关闭时同步
+    int record_thumb_seconds; // 录制时每隔多少秒从预览截取一张缩略图写入 .tsk 索引，0 表示不截取
+    int record_thumb_width;   // 缩略图宽度（像素），高度按画面比例
+    char record_container[8]; // 录制封装："mkv"，或 "mp4"（分片 MP4，掉电后已写分片可直接播放）
+    int fragment_ms;       // 簇/分片时长（毫秒），决定掉电恢复后的定位粒度
+    int encoder_bitrate_kbps; // 编码码率（kbit/s）
+    int encoder_gop;       // 关键帧间隔（帧），0 表示与帧率相同（每秒一个）
+    char encoder_rc[8];    // 码率控制："cbr"、"vbr" 或 "fixqp"
+    int preview_fps;       // 预览帧率，0 表示与采集帧率相同
+    int preview_fps_adaptive; // 自适应预览帧率：CPU 占用或编码队列过高时逐级降低预览帧率，负载回落后恢复
+    int preview_fps_min;   // 自适应降帧的下限
+    int preview_cpu_high;  // VideoProcess 占全部核心的百分比超过该值时降一级
+    int preview_cpu_low;   // 低于该值（且编码队列空闲）时升一级
+    int preview_rotation;  // 预览旋转角度（顺时针）：0、90、180、270
+    int screen_width;      // 预览屏幕尺寸（旋转后的显示方向）
+    int screen_height;
+    int preview_legacy_shm; // 旧版 UI（app/lvgl/lvglsim）兼容：最新预览帧另复制到 key 1234 的单帧布局（preview_legacy.h）
+    int record_shm_flag;   // 旧版 UI 兼容：轮询 key 5678 的 is_recording 标志启停录像，否则只响应 record_ctl 命令
+    char audio_codec[8];   // 音频编码："opus"、"aac"、"pcm"（不压缩）或 "vorbis"（mp4 封装下 vorbis/pcm 改用 aac）
+    int audio_rate;        // 音频采样率（Hz），与声卡一致时不做重采样
+    int audio_channels;    // 音频声道数
+    int audio_bitrate_kbps; // opus/aac/vorbis 码率（kbit/s）
+    int audio_complexity;  // opus 编码复杂度 0~10，越低越省 CPU
+    int telemetry_tracks;  // IMU/GNSS 数据作为元数据轨写入 mkv 录像（按簇打包）
+    int eis;               // 陀螺仪电子防抖（编码前裁切/扭正），关闭时帧直通
+    int eis_lookahead;     // 防抖路径平滑前后各看的帧数，录像延迟增加相应帧数
+    int eis_crop_pct;      // 每边保留的防抖余量（画面百分比），输出放大回原尺寸
+    int eis_fov_deg;       // 镜头水平视场角（度）
+    int eis_readout_us;    // 卷帘快门读出时间（首行到末行，微秒）
+    int eis_gyro_offset_us; // 陀螺仪与帧时间的偏差校准（微秒）
+    int eis_threads;       // 扭正并行线程数
+    char eis_gyro_axes[8]; // IMU 轴到相机轴（右、下、光轴）的映射，如 "+x+y+z"
+    int preview_level;     // 预览按 IMU 横滚角反向旋转，保持地平线水平（仅预览，录像不变）
+    int preview_hud;       // 预览叠加地平线和俯仰刻度（视场角取 eis_fov_deg）
+    int enc_queue_buffers;     // 各分支队列深度（缓冲区个数）
+    int preview_queue_buffers;
+    int audio_queue_buffers;
+    int record_integrity;  // 录制完整性模式：编码后插入非丢弃缓冲，卡顿时优先丢预览帧
+    int record_buffer_ms;  // 录制缓冲时长（毫秒），存储卡顿不超过该时长时不丢帧
+    int simulate;          // 仿真模式：无需摄像头/声卡/MPP，用于板外运行和性能分析
+    char sim_input[128];   // 仿真视频输入文件（按实时速度回放），为空时使用 videotestsrc
+    char sim_encoder[8];   // 仿真软件编码器："x265" 或 "x264"
+    char config_path[128]; // 加载/保存的配置文件
 } VideoConfig;
 
-VideoConfig* load_config(void);
+// 修改一项配置后的生效方式
+typedef enum {
+    CONFIG_APPLY_LIVE = 0,          // 运行中直接生效
+    CONFIG_APPLY_RELINK = 1,        // 重启采集源（数帧中断），录制中不可修改
+    CONFIG_APPLY_NEXT_RECORDING = 2,    // 下次开始录制时生效
+    CONFIG_APPLY_RESTART = 3,       // 重启 VideoProcess 后生效
+} ConfigApply;
+
+// 默认配置，path 非 NULL 时再读取配置文件（文件不存在时使用默认值）
+VideoConfig* load_config(const char *path);
+void config_set_defaults(VideoConfig *config);
 void calculate_preview_size(VideoConfig *config, int screen_width, int screen_height);
 void free_config(VideoConfig *config);
 
-#endif // CONFIG_H
\ No newline at end of file
+// 读取 "key = value" 格式的配置文件，返回 0 或 -1（文件无法打开）
+int config_load_file(VideoConfig *config, const char *path);
+// 写回 config->config_path，返回 0 或 -1
+int config_save_file(const VideoConfig *config);
+
+// 按名称修改一项配置，返回生效方式，未知键或非法值返回 -1
+int config_set(VideoConfig *config, const char *key, const char *value);
+// 按名称读取一项配置，返回 0 或 -1（未知键）
+int config_get(const VideoConfig *config, const char *key, char *buf, size_t size);
+
+#endif // CONFIG_H
@@ -0,0 +1,77 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/include/eis.h
+ */
+#ifndef EIS_H
+#define EIS_H
+
+#include <stdint.h>
+#include "eis_kernel.h"
+
+/*
+ * Gyro-based stabilization: the camera orientation is integrated from the
+ * gyro, smoothed over a window of frames around the one being output, and
+ * each output row is warped from where the real camera pointed when that
+ * row was read out (rolling shutter) to where the smoothed camera points.
+ *
+ * Camera axes: x right, y down, z along the optical axis. Times are
+ * CLOCK_MONOTONIC ns, the pipeline clock (see create_pipeline).
+ */
+
+/* ---------- gyro store (one per process, filled by the telemetry receiver) ---------- */
+
+// Drop everything and keep the last `capacity` samples from now on
+void eis_gyro_reset(unsigned capacity);
+
+// IMU to camera axes as three signed IMU axes for camera x, y and z,
+// e.g. "+x+y+z" (default) or "-y+x+z". Returns 0, or -1 if malformed.
+int eis_gyro_set_axes(const char *spec);
+
+// One gyro sample (rad/s, IMU axes). Samples must come in time order.
+void eis_gyro_add(uint64_t mono_ns, const float rate[3]);
+
+// Newest sample time, 0 if none
+uint64_t eis_gyro_latest(void);
+
+// Newest roll and pitch (rad) from the IMU's own attitude filter
+void eis_attitude_set(uint64_t mono_ns, float roll, float pitch);
+
+// That attitude as the camera sees it, through the axes mapping: `tilt` is
+// how far the horizon is turned clockwise in the picture and `elevation`
+// how far the optical axis points above it (rad). Returns 0, or -1 if there
+// is no attitude newer than max_age_ns before now_ns.
+int eis_attitude_camera(uint64_t now_ns, uint64_t max_age_ns, float *tilt, float *elevation);
+
+/* ---------- per-stream stabilizer ---------- */
+
+typedef struct {
+    int width, height;
+    float fov_deg;          // horizontal field of view of the lens
+    float crop;             // margin kept per side, fraction of the frame
+    float readout_ms;       // rolling shutter, first to last row
+    float gyro_offset_ms;   // added to frame times to look up the gyro
+    int lookahead;          // frames either side of the output frame
+} EisParams;
+
+typedef struct EisStabilizer EisStabilizer;
+
+EisStabilizer* eis_stabilizer_new(const EisParams *params);
+void eis_stabilizer_free(EisStabilizer *stabilizer);
+
+// New parameters take effect from the next frame (width and height are
+// fixed for the life of the stabilizer)
+void eis_stabilizer_set_params(EisStabilizer *stabilizer, const EisParams *params);
+
+// Remember the capture time of an incoming frame; the window is made of
+// these
+void eis_stabilizer_add_frame(EisStabilizer *stabilizer, uint64_t frame_ns);
+
+// Forget the frame times (seek, flush)
+void eis_stabilizer_clear(EisStabilizer *stabilizer);
+
+// Fill the kernel mesh for the frame captured at frame_ns, which must be
+// one added before. Returns 1 if it was stabilized, 0 if the gyro did not
+// cover it (the mesh then only crops, so the framing does not jump).
+int eis_stabilizer_mesh(EisStabilizer *stabilizer, uint64_t frame_ns, EisKernel *kernel);
+
+#endif // EIS_H
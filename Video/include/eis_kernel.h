@@ -0,0 +1,46 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/include/eis_kernel.h
+ */
+#ifndef EIS_KERNEL_H
+#define EIS_KERNEL_H
+
+#include <stdint.h>
+
+// 网格间距（像素），网格点之间的源坐标按双线性插值
+#define EIS_MESH_STEP 32
+
+typedef struct EisKernel EisKernel;
+
+// Create a kernel that remaps a width x height NV12 frame onto another of
+// the same size. Where each output pixel comes from is given by a mesh of
+// source positions, one every EIS_MESH_STEP output pixels in both
+// directions; the rows are split into `threads` bands run in parallel.
+EisKernel* eis_kernel_new(int width, int height, int threads);
+void eis_kernel_free(EisKernel *kernel);
+
+// Select the vectorized path (default) or the scalar reference path.
+// Both produce bit-identical output.
+void eis_kernel_set_simd(EisKernel *kernel, int enable);
+
+// Name of the compiled-in SIMD path: "neon", "sse2" or "none"
+const char* eis_kernel_simd_name(void);
+
+int eis_kernel_threads(const EisKernel *kernel);
+
+// The mesh: rows x cols points of (x, y) source luma coordinates, point
+// (i, j) for output pixel (j * EIS_MESH_STEP, i * EIS_MESH_STEP). The last
+// row and column may lie past the frame edge. Fill it before each process.
+float* eis_kernel_mesh(EisKernel *kernel, int *cols, int *rows);
+
+// Mesh of the unchanged frame
+void eis_kernel_set_identity(EisKernel *kernel);
+
+// Remap one frame. Source positions outside the frame repeat the edge.
+void eis_kernel_process(EisKernel *kernel,
+                        const uint8_t *src_y, int src_y_stride,
+                        const uint8_t *src_uv, int src_uv_stride,
+                        uint8_t *dst_y, int dst_y_stride,
+                        uint8_t *dst_uv, int dst_uv_stride);
+
+#endif // EIS_KERNEL_H
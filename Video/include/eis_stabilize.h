@@ -0,0 +1,40 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/include/eis_stabilize.h
+ */
+#ifndef EIS_STABILIZE_H
+#define EIS_STABILIZE_H
+
+#include <gst/gst.h>
+
+// "eisstabilize": gyro-based stabilization of NV12 frames (eis.h). Each
+// frame is copied into a look-ahead ring, so the camera gets its buffer
+// back at once, and leaves "lookahead" frames later warped toward the
+// smoothed camera path, cropped by "crop" per side and scaled back to the
+// input size. The gyro comes from eis_gyro_add(). Frame capture times are
+// base time + PTS running time, or "timestamp-offset" + running time when
+// that is set (offline runs on a recorded clip). With "enabled" FALSE
+// frames pass through untouched.
+#define GST_TYPE_EIS_STABILIZE (gst_eis_stabilize_get_type())
+#define GST_EIS_STABILIZE(obj) \
+    (G_TYPE_CHECK_INSTANCE_CAST((obj), GST_TYPE_EIS_STABILIZE, GstEisStabilize))
+
+typedef struct _GstEisStabilize GstEisStabilize;
+typedef struct _GstEisStabilizeClass GstEisStabilizeClass;
+
+GType gst_eis_stabilize_get_type(void);
+
+gboolean eis_stabilize_register(void);
+
+typedef struct {
+    guint64 frames;         // frames pushed
+    guint64 stabilized;     // of those, covered by the gyro
+    guint64 copy_ns;        // copying input into the look-ahead ring
+    guint64 model_ns;       // path smoothing and mesh
+    guint64 warp_ns;        // remap (all threads, wall time)
+} EisStabilizeStats;
+
+// Counters since the element was created
+void eis_stabilize_get_stats(GstElement *element, EisStabilizeStats *stats);
+
+#endif // EIS_STABILIZE_H
@@ -8,11 +8,17 @@
 #include <gst/gst.h>
 #include "config.h"
 
-void* shm_ptr;  // 全局共享内存指针
+extern void* shm_ptr;  // 全局共享内存指针（定义在 main.c）
 
 GstElement* create_pipeline(VideoConfig *config);
 void start_pipeline(GstElement *pipeline, VideoConfig *config); 
 void monitor_pipeline(GstElement *pipeline);
 void cleanup_pipeline(GstElement *pipeline);
 
+// 配置预览 appsink：回调发布到共享内存环形缓冲区，zero_copy 时由共享内存槽位分配缓冲区
+void setup_preview_sink(GstElement *app_sink, gboolean zero_copy);
+
+// 最近一次开始录制后第一个缓冲区到达 filesink 的时间（CLOCK_MONOTONIC, ns），尚未到达为 0
+guint64 get_record_first_frame_ns(void);
+
 #endif // PIPELINE_H
\ No newline at end of file
@@ -0,0 +1,46 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/include/pipeline_probes.h
+ */
+#ifndef PIPELINE_PROBES_H
+#define PIPELINE_PROBES_H
+
+#include <gst/gst.h>
+#include "pipeline_stats.h"
+
+/*
+ * Pad probes feeding the shared-memory PipelineStatsBlock. Elements are
+ * found by the names create_pipeline() gives them ("tee", "enc_queue",
+ * "app_queue", "audio_queue", "record_queue", "parser", "video_prerecord",
+ * "app_sink"); missing ones are skipped.
+ *
+ * Frames the leaky enc_queue drops never get encoded. While recording each
+ * such hole counts as a gap: the next encoded frame is marked DISCONT and
+ * the gap callback, if any, is told where it is and how many frames it
+ * lost.
+ *
+ * While recording, every video frame leaving video_prerecord is followed
+ * into the muxer and out of it (matched by size, muxers pass frame data
+ * through as one buffer) until storagesink reports its bytes written.
+ * Frames still in flight when a session ends count as unwritten.
+ */
+
+// Create the stats block and attach the probes
+void pipeline_probes_install(GstElement *pipeline);
+
+// Follow the frames of a new recording session through its muxer and sink
+void pipeline_probes_record_start(GstElement *mux, GstElement *storage);
+// Session over (its sink is stopped): count what never reached the file
+void pipeline_probes_record_stop(void);
+
+// Called from the encoder input thread, only while recording
+typedef void (*PipelineGapFunc)(GstClockTime pts, guint64 frames, gpointer user_data);
+void pipeline_probes_set_gap_callback(PipelineGapFunc func, gpointer user_data);
+
+// The live block (for benchmarks), NULL before install
+const PipelineStatsBlock* pipeline_probes_stats(void);
+
+// Print the counters and remove the block
+void pipeline_probes_cleanup(void);
+
+#endif // PIPELINE_PROBES_H
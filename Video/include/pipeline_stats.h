@@ -0,0 +1,109 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/include/pipeline_stats.h
+ */
+#ifndef PIPELINE_STATS_H
+#define PIPELINE_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Pipeline statistics block in shared memory (SysV key PIPELINE_STATS_SHM_KEY).
+ *
+ * VideoProcess updates the counters from pad probes as buffers pass; they
+ * only ever grow while the process runs. Readers (video_stats, UI) attach
+ * read-only and may see one counter a frame ahead of another, nothing
+ * worse. Queue levels, drops and the bitrate are refreshed once a second.
+ *
+ * Latencies are measured from capture (buffer PTS on the pipeline clock)
+ * to the frame reaching the preview sink, leaving the encoder, and having
+ * its bytes written to the recording file by storagesink.
+ *
+ * This header is the whole contract for readers, who link against
+ * libpipeline_stats.a.
+ */
+
+#define PIPELINE_STATS_SHM_KEY  5679
+#define PIPELINE_STATS_MAGIC    0x31545350u  // "PST1"
+#define PIPELINE_STATS_VERSION  2
+
+// Latency histograms use log2 buckets of microseconds: bucket 0 is < 2 us,
+// bucket i covers [2^i, 2^(i+1)) us, the last one everything above.
+#define PIPELINE_STATS_BUCKETS  24
+
+typedef enum {
+    PIPELINE_QUEUE_ENCODER = 0,     // enc_queue: capture -> encoder
+    PIPELINE_QUEUE_PREVIEW,         // app_queue: capture -> preview transform
+    PIPELINE_QUEUE_AUDIO,           // audio_queue
+    PIPELINE_QUEUE_RECORD,          // record_queue: encoder -> recording (integrity mode)
+    PIPELINE_QUEUE_COUNT,
+} PipelineQueue;
+
+typedef struct {
+    uint64_t in;            // buffers offered to the queue
+    uint64_t out;           // buffers it passed on
+    uint64_t dropped;       // discarded by the leaky queue
+    uint32_t level;         // buffers queued at the last refresh
+    uint32_t level_max;
+} PipelineQueueStats;
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum_us;
+    uint64_t max_us;
+    uint64_t buckets[PIPELINE_STATS_BUCKETS];
+} PipelineLatencyHist;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pid;
+    uint32_t pad;
+    uint64_t started_ns;            // CLOCK_MONOTONIC
+    uint64_t updated_ns;            // last refresh
+
+    uint64_t captured;              // frames out of the source
+    uint64_t capture_missing;       // frames missing from the source timestamps
+
+    uint64_t encode_missing;        // frames missing from the encoder input
+    uint64_t encoded;               // frames out of the encoder
+    uint64_t encoded_bytes;
+    uint64_t keyframes;
+    uint64_t bitrate_bps;           // encoder output over the last second
+
+    uint64_t preview_published;     // frames in the preview ring
+    uint64_t preview_decimated;     // skipped to honour preview_fps
+
+    uint64_t record_sessions;
+    uint64_t record_frames;         // video frames handed to the muxer
+    uint64_t record_written;        // ... whose bytes storagesink has written
+    uint64_t record_unwritten;      // ... still unwritten when a session ended
+    uint64_t record_gaps;           // discontinuities while recording
+    uint64_t record_lost;           // frames they left out
+
+    PipelineQueueStats queues[PIPELINE_QUEUE_COUNT];
+    PipelineLatencyHist capture_to_preview;
+    PipelineLatencyHist capture_to_encoded;
+    PipelineLatencyHist capture_to_disk;
+} PipelineStatsBlock;
+
+// Producer side: reset the block and mark it valid
+void pipeline_stats_init(PipelineStatsBlock *stats, uint32_t pid, uint64_t started_ns);
+void pipeline_stats_add_latency(PipelineLatencyHist *hist, uint64_t us);
+
+// Counters may be updated from several threads
+#define PIPELINE_STATS_ADD(field, n)  __atomic_fetch_add(&(field), (n), __ATOMIC_RELAXED)
+#define PIPELINE_STATS_SET(field, v)  __atomic_store_n(&(field), (v), __ATOMIC_RELAXED)
+
+// Reader side: attach read-only, NULL if VideoProcess has not created it
+const PipelineStatsBlock* pipeline_stats_attach(void);
+void pipeline_stats_detach(const PipelineStatsBlock *stats);
+
+// Upper bound (us) of the bucket holding the p-th percentile, p in [0, 100]
+uint64_t pipeline_stats_percentile(const PipelineLatencyHist *hist, double p);
+
+// Human readable dump
+void pipeline_stats_print(const PipelineStatsBlock *stats, FILE *out);
+
+#endif // PIPELINE_STATS_H
@@ -0,0 +1,27 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/include/prerecord.h
+ */
+#ifndef PRERECORD_H
+#define PRERECORD_H
+
+#include <gst/gst.h>
+
+// "prerecord": sits between the encoder/parser and the muxer. While
+// "recording" is FALSE it keeps the last "duration" of encoded data
+// (bounded by "max-bytes") in memory, grouped by keyframe, and pushes
+// nothing. When "recording" becomes TRUE the buffered GOPs are pushed
+// first, starting at a keyframe, followed by live data. Every buffer of
+// a stream without delta units (audio) counts as a keyframe.
+#define GST_TYPE_PRERECORD (gst_prerecord_get_type())
+#define GST_PRERECORD(obj) \
+    (G_TYPE_CHECK_INSTANCE_CAST((obj), GST_TYPE_PRERECORD, GstPrerecord))
+
+typedef struct _GstPrerecord GstPrerecord;
+typedef struct _GstPrerecordClass GstPrerecordClass;
+
+GType gst_prerecord_get_type(void);
+
+gboolean prerecord_register(void);
+
+#endif // PRERECORD_H
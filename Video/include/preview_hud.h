@@ -0,0 +1,36 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/include/preview_hud.h
+ */
+#ifndef PREVIEW_HUD_H
+#define PREVIEW_HUD_H
+
+#include <stdint.h>
+#include "preview_kernel.h"
+
+typedef struct PreviewHud PreviewHud;
+
+// Attitude overlay for the preview: a horizon line, a pitch ladder every
+// 10 degrees and a fixed centre mark. It is drawn in scaled-image
+// coordinates and stored rotated like the kernel output, as premultiplied
+// BGRA plus the x extent drawn on every destination row, so blending only
+// touches those spans.
+PreviewHud* preview_hud_new(int scaled_width, int scaled_height, PreviewRotation rotation);
+void preview_hud_free(PreviewHud *hud);
+
+// Vectorized blend (default) or the scalar reference; bit-identical
+void preview_hud_set_simd(PreviewHud *hud, int enable);
+
+// Redraw for a horizon turned `tilt` radians clockwise in the picture,
+// with the optical axis `elevation` radians above it; `focal` is the focal
+// length in scaled pixels
+void preview_hud_draw(PreviewHud *hud, float tilt, float elevation, float focal);
+
+// Erase everything drawn
+void preview_hud_clear(PreviewHud *hud);
+
+// Blend the overlay onto a kernel output frame (BGRA, dst_stride bytes per
+// row)
+void preview_hud_blend(const PreviewHud *hud, uint8_t *dst, int dst_stride);
+
+#endif // PREVIEW_HUD_H
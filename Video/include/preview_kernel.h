@@ -0,0 +1,61 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/include/preview_kernel.h
+ */
+#ifndef PREVIEW_KERNEL_H
+#define PREVIEW_KERNEL_H
+
+#include <stdint.h>
+
+// 旋转方向，数值与 videoflip 的 method 属性一致
+typedef enum {
+    PREVIEW_ROTATE_NONE  = 0,
+    PREVIEW_ROTATE_90CW  = 1,
+    PREVIEW_ROTATE_180   = 2,
+    PREVIEW_ROTATE_90CCW = 3,
+} PreviewRotation;
+
+// YUV -> RGB 转换矩阵（limited range）
+typedef enum {
+    PREVIEW_MATRIX_BT601 = 0,
+    PREVIEW_MATRIX_BT709 = 1,
+} PreviewMatrix;
+
+typedef struct PreviewKernel PreviewKernel;
+
+// Create a kernel that bilinearly scales an NV12 src_width x src_height
+// frame to scaled_width x scaled_height, converts it to BGRA and rotates it.
+// The destination is scaled_width x scaled_height for NONE/180 and
+// scaled_height x scaled_width for the 90-degree rotations.
+PreviewKernel* preview_kernel_new(int src_width, int src_height,
+                                  int scaled_width, int scaled_height,
+                                  PreviewRotation rotation, PreviewMatrix matrix);
+void preview_kernel_free(PreviewKernel *kernel);
+
+// Select the vectorized path (default) or the scalar reference path.
+// Both produce bit-identical output.
+void preview_kernel_set_simd(PreviewKernel *kernel, int enable);
+
+// Name of the compiled-in SIMD path: "neon", "sse2" or "none"
+const char* preview_kernel_simd_name(void);
+
+// Level the picture: a scene turned `angle` radians clockwise in the
+// scaled image comes out upright, magnified `zoom` times about the centre
+// (>= 1). Luma is then sampled bilinearly along the rotated grid and chroma
+// from the nearest sample. 0 and 1 go back to the plain separable path.
+void preview_kernel_set_level(PreviewKernel *kernel, float angle, float zoom);
+
+// Smallest zoom that keeps the corners of the picture covered at `angle`
+float preview_kernel_level_zoom(const PreviewKernel *kernel, float angle);
+
+int preview_kernel_dst_width(const PreviewKernel *kernel);
+int preview_kernel_dst_height(const PreviewKernel *kernel);
+
+// Run the fused scale + convert + rotate pass in one go, writing straight
+// into dst (BGRA, dst_stride bytes per row).
+void preview_kernel_process(PreviewKernel *kernel,
+                            const uint8_t *y_plane, int y_stride,
+                            const uint8_t *uv_plane, int uv_stride,
+                            uint8_t *dst, int dst_stride);
+
+#endif // PREVIEW_KERNEL_H
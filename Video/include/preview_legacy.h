@@ -0,0 +1,35 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/include/preview_legacy.h
+ */
+#ifndef PREVIEW_LEGACY_H
+#define PREVIEW_LEGACY_H
+
+#include <stdint.h>
+#include "preview_ring.h"
+
+/*
+ * Preview in the layout UIs built before the frame ring read (the shipped
+ * app/lvgl/lvglsim, which cannot be rebuilt): SysV key
+ * PREVIEW_LEGACY_SHM_KEY holds the newest frame as tightly packed BGRA
+ * at offset 0, guarded by the named semaphore PREVIEW_LEGACY_SEM.
+ *
+ * Opt-in (preview_legacy_shm = 1): every preview frame costs one more
+ * copy. The producer takes the semaphore with sem_trywait and skips the
+ * frame while a reader holds it, so the preview thread never waits on
+ * the UI.
+ */
+
+#define PREVIEW_LEGACY_SHM_KEY  1234
+#define PREVIEW_LEGACY_SEM      "/preview_sem"
+#define PREVIEW_LEGACY_SIZE     (800 * 480 * 4)
+
+// Create or attach the segment and the semaphore, 0 on success
+int preview_legacy_open(void);
+
+// Copy a published BGRA frame; does nothing unless the mirror is open
+void preview_legacy_publish(const uint8_t *data, const PreviewFrameInfo *info);
+
+void preview_legacy_close(void);
+
+#endif // PREVIEW_LEGACY_H
@@ -0,0 +1,191 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/include/preview_ring.h
+ */
+#ifndef PREVIEW_RING_H
+#define PREVIEW_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * Preview frame ring in shared memory (SysV key PREVIEW_RING_SHM_KEY).
+ *
+ * The producer (VideoProcess) never blocks: it always writes into a slot
+ * other than the newest one and publishes it with a per-slot sequence
+ * counter (seqlock). The counter is odd while a slot is being written.
+ * Readers take the newest slot, copy it and re-check the counter. If the
+ * counter changed during the copy, the frame was torn and the reader
+ * retries.
+ *
+ * Any number of readers (LVGL UI, web live view, motion detector) share
+ * the ring, each with its own cursor: the last frame it was handed. They
+ * never write to the ring, so none of them can hold up the producer or
+ * one another; a reader that falls behind skips frames. Readers register
+ * in a separate table (SysV key PREVIEW_READERS_SHM_KEY), where each one
+ * publishes its own cursor and lag/skip counters for video_stats.
+ *
+ * This header is the whole contract for readers (LVGL UI etc.), who link
+ * against libpreview_ring.a. UIs built against the single-buffer layout
+ * at key 1234 are served by preview_legacy.h instead.
+ */
+
+#define PREVIEW_RING_SHM_KEY   1236
+
+#define PREVIEW_RING_MAGIC     0x31565250u  // "PRV1"
+#define PREVIEW_RING_VERSION   1
+#define PREVIEW_RING_MAX_SLOTS 8
+#define PREVIEW_RING_SLOTS     3            // 三缓冲
+#define PREVIEW_RING_NONE      0xFFFFFFFFu
+
+#define PREVIEW_FORMAT_BGRA    1
+
+// 每个槽位最大帧尺寸（800x480 BGRA）
+#define PREVIEW_SLOT_SIZE      (800 * 480 * 4)
+
+typedef struct {
+    uint32_t seq;           // seqlock 计数，奇数表示正在写入
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;        // 每行字节数
+    uint32_t format;        // PREVIEW_FORMAT_*
+    uint32_t size;          // 有效数据字节数
+    uint64_t frame_number;  // 递增帧号
+    uint64_t capture_ns;    // 采集时间 (CLOCK_MONOTONIC, ns)
+    uint8_t  pad[24];
+} __attribute__((aligned(64))) PreviewSlotHeader;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t slot_size;     // 每个槽位数据区大小
+    uint32_t data_offset;   // 槽位 0 数据相对段首的偏移
+    uint32_t latest;        // 最新完整帧所在槽位，PREVIEW_RING_NONE 表示尚无数据
+    uint64_t published;     // 已发布帧数
+    uint8_t  pad[32];
+    PreviewSlotHeader slots[PREVIEW_RING_MAX_SLOTS];
+} __attribute__((aligned(64))) PreviewRingHeader;
+
+#define PREVIEW_READERS_SHM_KEY  1235
+#define PREVIEW_READERS_MAGIC    0x31445250u  // "PRD1"
+#define PREVIEW_READERS_VERSION  1
+#define PREVIEW_RING_MAX_READERS 8
+
+// One registered reader; only that reader writes it
+typedef struct {
+    int32_t  pid;           // 0 表示空闲
+    char     name[20];
+    uint64_t cursor;        // 最近交付的帧号
+    uint64_t delivered;     // 已交付帧数
+    uint64_t skipped;       // 注册后发布但未交付的帧数
+    uint64_t retries;       // 被生产者覆盖而重读的次数
+    uint64_t lag_frames;    // 最近一次读取时落后最新帧的帧数
+    uint64_t latency_ns;    // 最近交付帧的采集到交付延迟
+    uint64_t updated_ns;    // 最近一次读取时间 (CLOCK_MONOTONIC, ns)
+    uint8_t  pad[48];
+} __attribute__((aligned(64))) PreviewReaderStats;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t max_readers;
+    uint8_t  pad[52];
+    PreviewReaderStats readers[PREVIEW_RING_MAX_READERS];
+} __attribute__((aligned(64))) PreviewReaderTable;
+
+// Total shared memory size for a ring
+#define PREVIEW_RING_SHM_SIZE(slots, slot_size) \
+    (sizeof(PreviewRingHeader) + (size_t)(slots) * (slot_size))
+
+// Metadata returned to readers
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    uint32_t format;
+    uint32_t size;
+    uint64_t frame_number;
+    uint64_t capture_ns;
+} PreviewFrameInfo;
+
+/* ---------- producer ---------- */
+
+// Initialise the ring header in a freshly attached segment
+int preview_ring_init(void *shm, size_t shm_size, uint32_t slot_count, uint32_t slot_size);
+
+// Reserve a slot for writing. Never returns the newest published slot.
+// Returns the slot data pointer and stores the slot index in *slot.
+uint8_t* preview_ring_begin_write(PreviewRingHeader *ring, uint32_t *slot);
+
+// Same as preview_ring_begin_write for a slot chosen by the caller (the
+// shared memory buffer pool). The caller must not pick the newest slot
+// unless no other slot is free.
+uint8_t* preview_ring_begin_write_slot(PreviewRingHeader *ring, uint32_t slot);
+
+// Slot holding the newest published frame, PREVIEW_RING_NONE if none yet
+uint32_t preview_ring_latest(const PreviewRingHeader *ring);
+
+// Publish a written slot as the newest frame
+void preview_ring_commit(PreviewRingHeader *ring, uint32_t slot, const PreviewFrameInfo *info);
+
+// Release a reserved slot without publishing it
+void preview_ring_abort(PreviewRingHeader *ring, uint32_t slot);
+
+uint8_t* preview_ring_slot_data(PreviewRingHeader *ring, uint32_t slot);
+
+// Initialise the reader table in a freshly attached segment
+void preview_readers_init(PreviewReaderTable *table);
+
+/* ---------- reader ---------- */
+
+typedef struct {
+    int shmid;
+    PreviewRingHeader *ring;
+    uint64_t last_frame;    // last frame number handed out (the cursor)
+    uint64_t retries;       // copies discarded because the producer overwrote them
+    uint64_t delivered;
+    uint64_t skipped;       // frames published after the first one handed out, never handed out
+    int readers_shmid;
+    PreviewReaderTable *table;
+    PreviewReaderStats *entry;  // NULL when the table is missing or full
+} PreviewReader;
+
+// Attach to the ring published by VideoProcess (read-only) and register
+// as `name` (NULL: the program name). 0 on success; a missing or full
+// reader table only leaves the reader unlisted.
+int preview_reader_open(PreviewReader *reader);
+int preview_reader_open_named(PreviewReader *reader, const char *name);
+// Same on a ring and table mapped by the caller (table may be NULL)
+int preview_reader_attach(PreviewReader *reader, PreviewRingHeader *ring,
+                          PreviewReaderTable *table, const char *name);
+void preview_reader_close(PreviewReader *reader);
+
+// Copy the newest complete frame into dst.
+// Returns 1 when a new frame was copied, 0 when nothing newer than the
+// last call is available, -1 on error (dst too small, ring not ready, or
+// the producer kept overwriting the slot).
+int preview_reader_copy_latest(PreviewReader *reader, void *dst, size_t dst_size, PreviewFrameInfo *info);
+
+// Copy the oldest frame after the cursor that is still in the ring, so a
+// reader that keeps up sees every frame; one that falls behind skips to
+// the oldest frame left. Same return values.
+int preview_reader_copy_next(PreviewReader *reader, void *dst, size_t dst_size, PreviewFrameInfo *info);
+
+// Lower level variant working on any mapped ring header
+int preview_ring_read_latest(const PreviewRingHeader *ring, void *dst, size_t dst_size,
+                             PreviewFrameInfo *info, uint64_t *retries);
+int preview_ring_read_next(const PreviewRingHeader *ring, uint64_t after, void *dst, size_t dst_size,
+                           PreviewFrameInfo *info, uint64_t *retries);
+
+/* ---------- reader table ---------- */
+
+// Attach to the reader table read-only, NULL if VideoProcess has not created it
+const PreviewReaderTable* preview_readers_attach(void);
+void preview_readers_detach(const PreviewReaderTable *table);
+
+// Human readable dump of the registered readers
+void preview_readers_print(const PreviewReaderTable *table, uint64_t published, FILE *out);
+
+#endif // PREVIEW_RING_H
@@ -0,0 +1,38 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/include/preview_shm_pool.h
+ */
+#ifndef PREVIEW_SHM_POOL_H
+#define PREVIEW_SHM_POOL_H
+
+#include <gst/gst.h>
+#include "preview_ring.h"
+
+// Buffer pool whose buffers wrap the frame slots of a preview ring, so the
+// element in front of the appsink renders straight into memory the UI
+// reads. Acquiring a buffer opens its slot for writing (odd seqlock
+// counter); preview_shm_pool_commit publishes it, and a buffer released
+// without being committed is aborted.
+#define GST_TYPE_PREVIEW_SHM_POOL (gst_preview_shm_pool_get_type())
+#define GST_PREVIEW_SHM_POOL(obj) \
+    (G_TYPE_CHECK_INSTANCE_CAST((obj), GST_TYPE_PREVIEW_SHM_POOL, GstPreviewShmPool))
+#define GST_IS_PREVIEW_SHM_POOL(obj) \
+    (G_TYPE_CHECK_INSTANCE_TYPE((obj), GST_TYPE_PREVIEW_SHM_POOL))
+
+typedef struct _GstPreviewShmPool GstPreviewShmPool;
+typedef struct _GstPreviewShmPoolClass GstPreviewShmPoolClass;
+
+GType gst_preview_shm_pool_get_type(void);
+
+GstBufferPool* preview_shm_pool_new(PreviewRingHeader *ring);
+
+// Answer ALLOCATION queries on the appsink's sink pad with a pool over
+// the ring. Buffers that do not fit a slot are negotiated normally and
+// must be copied by the caller.
+gboolean preview_shm_pool_install(GstElement *appsink, PreviewRingHeader *ring);
+
+// Publish a buffer that came from a preview shm pool. Returns FALSE if
+// the buffer is not backed by a ring slot (caller falls back to copying).
+gboolean preview_shm_pool_commit(GstBuffer *buffer, const PreviewFrameInfo *info);
+
+#endif // PREVIEW_SHM_POOL_H
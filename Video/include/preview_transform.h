@@ -0,0 +1,28 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/include/preview_transform.h
+ */
+#ifndef PREVIEW_TRANSFORM_H
+#define PREVIEW_TRANSFORM_H
+
+#include <gst/gst.h>
+
+// "previewtransform": NV12 in, BGRA out. Scales to width x height, then
+// rotates by "method" (same values as videoflip), in a single pass.
+// "level" counters the camera roll and "hud" draws the horizon and pitch
+// ladder, both from the IMU attitude (eis_attitude_set); frames are left
+// alone while there is none.
+#define GST_TYPE_PREVIEW_TRANSFORM (gst_preview_transform_get_type())
+#define GST_PREVIEW_TRANSFORM(obj) \
+    (G_TYPE_CHECK_INSTANCE_CAST((obj), GST_TYPE_PREVIEW_TRANSFORM, GstPreviewTransform))
+
+typedef struct _GstPreviewTransform GstPreviewTransform;
+typedef struct _GstPreviewTransformClass GstPreviewTransformClass;
+
+GType gst_preview_transform_get_type(void);
+
+// Register the element with the application so it can be created with
+// gst_element_factory_make("previewtransform", ...)
+gboolean preview_transform_register(void);
+
+#endif // PREVIEW_TRANSFORM_H
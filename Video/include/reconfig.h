@@ -0,0 +1,58 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/include/reconfig.h
+ */
+#ifndef RECONFIG_H
+#define RECONFIG_H
+
+#include <gst/gst.h>
+#include "config.h"
+
+/*
+ * Applying VideoConfig to a pipeline, at start and while it runs. Elements
+ * are looked up by the names create_pipeline() gives them ("source",
+ * "capture_caps", "encoder", "audio-encoder", "enc_queue", "app_queue",
+ * "audio_queue", "record_queue", "audio_record_queue", "preview_transform",
+ * "video_prerecord", "audio_prerecord", "imu_prerecord", "gnss_prerecord",
+ * "eis");
+ * missing ones are skipped, so test pipelines only need the parts they
+ * exercise.
+ */
+
+// Encoder rate control and GOP (mpph265enc, or x265enc/x264enc in simulation)
+void reconfig_encoder(GstElement *encoder, const VideoConfig *config);
+
+// Capture caps for the "capture_caps" filter; the caller unrefs
+GstCaps* reconfig_capture_caps(const VideoConfig *config);
+
+// Audio codec actually used: audio_codec, unless the container cannot carry it
+const char* reconfig_audio_codec(const VideoConfig *config);
+// Element factory for it ("identity" for PCM)
+const char* reconfig_audio_encoder_factory(const VideoConfig *config);
+// Raw caps in front of the audio encoder; when the sound card delivers
+// them, audioconvert and audioresample pass its buffers through untouched.
+// The caller unrefs.
+GstCaps* reconfig_audio_caps(const VideoConfig *config);
+// Audio bitrate, and the Opus complexity
+void reconfig_audio_encoder(GstElement *encoder, const VideoConfig *config);
+
+// Install the preview rate limiter and apply every live setting
+void reconfig_install(GstElement *pipeline, const VideoConfig *config);
+
+// Preview frames dropped so far to honour preview_fps (lowered further by
+// preview_fps_adaptive), or to make way for the encoder (record_integrity)
+guint reconfig_preview_decimated(void);
+
+// Preview rate the limiter currently aims for. With preview_fps_adaptive
+// it steps down one divisor at a time (30, 15, 10, 7.5 ... fps) while the
+// process uses more than preview_cpu_high % of the cores or the encoder
+// queue fills, and back up while it stays under preview_cpu_low; each step
+// is logged with the CPU it saved or cost.
+gdouble reconfig_preview_fps(void);
+
+// Apply a setting changed with config_set(). CONFIG_APPLY_RELINK restarts
+// the capture source with new caps while the rest of the pipeline keeps
+// running. Returns 0, or -1 if the source could not be restarted.
+int reconfig_apply(GstElement *pipeline, const VideoConfig *config, ConfigApply apply);
+
+#endif // RECONFIG_H
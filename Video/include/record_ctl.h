@@ -0,0 +1,79 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/include/record_ctl.h
+ */
+#ifndef RECORD_CTL_H
+#define RECORD_CTL_H
+
+#include <stdint.h>
+
+/*
+ * Record control channel (Unix SOCK_SEQPACKET socket).
+ *
+ * Each RecordCommand is answered with exactly one RecordReply once the
+ * command has been carried out. There is no polling on either side: VideoProcess
+ * sleeps in poll() until a command arrives. UI processes link against
+ * librecord_ctl.a.
+ *
+ * Until the on-device UI (app/lvgl) moves to this channel, VideoProcess
+ * also starts or stops a recording when the is_recording flag in the
+ * record control shared memory (key 5678) changes, checking it every
+ * 100 ms, and keeps writing the current state back to it.
+ */
+
+#define RECORD_CTL_SOCKET "/tmp/record_ctl.sock"
+
+typedef enum {
+    RECORD_CMD_START  = 1,
+    RECORD_CMD_STOP   = 2,
+    RECORD_CMD_STATUS = 3,
+    RECORD_CMD_CONFIG_SET  = 4,    // key = value, applied live where possible
+    RECORD_CMD_CONFIG_GET  = 5,    // value of key
+    RECORD_CMD_CONFIG_SAVE = 6,    // write the running config back to its file
+} RecordCommandOp;
+
+typedef enum {
+    RECORD_OK              = 0,
+    RECORD_ALREADY         = 1,    // already recording / already stopped
+    RECORD_ERR_STORAGE     = -1,   // record directory missing or read-only
+    RECORD_ERR_PIPELINE    = -2,   // filesink could not be restarted
+    RECORD_ERR_BAD_COMMAND = -3,
+    RECORD_ERR_BAD_CONFIG  = -4,   // unknown key or value out of range
+    RECORD_ERR_BUSY        = -5,   // capture and preview rotation changes wait until recording stops
+} RecordResult;
+
+typedef struct {
+    uint32_t op;            // RecordCommandOp
+    uint32_t seq;           // echoed in the reply
+    char     key[32];       // config commands only
+    char     value[96];
+} RecordCommand;
+
+typedef struct {
+    uint32_t seq;
+    int32_t  result;        // RecordResult
+    uint32_t recording;     // state after the command
+    uint32_t apply;         // ConfigApply of a CONFIG_SET (see config.h)
+    uint64_t started_ns;    // CLOCK_MONOTONIC time the recording was opened, 0 if idle
+    char     filename[256]; // current / last recording file
+    char     value[96];     // CONFIG_GET/SET: the value now in effect
+} RecordReply;
+
+// Connect to VideoProcess, returns a socket fd or -1
+int record_ctl_connect(void);
+void record_ctl_close(int fd);
+
+// Send a command and wait for its reply. 0 on success (reply->result
+// holds the outcome of the command), -1 on a transport error.
+int record_ctl_request(int fd, RecordCommandOp op, RecordReply *reply);
+
+// Config commands; value is only used by RECORD_CMD_CONFIG_SET
+int record_ctl_config(int fd, RecordCommandOp op, const char *key, const char *value,
+                      RecordReply *reply);
+
+const char* record_result_str(int32_t result);
+
+// Server side: bind and listen on RECORD_CTL_SOCKET, returns fd or -1
+int record_ctl_listen(void);
+
+#endif // RECORD_CTL_H
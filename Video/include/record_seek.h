@@ -0,0 +1,81 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/include/record_seek.h
+ */
+#ifndef RECORD_SEEK_H
+#define RECORD_SEEK_H
+
+#include <stdint.h>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include "preview_kernel.h"
+
+/*
+ * Seek sidecar written next to every recording segment while it records:
+ * record_YYYYMMDD_HHMMSS.mkv gets record_YYYYMMDD_HHMMSS.tsk, so the web
+ * server can seek and show thumbnails from a few KB instead of the video.
+ *
+ * A RecordSeekHeader, then RecordSeekRecords, each followed by `size`
+ * payload bytes:
+ *  - RECORD_SEEK_KEYFRAME: no payload. `offset` is the byte offset of the
+ *    Matroska cluster (or block) that starts with the keyframe.
+ *  - RECORD_SEEK_THUMBNAIL: a JPEG taken from the preview branch. `offset`
+ *    is that of the last keyframe at or before it.
+ * Times are ns into the segment. Records are appended in batches (a
+ * thumbnail or a few KB of keyframes at a time), so a reader may see a
+ * short tail missing but never a torn record followed by more data.
+ * MP4 segments only get thumbnails: the fragments do not mark keyframes.
+ */
+
+#define RECORD_SEEK_MAGIC       0x314B5354u     // "TSK1"
+#define RECORD_SEEK_VERSION     1
+#define RECORD_SEEK_EXTENSION   ".tsk"
+
+typedef enum {
+    RECORD_SEEK_KEYFRAME = 1,
+    RECORD_SEEK_THUMBNAIL = 2,
+} RecordSeekType;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;       // sizeof(RecordSeekRecord)
+    uint32_t pad;
+} RecordSeekHeader;
+
+typedef struct {
+    uint32_t type;              // RecordSeekType
+    uint32_t size;              // payload bytes that follow
+    uint64_t time_ns;           // into the segment
+    uint64_t offset;            // byte offset into the segment
+} RecordSeekRecord;
+
+typedef struct RecordSeek RecordSeek;
+
+// `keyframes` records keyframe offsets (Matroska only); thumbnails are
+// thumb_width wide every thumb_seconds (0: none), turned back from the
+// preview's `rotation`, which must not change while recording
+RecordSeek* record_seek_new(int keyframes, int thumb_seconds, int thumb_width, PreviewRotation rotation);
+
+// Keep `seek` alive while calling it without the owner's lock (the preview
+// thread); take the reference under whatever lock hands out the pointer
+RecordSeek* record_seek_ref(RecordSeek *seek);
+void record_seek_unref(RecordSeek *seek);
+
+// Wait for the references to be dropped, write out everything pending and
+// close the last sidecar
+void record_seek_free(RecordSeek *seek);
+
+// Follow the muxer output into `storage` (splitmuxsink's sink); a new
+// sidecar is started with every file it opens
+void record_seek_attach(RecordSeek *seek, GstElement *storage);
+
+// splitmuxsink-fragment-opened: running time the segment starts at
+void record_seek_segment_opened(RecordSeek *seek, const char *location, uint64_t running_time);
+
+// A preview frame (BGRA as the preview branch renders it); takes a
+// thumbnail when one is due, never waits on the encoder or the card. Only
+// ever called from the preview thread: it owns the thumbnail encoder
+void record_seek_preview(RecordSeek *seek, GstBuffer *buffer, const GstVideoInfo *info);
+
+#endif // RECORD_SEEK_H
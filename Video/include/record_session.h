@@ -0,0 +1,77 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/include/record_session.h
+ */
+#ifndef RECORD_SESSION_H
+#define RECORD_SESSION_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * One recording session (start .. stop), split into keyframe-aligned
+ * segments by splitmuxsink. Segment files are named after the wall clock
+ * time they were opened (record_YYYYMMDD_HHMMSS.<ext>, the first one after
+ * the session), so existing tools keep finding them. The manifest
+ * session_<session>.json lists the segments and is rewritten (tmp +
+ * rename) every time a segment opens or closes, so a power cut leaves a
+ * manifest describing every finished segment. The rewrite happens on the
+ * session's own writer thread: segment messages only update memory, so
+ * the streaming threads and locks they hold never wait on the card.
+ *
+ * Frames that never made it into the recording (dropped ahead of the
+ * encoder) are listed as gaps; they reach the manifest with its next
+ * rewrite, so reporting one never waits on the card.
+ *
+ * session_<session>.tsidx holds one RecordIndexEntry per video frame: its
+ * capture time (CLOCK_MONOTONIC) and running time. The segment whose
+ * start_ns is the last one at or before a frame's running time holds it,
+ * at running time - start_ns into the file. Entries are appended and synced
+ * by the writer thread every second and whenever the manifest is
+ * rewritten, so an unsegmented recording loses at most the last second of
+ * them on a power cut; the manifest carries the UTC offset of the
+ * common timebase (timebase.h), so a telemetry sample at UTC t maps to the
+ * frame captured at t - utc_offset_ns without reading the video.
+ */
+
+#define RECORD_INDEX_MAGIC      0x31585354u     // "TSX1"
+#define RECORD_INDEX_VERSION    1
+#define RECORD_INDEX_KEYFRAME   (1ull << 63)    // in running_time
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entry_size;        // sizeof(RecordIndexEntry)
+    uint32_t pad;
+} RecordIndexHeader;
+
+typedef struct {
+    uint64_t capture_ns;        // CLOCK_MONOTONIC
+    uint64_t running_time;      // ns, RECORD_INDEX_KEYFRAME set on keyframes
+} RecordIndexEntry;
+
+typedef struct RecordSession RecordSession;
+
+RecordSession* record_session_new(const char *dir, const char *extension,
+                                  int segment_seconds, int segment_max_mb);
+void record_session_free(RecordSession *session);
+
+const char* record_session_name(const RecordSession *session);
+
+// Path for segment "index"; the caller frees it with free()
+char* record_session_location(RecordSession *session, unsigned index);
+
+// splitmuxsink fragment messages (running time in ns)
+void record_session_segment_opened(RecordSession *session, const char *location, uint64_t running_time);
+void record_session_segment_closed(RecordSession *session, const char *location, uint64_t running_time);
+
+// "frames" frames are missing just before running time "pts" (ns)
+void record_session_discontinuity(RecordSession *session, uint64_t pts, uint64_t frames);
+
+// A video frame went to the muxer (streaming thread, never touches the card)
+void record_session_frame(RecordSession *session, uint64_t running_time, uint64_t capture_ns, int keyframe);
+
+// Mark the session complete, write the final manifest and stop the writer
+void record_session_finish(RecordSession *session, int clean);
+
+#endif // RECORD_SESSION_H
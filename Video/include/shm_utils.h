@@ -7,11 +7,18 @@
 
 #include <sys/ipc.h>
 #include <sys/shm.h>
+#include "preview_ring.h"
 
-#define SHM_KEY 1234
-#define SHM_SIZE 800 * 480 * 4  // 默认支持1080p RGBA，可根据需要调整
+// 1234 留给旧版 UI 的单帧布局（preview_legacy.h）
+#define SHM_KEY PREVIEW_RING_SHM_KEY
+// 预览帧环形缓冲区：头部 + PREVIEW_RING_SLOTS 个 800x480 BGRA 槽位
+#define SHM_SIZE PREVIEW_RING_SHM_SIZE(PREVIEW_RING_SLOTS, PREVIEW_SLOT_SIZE)
+
+// 预览读者登记表：各读者的游标和滞后/跳帧计数，读者以读写方式挂接
+#define READERS_SHM_SIZE sizeof(PreviewReaderTable)
 
 int create_shm(void);
+int create_readers_shm(void);
 void* attach_shm(int shmid);
 void detach_shm(void *shm_ptr);
 void destroy_shm(int shmid);
@@ -0,0 +1,54 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/include/storage_sink.h
+ */
+#ifndef STORAGE_SINK_H
+#define STORAGE_SINK_H
+
+#include <gst/gst.h>
+
+// "storagesink": file sink for slow flash media. Incoming data is copied
+// into "chunk-size" staging buffers that end on chunk-aligned file offsets
+// and written by a dedicated thread, so streaming threads never wait on
+// the card unless all "max-chunks" buffers are in flight. The file is
+// preallocated "preallocate" bytes ahead of the data (fallocate, released
+// again on close) and synced every "sync-interval". Byte segment events
+// (muxers rewriting headers) are honoured like filesink does. The
+// "written" signal (guint64 total bytes) follows each completed write.
+#define GST_TYPE_STORAGE_SINK (gst_storage_sink_get_type())
+#define GST_STORAGE_SINK(obj) \
+    (G_TYPE_CHECK_INSTANCE_CAST((obj), GST_TYPE_STORAGE_SINK, GstStorageSink))
+
+typedef struct _GstStorageSink GstStorageSink;
+typedef struct _GstStorageSinkClass GstStorageSinkClass;
+
+GType gst_storage_sink_get_type(void);
+
+gboolean storage_sink_register(void);
+
+// Histograms use log2 buckets of microseconds: bucket 0 is < 2 us,
+// bucket i covers [2^i, 2^(i+1)) us, the last one everything above.
+#define STORAGE_SINK_HIST_BUCKETS 24
+#define STORAGE_SINK_MAX_CHUNKS   32
+
+typedef struct {
+    guint64 bytes;                  // written to the file
+    guint64 writes;                 // chunk writes
+    guint64 syncs;
+    guint64 waits;                  // render blocked for a free chunk
+    guint queue_max;
+    guint64 queue_depth[STORAGE_SINK_MAX_CHUNKS + 1];  // chunks pending when one is queued
+    guint64 write_us[STORAGE_SINK_HIST_BUCKETS];
+    guint64 sync_us[STORAGE_SINK_HIST_BUCKETS];
+    guint64 wait_us[STORAGE_SINK_HIST_BUCKETS];
+} StorageSinkStats;
+
+// Counters since the element was created (they survive file changes)
+void storage_sink_get_stats(GstElement *sink, StorageSinkStats *stats);
+
+// Upper bound (us) of the bucket holding the p-th percentile, p in [0, 100]
+guint64 storage_sink_hist_percentile(const guint64 *hist, double p);
+
+void storage_sink_print_stats(const StorageSinkStats *stats);
+
+#endif // STORAGE_SINK_H
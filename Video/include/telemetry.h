@@ -0,0 +1,93 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/include/telemetry.h
+ */
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+
+/*
+ * IMU and GNSS telemetry for the recording (SysV message queue
+ * TELEMETRY_MSG_KEY, the queue imu_logger always sent its attitude to).
+ *
+ * imu_logger and gnss_collector send one message per sample, whether or not
+ * anything is recording, and never block: with VideoProcess gone the queue
+ * fills and samples are dropped. VideoProcess keeps them like audio, in a
+ * pre-record buffer per source, and muxes them into Matroska recordings as
+ * one subtitle track each (codec "application/x-subtitle-unknown").
+ *
+ * Each block of those tracks is a TelemetryBlockHeader followed by count
+ * records of record_size bytes, little endian as written. There is one
+ * block per source per cluster (fragment_ms), empty if nothing arrived.
+ * Records are stamped with CLOCK_MONOTONIC like the session frame index
+ * (.tsidx capture_ns); within the file a record sits at
+ * block timestamp + (mono_ns - base_ns).
+ *
+ * imu_logger and gnss_collector compile src/telemetry.c; it has no
+ * dependencies.
+ */
+
+#define TELEMETRY_MSG_KEY       0x1234
+#define TELEMETRY_BLOCK_MAGIC   0x314d4c54u     // "TLM1"
+
+// Message type, also the block type
+typedef enum {
+    TELEMETRY_IMU = 1,
+    TELEMETRY_GNSS = 2,
+} TelemetryType;
+
+typedef struct {
+    uint64_t mono_ns;       // sample time (CLOCK_MONOTONIC)
+    uint32_t seq;           // per sender, gaps are samples dropped on the way
+    float roll, pitch, yaw; // fused attitude (rad)
+    float gyro[3];          // rad/s
+    float accel[3];         // m/s²
+} TelemetryImu;
+
+#define TELEMETRY_GNSS_UTC_VALID    0x1     // utc_ns holds the fix time
+
+typedef struct {
+    uint64_t mono_ns;       // when the fix was read
+    uint64_t utc_ns;        // fix time from the NMEA sentences
+    double latitude;        // degrees, north positive
+    double longitude;       // degrees, east positive
+    float altitude;         // metres above mean sea level
+    uint32_t seq;
+    uint16_t satellites;
+    uint16_t flags;         // TELEMETRY_GNSS_*
+    uint32_t pad;
+} TelemetryGnss;
+
+typedef struct {
+    long mtype;             // TelemetryType
+    union {
+        TelemetryImu imu;
+        TelemetryGnss gnss;
+    } u;
+} TelemetryMsg;
+
+typedef struct {
+    uint32_t magic;         // TELEMETRY_BLOCK_MAGIC
+    uint16_t type;          // TelemetryType
+    uint16_t record_size;
+    uint32_t count;
+    uint32_t dropped;       // samples lost since the previous block
+    uint64_t base_ns;       // CLOCK_MONOTONIC at the block timestamp
+} TelemetryBlockHeader;
+
+// Attach to (or create) the queue; -1 on failure
+int telemetry_open(void);
+
+// Queue one sample without blocking. Returns 0, or -1 if it was dropped
+// (queue full or gone).
+int telemetry_send(int msqid, TelemetryType type, const void *record);
+
+// Take the next sample without blocking: 1 with *msg filled, 0 when the
+// queue is empty, -1 if it is gone (telemetry_open again)
+int telemetry_receive(int msqid, TelemetryMsg *msg);
+
+// Record size for a type, 0 if unknown
+uint16_t telemetry_record_size(TelemetryType type);
+
+#endif // TELEMETRY_H
@@ -0,0 +1,42 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/include/telemetry_mux.h
+ */
+#ifndef TELEMETRY_MUX_H
+#define TELEMETRY_MUX_H
+
+#include <gst/gst.h>
+#include "telemetry.h"
+
+/*
+ * IMU and GNSS samples from the telemetry queue (telemetry.h) turned into
+ * timed buffers for the recording. Each source gets an appsrc
+ * ("imu_telemetry", "gnss_telemetry") feeding a pre-record buffer
+ * ("imu_prerecord", "gnss_prerecord") that pipeline.c links to the
+ * segment muxer like audio_prerecord.
+ *
+ * A receiver thread batches the samples and pushes one block per source
+ * every batch period, empty ones included, so the muxer never waits on a
+ * silent source. Block timestamps are running time on the pipeline clock,
+ * which is CLOCK_MONOTONIC (see create_pipeline).
+ */
+
+// Add the appsrc and pre-record buffer of every source
+gboolean telemetry_mux_add(GstElement *pipeline);
+
+// Start the receiver; the pipeline is PLAYING (its base time is known)
+void telemetry_mux_start(GstElement *pipeline, guint batch_ms);
+
+// Block length from the next block on, normally the cluster duration
+void telemetry_mux_set_batch(guint batch_ms);
+
+// Also hand every IMU sample to func (stabilization), from the receiver
+// thread and whether or not anything records. Set before
+// telemetry_mux_start; the receiver then runs even without tracks.
+typedef void (*TelemetryImuFunc)(const TelemetryImu *sample, gpointer user_data);
+void telemetry_mux_set_imu_callback(TelemetryImuFunc func, gpointer user_data);
+
+// Stop the receiver and print what it got
+void telemetry_mux_stop(void);
+
+#endif // TELEMETRY_MUX_H
@@ -0,0 +1,76 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/include/timebase.h
+ */
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include <stdint.h>
+
+/*
+ * Common timebase for video, IMU and GNSS (SysV key TIMEBASE_SHM_KEY).
+ *
+ * Every frame, IMU sample and GNSS fix is stamped with CLOCK_MONOTONIC
+ * nanoseconds, which never jump. The block publishes the offset that turns
+ * them into UTC: utc_ns = monotonic_ns + utc_offset_ns.
+ *
+ * Any process may publish. The system clock is used once it looks set
+ * (the board has no RTC and boots in 1970); GNSS fixes fill in until then,
+ * but only valid ones (GGA quality > 0, RMC status 'A'): a receiver
+ * without a fix reports whatever its own clock says.
+ * An offset replaces the current one if it comes from the same source or
+ * is at least as precise, so an NTP step reaches everyone with the next
+ * system publish. The block is a seqlock: readers retry while seq is odd
+ * or changes under them.
+ *
+ * VideoProcess, imu_logger and gnss_collector link src/timebase.c; it has
+ * no dependencies.
+ */
+
+#define TIMEBASE_SHM_KEY    5680
+#define TIMEBASE_MAGIC      0x31425454u     // "TTB1"
+#define TIMEBASE_VERSION    1
+
+typedef enum {
+    TIMEBASE_SOURCE_NONE = 0,       // nothing published: UTC unknown
+    TIMEBASE_SOURCE_SYSTEM = 1,     // CLOCK_REALTIME (NTP or set by hand)
+    TIMEBASE_SOURCE_GNSS = 2,       // NMEA time of a valid fix
+} TimebaseSource;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seq;                   // odd while being written
+    uint32_t source;                // TimebaseSource
+    int64_t  utc_offset_ns;         // UTC = CLOCK_MONOTONIC + offset
+    uint64_t uncertainty_ns;        // how far off the offset may be
+    uint64_t updated_ns;            // CLOCK_MONOTONIC of the last publish
+    uint32_t publisher_pid;
+    uint32_t pad;
+} TimebaseBlock;
+
+// CLOCK_MONOTONIC in nanoseconds
+uint64_t timebase_now_ns(void);
+
+// Attach (creating the block if needed). Returns 0, or -1 if shared
+// memory is unavailable; publishing and lookups then stay process-local.
+int timebase_open(void);
+void timebase_close(void);
+
+// Publish an offset; returns 1 if it replaced the current one, 0 if a more
+// precise one from another source was kept
+int timebase_publish(int64_t utc_offset_ns, TimebaseSource source, uint64_t uncertainty_ns);
+
+// Measure CLOCK_REALTIME against CLOCK_MONOTONIC and publish it. Returns
+// -1 without publishing while the system clock is not set.
+int timebase_publish_system(void);
+
+// Current offset; returns its TimebaseSource (NONE: offset is 0)
+TimebaseSource timebase_utc_offset(int64_t *utc_offset_ns, uint64_t *uncertainty_ns);
+
+// monotonic_ns as UTC nanoseconds since the epoch, 0 while unknown
+uint64_t timebase_to_utc_ns(uint64_t monotonic_ns);
+
+const char* timebase_source_name(TimebaseSource source);
+
+#endif // TIMEBASE_H
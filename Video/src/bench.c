@@ -0,0 +1,2019 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/src/bench.c
+ */
+#include "bench.h"
+#include "preview_kernel.h"
+#include "preview_hud.h"
+#include "preview_ring.h"
+#include "pipeline.h"
+#include "record_ctl.h"
+#include "storage_sink.h"
+#include "reconfig.h"
+#include "pipeline_probes.h"
+#include "eis.h"
+#include "eis_kernel.h"
+#include "eis_stabilize.h"
+#include "telemetry.h"
+#include <math.h>
+#include <gst/gst.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static double now_ms(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// p in [0, 100]; sorts the samples in place
+static double percentile(double *samples, int count, double p) {
+    if (count <= 0) return 0;
+    qsort(samples, count, sizeof(double), compare_double);
+    int idx = (int)(p / 100.0 * (count - 1) + 0.5);
+    return samples[idx];
+}
+
+// Run a pipeline to EOS and release it, returns wall/CPU time in ms
+static int run_pipeline(GstElement *pipeline, double *wall_ms, double *cpu_ms) {
+    GError *err = NULL;
+    double wall0 = now_ms(CLOCK_MONOTONIC);
+    double cpu0 = now_ms(CLOCK_PROCESS_CPUTIME_ID);
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                                 GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
+    int ret = 0;
+    if (msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+        gst_message_parse_error(msg, &err, NULL);
+        g_printerr("Benchmark pipeline error: %s\n", err->message);
+        g_clear_error(&err);
+        ret = -1;
+    }
+    *wall_ms = now_ms(CLOCK_MONOTONIC) - wall0;
+    *cpu_ms = now_ms(CLOCK_PROCESS_CPUTIME_ID) - cpu0;
+
+    if (msg) gst_message_unref(msg);
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    return ret;
+}
+
+static GstElement* parse_pipeline(const char *desc) {
+    GError *err = NULL;
+    GstElement *pipeline = gst_parse_launch(desc, &err);
+    if (!pipeline) {
+        g_printerr("Failed to build benchmark pipeline: %s\n", err ? err->message : "unknown");
+        g_clear_error(&err);
+    }
+    return pipeline;
+}
+
+// Run a gst-launch style description to EOS, returns wall/CPU time in ms
+static int run_launch(const char *desc, double *wall_ms, double *cpu_ms) {
+    GstElement *pipeline = parse_pipeline(desc);
+    if (!pipeline) {
+        return -1;
+    }
+    return run_pipeline(pipeline, wall_ms, cpu_ms);
+}
+
+/* ---------- preview: fused kernel vs videoscale ! videoconvert ! videoflip ---------- */
+
+#define PREVIEW_SRC_W   1920
+#define PREVIEW_SRC_H   1080
+#define PREVIEW_DST_W   800
+#define PREVIEW_DST_H   450
+#define PREVIEW_FRAMES  300
+
+static int bench_preview(void) {
+    int y_stride = PREVIEW_SRC_W;
+    int uv_stride = PREVIEW_SRC_W;
+    uint8_t *y = (uint8_t *)malloc((size_t)y_stride * PREVIEW_SRC_H);
+    uint8_t *uv = (uint8_t *)malloc((size_t)uv_stride * PREVIEW_SRC_H / 2);
+    uint8_t *out_scalar = (uint8_t *)malloc((size_t)PREVIEW_DST_W * PREVIEW_DST_H * 4);
+    uint8_t *out_simd = (uint8_t *)malloc((size_t)PREVIEW_DST_W * PREVIEW_DST_H * 4);
+    PreviewKernel *kernel = preview_kernel_new(PREVIEW_SRC_W, PREVIEW_SRC_H, PREVIEW_DST_W, PREVIEW_DST_H,
+                                               PREVIEW_ROTATE_90CW, PREVIEW_MATRIX_BT709);
+    if (!y || !uv || !out_scalar || !out_simd || !kernel) {
+        g_printerr("Out of memory\n");
+        free(y); free(uv); free(out_scalar); free(out_simd);
+        preview_kernel_free(kernel);
+        return -1;
+    }
+
+    // Gradient with some noise so no path can shortcut on flat input
+    srand(1);
+    for (int r = 0; r < PREVIEW_SRC_H; r++)
+        for (int c = 0; c < PREVIEW_SRC_W; c++)
+            y[r * y_stride + c] = (uint8_t)((r + c) / 12 + (rand() & 15));
+    for (int i = 0; i < uv_stride * PREVIEW_SRC_H / 2; i++)
+        uv[i] = (uint8_t)(96 + (rand() & 63));
+
+    int dst_stride = preview_kernel_dst_width(kernel) * 4;
+    double ms[2];
+    uint8_t *outs[2] = { out_scalar, out_simd };
+    for (int simd = 0; simd < 2; simd++) {
+        preview_kernel_set_simd(kernel, simd);
+        double t0 = now_ms(CLOCK_MONOTONIC);
+        for (int i = 0; i < PREVIEW_FRAMES; i++) {
+            preview_kernel_process(kernel, y, y_stride, uv, uv_stride, outs[simd], dst_stride);
+        }
+        ms[simd] = (now_ms(CLOCK_MONOTONIC) - t0) / PREVIEW_FRAMES;
+    }
+    int exact = memcmp(out_scalar, out_simd, (size_t)dst_stride * preview_kernel_dst_height(kernel)) == 0;
+
+    g_print("Preview kernel %dx%d NV12 -> %dx%d BGRA, rotate 90cw (%d frames)\n",
+            PREVIEW_SRC_W, PREVIEW_SRC_H, PREVIEW_DST_W, PREVIEW_DST_H, PREVIEW_FRAMES);
+    g_print("  scalar:        %7.2f ms/frame\n", ms[0]);
+    g_print("  simd (%s):   %7.2f ms/frame  (%.1fx, %s)\n", preview_kernel_simd_name(), ms[1],
+            ms[0] / ms[1], exact ? "bit-exact" : "MISMATCH");
+
+    preview_kernel_free(kernel);
+    free(y); free(uv); free(out_scalar); free(out_simd);
+
+    // Same work as GStreamer pipelines; the source-only run is subtracted
+    char src[256];
+    snprintf(src, sizeof(src),
+             "videotestsrc num-buffers=%d pattern=smpte ! video/x-raw,format=NV12,width=%d,height=%d,framerate=30/1",
+             PREVIEW_FRAMES, PREVIEW_SRC_W, PREVIEW_SRC_H);
+    const char *names[3] = { "source only", "videoscale+videoconvert+videoflip", "previewtransform" };
+    char descs[3][512];
+    snprintf(descs[0], sizeof(descs[0]), "%s ! fakesink", src);
+    snprintf(descs[1], sizeof(descs[1]),
+             "%s ! videoscale ! video/x-raw,format=NV12,width=%d,height=%d ! videoconvert ! "
+             "video/x-raw,format=BGRA ! videoflip method=1 ! fakesink",
+             src, PREVIEW_DST_W, PREVIEW_DST_H);
+    snprintf(descs[2], sizeof(descs[2]), "%s ! previewtransform width=%d height=%d method=1 ! fakesink",
+             src, PREVIEW_DST_W, PREVIEW_DST_H);
+
+    double wall[3], cpu[3];
+    for (int i = 0; i < 3; i++) {
+        if (run_launch(descs[i], &wall[i], &cpu[i]) != 0) {
+            return -1;
+        }
+    }
+    g_print("Pipeline CPU per frame (source cost subtracted):\n");
+    for (int i = 1; i < 3; i++) {
+        g_print("  %-36s %7.2f ms/frame\n", names[i], (cpu[i] - cpu[0]) / PREVIEW_FRAMES);
+    }
+    return exact ? 0 : 1;
+}
+
+/* ---------- ring: producer latency and tear rate with a slow reader ---------- */
+
+#define RING_FRAMES     600     // 10 s at 60 fps
+#define RING_FRAME_US   16667
+#define RING_W          450
+#define RING_H          800
+
+typedef struct {
+    PreviewRingHeader *ring;
+    volatile int running;
+    uint64_t frames_read;
+    uint64_t torn_delivered;
+    uint64_t failed_reads;
+    uint64_t retries;
+} RingBenchReader;
+
+// Slow reader: a 25 fps UI that also stalls now and then
+static void* ring_bench_reader(void *arg) {
+    RingBenchReader *rd = (RingBenchReader *)arg;
+    size_t size = (size_t)RING_W * RING_H * 4;
+    uint8_t *frame = (uint8_t *)malloc(size);
+    uint64_t last = 0;
+    unsigned loops = 0;
+
+    while (rd->running) {
+        PreviewFrameInfo info;
+        int ret = preview_ring_read_latest(rd->ring, frame, size, &info, &rd->retries);
+        if (ret < 0) {
+            rd->failed_reads++;
+        } else if (ret == 1 && info.frame_number != last) {
+            last = info.frame_number;
+            rd->frames_read++;
+            // Every byte of a frame carries its frame number
+            uint8_t expect = (uint8_t)info.frame_number;
+            for (size_t i = 0; i < size; i += 4096) {
+                if (frame[i] != expect) {
+                    rd->torn_delivered++;
+                    break;
+                }
+            }
+        }
+        usleep((++loops % 16) == 0 ? 200000 : 40000);
+    }
+    free(frame);
+    return NULL;
+}
+
+static int bench_ring(void) {
+    size_t frame_size = (size_t)RING_W * RING_H * 4;
+    size_t shm_size = PREVIEW_RING_SHM_SIZE(PREVIEW_RING_SLOTS, PREVIEW_SLOT_SIZE);
+    void *shm = aligned_alloc(64, (shm_size + 63) & ~(size_t)63);
+    uint8_t *src = (uint8_t *)malloc(frame_size);
+    double *latency_us = (double *)malloc(sizeof(double) * RING_FRAMES);
+    if (!shm || !src || !latency_us || preview_ring_init(shm, shm_size, PREVIEW_RING_SLOTS, PREVIEW_SLOT_SIZE) != 0) {
+        g_printerr("Failed to set up ring benchmark\n");
+        free(shm); free(src); free(latency_us);
+        return -1;
+    }
+
+    RingBenchReader rd;
+    memset(&rd, 0, sizeof(rd));
+    rd.ring = (PreviewRingHeader *)shm;
+    rd.running = 1;
+    pthread_t tid;
+    pthread_create(&tid, NULL, ring_bench_reader, &rd);
+
+    for (int i = 0; i < RING_FRAMES; i++) {
+        uint64_t frame_number = (uint64_t)i + 1;
+        memset(src, (uint8_t)frame_number, frame_size);
+
+        double t0 = now_ms(CLOCK_MONOTONIC);
+        uint32_t slot;
+        uint8_t *dst = preview_ring_begin_write(rd.ring, &slot);
+        memcpy(dst, src, frame_size);
+        PreviewFrameInfo info = { RING_W, RING_H, RING_W * 4, PREVIEW_FORMAT_BGRA,
+                                  (uint32_t)frame_size, frame_number, 0 };
+        preview_ring_commit(rd.ring, slot, &info);
+        latency_us[i] = (now_ms(CLOCK_MONOTONIC) - t0) * 1000.0;
+
+        usleep(RING_FRAME_US);
+    }
+    rd.running = 0;
+    pthread_join(tid, NULL);
+
+    g_print("Preview ring, %d slots, %dx%d BGRA, %d frames at 60 fps, slow reader\n",
+            PREVIEW_RING_SLOTS, RING_W, RING_H, RING_FRAMES);
+    g_print("  producer publish latency: p50 %.1f us  p99 %.1f us  max %.1f us\n",
+            percentile(latency_us, RING_FRAMES, 50), percentile(latency_us, RING_FRAMES, 99),
+            percentile(latency_us, RING_FRAMES, 100));
+    g_print("  reader: %llu frames, %llu seqlock retries, %llu failed reads, %llu torn frames delivered\n",
+            (unsigned long long)rd.frames_read, (unsigned long long)rd.retries,
+            (unsigned long long)rd.failed_reads, (unsigned long long)rd.torn_delivered);
+
+    int ret = rd.torn_delivered ? 1 : 0;
+    free(shm); free(src); free(latency_us);
+    return ret;
+}
+
+/* ---------- broadcast: independent readers at different speeds ---------- */
+
+typedef struct {
+    const char *name;
+    gboolean every_frame;       // copy_next (motion detector) instead of copy_latest
+    int period_us;              // between reads
+    int stall_every;            // every n-th read also stalls for stall_us (0: never)
+    int stall_us;
+    PreviewRingHeader *ring;
+    PreviewReaderTable *table;
+    volatile int running;
+    PreviewReader reader;
+    uint64_t first_frame;
+    uint64_t torn_delivered;
+    uint64_t out_of_order;
+    uint64_t failed_reads;
+} BroadcastReader;
+
+static void* broadcast_reader(void *arg) {
+    BroadcastReader *rd = (BroadcastReader *)arg;
+    size_t size = (size_t)RING_W * RING_H * 4;
+    uint8_t *frame = (uint8_t *)malloc(size);
+    unsigned reads = 0;
+
+    if (preview_reader_attach(&rd->reader, rd->ring, rd->table, rd->name) != 0) {
+        free(frame);
+        return NULL;
+    }
+    while (rd->running) {
+        PreviewFrameInfo info;
+        uint64_t before = rd->reader.last_frame;
+        int ret = rd->every_frame
+            ? preview_reader_copy_next(&rd->reader, frame, size, &info)
+            : preview_reader_copy_latest(&rd->reader, frame, size, &info);
+        if (ret < 0) {
+            rd->failed_reads++;
+        } else if (ret == 1) {
+            if (!rd->first_frame) rd->first_frame = info.frame_number;
+            if (info.frame_number <= before) rd->out_of_order++;
+            uint8_t expect = (uint8_t)info.frame_number;
+            for (size_t i = 0; i < size; i += 4096) {
+                if (frame[i] != expect) {
+                    rd->torn_delivered++;
+                    break;
+                }
+            }
+        }
+        // copy_next readers only wait when they have caught up
+        if (!rd->every_frame || ret != 1) {
+            ++reads;
+            usleep(rd->stall_every && reads % rd->stall_every == 0 ? rd->stall_us : rd->period_us);
+        } else {
+            usleep(rd->period_us);
+        }
+    }
+    free(frame);
+    return NULL;
+}
+
+// Publish RING_FRAMES more frames at 60 fps, returns the per-frame latencies (us)
+static void broadcast_produce(PreviewRingHeader *ring, uint8_t *src, size_t frame_size, double *latency_us) {
+    for (int i = 0; i < RING_FRAMES; i++) {
+        uint64_t frame_number = ring->published + 1;
+        memset(src, (uint8_t)frame_number, frame_size);
+
+        double t0 = now_ms(CLOCK_MONOTONIC);
+        uint32_t slot;
+        uint8_t *dst = preview_ring_begin_write(ring, &slot);
+        memcpy(dst, src, frame_size);
+        PreviewFrameInfo info = { RING_W, RING_H, RING_W * 4, PREVIEW_FORMAT_BGRA,
+                                  (uint32_t)frame_size, frame_number, (uint64_t)(t0 * 1e6) };
+        preview_ring_commit(ring, slot, &info);
+        latency_us[i] = (now_ms(CLOCK_MONOTONIC) - t0) * 1000.0;
+
+        usleep(RING_FRAME_US);
+    }
+}
+
+// Three readers share the ring: a motion detector that wants every frame,
+// a 30 fps UI and a 5 fps web view that stalls for a second now and then.
+// None may receive a torn frame, each one's delivered + skipped must
+// account for every frame since it started, and the motion detector must
+// not skip. The producer's publish latency is shown with and without
+// readers (on a single core they compete with it for the CPU, not for
+// the ring).
+static int bench_broadcast(void) {
+    size_t frame_size = (size_t)RING_W * RING_H * 4;
+    size_t shm_size = PREVIEW_RING_SHM_SIZE(PREVIEW_RING_SLOTS, PREVIEW_SLOT_SIZE);
+    void *shm = aligned_alloc(64, (shm_size + 63) & ~(size_t)63);
+    PreviewReaderTable *table = (PreviewReaderTable *)aligned_alloc(64, sizeof(PreviewReaderTable));
+    uint8_t *src = (uint8_t *)malloc(frame_size);
+    double *alone_us = (double *)malloc(sizeof(double) * RING_FRAMES);
+    double *shared_us = (double *)malloc(sizeof(double) * RING_FRAMES);
+    if (!shm || !table || !src || !alone_us || !shared_us ||
+        preview_ring_init(shm, shm_size, PREVIEW_RING_SLOTS, PREVIEW_SLOT_SIZE) != 0) {
+        g_printerr("Failed to set up broadcast benchmark\n");
+        free(shm); free(table); free(src); free(alone_us); free(shared_us);
+        return -1;
+    }
+    PreviewRingHeader *ring = (PreviewRingHeader *)shm;
+    preview_readers_init(table);
+
+    broadcast_produce(ring, src, frame_size, alone_us);
+
+    BroadcastReader readers[3] = {
+        { .name = "motion", .every_frame = TRUE, .period_us = 2000 },
+        { .name = "lvgl", .period_us = 33333 },
+        { .name = "web", .period_us = 200000, .stall_every = 5, .stall_us = 1000000 },
+    };
+    pthread_t tids[3];
+    for (int i = 0; i < 3; i++) {
+        readers[i].ring = ring;
+        readers[i].table = table;
+        readers[i].running = 1;
+        pthread_create(&tids[i], NULL, broadcast_reader, &readers[i]);
+    }
+    uint64_t published0 = ring->published;
+    broadcast_produce(ring, src, frame_size, shared_us);
+    for (int i = 0; i < 3; i++) {
+        readers[i].running = 0;
+        pthread_join(tids[i], NULL);
+    }
+
+    g_print("Preview broadcast, %d slots, %dx%d BGRA, %d frames at 60 fps\n",
+            PREVIEW_RING_SLOTS, RING_W, RING_H, RING_FRAMES);
+    g_print("  producer publish latency, no readers:    p50 %.1f us  p99 %.1f us  max %.1f us\n",
+            percentile(alone_us, RING_FRAMES, 50), percentile(alone_us, RING_FRAMES, 99),
+            percentile(alone_us, RING_FRAMES, 100));
+    g_print("  producer publish latency, three readers: p50 %.1f us  p99 %.1f us  max %.1f us\n",
+            percentile(shared_us, RING_FRAMES, 50), percentile(shared_us, RING_FRAMES, 99),
+            percentile(shared_us, RING_FRAMES, 100));
+    preview_readers_print(table, ring->published - published0, stdout);
+
+    int ret = 0;
+    for (int i = 0; i < 3; i++) {
+        BroadcastReader *rd = &readers[i];
+        PreviewReader *r = &rd->reader;
+        uint64_t span = rd->first_frame ? r->last_frame - rd->first_frame + 1 : 0;
+        const char *verdict = "ok";
+        if (!r->entry) {
+            verdict = "NOT REGISTERED";
+        } else if (rd->torn_delivered || rd->out_of_order) {
+            verdict = "TORN OR OUT OF ORDER FRAMES";
+        } else if (r->delivered + r->skipped != span || r->entry->delivered != r->delivered ||
+                   r->entry->skipped != r->skipped) {
+            verdict = "COUNTERS DO NOT ADD UP";
+        } else if (rd->every_frame && r->skipped > RING_FRAMES / 100) {
+            verdict = "FAST READER SKIPPED";
+        }
+        if (strcmp(verdict, "ok") != 0) {
+            ret = 1;
+        }
+        g_print("  %-7s %5llu delivered %5llu skipped %4llu retries %3llu failed reads  %s\n", rd->name,
+                (unsigned long long)r->delivered, (unsigned long long)r->skipped,
+                (unsigned long long)r->retries, (unsigned long long)rd->failed_reads, verdict);
+        preview_reader_close(r);
+    }
+
+    free(shm); free(table); free(src); free(alone_us); free(shared_us);
+    return ret;
+}
+
+/* ---------- zerocopy: appsink memcpy into the ring vs rendering into shm slots ---------- */
+
+static int bench_zerocopy(void) {
+    size_t shm_size = PREVIEW_RING_SHM_SIZE(PREVIEW_RING_SLOTS, PREVIEW_SLOT_SIZE);
+    size_t frame_size = (size_t)PREVIEW_DST_W * PREVIEW_DST_H * 4;
+    uint8_t *last[2] = { (uint8_t *)malloc(frame_size), (uint8_t *)malloc(frame_size) };
+    const char *names[2] = { "copy in on_new_sample", "shm buffer pool" };
+    double wall[2], cpu[2];
+    uint64_t published[2];
+    int ret = 0;
+
+    char desc[512];
+    snprintf(desc, sizeof(desc),
+             "videotestsrc num-buffers=%d pattern=smpte ! video/x-raw,format=NV12,width=%d,height=%d,framerate=30/1 ! "
+             "previewtransform width=%d height=%d method=1 ! appsink name=sink",
+             PREVIEW_FRAMES, PREVIEW_SRC_W, PREVIEW_SRC_H, PREVIEW_DST_W, PREVIEW_DST_H);
+
+    for (int zero_copy = 0; zero_copy < 2 && ret == 0; zero_copy++) {
+        // The ring lives in ordinary memory here; the pool does not care
+        void *ring = aligned_alloc(64, (shm_size + 63) & ~(size_t)63);
+        GstElement *pipeline = parse_pipeline(desc);
+        if (!ring || !last[zero_copy] || !pipeline ||
+            preview_ring_init(ring, shm_size, PREVIEW_RING_SLOTS, PREVIEW_SLOT_SIZE) != 0) {
+            if (pipeline) gst_object_unref(pipeline);
+            free(ring);
+            ret = -1;
+            break;
+        }
+        shm_ptr = ring;
+
+        GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+        setup_preview_sink(sink, zero_copy);
+        gst_object_unref(sink);
+
+        if (run_pipeline(pipeline, &wall[zero_copy], &cpu[zero_copy]) != 0 ||
+            preview_ring_read_latest(ring, last[zero_copy], frame_size, NULL, NULL) != 1) {
+            ret = -1;
+        }
+        published[zero_copy] = ((PreviewRingHeader *)ring)->published;
+        shm_ptr = NULL;
+        free(ring);
+    }
+
+    if (ret == 0) {
+        int same = memcmp(last[0], last[1], frame_size) == 0;
+        g_print("Preview publish, %d frames %dx%d NV12 -> %dx%d BGRA\n",
+                PREVIEW_FRAMES, PREVIEW_SRC_W, PREVIEW_SRC_H, PREVIEW_DST_H, PREVIEW_DST_W);
+        for (int i = 0; i < 2; i++) {
+            g_print("  %-24s %7.2f ms CPU/frame  %7.2f ms wall/frame  %llu published\n", names[i],
+                    cpu[i] / PREVIEW_FRAMES, wall[i] / PREVIEW_FRAMES, (unsigned long long)published[i]);
+        }
+        g_print("  memcpy avoided: %.1f MB/s at 30 fps, last frame %s\n",
+                frame_size * 30 / 1e6, same ? "identical" : "DIFFERS");
+        ret = same ? 0 : 1;
+    }
+    free(last[0]); free(last[1]);
+    return ret;
+}
+
+/* ---------- record: command-to-first-frame latency over the control socket ---------- */
+
+#define RECORD_CYCLES       1000
+#define RECORD_WAIT_US      1000000
+
+static double mono_ms(void) {
+    return now_ms(CLOCK_MONOTONIC);
+}
+
+static int bench_record(void) {
+    VideoConfig config;
+    config_set_defaults(&config);
+    config.record_width = 320;
+    config.record_height = 240;
+    config.record_framerate = 120;
+    strcpy(config.record_dir, "/tmp/record_bench");
+    config.segment_seconds = 60;
+    config.prerecord_seconds = 0;   // start_pipeline applies it to video_prerecord
+
+    // Same element names as create_pipeline() so start_pipeline() finds them
+    char desc[512];
+    snprintf(desc, sizeof(desc),
+             "videotestsrc is-live=true ! video/x-raw,width=%d,height=%d,framerate=%d/1 ! queue ! "
+             "prerecord name=video_prerecord duration=0",
+             config.record_width, config.record_height, config.record_framerate);
+    GstElement *pipeline = parse_pipeline(desc);
+    if (!pipeline) {
+        return -1;
+    }
+    start_pipeline(pipeline, &config);
+
+    int fd = record_ctl_connect();
+    double *ack_ms = (double *)malloc(sizeof(double) * RECORD_CYCLES);
+    double *first_ms = (double *)malloc(sizeof(double) * RECORD_CYCLES);
+    int done = 0, failures = 0, timeouts = 0;
+
+    for (int i = 0; fd >= 0 && ack_ms && first_ms && i < RECORD_CYCLES; i++) {
+        RecordReply reply;
+        double t0 = mono_ms();
+        if (record_ctl_request(fd, RECORD_CMD_START, &reply) != 0) {
+            failures++;
+            break;
+        }
+        double t_ack = mono_ms();
+        if (reply.result != RECORD_OK) {
+            g_printerr("start failed: %s\n", record_result_str(reply.result));
+            failures++;
+            continue;
+        }
+
+        // Wait for the first buffer to reach the muxer
+        guint64 first_ns = 0;
+        for (int waited = 0; waited < RECORD_WAIT_US && first_ns == 0; waited += 100) {
+            first_ns = get_record_first_frame_ns();
+            if (first_ns == 0) usleep(100);
+        }
+        if (first_ns == 0) {
+            timeouts++;
+        } else {
+            ack_ms[done] = t_ack - t0;
+            first_ms[done] = first_ns / 1e6 - t0;
+            done++;
+        }
+
+        if (record_ctl_request(fd, RECORD_CMD_STOP, &reply) != 0 || reply.result != RECORD_OK) {
+            failures++;
+        }
+    }
+
+    record_ctl_close(fd);
+    cleanup_pipeline(pipeline);
+
+    g_print("Record control, %d start/stop cycles (%dx%d@%d videotestsrc)\n",
+            RECORD_CYCLES, config.record_width, config.record_height, config.record_framerate);
+    g_print("  completed %d, failed %d, no frame within %d ms %d\n",
+            done, failures, RECORD_WAIT_US / 1000, timeouts);
+    if (done > 0) {
+        g_print("  command -> ack:          p50 %6.2f ms  p90 %6.2f ms  p99 %6.2f ms  max %6.2f ms\n",
+                percentile(ack_ms, done, 50), percentile(ack_ms, done, 90),
+                percentile(ack_ms, done, 99), percentile(ack_ms, done, 100));
+        g_print("  command -> first frame:  p50 %6.2f ms  p90 %6.2f ms  p99 %6.2f ms  max %6.2f ms\n",
+                percentile(first_ms, done, 50), percentile(first_ms, done, 90),
+                percentile(first_ms, done, 99), percentile(first_ms, done, 100));
+        g_print("  (frame interval %.2f ms bounds the first-frame wait)\n", 1000.0 / config.record_framerate);
+    }
+
+    free(ack_ms); free(first_ms);
+    return (fd < 0 || failures || done == 0) ? 1 : 0;
+}
+
+/* ---------- prerecord: memory bound and hand-over with a software H.265 encoder ---------- */
+
+#define PREREC_FRAMES   600     // 20 s at 30 fps
+#define PREREC_SWITCH   450     // recording starts at 15 s
+#define PREREC_GOP      30
+
+typedef struct {
+    GstElement *pre;
+    int frames_in;
+    GstClockTime switch_ts;
+    guint64 peak_bytes;
+    guint64 peak_time;
+    guint peak_gops;
+    int frames_out;
+    gboolean first_keyframe;
+    GstClockTime first_ts;
+} PrerecordRun;
+
+static GstPadProbeReturn prerecord_in_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    PrerecordRun *run = (PrerecordRun *)user_data;
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+    guint64 bytes, time;
+    guint gops;
+
+    // State left by the previous buffer
+    g_object_get(run->pre, "buffered-bytes", &bytes, "buffered-time", &time, "buffered-gops", &gops, NULL);
+    if (bytes > run->peak_bytes) run->peak_bytes = bytes;
+    if (time > run->peak_time) run->peak_time = time;
+    if (gops > run->peak_gops) run->peak_gops = gops;
+
+    if (++run->frames_in == PREREC_SWITCH) {
+        run->switch_ts = GST_BUFFER_DTS_OR_PTS(buf);
+        g_object_set(run->pre, "recording", TRUE, NULL);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn prerecord_out_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    PrerecordRun *run = (PrerecordRun *)user_data;
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+
+    if (run->frames_out++ == 0) {
+        run->first_keyframe = !GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_DELTA_UNIT);
+        run->first_ts = GST_BUFFER_DTS_OR_PTS(buf);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static int run_prerecord(guint64 duration, guint64 max_bytes, PrerecordRun *run) {
+    char desc[512];
+    snprintf(desc, sizeof(desc),
+             "videotestsrc num-buffers=%d pattern=snow ! video/x-raw,width=640,height=360,framerate=30/1 ! "
+             "x265enc tune=zerolatency speed-preset=ultrafast bitrate=2000 key-int-max=%d ! h265parse ! "
+             "prerecord name=pre duration=%" G_GUINT64_FORMAT " max-bytes=%" G_GUINT64_FORMAT " ! "
+             "fakesink name=sink sync=false",
+             PREREC_FRAMES, PREREC_GOP, duration, max_bytes);
+    GstElement *pipeline = parse_pipeline(desc);
+    if (!pipeline) {
+        return -1;
+    }
+
+    memset(run, 0, sizeof(*run));
+    run->pre = gst_bin_get_by_name(GST_BIN(pipeline), "pre");
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    GstPad *in = gst_element_get_static_pad(run->pre, "sink");
+    GstPad *out = gst_element_get_static_pad(sink, "sink");
+    gst_pad_add_probe(in, GST_PAD_PROBE_TYPE_BUFFER, prerecord_in_probe, run, NULL);
+    gst_pad_add_probe(out, GST_PAD_PROBE_TYPE_BUFFER, prerecord_out_probe, run, NULL);
+    gst_object_unref(in);
+    gst_object_unref(out);
+    gst_object_unref(sink);
+
+    double wall, cpu;
+    int ret = run_pipeline(pipeline, &wall, &cpu);
+    gst_object_unref(run->pre);
+    run->pre = NULL;
+    return ret;
+}
+
+static int bench_prerecord(void) {
+    const guint64 gop_ns = (guint64)PREREC_GOP * GST_SECOND / 30;
+    struct {
+        const char *name;
+        guint64 duration;
+        guint64 max_bytes;
+    } cases[2] = {
+        { "time bound (2 s, 64 MB)",     2 * GST_SECOND,  64 * 1024 * 1024 },
+        { "memory bound (10 s, 400 kB)", 10 * GST_SECOND, 400 * 1000 },
+    };
+    int failed = 0;
+
+    g_print("Pre-record ring, x265enc 640x360@30 snow 2 Mbit/s, GOP %d, record at frame %d of %d\n",
+            PREREC_GOP, PREREC_SWITCH, PREREC_FRAMES);
+    for (int i = 0; i < 2; i++) {
+        PrerecordRun run;
+        if (run_prerecord(cases[i].duration, cases[i].max_bytes, &run) != 0) {
+            return -1;
+        }
+        double covered = GST_CLOCK_TIME_IS_VALID(run.first_ts) && run.switch_ts >= run.first_ts
+            ? (run.switch_ts - run.first_ts) / 1e9 : 0;
+        int ok = run.first_keyframe &&
+                 run.peak_bytes <= cases[i].max_bytes &&
+                 run.peak_time <= cases[i].duration + gop_ns &&
+                 run.frames_out >= PREREC_FRAMES - PREREC_SWITCH;
+        // With room to spare the ring must reach back the full duration
+        if (i == 0) {
+            ok = ok && covered * 1e9 >= cases[i].duration;
+        }
+        failed |= !ok;
+
+        g_print("  %-28s peak %7.1f kB  %5.2f s  %u GOPs | out %d frames, first %s, %.2f s before start  %s\n",
+                cases[i].name, run.peak_bytes / 1000.0, run.peak_time / 1e9, run.peak_gops,
+                run.frames_out, run.first_keyframe ? "keyframe" : "DELTA", covered, ok ? "ok" : "FAIL");
+    }
+    return failed ? 1 : 0;
+}
+
+/* ---------- storage: filesink vs storagesink replaying an H.265 recording ---------- */
+
+// Replays in real time through a leaky 3-buffer queue like enc_queue, so a
+// slow write shows up as a gap at the queue output and as dropped frames.
+// STORAGE_BENCH_DIR should be a tmpfs or loop-mounted image (or the card);
+// STORAGE_BENCH_INPUT an existing recording, otherwise one is encoded.
+#define STORAGE_SRC_FRAMES  900
+#define STORAGE_MAX_SAMPLES 65536
+#define STORAGE_STALL_MS    100
+
+typedef struct {
+    int in;
+    int out;
+    double last_out;
+    int stalls;
+    int n_gaps;
+    double *gaps;
+} StorageRun;
+
+static GstPadProbeReturn storage_in_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    ((StorageRun *)user_data)->in++;
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn storage_out_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    StorageRun *run = (StorageRun *)user_data;
+    double now = mono_ms();
+    if (run->out++ > 0 && run->n_gaps < STORAGE_MAX_SAMPLES) {
+        double gap = now - run->last_out;
+        run->gaps[run->n_gaps++] = gap;
+        if (gap >= STORAGE_STALL_MS) run->stalls++;
+    }
+    run->last_out = now;
+    return GST_PAD_PROBE_OK;
+}
+
+static int run_storage(const char *input, const char *sink_desc, const char *output,
+                       StorageRun *run, StorageSinkStats *stats) {
+    char desc[1024];
+    snprintf(desc, sizeof(desc),
+             "filesrc location=%s ! matroskademux ! h265parse ! identity sync=true ! "
+             "queue name=q max-size-buffers=3 max-size-time=0 max-size-bytes=0 leaky=downstream ! "
+             "matroskamux ! %s name=sink location=%s",
+             input, sink_desc, output);
+    memset(run, 0, sizeof(*run));
+    GstElement *pipeline = parse_pipeline(desc);
+    if (!pipeline) {
+        return -1;
+    }
+
+    run->gaps = (double *)malloc(sizeof(double) * STORAGE_MAX_SAMPLES);
+    GstElement *q = gst_bin_get_by_name(GST_BIN(pipeline), "q");
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    GstPad *in = gst_element_get_static_pad(q, "sink");
+    GstPad *out = gst_element_get_static_pad(q, "src");
+    gst_pad_add_probe(in, GST_PAD_PROBE_TYPE_BUFFER, storage_in_probe, run, NULL);
+    gst_pad_add_probe(out, GST_PAD_PROBE_TYPE_BUFFER, storage_out_probe, run, NULL);
+    gst_object_unref(in);
+    gst_object_unref(out);
+    gst_object_unref(q);
+
+    double wall, cpu;
+    int ret = run->gaps ? run_pipeline(pipeline, &wall, &cpu) : -1;
+    if (stats) {
+        storage_sink_get_stats(sink, stats);
+    }
+    gst_object_unref(sink);
+    return ret;
+}
+
+static int bench_storage(void) {
+    const char *dir = getenv("STORAGE_BENCH_DIR");
+    const char *input = getenv("STORAGE_BENCH_INPUT");
+    char src_path[256], old_path[256], new_path[256];
+    double wall, cpu;
+
+    if (!dir) dir = "/tmp";
+    if (!input) {
+        snprintf(src_path, sizeof(src_path), "/tmp/storage_bench_src.mkv");
+        char desc[512];
+        snprintf(desc, sizeof(desc),
+                 "videotestsrc num-buffers=%d pattern=snow ! video/x-raw,width=1280,height=720,framerate=30/1 ! "
+                 "x265enc speed-preset=ultrafast bitrate=8000 key-int-max=30 ! h265parse ! "
+                 "matroskamux ! filesink location=%s",
+                 STORAGE_SRC_FRAMES, src_path);
+        g_print("Encoding %d frames of test bitstream into %s...\n", STORAGE_SRC_FRAMES, src_path);
+        if (run_launch(desc, &wall, &cpu) != 0) {
+            return -1;
+        }
+        input = src_path;
+    }
+    snprintf(old_path, sizeof(old_path), "%s/storage_bench_filesink.mkv", dir);
+    snprintf(new_path, sizeof(new_path), "%s/storage_bench_storagesink.mkv", dir);
+
+    StorageRun runs[2];
+    StorageSinkStats stats;
+    memset(runs, 0, sizeof(runs));
+    if (run_storage(input, "filesink", old_path, &runs[0], NULL) != 0 ||
+        run_storage(input, "storagesink", new_path, &runs[1], &stats) != 0) {
+        free(runs[0].gaps);
+        free(runs[1].gaps);
+        return -1;
+    }
+
+    // Same muxer input, so both files must come out the same size
+    struct stat st_old, st_new;
+    int same = stat(old_path, &st_old) == 0 && stat(new_path, &st_new) == 0 &&
+               st_old.st_size == st_new.st_size;
+
+    g_print("Storage sink, real-time replay of %s into %s\n", input, dir);
+    const char *names[2] = { "filesink", "storagesink" };
+    for (int i = 0; i < 2; i++) {
+        StorageRun *run = &runs[i];
+        int n = run->n_gaps;
+        g_print("  %-12s in %5d  out %5d  dropped %4d | gap p50 %6.2f ms  p99 %7.2f ms  max %7.2f ms  >=%d ms: %d\n",
+                names[i], run->in, run->out, run->in - run->out,
+                percentile(run->gaps, n, 50), percentile(run->gaps, n, 99), percentile(run->gaps, n, 100),
+                STORAGE_STALL_MS, run->stalls);
+        free(run->gaps);
+    }
+    g_print("storagesink:\n");
+    storage_sink_print_stats(&stats);
+    g_print("  output size %s\n", same ? "identical" : "DIFFERS");
+    return same ? 0 : 1;
+}
+
+/* ---------- reconfig: output gap while settings change on a running pipeline ---------- */
+
+#define RECONFIG_SETTLE_MS  1000
+
+// Longest time between two buffers at one sink since the last reset
+typedef struct {
+    GMutex lock;
+    double last_ms;
+    double max_gap_ms;
+    int frames;
+} ReconfigTap;
+
+static GstPadProbeReturn reconfig_tap_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    ReconfigTap *tap = (ReconfigTap *)user_data;
+    double t = mono_ms();
+    g_mutex_lock(&tap->lock);
+    if (tap->last_ms > 0 && t - tap->last_ms > tap->max_gap_ms) {
+        tap->max_gap_ms = t - tap->last_ms;
+    }
+    tap->last_ms = t;
+    tap->frames++;
+    g_mutex_unlock(&tap->lock);
+    return GST_PAD_PROBE_OK;
+}
+
+static void reconfig_tap_attach(GstElement *pipeline, const char *name, ReconfigTap *tap) {
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), name);
+    GstPad *pad = gst_element_get_static_pad(sink, "sink");
+    g_mutex_init(&tap->lock);
+    tap->last_ms = 0;
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, reconfig_tap_probe, tap, NULL);
+    gst_object_unref(pad);
+    gst_object_unref(sink);
+}
+
+// Returns the largest gap since the previous call, the window starts at the
+// last frame before the change
+static double reconfig_tap_take(ReconfigTap *tap, int *frames) {
+    g_mutex_lock(&tap->lock);
+    double gap = tap->max_gap_ms;
+    *frames = tap->frames;
+    tap->max_gap_ms = 0;
+    tap->frames = 0;
+    g_mutex_unlock(&tap->lock);
+    return gap;
+}
+
+static double preview_interval_ms(const VideoConfig *config) {
+    int fps = config->preview_fps > 0 && config->preview_fps < config->record_framerate
+        ? config->preview_fps : config->record_framerate;
+    return 1000.0 / fps;
+}
+
+// Frames missing from a gap, against the slower of the two frame rates
+static int lost_frames(double gap_ms, double interval_before, double interval_after) {
+    double interval = interval_before > interval_after ? interval_before : interval_after;
+    int lost = (int)(gap_ms / interval + 0.5) - 1;
+    return lost > 0 ? lost : 0;
+}
+
+static int bench_reconfig(void) {
+    static const struct { const char *key, *value; } changes[] = {
+        { "encoder_bitrate_kbps", "2000" },
+        { "encoder_gop", "15" },
+        { "encoder_rc", "vbr" },
+        { "enc_queue_buffers", "6" },
+        { "preview_queue_buffers", "2" },
+        { "preview_rotation", "0" },
+        { "screen_width", "640" },
+        { "preview_fps", "10" },
+        { "preview_fps", "0" },
+        { "prerecord_seconds", "2" },
+        { "record_width", "640" },
+        { "record_height", "480" },
+        { "record_framerate", "15" },
+        { "record_framerate", "30" },
+    };
+    VideoConfig config;
+    config_set_defaults(&config);
+    config.record_width = 320;
+    config.record_height = 240;
+    config.record_framerate = 30;
+    calculate_preview_size(&config, config.screen_width, config.screen_height);
+
+    // Same element names as create_pipeline(); x265enc stands in for mpph265enc
+    GstElement *pipeline = parse_pipeline(
+        "videotestsrc is-live=true do-timestamp=true name=source ! capsfilter name=capture_caps ! tee name=tee "
+        "tee. ! queue name=enc_queue max-size-time=0 leaky=downstream ! "
+        "x265enc name=encoder speed-preset=ultrafast tune=zerolatency ! h265parse ! "
+        "fakesink name=enc_sink sync=false "
+        "tee. ! queue name=app_queue max-size-time=0 leaky=downstream ! "
+        "previewtransform name=preview_transform ! fakesink name=preview_sink sync=false");
+    if (!pipeline) {
+        return -1;
+    }
+    GstElement *filter = gst_bin_get_by_name(GST_BIN(pipeline), "capture_caps");
+    GstCaps *caps = reconfig_capture_caps(&config);
+    g_object_set(G_OBJECT(filter), "caps", caps, NULL);
+    gst_caps_unref(caps);
+    gst_object_unref(filter);
+    reconfig_install(pipeline, &config);
+
+    ReconfigTap enc_tap, preview_tap;
+    reconfig_tap_attach(pipeline, "enc_sink", &enc_tap);
+    reconfig_tap_attach(pipeline, "preview_sink", &preview_tap);
+
+    if (gst_element_set_state(pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        g_printerr("Failed to start reconfig pipeline\n");
+        gst_object_unref(pipeline);
+        return -1;
+    }
+    g_usleep(2 * G_USEC_PER_SEC);   // encoder warm-up
+    int frames;
+    reconfig_tap_take(&enc_tap, &frames);
+    reconfig_tap_take(&preview_tap, &frames);
+
+    g_print("Reconfiguration downtime, %dx%d@%d videotestsrc -> x265enc / previewtransform\n",
+            config.record_width, config.record_height, config.record_framerate);
+    g_print("  %-28s %-8s %9s   %-22s %-22s\n", "setting", "mode", "apply", "encoder gap (lost)", "preview gap (lost)");
+
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(changes) / sizeof(changes[0]); i++) {
+        double enc_before = 1000.0 / config.record_framerate;
+        double preview_before = preview_interval_ms(&config);
+
+        double t0 = mono_ms();
+        int apply = config_set(&config, changes[i].key, changes[i].value);
+        if (apply < 0 || reconfig_apply(pipeline, &config, (ConfigApply)apply) != 0) {
+            g_printerr("Failed to apply %s = %s\n", changes[i].key, changes[i].value);
+            failures++;
+            continue;
+        }
+        double apply_ms = mono_ms() - t0;
+        g_usleep(RECONFIG_SETTLE_MS * 1000);
+
+        int enc_frames, preview_frames;
+        double enc_gap = reconfig_tap_take(&enc_tap, &enc_frames);
+        double preview_gap = reconfig_tap_take(&preview_tap, &preview_frames);
+        int enc_lost = lost_frames(enc_gap, enc_before, 1000.0 / config.record_framerate);
+        int preview_lost = lost_frames(preview_gap, preview_before, preview_interval_ms(&config));
+        if (enc_frames == 0 || preview_frames == 0) {
+            g_printerr("No output after %s = %s\n", changes[i].key, changes[i].value);
+            failures++;
+        }
+        // Live changes must not cost a frame
+        if (apply == CONFIG_APPLY_LIVE && (enc_lost > 0 || preview_lost > 0)) {
+            failures++;
+        }
+
+        char setting[64];
+        snprintf(setting, sizeof(setting), "%s=%s", changes[i].key, changes[i].value);
+        g_print("  %-28s %-8s %6.2f ms   %7.1f ms (%3d)       %7.1f ms (%3d)\n",
+                setting, apply == CONFIG_APPLY_RELINK ? "relink" : "live", apply_ms,
+                enc_gap, enc_lost, preview_gap, preview_lost);
+    }
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    g_print("  (live changes must lose 0 frames; relink cost is the source restart)\n");
+    return failures ? 1 : 0;
+}
+
+/* ---------- pipeline: create_pipeline() end to end in simulation mode ---------- */
+
+#define PIPELINE_WARMUP_MS      2000
+#define PIPELINE_SECONDS        10
+#define PIPELINE_MAX_LATENCY    4096
+
+// One branch of the pipeline: buffers into/out of its queue and the CPU
+// time of the thread that drains it
+typedef struct {
+    const char *name;
+    const char *queue;          // NULL for the capture thread
+    volatile gint in, out;
+    clockid_t thread_clock;
+    volatile gint have_thread;
+} PipelineBranch;
+
+typedef struct {
+    double cpu_ms;
+    gint in, out, level;
+} BranchSnapshot;
+
+typedef struct {
+    GstElement *sink;           // for the base time
+    volatile gint measuring;
+    double samples[PIPELINE_MAX_LATENCY];
+    volatile gint count;
+} LatencyTap;
+
+static GstPadProbeReturn branch_in_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    g_atomic_int_inc(&((PipelineBranch *)user_data)->in);
+    return GST_PAD_PROBE_OK;
+}
+
+// Runs in the streaming thread the branch is measured by
+static GstPadProbeReturn branch_out_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    PipelineBranch *branch = (PipelineBranch *)user_data;
+    if (!g_atomic_int_get(&branch->have_thread)) {
+        if (pthread_getcpuclockid(pthread_self(), &branch->thread_clock) == 0) {
+            g_atomic_int_set(&branch->have_thread, 1);
+        }
+    }
+    g_atomic_int_inc(&branch->out);
+    return GST_PAD_PROBE_OK;
+}
+
+// Capture time (base time + PTS, CLOCK_MONOTONIC) to arrival
+static GstPadProbeReturn latency_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    LatencyTap *tap = (LatencyTap *)user_data;
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (!g_atomic_int_get(&tap->measuring) || !GST_BUFFER_PTS_IS_VALID(buf)) {
+        return GST_PAD_PROBE_OK;
+    }
+    double capture_ms = (gst_element_get_base_time(tap->sink) + GST_BUFFER_PTS(buf)) / 1e6;
+    gint i = g_atomic_int_get(&tap->count);
+    if (i < PIPELINE_MAX_LATENCY) {
+        tap->samples[i] = mono_ms() - capture_ms;
+        g_atomic_int_set(&tap->count, i + 1);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static void add_probe(GstElement *pipeline, const char *element, const char *pad_name,
+                      GstPadProbeCallback callback, gpointer data) {
+    GstElement *e = gst_bin_get_by_name(GST_BIN(pipeline), element);
+    GstPad *pad = gst_element_get_static_pad(e, pad_name);
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, callback, data, NULL);
+    gst_object_unref(pad);
+    gst_object_unref(e);
+}
+
+static void branch_snapshot(GstElement *pipeline, PipelineBranch *branch, BranchSnapshot *snap) {
+    guint level = 0;
+    snap->in = g_atomic_int_get(&branch->in);
+    snap->out = g_atomic_int_get(&branch->out);
+    snap->cpu_ms = g_atomic_int_get(&branch->have_thread) ? now_ms(branch->thread_clock) : 0;
+    if (branch->queue) {
+        GstElement *queue = gst_bin_get_by_name(GST_BIN(pipeline), branch->queue);
+        g_object_get(G_OBJECT(queue), "current-level-buffers", &level, NULL);
+        gst_object_unref(queue);
+    }
+    snap->level = (gint)level;
+}
+
+typedef struct {
+    int width, height, fps;
+} PipelineMode;
+
+static int run_pipeline_mode(const PipelineMode *mode, const char *input, const char *encoder, int seconds) {
+    PipelineBranch branches[] = {
+        { .name = "capture" },
+        { .name = "encoder", .queue = "enc_queue" },
+        { .name = "preview", .queue = "app_queue" },
+        { .name = "audio", .queue = "audio_queue" },
+    };
+    enum { N_BRANCHES = sizeof(branches) / sizeof(branches[0]) };
+    BranchSnapshot before[N_BRANCHES], after[N_BRANCHES];
+    LatencyTap *preview_tap = g_new0(LatencyTap, 1);
+    LatencyTap *encode_tap = g_new0(LatencyTap, 1);
+    int ret = 0;
+
+    VideoConfig config;
+    config_set_defaults(&config);
+    config.simulate = 1;
+    config.record_width = mode->width;
+    config.record_height = mode->height;
+    config.record_framerate = mode->fps;
+    if (input) g_strlcpy(config.sim_input, input, sizeof(config.sim_input));
+    if (encoder) g_strlcpy(config.sim_encoder, encoder, sizeof(config.sim_encoder));
+    calculate_preview_size(&config, config.screen_width, config.screen_height);
+
+    // The preview ring lives in ordinary memory here
+    size_t shm_size = PREVIEW_RING_SHM_SIZE(PREVIEW_RING_SLOTS, PREVIEW_SLOT_SIZE);
+    void *ring = aligned_alloc(64, (shm_size + 63) & ~(size_t)63);
+    if (!ring || preview_ring_init(ring, shm_size, PREVIEW_RING_SLOTS, PREVIEW_SLOT_SIZE) != 0) {
+        free(ring);
+        g_free(preview_tap); g_free(encode_tap);
+        return -1;
+    }
+    shm_ptr = ring;
+
+    GstElement *pipeline = create_pipeline(&config);
+    if (!pipeline) {
+        shm_ptr = NULL;
+        free(ring);
+        g_free(preview_tap); g_free(encode_tap);
+        return -1;
+    }
+    reconfig_install(pipeline, &config);
+
+    // Capture is counted where the source thread pushes into the tee
+    add_probe(pipeline, "tee", "sink", branch_out_probe, &branches[0]);
+    add_probe(pipeline, "tee", "sink", branch_in_probe, &branches[0]);
+    for (int i = 1; i < N_BRANCHES; i++) {
+        add_probe(pipeline, branches[i].queue, "sink", branch_in_probe, &branches[i]);
+        add_probe(pipeline, branches[i].queue, "src", branch_out_probe, &branches[i]);
+    }
+    preview_tap->sink = gst_bin_get_by_name(GST_BIN(pipeline), "app_sink");
+    encode_tap->sink = preview_tap->sink;
+    add_probe(pipeline, "app_sink", "sink", latency_probe, preview_tap);
+    add_probe(pipeline, "video_prerecord", "sink", latency_probe, encode_tap);
+
+    if (gst_element_set_state(pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        g_printerr("Failed to start simulated pipeline\n");
+        ret = -1;
+    } else {
+        g_usleep(PIPELINE_WARMUP_MS * 1000);
+        for (int i = 0; i < N_BRANCHES; i++) branch_snapshot(pipeline, &branches[i], &before[i]);
+        double wall0 = mono_ms(), cpu0 = now_ms(CLOCK_PROCESS_CPUTIME_ID);
+        g_atomic_int_set(&preview_tap->measuring, 1);
+        g_atomic_int_set(&encode_tap->measuring, 1);
+
+        g_usleep((gulong)seconds * G_USEC_PER_SEC);
+
+        g_atomic_int_set(&preview_tap->measuring, 0);
+        g_atomic_int_set(&encode_tap->measuring, 0);
+        for (int i = 0; i < N_BRANCHES; i++) branch_snapshot(pipeline, &branches[i], &after[i]);
+        double wall = mono_ms() - wall0, cpu = now_ms(CLOCK_PROCESS_CPUTIME_ID) - cpu0;
+
+        GstBus *bus = gst_element_get_bus(pipeline);
+        GstMessage *msg = gst_bus_pop_filtered(bus, GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
+        if (msg) {
+            GError *err = NULL;
+            if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+                gst_message_parse_error(msg, &err, NULL);
+                g_printerr("Simulated pipeline error: %s\n", err->message);
+                g_clear_error(&err);
+            } else {
+                g_printerr("Input ended before the measurement did\n");
+            }
+            gst_message_unref(msg);
+            ret = -1;
+        }
+        gst_object_unref(bus);
+
+        g_print("%dx%d@%d, %s, %s encoder, %.1f s\n", mode->width, mode->height, mode->fps,
+                input ? input : "videotestsrc", config.sim_encoder, wall / 1000);
+        g_print("  %-8s %9s %11s %9s %9s\n", "branch", "fps", "CPU ms/s", "CPU %", "dropped");
+        double branch_cpu = 0;
+        for (int i = 0; i < N_BRANCHES; i++) {
+            double fps = (after[i].out - before[i].out) * 1000.0 / wall;
+            double cpu_ms = after[i].cpu_ms - before[i].cpu_ms;
+            int dropped = (after[i].in - after[i].out - after[i].level) -
+                          (before[i].in - before[i].out - before[i].level);
+            branch_cpu += cpu_ms;
+            g_print("  %-8s %9.2f %11.1f %8.1f%% %9d\n", branches[i].name, fps,
+                    cpu_ms * 1000 / wall, cpu_ms * 100 / wall, dropped);
+        }
+        // Encoder worker threads, bus and clock threads
+        g_print("  %-8s %9s %11.1f %8.1f%%\n", "other", "", (cpu - branch_cpu) * 1000 / wall,
+                (cpu - branch_cpu) * 100 / wall);
+        g_print("  %-8s %9s %11.1f %8.1f%%\n", "total", "", cpu * 1000 / wall, cpu * 100 / wall);
+
+        LatencyTap *taps[2] = { encode_tap, preview_tap };
+        const char *names[2] = { "capture -> encoded", "capture -> preview" };
+        for (int i = 0; i < 2; i++) {
+            int n = g_atomic_int_get(&taps[i]->count);
+            if (n > 0) {
+                g_print("  %-19s p50 %6.2f ms  p90 %6.2f ms  p99 %6.2f ms  max %6.2f ms\n", names[i],
+                        percentile(taps[i]->samples, n, 50), percentile(taps[i]->samples, n, 90),
+                        percentile(taps[i]->samples, n, 99), percentile(taps[i]->samples, n, 100));
+            }
+        }
+
+        // Anything well short of the capture rate is a regression
+        double encoded_fps = (after[1].out - before[1].out) * 1000.0 / wall;
+        if (encoded_fps < mode->fps * 0.95) {
+            g_print("  encoder branch BELOW TARGET (%.2f of %d fps)\n", encoded_fps, mode->fps);
+            ret = ret ? ret : 1;
+        }
+    }
+
+    gst_object_unref(preview_tap->sink);
+    cleanup_pipeline(pipeline);
+    shm_ptr = NULL;
+    free(ring);
+    g_free(preview_tap);
+    g_free(encode_tap);
+    return ret;
+}
+
+// PIPELINE_BENCH_MODES="WxH@fps,..." (default 640x480@30,1280x720@30,1920x1080@30),
+// PIPELINE_BENCH_SECONDS, PIPELINE_BENCH_INPUT (file to replay instead of
+// videotestsrc), PIPELINE_BENCH_ENCODER (x265 or x264)
+static int bench_pipeline(void) {
+    const char *modes = getenv("PIPELINE_BENCH_MODES");
+    const char *seconds_env = getenv("PIPELINE_BENCH_SECONDS");
+    const char *input = getenv("PIPELINE_BENCH_INPUT");
+    const char *encoder = getenv("PIPELINE_BENCH_ENCODER");
+    int seconds = seconds_env ? atoi(seconds_env) : PIPELINE_SECONDS;
+    if (!modes) modes = "640x480@30,1280x720@30,1920x1080@30";
+    if (seconds <= 0) seconds = PIPELINE_SECONDS;
+
+    int ret = 0;
+    gchar **list = g_strsplit(modes, ",", -1);
+    for (int i = 0; list[i]; i++) {
+        PipelineMode mode;
+        if (sscanf(list[i], "%dx%d@%d", &mode.width, &mode.height, &mode.fps) != 3 ||
+            mode.width <= 0 || mode.height <= 0 || mode.fps <= 0) {
+            g_printerr("Bad mode %s, expected WxH@fps\n", list[i]);
+            ret = -1;
+            break;
+        }
+        int r = run_pipeline_mode(&mode, input, encoder, seconds);
+        if (r < 0) {
+            ret = -1;
+            break;
+        }
+        if (r > 0) ret = 1;
+    }
+    g_strfreev(list);
+    return ret;
+}
+
+/* ---------- integrity: card stalls against the recording time budget ---------- */
+
+#define INTEGRITY_BUFFER_MS     2000
+#define INTEGRITY_SETTLE_MS     2000
+
+typedef struct {
+    volatile guint stall_ms;    // next buffer sleeps this long, once
+} StallTap;
+
+// storagesink input: holds the muxer's streaming thread like a slow card
+static GstPadProbeReturn stall_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    StallTap *tap = (StallTap *)user_data;
+    guint ms = g_atomic_int_and(&tap->stall_ms, 0);
+    if (ms > 0) {
+        g_usleep((gulong)ms * 1000);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static gboolean attach_stall(GstElement *pipeline, StallTap *tap) {
+    GstElement *record = gst_bin_get_by_name(GST_BIN(pipeline), "record_sink");
+    GstElement *storage = NULL;
+    if (record) {
+        g_object_get(G_OBJECT(record), "sink", &storage, NULL);
+        gst_object_unref(record);
+    }
+    if (!storage) {
+        return FALSE;
+    }
+    GstPad *pad = gst_element_get_static_pad(storage, "sink");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+                      stall_probe, tap, NULL);
+    gst_object_unref(pad);
+    gst_object_unref(storage);
+    return TRUE;
+}
+
+// INTEGRITY_BENCH_STALLS="ms,..." (default 500,1000,1500,2000,3000,4000).
+// Stalls within the record_buffer_ms budget must not lose a frame; longer
+// ones may, but every lost frame must show up as a recorded gap.
+static int bench_integrity(void) {
+    const char *stalls_env = getenv("INTEGRITY_BENCH_STALLS");
+    VideoConfig config;
+    config_set_defaults(&config);
+    config.simulate = 1;
+    config.record_width = 640;
+    config.record_height = 480;
+    config.record_framerate = 30;
+    config.record_integrity = 1;
+    config.record_buffer_ms = INTEGRITY_BUFFER_MS;
+    config.prerecord_seconds = 0;
+    config.segment_seconds = 60;
+    strcpy(config.record_dir, "/tmp/integrity_bench");
+    calculate_preview_size(&config, config.screen_width, config.screen_height);
+
+    size_t shm_size = PREVIEW_RING_SHM_SIZE(PREVIEW_RING_SLOTS, PREVIEW_SLOT_SIZE);
+    void *ring = aligned_alloc(64, (shm_size + 63) & ~(size_t)63);
+    if (!ring || preview_ring_init(ring, shm_size, PREVIEW_RING_SLOTS, PREVIEW_SLOT_SIZE) != 0) {
+        free(ring);
+        return -1;
+    }
+    shm_ptr = ring;
+
+    GstElement *pipeline = create_pipeline(&config);
+    if (!pipeline) {
+        shm_ptr = NULL;
+        free(ring);
+        return -1;
+    }
+    start_pipeline(pipeline, &config);
+    const PipelineStatsBlock *stats = pipeline_probes_stats();
+    int fd = record_ctl_connect();
+    if (fd < 0 || !stats) {
+        g_printerr("Recording control unavailable\n");
+        record_ctl_close(fd);
+        cleanup_pipeline(pipeline);
+        shm_ptr = NULL;
+        free(ring);
+        return -1;
+    }
+    g_usleep(INTEGRITY_SETTLE_MS * 1000);   // encoder warm-up
+
+    g_print("Recording integrity, %dx%d@%d simulated, record_buffer_ms=%d\n",
+            config.record_width, config.record_height, config.record_framerate, config.record_buffer_ms);
+    g_print("  %8s %9s %9s %6s %9s %9s %10s\n", "stall", "dropped", "lost", "gaps", "muxed", "written", "unwritten");
+
+    int failures = 0;
+    gchar **list = g_strsplit(stalls_env ? stalls_env : "500,1000,1500,2000,3000,4000", ",", -1);
+    for (int i = 0; list[i]; i++) {
+        int stall_ms = atoi(list[i]);
+        StallTap tap = { 0 };
+        RecordReply reply;
+        PipelineStatsBlock started;
+        memcpy(&started, stats, sizeof(started));
+
+        if (record_ctl_request(fd, RECORD_CMD_START, &reply) != 0 || reply.result != RECORD_OK ||
+            !attach_stall(pipeline, &tap)) {
+            g_printerr("Failed to start recording\n");
+            failures++;
+            break;
+        }
+        g_usleep(INTEGRITY_SETTLE_MS * 1000);
+        PipelineStatsBlock before;
+        memcpy(&before, stats, sizeof(before));
+
+        g_atomic_int_set(&tap.stall_ms, (guint)stall_ms);
+        // Recover from the backlog, then let the once-a-second refresh catch up
+        g_usleep((gulong)(stall_ms + 2 * INTEGRITY_SETTLE_MS) * 1000);
+        PipelineStatsBlock after;
+        memcpy(&after, stats, sizeof(after));
+
+        if (record_ctl_request(fd, RECORD_CMD_STOP, &reply) != 0 || reply.result != RECORD_OK) {
+            failures++;
+        }
+        PipelineStatsBlock stopped;
+        memcpy(&stopped, stats, sizeof(stopped));
+
+        guint64 dropped = after.queues[PIPELINE_QUEUE_ENCODER].dropped - before.queues[PIPELINE_QUEUE_ENCODER].dropped;
+        guint64 lost = after.record_lost - before.record_lost;
+        guint64 gaps = after.record_gaps - before.record_gaps;
+        // The whole session has to reach the card
+        guint64 muxed = stopped.record_frames - started.record_frames;
+        guint64 written = stopped.record_written - started.record_written;
+        guint64 unwritten = stopped.record_unwritten - started.record_unwritten;
+
+        const char *verdict = "ok";
+        if (stall_ms <= config.record_buffer_ms && lost > 0) {
+            verdict = "LOST FRAMES WITHIN BUDGET";
+        } else if (lost != dropped) {
+            verdict = "UNACCOUNTED DROPS";
+        } else if (unwritten > 0 || written != muxed) {
+            verdict = "FRAMES NOT WRITTEN";
+        }
+        if (strcmp(verdict, "ok") != 0) {
+            failures++;
+        }
+        g_print("  %5d ms %9" G_GUINT64_FORMAT " %9" G_GUINT64_FORMAT " %6" G_GUINT64_FORMAT
+                " %9" G_GUINT64_FORMAT " %9" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT "  %s\n",
+                stall_ms, dropped, lost, gaps, muxed, written, unwritten, verdict);
+    }
+    g_strfreev(list);
+
+    record_ctl_close(fd);
+    cleanup_pipeline(pipeline);
+    shm_ptr = NULL;
+    free(ring);
+    g_print("  (dropped: enc_queue leaks; lost: frames recorded as gaps in the session manifest)\n");
+    return failures ? 1 : 0;
+}
+
+/* ---------- audio: encoder CPU per second of audio ---------- */
+
+#define AUDIO_SECONDS           60
+#define AUDIO_BUFFER_MS         20
+
+static GstPadProbeReturn audio_bytes_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    *(guint64 *)user_data += gst_buffer_get_size(GST_PAD_PROBE_INFO_BUFFER(info));
+    return GST_PAD_PROBE_OK;
+}
+
+// Generated audio as fast as the CPU allows; "input" is the format the
+// sound card would deliver
+static int run_audio(const VideoConfig *config, int rate, int channels, gboolean encode,
+                     int seconds, double *cpu_ms, guint64 *bytes) {
+    char desc[512];
+    int len = snprintf(desc, sizeof(desc),
+                       "audiotestsrc num-buffers=%d samplesperbuffer=%d wave=pink-noise ! "
+                       "audio/x-raw,format=S16LE,layout=interleaved,rate=%d,channels=%d",
+                       seconds * 1000 / AUDIO_BUFFER_MS, rate * AUDIO_BUFFER_MS / 1000, rate, channels);
+    if (encode) {
+        // Same chain as create_pipeline()
+        snprintf(desc + len, sizeof(desc) - len,
+                 " ! audioconvert ! audioresample quality=2 ! capsfilter name=audio_caps ! "
+                 "%s name=audio-encoder ! fakesink", reconfig_audio_encoder_factory(config));
+    } else {
+        snprintf(desc + len, sizeof(desc) - len, " ! fakesink");
+    }
+    GstElement *pipeline = parse_pipeline(desc);
+    if (!pipeline) {
+        return -1;
+    }
+    *bytes = 0;
+    if (encode) {
+        GstElement *filter = gst_bin_get_by_name(GST_BIN(pipeline), "audio_caps");
+        GstCaps *caps = reconfig_audio_caps(config);
+        g_object_set(G_OBJECT(filter), "caps", caps, NULL);
+        gst_caps_unref(caps);
+        gst_object_unref(filter);
+
+        GstElement *enc = gst_bin_get_by_name(GST_BIN(pipeline), "audio-encoder");
+        reconfig_audio_encoder(enc, config);
+        GstPad *pad = gst_element_get_static_pad(enc, "src");
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, audio_bytes_probe, bytes, NULL);
+        gst_object_unref(pad);
+        gst_object_unref(enc);
+    }
+    double wall_ms;
+    return run_pipeline(pipeline, &wall_ms, cpu_ms);
+}
+
+// AUDIO_BENCH_CODECS="opus,aac,..." (default pcm,opus,aac,vorbis),
+// AUDIO_BENCH_SECONDS (of audio per run), AUDIO_BENCH_RATE,
+// AUDIO_BENCH_CHANNELS. Each codec is fed once in its target format (the
+// card delivers it, nothing is resampled) and once from 44.1 kHz stereo.
+static int bench_audio(void) {
+    const char *codecs = getenv("AUDIO_BENCH_CODECS");
+    const char *seconds_env = getenv("AUDIO_BENCH_SECONDS");
+    const char *rate_env = getenv("AUDIO_BENCH_RATE");
+    const char *channels_env = getenv("AUDIO_BENCH_CHANNELS");
+    int seconds = seconds_env ? atoi(seconds_env) : AUDIO_SECONDS;
+    if (seconds <= 0) seconds = AUDIO_SECONDS;
+
+    VideoConfig config;
+    config_set_defaults(&config);
+    if ((rate_env && config_set(&config, "audio_rate", rate_env) < 0) ||
+        (channels_env && config_set(&config, "audio_channels", channels_env) < 0)) {
+        g_printerr("Bad AUDIO_BENCH_RATE/AUDIO_BENCH_CHANNELS\n");
+        return -1;
+    }
+    const struct { const char *name; int rate, channels; } inputs[] = {
+        { "native", config.audio_rate, config.audio_channels },
+        { "44.1k stereo", 44100, 2 },
+    };
+
+    g_print("Audio encoding, %d s of pink noise per run, target %d Hz x %d, %d kbit/s, opus complexity %d\n",
+            seconds, config.audio_rate, config.audio_channels, config.audio_bitrate_kbps, config.audio_complexity);
+    g_print("  %-8s %-13s %12s %9s %10s\n", "codec", "input", "CPU ms/s", "core %", "kbit/s");
+
+    int ret = 0;
+    gchar **list = g_strsplit(codecs ? codecs : "pcm,opus,aac,vorbis", ",", -1);
+    for (int i = 0; list[i]; i++) {
+        if (config_set(&config, "audio_codec", list[i]) < 0) {
+            g_printerr("Unknown codec %s\n", list[i]);
+            ret = -1;
+            break;
+        }
+        for (size_t j = 0; j < sizeof(inputs) / sizeof(inputs[0]); j++) {
+            double base_ms, cpu_ms;
+            guint64 bytes, none;
+            // The generator's own cost is subtracted
+            if (run_audio(&config, inputs[j].rate, inputs[j].channels, FALSE, seconds, &base_ms, &none) != 0 ||
+                run_audio(&config, inputs[j].rate, inputs[j].channels, TRUE, seconds, &cpu_ms, &bytes) != 0) {
+                g_print("  %-8s %-13s  unavailable\n", list[i], inputs[j].name);
+                continue;
+            }
+            double per_second = (cpu_ms - base_ms) / seconds;
+            g_print("  %-8s %-13s %12.2f %8.2f%% %10.1f\n", list[i], inputs[j].name,
+                    per_second, per_second / 10.0, bytes * 8.0 / 1000 / seconds);
+        }
+    }
+    g_strfreev(list);
+    g_print("  (CPU ms/s: encoder-side CPU per second of audio; native input needs no resampling)\n");
+    return ret;
+}
+
+/* ---------- eis: stabilizer cost per frame on a recorded clip ---------- */
+
+#define EIS_FRAMES              300
+#define EIS_FRAME_W             1920
+#define EIS_FRAME_H             1080
+#define EIS_FPS                 30
+#define EIS_GYRO_HZ             200
+#define EIS_SYNTH_OFFSET_NS     1000000000ull   // monotonic time of the test clip's t=0
+
+typedef struct {
+    guint64 mono_ns;
+    float rate[3];
+} EisGyroSample;
+
+typedef struct {
+    GArray *samples;            // EisGyroSample
+    gint64 offset;              // monotonic - file time, from the first IMU block
+    gboolean have_offset;
+} EisGyroLog;
+
+static GstPadProbeReturn eis_telemetry_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    EisGyroLog *log = (EisGyroLog *)user_data;
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    GstMapInfo map;
+    if (!gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+        return GST_PAD_PROBE_OK;
+    }
+    TelemetryBlockHeader header;
+    if (map.size >= sizeof(header)) {
+        memcpy(&header, map.data, sizeof(header));
+    }
+    if (map.size >= sizeof(header) && header.magic == TELEMETRY_BLOCK_MAGIC && header.type == TELEMETRY_IMU &&
+        header.record_size == sizeof(TelemetryImu) &&
+        map.size >= sizeof(header) + (gsize)header.count * header.record_size) {
+        // Block timestamp <-> base_ns ties the file timeline to CLOCK_MONOTONIC
+        if (!log->have_offset && GST_BUFFER_PTS_IS_VALID(buffer)) {
+            log->offset = (gint64)header.base_ns - (gint64)GST_BUFFER_PTS(buffer);
+            log->have_offset = TRUE;
+        }
+        for (guint32 i = 0; i < header.count; i++) {
+            TelemetryImu imu;
+            memcpy(&imu, map.data + sizeof(header) + (gsize)i * header.record_size, sizeof(imu));
+            EisGyroSample sample = { imu.mono_ns, { imu.gyro[0], imu.gyro[1], imu.gyro[2] } };
+            g_array_append_val(log->samples, sample);
+        }
+    }
+    gst_buffer_unmap(buffer, &map);
+    return GST_PAD_PROBE_OK;
+}
+
+// Every demuxed stream goes to a fakesink; telemetry tracks are read on the way
+static void eis_demux_pad_added(GstElement *demux, GstPad *pad, gpointer user_data) {
+    GstElement *pipeline = GST_ELEMENT(gst_element_get_parent(demux));
+    GstElement *sink = gst_element_factory_make("fakesink", NULL);
+    g_object_set(G_OBJECT(sink), "sync", FALSE, NULL);
+    gst_bin_add(GST_BIN(pipeline), sink);
+    GstPad *sink_pad = gst_element_get_static_pad(sink, "sink");
+    GstCaps *caps = gst_pad_query_caps(pad, NULL);
+    if (caps && !gst_caps_is_empty(caps) && gst_structure_has_name(gst_caps_get_structure(caps, 0), "application/x-subtitle-unknown")) {
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, eis_telemetry_probe, user_data, NULL);
+    }
+    if (caps) gst_caps_unref(caps);
+    gst_pad_link(pad, sink_pad);
+    gst_object_unref(sink_pad);
+    gst_element_sync_state_with_parent(sink);
+    gst_object_unref(pipeline);
+}
+
+// The recording's IMU track: the raw gyro, and where the clip sits in time
+static int eis_read_gyro(const char *path, EisGyroLog *log) {
+    gchar *desc = g_strdup_printf("filesrc location=\"%s\" ! matroskademux name=demux", path);
+    GstElement *pipeline = parse_pipeline(desc);
+    g_free(desc);
+    if (!pipeline) {
+        return -1;
+    }
+    GstElement *demux = gst_bin_get_by_name(GST_BIN(pipeline), "demux");
+    g_signal_connect(demux, "pad-added", G_CALLBACK(eis_demux_pad_added), log);
+    gst_object_unref(demux);
+    double wall_ms, cpu_ms;
+    return run_pipeline(pipeline, &wall_ms, &cpu_ms);
+}
+
+// Hand-held shake: a few incommensurate wobbles on every axis plus a slow pan
+static void eis_synth_gyro(EisGyroLog *log, int frames) {
+    guint64 end = EIS_SYNTH_OFFSET_NS + (guint64)(frames + EIS_FPS) * GST_SECOND / EIS_FPS;
+    for (guint64 t = EIS_SYNTH_OFFSET_NS / 2; t < end; t += GST_SECOND / EIS_GYRO_HZ) {
+        double s = t * 1e-9;
+        EisGyroSample sample = { t, {
+            (float)(0.25 * sin(2 * M_PI * 3.1 * s) + 0.08 * sin(2 * M_PI * 8.7 * s)),
+            (float)(0.20 * sin(2 * M_PI * 2.3 * s + 1.0) + 0.06 * sin(2 * M_PI * 7.3 * s) + 0.05),
+            (float)(0.10 * sin(2 * M_PI * 1.7 * s + 2.0)),
+        } };
+        g_array_append_val(log->samples, sample);
+    }
+    log->offset = (gint64)EIS_SYNTH_OFFSET_NS;
+    log->have_offset = TRUE;
+}
+
+static void eis_load_gyro(const EisGyroLog *log) {
+    eis_gyro_reset(log->samples->len);
+    for (guint i = 0; i < log->samples->len; i++) {
+        const EisGyroSample *sample = &g_array_index(log->samples, EisGyroSample, i);
+        eis_gyro_add(sample->mono_ns, sample->rate);
+    }
+}
+
+// Warp of one stabilized frame (synthetic shake), scalar against SIMD
+static int eis_check_kernel(void) {
+    size_t y_size = (size_t)EIS_FRAME_W * EIS_FRAME_H, uv_size = y_size / 2;
+    uint8_t *src = (uint8_t *)malloc(y_size + uv_size);
+    uint8_t *out[2] = { (uint8_t *)malloc(y_size + uv_size), (uint8_t *)malloc(y_size + uv_size) };
+    EisParams params = { EIS_FRAME_W, EIS_FRAME_H, 80.0f, 0.1f, 16.0f, 0.0f, 5 };
+    EisStabilizer *stabilizer = eis_stabilizer_new(&params);
+    EisKernel *kernel = eis_kernel_new(EIS_FRAME_W, EIS_FRAME_H, 1);
+    if (!src || !out[0] || !out[1] || !stabilizer || !kernel) {
+        g_printerr("Out of memory\n");
+        free(src); free(out[0]); free(out[1]);
+        eis_stabilizer_free(stabilizer);
+        eis_kernel_free(kernel);
+        return -1;
+    }
+    srand(1);
+    for (size_t i = 0; i < y_size + uv_size; i++) {
+        src[i] = (uint8_t)rand();
+    }
+    EisGyroLog log = { g_array_new(FALSE, FALSE, sizeof(EisGyroSample)), 0, FALSE };
+    eis_synth_gyro(&log, EIS_FRAMES);
+    eis_load_gyro(&log);
+    g_array_free(log.samples, TRUE);
+    for (int i = 0; i < EIS_FRAMES; i++) {
+        eis_stabilizer_add_frame(stabilizer, EIS_SYNTH_OFFSET_NS + (guint64)i * GST_SECOND / EIS_FPS);
+    }
+    int stabilized = eis_stabilizer_mesh(stabilizer,
+                                         EIS_SYNTH_OFFSET_NS + (guint64)(EIS_FRAMES - 10) * GST_SECOND / EIS_FPS,
+                                         kernel);
+
+    double ms[2];
+    for (int simd = 0; simd < 2; simd++) {
+        eis_kernel_set_simd(kernel, simd);
+        double t0 = now_ms(CLOCK_MONOTONIC);
+        for (int i = 0; i < 30; i++) {
+            eis_kernel_process(kernel, src, EIS_FRAME_W, src + y_size, EIS_FRAME_W,
+                               out[simd], EIS_FRAME_W, out[simd] + y_size, EIS_FRAME_W);
+        }
+        ms[simd] = (now_ms(CLOCK_MONOTONIC) - t0) / 30;
+    }
+    int exact = memcmp(out[0], out[1], y_size + uv_size) == 0;
+    g_print("Warp kernel %dx%d NV12, one thread%s\n", EIS_FRAME_W, EIS_FRAME_H,
+            stabilized ? "" : " (crop only, gyro missing)");
+    g_print("  scalar:        %7.2f ms/frame\n", ms[0]);
+    g_print("  simd (%s):   %7.2f ms/frame  (%.1fx, %s)\n", eis_kernel_simd_name(), ms[1],
+            ms[0] / ms[1], exact ? "bit-exact" : "MISMATCH");
+
+    eis_stabilizer_free(stabilizer);
+    eis_kernel_free(kernel);
+    free(src); free(out[0]); free(out[1]);
+    return exact ? 0 : 1;
+}
+
+// EIS_BENCH_INPUT: a Matroska recording; its IMU track is the gyro log.
+// Without it, 1080p test frames with a synthetic hand-held shake.
+// EIS_BENCH_FRAMES (default 300), EIS_BENCH_THREADS="1,2,4" (default 1,4),
+// EIS_BENCH_LOOKAHEAD. Decoding is not counted: the element's own copy,
+// motion model and warp times are, in wall time per frame against the
+// frame interval.
+static int bench_eis(void) {
+    const char *input = getenv("EIS_BENCH_INPUT");
+    const char *frames_env = getenv("EIS_BENCH_FRAMES");
+    const char *threads_env = getenv("EIS_BENCH_THREADS");
+    const char *lookahead_env = getenv("EIS_BENCH_LOOKAHEAD");
+    int frames = frames_env ? atoi(frames_env) : EIS_FRAMES;
+    int lookahead = lookahead_env ? atoi(lookahead_env) : 5;
+    if (frames <= 0) frames = EIS_FRAMES;
+
+    int ret = eis_check_kernel();
+    if (ret < 0) {
+        return ret;
+    }
+
+    EisGyroLog log = { g_array_new(FALSE, FALSE, sizeof(EisGyroSample)), 0, FALSE };
+    if (input) {
+        if (eis_read_gyro(input, &log) != 0) {
+            g_array_free(log.samples, TRUE);
+            return -1;
+        }
+        if (!log.have_offset || log.samples->len == 0) {
+            g_printerr("%s has no IMU track (recorded with telemetry_tracks = 0?)\n", input);
+            g_array_free(log.samples, TRUE);
+            return -1;
+        }
+    } else {
+        eis_synth_gyro(&log, frames);
+    }
+    g_print("Stabilizing %d frames of %s, gyro: %u samples%s, look-ahead %d\n",
+            frames, input ? input : "1080p30 test video", log.samples->len,
+            input ? " from the IMU track" : " (synthetic shake)", lookahead);
+
+    char src[512];
+    if (input) {
+        snprintf(src, sizeof(src),
+                 "filesrc location=\"%s\" ! matroskademux name=demux demux.video_0 ! decodebin ! "
+                 "videoconvert ! video/x-raw,format=NV12 ! identity eos-after=%d", input, frames);
+    } else {
+        snprintf(src, sizeof(src),
+                 "videotestsrc num-buffers=%d pattern=ball ! "
+                 "video/x-raw,format=NV12,width=%d,height=%d,framerate=%d/1",
+                 frames, EIS_FRAME_W, EIS_FRAME_H, EIS_FPS);
+    }
+
+    g_print("  %7s %-6s %9s %9s %9s %9s %11s\n", "threads", "warp", "copy", "model", "warp", "total", "stabilized");
+    gchar **list = g_strsplit(threads_env ? threads_env : "1,4", ",", -1);
+    for (int i = 0; list[i] && ret == 0; i++) {
+        int threads = atoi(list[i]);
+        for (int simd = 0; simd < 2; simd++) {
+            gchar *desc = g_strdup_printf("%s ! eisstabilize name=eis threads=%d use-simd=%s lookahead=%d "
+                                          "timestamp-offset=%" G_GINT64_FORMAT " ! fakesink sync=false",
+                                          src, threads, simd ? "true" : "false", lookahead, log.offset);
+            GstElement *pipeline = parse_pipeline(desc);
+            g_free(desc);
+            if (!pipeline) {
+                ret = -1;
+                break;
+            }
+            // Same gyro for every run
+            eis_load_gyro(&log);
+            GstElement *eis = gst_bin_get_by_name(GST_BIN(pipeline), "eis");
+            double wall_ms, cpu_ms;
+            if (run_pipeline(pipeline, &wall_ms, &cpu_ms) != 0) {
+                gst_object_unref(eis);
+                ret = -1;
+                break;
+            }
+            EisStabilizeStats stats;
+            eis_stabilize_get_stats(eis, &stats);
+            gst_object_unref(eis);
+            double n = stats.frames ? (double)stats.frames : 1.0;
+            double copy = stats.copy_ns / 1e6 / n, model = stats.model_ns / 1e6 / n, warp = stats.warp_ns / 1e6 / n;
+            g_print("  %7d %-6s %9.2f %9.2f %9.2f %9.2f %5" G_GUINT64_FORMAT "/%-5" G_GUINT64_FORMAT "%s\n",
+                    threads, simd ? eis_kernel_simd_name() : "scalar", copy, model, warp, copy + model + warp,
+                    stats.stabilized, stats.frames,
+                    copy + model + warp > 1000.0 / EIS_FPS ? "  over budget" : "");
+        }
+    }
+    g_strfreev(list);
+    g_array_free(log.samples, TRUE);
+    g_print("  (ms per frame, wall time; %.1f ms is one frame at %d fps)\n", 1000.0 / EIS_FPS, EIS_FPS);
+    return ret;
+}
+
+/* ---------- hud: horizon levelling and attitude overlay on the preview ---------- */
+
+#define HUD_BUDGET_MS   2.0
+#define HUD_FOV_DEG     80.0
+
+// Roll and pitch of frame i: a slow sway through +-15 and +-8 degrees
+static void hud_attitude(int i, float *tilt, float *elevation) {
+    *tilt = (float)(15.0 * M_PI / 180.0 * sin(i * 0.05));
+    *elevation = (float)(8.0 * M_PI / 180.0 * sin(i * 0.031));
+}
+
+// One preview frame the way previewtransform makes it
+static void hud_frame(PreviewKernel *kernel, PreviewHud *hud, int level, int overlay, int i,
+                      const uint8_t *y, const uint8_t *uv, uint8_t *out, int dst_stride) {
+    float tilt, elevation, angle = 0, zoom = 1;
+    hud_attitude(i, &tilt, &elevation);
+    if (level) {
+        angle = tilt;
+        zoom = preview_kernel_level_zoom(kernel, angle);
+    }
+    preview_kernel_set_level(kernel, angle, zoom);
+    preview_kernel_process(kernel, y, PREVIEW_SRC_W, uv, PREVIEW_SRC_W, out, dst_stride);
+    if (overlay) {
+        float focal = (float)(PREVIEW_DST_W / 2.0 / tan(HUD_FOV_DEG * M_PI / 360.0)) * zoom;
+        preview_hud_draw(hud, tilt - angle, elevation, focal);
+        preview_hud_blend(hud, out, dst_stride);
+    }
+}
+
+// HUD_BENCH_FRAMES (default 300). 1080p NV12 into the 800x450 90cw preview
+// with the attitude swaying every frame; levelling and the overlay are
+// timed on top of the plain kernel against the per-frame budget, and each
+// configuration is checked scalar against SIMD.
+static int bench_hud(void) {
+    const char *env = getenv("HUD_BENCH_FRAMES");
+    int frames = env ? atoi(env) : PREVIEW_FRAMES;
+    if (frames < 1) frames = PREVIEW_FRAMES;
+
+    size_t out_size = (size_t)PREVIEW_DST_W * PREVIEW_DST_H * 4;
+    uint8_t *y = (uint8_t *)malloc((size_t)PREVIEW_SRC_W * PREVIEW_SRC_H);
+    uint8_t *uv = (uint8_t *)malloc((size_t)PREVIEW_SRC_W * PREVIEW_SRC_H / 2);
+    uint8_t *out[2] = { (uint8_t *)malloc(out_size), (uint8_t *)malloc(out_size) };
+    PreviewKernel *kernel = preview_kernel_new(PREVIEW_SRC_W, PREVIEW_SRC_H, PREVIEW_DST_W, PREVIEW_DST_H,
+                                               PREVIEW_ROTATE_90CW, PREVIEW_MATRIX_BT709);
+    PreviewHud *hud = preview_hud_new(PREVIEW_DST_W, PREVIEW_DST_H, PREVIEW_ROTATE_90CW);
+    if (!y || !uv || !out[0] || !out[1] || !kernel || !hud) {
+        g_printerr("Out of memory\n");
+        free(y); free(uv); free(out[0]); free(out[1]);
+        preview_kernel_free(kernel);
+        preview_hud_free(hud);
+        return -1;
+    }
+
+    srand(1);
+    for (int r = 0; r < PREVIEW_SRC_H; r++)
+        for (int c = 0; c < PREVIEW_SRC_W; c++)
+            y[r * PREVIEW_SRC_W + c] = (uint8_t)((r + c) / 12 + (rand() & 15));
+    for (int i = 0; i < PREVIEW_SRC_W * PREVIEW_SRC_H / 2; i++)
+        uv[i] = (uint8_t)(96 + (rand() & 63));
+
+    static const struct {
+        const char *name;
+        int level, overlay;
+    } runs[] = {
+        { "plain",       0, 0 },
+        { "level",       1, 0 },
+        { "hud",         0, 1 },
+        { "level + hud", 1, 1 },
+    };
+    int dst_stride = preview_kernel_dst_width(kernel) * 4;
+    double plain_ms = 0;
+    int ret = 0;
+
+    g_print("Preview levelling and HUD, %dx%d NV12 -> %dx%d BGRA rotate 90cw, %d frames (SIMD: %s)\n",
+            PREVIEW_SRC_W, PREVIEW_SRC_H, PREVIEW_DST_W, PREVIEW_DST_H, frames, preview_kernel_simd_name());
+    g_print("  %-12s %10s %10s  %s\n", "stage", "ms/frame", "added", "scalar vs SIMD");
+    for (size_t r = 0; r < G_N_ELEMENTS(runs); r++) {
+        preview_kernel_set_simd(kernel, 1);
+        preview_hud_set_simd(hud, 1);
+        double t0 = now_ms(CLOCK_MONOTONIC);
+        for (int i = 0; i < frames; i++) {
+            hud_frame(kernel, hud, runs[r].level, runs[r].overlay, i, y, uv, out[1], dst_stride);
+        }
+        double ms = (now_ms(CLOCK_MONOTONIC) - t0) / frames;
+        if (r == 0) plain_ms = ms;
+
+        // Last frame again on the scalar paths
+        preview_kernel_set_simd(kernel, 0);
+        preview_hud_set_simd(hud, 0);
+        hud_frame(kernel, hud, runs[r].level, runs[r].overlay, frames - 1, y, uv, out[0], dst_stride);
+        int exact = memcmp(out[0], out[1], out_size) == 0;
+        if (!exact) ret = 1;
+
+        double added = ms - plain_ms;
+        if (r == 0) {
+            g_print("  %-12s %10.2f %10s  %s\n", runs[r].name, ms, "-", exact ? "bit-exact" : "MISMATCH");
+        } else {
+            g_print("  %-12s %10.2f %+10.2f  %s%s\n", runs[r].name, ms, added,
+                    exact ? "bit-exact" : "MISMATCH", added > HUD_BUDGET_MS ? ", OVER BUDGET" : "");
+        }
+    }
+    g_print("  (budget: %.1f ms/frame added on top of the plain preview)\n", HUD_BUDGET_MS);
+
+    preview_kernel_free(kernel);
+    preview_hud_free(hud);
+    free(y); free(uv); free(out[0]); free(out[1]);
+    return ret;
+}
+
+/* ---------- adaptive: preview rate under CPU load ---------- */
+
+#define ADAPTIVE_SETTLE_MS      2000
+
+static volatile gint adaptive_hog_stop = 0;
+
+static gpointer adaptive_hog(gpointer data) {
+    volatile guint64 spins = 0;
+    while (!g_atomic_int_get(&adaptive_hog_stop)) {
+        spins++;
+    }
+    return NULL;
+}
+
+// Once a second: target rate, frames published and process CPU
+static void adaptive_sample(const PipelineStatsBlock *stats, int second, const char *phase,
+                            guint64 *published, double *cpu_ms) {
+    g_usleep(G_USEC_PER_SEC);
+    double cpu = now_ms(CLOCK_PROCESS_CPUTIME_ID);
+    guint64 now = stats->preview_published;
+    g_print("  %4d s  %-6s %6.1f fps target %5" G_GUINT64_FORMAT " published  %6.0f ms CPU/s\n",
+            second, phase, reconfig_preview_fps(), now - *published, cpu - *cpu_ms);
+    *published = now;
+    *cpu_ms = cpu;
+}
+
+// ADAPTIVE_BENCH_HOGS (busy threads, default one per core),
+// ADAPTIVE_BENCH_LOAD_SECONDS, ADAPTIVE_BENCH_CALM_SECONDS. Runs the
+// simulated pipeline with preview_fps_adaptive: the preview must step down
+// while the hogs run and be back at full rate once they stop. The
+// controller logs the CPU each step saved.
+static int bench_adaptive(void) {
+    const char *hogs_env = getenv("ADAPTIVE_BENCH_HOGS");
+    const char *load_env = getenv("ADAPTIVE_BENCH_LOAD_SECONDS");
+    const char *calm_env = getenv("ADAPTIVE_BENCH_CALM_SECONDS");
+    int hogs = hogs_env ? atoi(hogs_env) : (int)g_get_num_processors();
+    int load_seconds = load_env ? atoi(load_env) : 10;
+    int calm_seconds = calm_env ? atoi(calm_env) : 20;
+    if (hogs <= 0) hogs = 1;
+
+    VideoConfig config;
+    config_set_defaults(&config);
+    config.simulate = 1;
+    config.record_width = 640;
+    config.record_height = 480;
+    config.record_framerate = 30;
+    config.preview_fps_adaptive = 1;
+    calculate_preview_size(&config, config.screen_width, config.screen_height);
+
+    size_t shm_size = PREVIEW_RING_SHM_SIZE(PREVIEW_RING_SLOTS, PREVIEW_SLOT_SIZE);
+    void *ring = aligned_alloc(64, (shm_size + 63) & ~(size_t)63);
+    if (!ring || preview_ring_init(ring, shm_size, PREVIEW_RING_SLOTS, PREVIEW_SLOT_SIZE) != 0) {
+        free(ring);
+        return -1;
+    }
+    shm_ptr = ring;
+
+    GstElement *pipeline = create_pipeline(&config);
+    if (!pipeline) {
+        shm_ptr = NULL;
+        free(ring);
+        return -1;
+    }
+    start_pipeline(pipeline, &config);
+    const PipelineStatsBlock *stats = pipeline_probes_stats();
+    if (!stats) {
+        cleanup_pipeline(pipeline);
+        shm_ptr = NULL;
+        free(ring);
+        return -1;
+    }
+    g_usleep(ADAPTIVE_SETTLE_MS * 1000);   // encoder warm-up
+
+    g_print("Adaptive preview rate, %dx%d@%d simulated, %d busy threads for %d s, CPU %d%%/%d%% of %d cores\n",
+            config.record_width, config.record_height, config.record_framerate, hogs, load_seconds,
+            config.preview_cpu_high, config.preview_cpu_low, (int)g_get_num_processors());
+    guint64 published = stats->preview_published;
+    double cpu_ms = now_ms(CLOCK_PROCESS_CPUTIME_ID);
+    int second = 0;
+
+    GThread **threads = g_new0(GThread *, hogs);
+    g_atomic_int_set(&adaptive_hog_stop, 0);
+    for (int i = 0; i < hogs; i++) {
+        threads[i] = g_thread_new("hog", adaptive_hog, NULL);
+    }
+    double lowest = reconfig_preview_fps();
+    for (int i = 0; i < load_seconds; i++) {
+        adaptive_sample(stats, ++second, "load", &published, &cpu_ms);
+        lowest = MIN(lowest, reconfig_preview_fps());
+    }
+    g_atomic_int_set(&adaptive_hog_stop, 1);
+    for (int i = 0; i < hogs; i++) {
+        g_thread_join(threads[i]);
+    }
+    g_free(threads);
+    for (int i = 0; i < calm_seconds; i++) {
+        adaptive_sample(stats, ++second, "calm", &published, &cpu_ms);
+    }
+    double restored = reconfig_preview_fps();
+
+    cleanup_pipeline(pipeline);
+    shm_ptr = NULL;
+    free(ring);
+
+    int ret = 0;
+    if (lowest >= config.record_framerate) {
+        g_print("  FAIL: preview never stepped down under load\n");
+        ret = 1;
+    }
+    if (restored < config.record_framerate) {
+        g_print("  FAIL: preview still at %.1f fps after %d calm seconds\n", restored, calm_seconds);
+        ret = 1;
+    }
+    return ret;
+}
+
+int run_benchmark(const char *name) {
+    if (name && strcmp(name, "preview") == 0) {
+        return bench_preview();
+    }
+    if (name && strcmp(name, "ring") == 0) {
+        return bench_ring();
+    }
+    if (name && strcmp(name, "broadcast") == 0) {
+        return bench_broadcast();
+    }
+    if (name && strcmp(name, "zerocopy") == 0) {
+        return bench_zerocopy();
+    }
+    if (name && strcmp(name, "record") == 0) {
+        return bench_record();
+    }
+    if (name && strcmp(name, "prerecord") == 0) {
+        return bench_prerecord();
+    }
+    if (name && strcmp(name, "storage") == 0) {
+        return bench_storage();
+    }
+    if (name && strcmp(name, "reconfig") == 0) {
+        return bench_reconfig();
+    }
+    if (name && strcmp(name, "pipeline") == 0) {
+        return bench_pipeline();
+    }
+    if (name && strcmp(name, "integrity") == 0) {
+        return bench_integrity();
+    }
+    if (name && strcmp(name, "audio") == 0) {
+        return bench_audio();
+    }
+    if (name && strcmp(name, "eis") == 0) {
+        return bench_eis();
+    }
+    if (name && strcmp(name, "hud") == 0) {
+        return bench_hud();
+    }
+    if (name && strcmp(name, "adaptive") == 0) {
+        return bench_adaptive();
+    }
+    g_printerr("Unknown benchmark: %s\n", name ? name : "(null)");
+    g_printerr("Available: preview, ring, broadcast, zerocopy, record, prerecord, storage, reconfig, pipeline, integrity, audio, eis, hud, adaptive\n");
+    return -1;
+}
@@ -3,25 +3,336 @@
  * @FilePath: /TSPi_Action/Video/src/config.c
  */
 #include "../include/config.h"
+#include "../include/preview_ring.h"
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
 
-VideoConfig* load_config(void) {
-    VideoConfig *config = (VideoConfig *)malloc(sizeof(VideoConfig));
-    if (!config) {
-        return NULL;
-    }
+// 可通过配置文件和控制接口修改的配置项
+typedef enum {
+    FIELD_INT,
+    FIELD_STRING,
+} FieldType;
+
+typedef struct {
+    const char *key;
+    FieldType type;
+    size_t offset;
+    size_t size;            // 字符串容量
+    int min, max;           // 整数取值范围
+    const char *choices;    // 字符串可选值，以 '|' 分隔，NULL 表示不限
+    ConfigApply apply;
+} ConfigField;
+
+#define INT_FIELD(name, lo, hi, how) \
+    { #name, FIELD_INT, offsetof(VideoConfig, name), 0, lo, hi, NULL, how }
+#define STR_FIELD(name, opts, how) \
+    { #name, FIELD_STRING, offsetof(VideoConfig, name), sizeof(((VideoConfig *)0)->name), 0, 0, opts, how }
+
+static const ConfigField config_fields[] = {
+    INT_FIELD(record_width, 160, 4096, CONFIG_APPLY_RELINK),
+    INT_FIELD(record_height, 120, 4096, CONFIG_APPLY_RELINK),
+    INT_FIELD(record_framerate, 1, 240, CONFIG_APPLY_RELINK),
+    INT_FIELD(encoder_bitrate_kbps, 100, 200000, CONFIG_APPLY_LIVE),
+    INT_FIELD(encoder_gop, 0, 1000, CONFIG_APPLY_LIVE),
+    STR_FIELD(encoder_rc, "cbr|vbr|fixqp", CONFIG_APPLY_LIVE),
+    INT_FIELD(preview_fps, 0, 240, CONFIG_APPLY_LIVE),
+    INT_FIELD(preview_fps_adaptive, 0, 1, CONFIG_APPLY_LIVE),
+    INT_FIELD(preview_fps_min, 1, 240, CONFIG_APPLY_LIVE),
+    INT_FIELD(preview_cpu_high, 1, 100, CONFIG_APPLY_LIVE),
+    INT_FIELD(preview_cpu_low, 0, 100, CONFIG_APPLY_LIVE),
+    INT_FIELD(preview_rotation, 0, 270, CONFIG_APPLY_LIVE),
+    INT_FIELD(screen_width, 16, 4096, CONFIG_APPLY_LIVE),
+    INT_FIELD(screen_height, 16, 4096, CONFIG_APPLY_LIVE),
+    INT_FIELD(preview_legacy_shm, 0, 1, CONFIG_APPLY_RESTART),
+    INT_FIELD(record_shm_flag, 0, 1, CONFIG_APPLY_LIVE),
+    INT_FIELD(enc_queue_buffers, 1, 64, CONFIG_APPLY_LIVE),
+    INT_FIELD(preview_queue_buffers, 1, 64, CONFIG_APPLY_LIVE),
+    INT_FIELD(audio_queue_buffers, 1, 64, CONFIG_APPLY_LIVE),
+    INT_FIELD(record_buffer_ms, 100, 60000, CONFIG_APPLY_LIVE),
+    INT_FIELD(record_integrity, 0, 1, CONFIG_APPLY_RESTART),
+    INT_FIELD(prerecord_seconds, 0, 60, CONFIG_APPLY_LIVE),
+    INT_FIELD(prerecord_max_bytes, 0, 256 * 1024 * 1024, CONFIG_APPLY_LIVE),
+    STR_FIELD(record_dir, NULL, CONFIG_APPLY_NEXT_RECORDING),
+    INT_FIELD(segment_seconds, 0, 24 * 3600, CONFIG_APPLY_NEXT_RECORDING),
+    INT_FIELD(segment_max_mb, 0, 4095, CONFIG_APPLY_NEXT_RECORDING),
+    INT_FIELD(storage_chunk_kb, 4, 65536, CONFIG_APPLY_NEXT_RECORDING),
+    INT_FIELD(storage_queue_chunks, 2, 32, CONFIG_APPLY_NEXT_RECORDING),
+    INT_FIELD(storage_prealloc_mb, 0, 4095, CONFIG_APPLY_NEXT_RECORDING),
+    INT_FIELD(storage_sync_ms, 0, 60000, CONFIG_APPLY_NEXT_RECORDING),
+    INT_FIELD(fragment_ms, 100, 60000, CONFIG_APPLY_NEXT_RECORDING),
+    INT_FIELD(record_thumb_seconds, 0, 3600, CONFIG_APPLY_NEXT_RECORDING),
+    INT_FIELD(record_thumb_width, 32, 640, CONFIG_APPLY_NEXT_RECORDING),
+    STR_FIELD(record_container, "mkv|mp4", CONFIG_APPLY_RESTART),
+    STR_FIELD(audio_codec, "opus|aac|pcm|vorbis", CONFIG_APPLY_RESTART),
+    INT_FIELD(audio_rate, 8000, 96000, CONFIG_APPLY_RESTART),
+    INT_FIELD(audio_channels, 1, 2, CONFIG_APPLY_RESTART),
+    INT_FIELD(audio_bitrate_kbps, 6, 510, CONFIG_APPLY_LIVE),
+    INT_FIELD(audio_complexity, 0, 10, CONFIG_APPLY_LIVE),
+    INT_FIELD(telemetry_tracks, 0, 1, CONFIG_APPLY_RESTART),
+    INT_FIELD(eis, 0, 1, CONFIG_APPLY_LIVE),
+    INT_FIELD(eis_lookahead, 0, 15, CONFIG_APPLY_LIVE),
+    INT_FIELD(eis_crop_pct, 0, 25, CONFIG_APPLY_LIVE),
+    INT_FIELD(eis_fov_deg, 10, 170, CONFIG_APPLY_LIVE),
+    INT_FIELD(eis_readout_us, 0, 100000, CONFIG_APPLY_LIVE),
+    INT_FIELD(eis_gyro_offset_us, -500000, 500000, CONFIG_APPLY_LIVE),
+    INT_FIELD(eis_threads, 1, 16, CONFIG_APPLY_LIVE),
+    STR_FIELD(eis_gyro_axes, NULL, CONFIG_APPLY_LIVE),
+    INT_FIELD(preview_level, 0, 1, CONFIG_APPLY_LIVE),
+    INT_FIELD(preview_hud, 0, 1, CONFIG_APPLY_LIVE),
+    INT_FIELD(simulate, 0, 1, CONFIG_APPLY_RESTART),
+    STR_FIELD(sim_input, NULL, CONFIG_APPLY_RESTART),
+    STR_FIELD(sim_encoder, "x265|x264", CONFIG_APPLY_RESTART),
+};
+
+#define CONFIG_FIELD_COUNT (sizeof(config_fields) / sizeof(config_fields[0]))
+
+void config_set_defaults(VideoConfig *config) {
+    memset(config, 0, sizeof(*config));
     // 默认配置：1080p 30fps
     config->record_width = 1920;
     config->record_height = 1080;
     config->record_framerate = 30;
     config->preview_width = 800;    // 预览分辨率稍后计算
     config->preview_height = 480;
-    // TODO: 可扩展为从共享内存或文件读取配置参数
+    strcpy(config->record_dir, "/mnt/sdcard");
+    config->prerecord_seconds = 5;
+    config->prerecord_max_bytes = 16 * 1024 * 1024;  // 5 秒 1080p H.265 约 6 MB，留足余量
+    config->segment_seconds = 300;                   // 每 5 分钟切分一个文件
+    config->segment_max_mb = 2048;                   // 远低于 FAT32 的 4 GB 上限
+    config->storage_chunk_kb = 1024;                 // SD 卡擦除块量级的大块写入
+    config->storage_queue_chunks = 8;                // 8 MB 可吸收数秒的写入卡顿
+    config->storage_prealloc_mb = 64;
+    config->storage_sync_ms = 1000;                  // 掉电最多丢失约 2 秒数据
+    strcpy(config->record_container, "mkv");         // 网页端按 .mkv 列出录像
+    config->fragment_ms = 1000;                      // 与 GOP（1 秒）一致
+    config->record_thumb_seconds = 10;
+    config->record_thumb_width = 160;                // 单张约 5 KB
+    config->encoder_bitrate_kbps = 10000;
+    config->encoder_gop = 0;                         // 每秒一个关键帧
+    strcpy(config->encoder_rc, "cbr");
+    config->preview_fps = 0;
+    config->preview_fps_adaptive = 0;
+    config->preview_fps_min = 5;                     // 仍可看清构图
+    config->preview_cpu_high = 85;
+    config->preview_cpu_low = 60;
+    config->preview_rotation = 90;                   // 竖屏安装，顺时针旋转 90 度
+    config->screen_width = 480;                      // 竖屏 480x800
+    config->screen_height = 800;
+    config->preview_legacy_shm = 0;                  // 仅旧版 UI 需要，多一次整帧复制
+    config->record_shm_flag = 0;                     // 仅旧版 UI 需要，开启后控制线程定时醒来检查
+    strcpy(config->audio_codec, "opus");             // 同等音质下 CPU 远低于 vorbis
+    config->audio_rate = 48000;                      // 声卡原生采样率，免重采样
+    config->audio_channels = 1;                      // 单声道，编码量减半
+    config->audio_bitrate_kbps = 64;
+    config->audio_complexity = 2;
+    config->telemetry_tracks = 1;                    // 与视频同一写入流，网页端无需另取文件
+    config->eis = 0;                                 // 需先按镜头校准视场角和 IMU 轴向
+    config->eis_lookahead = 5;                       // 30fps 下约 170 ms
+    config->eis_crop_pct = 10;
+    config->eis_fov_deg = 80;
+    config->eis_readout_us = 16000;
+    config->eis_gyro_offset_us = 0;
+    config->eis_threads = 4;                         // RK3566 四核 A55
+    strcpy(config->eis_gyro_axes, "+x+y+z");
+    config->preview_level = 0;
+    config->preview_hud = 0;
+    config->enc_queue_buffers = 3;
+    config->preview_queue_buffers = 3;
+    config->audio_queue_buffers = 3;
+    config->record_integrity = 1;
+    config->record_buffer_ms = 4000;                 // 10 Mbit/s 时约 5 MB
+    config->simulate = 0;
+    strcpy(config->sim_encoder, "x265");
+}
+
+VideoConfig* load_config(const char *path) {
+    VideoConfig *config = (VideoConfig *)malloc(sizeof(VideoConfig));
+    if (!config) {
+        return NULL;
+    }
+    config_set_defaults(config);
+    if (path) {
+        strncpy(config->config_path, path, sizeof(config->config_path) - 1);
+        if (config_load_file(config, path) != 0) {
+            printf("Config file %s not found, using defaults\n", path);
+        }
+    }
+    calculate_preview_size(config, config->screen_width, config->screen_height);
     return config;
 }
 
+static const ConfigField* find_field(const char *key) {
+    for (size_t i = 0; i < CONFIG_FIELD_COUNT; i++) {
+        if (strcmp(config_fields[i].key, key) == 0) {
+            return &config_fields[i];
+        }
+    }
+    return NULL;
+}
+
+static int is_choice(const char *choices, const char *value) {
+    size_t len = strlen(value);
+    const char *p = choices;
+    while (p && *p) {
+        const char *end = strchr(p, '|');
+        size_t n = end ? (size_t)(end - p) : strlen(p);
+        if (n == len && strncmp(p, value, n) == 0) {
+            return 1;
+        }
+        p = end ? end + 1 : NULL;
+    }
+    return 0;
+}
+
+// 轴映射：三组 [+-][xyz]，每个轴恰好出现一次
+static int is_axis_map(const char *value) {
+    int used = 0;
+    if (strlen(value) != 6) {
+        return 0;
+    }
+    for (int i = 0; i < 6; i += 2) {
+        char s = value[i], a = value[i + 1];
+        if ((s != '+' && s != '-') || a < 'x' || a > 'z' || (used & (1 << (a - 'x')))) {
+            return 0;
+        }
+        used |= 1 << (a - 'x');
+    }
+    return 1;
+}
+
+int config_set(VideoConfig *config, const char *key, const char *value) {
+    const ConfigField *field = find_field(key);
+    if (!field || !value) {
+        return -1;
+    }
+    void *ptr = (char *)config + field->offset;
+    VideoConfig old = *config;
+
+    if (field->type == FIELD_INT) {
+        char *end;
+        errno = 0;
+        long v = strtol(value, &end, 10);
+        if (errno || end == value || *end || v < field->min || v > field->max) {
+            return -1;
+        }
+        if (strcmp(key, "preview_rotation") == 0 && v % 90 != 0) {
+            return -1;
+        }
+        *(int *)ptr = (int)v;
+    } else {
+        if (strlen(value) >= field->size || (field->choices && !is_choice(field->choices, value))) {
+            return -1;
+        }
+        if (strcmp(key, "eis_gyro_axes") == 0 && !is_axis_map(value)) {
+            return -1;
+        }
+        strcpy((char *)ptr, value);
+    }
+
+    // 预览尺寸跟随屏幕和旋转
+    if (strcmp(key, "screen_width") == 0 || strcmp(key, "screen_height") == 0 ||
+        strcmp(key, "preview_rotation") == 0 || field->apply == CONFIG_APPLY_RELINK) {
+        calculate_preview_size(config, config->screen_width, config->screen_height);
+        // 预览帧须放得进共享内存槽位，否则之后每帧都会被丢弃
+        if ((size_t)config->preview_width * config->preview_height * 4 > PREVIEW_SLOT_SIZE) {
+            *config = old;
+            return -1;
+        }
+    }
+    return field->apply;
+}
+
+int config_get(const VideoConfig *config, const char *key, char *buf, size_t size) {
+    const ConfigField *field = find_field(key);
+    if (!field) {
+        return -1;
+    }
+    const void *ptr = (const char *)config + field->offset;
+    if (field->type == FIELD_INT) {
+        snprintf(buf, size, "%d", *(const int *)ptr);
+    } else {
+        snprintf(buf, size, "%s", (const char *)ptr);
+    }
+    return 0;
+}
+
+static char* trim(char *s) {
+    while (isspace((unsigned char)*s)) s++;
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) end--;
+    *end = '\0';
+    return s;
+}
+
+int config_load_file(VideoConfig *config, const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        return -1;
+    }
+
+    char line[256];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        line_no++;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        char *s = trim(line);
+        if (*s == '\0') {
+            continue;
+        }
+        char *eq = strchr(s, '=');
+        if (!eq) {
+            fprintf(stderr, "%s:%d: expected key = value\n", path, line_no);
+            continue;
+        }
+        *eq = '\0';
+        char *key = trim(s);
+        char *value = trim(eq + 1);
+        if (config_set(config, key, value) < 0) {
+            fprintf(stderr, "%s:%d: invalid setting %s = %s, ignored\n", path, line_no, key, value);
+        }
+    }
+    fclose(fp);
+    calculate_preview_size(config, config->screen_width, config->screen_height);
+    return 0;
+}
+
+int config_save_file(const VideoConfig *config) {
+    char tmp[160];
+    char value[128];
+    if (config->config_path[0] == '\0') {
+        return -1;
+    }
+    snprintf(tmp, sizeof(tmp), "%s.tmp", config->config_path);
+
+    FILE *fp = fopen(tmp, "w");
+    if (!fp) {
+        perror("Failed to write config file");
+        return -1;
+    }
+    fprintf(fp, "# VideoProcess configuration (key = value)\n");
+    for (size_t i = 0; i < CONFIG_FIELD_COUNT; i++) {
+        config_get(config, config_fields[i].key, value, sizeof(value));
+        fprintf(fp, "%s = %s\n", config_fields[i].key, value);
+    }
+    if (fclose(fp) != 0 || rename(tmp, config->config_path) != 0) {
+        perror("Failed to replace config file");
+        return -1;
+    }
+    return 0;
+}
+
 void calculate_preview_size(VideoConfig *config, int screen_width, int screen_height) {
     if (!config) return;
+    // 旋转 90/270 度时，缩放后的画面在屏幕上宽高互换
+    if (config->preview_rotation == 90 || config->preview_rotation == 270) {
+        int t = screen_width;
+        screen_width = screen_height;
+        screen_height = t;
+    }
     float aspect_ratio = (float)config->record_width / config->record_height;
     if (screen_width / aspect_ratio <= screen_height) {
         config->preview_width = screen_width;
@@ -36,4 +347,4 @@ void free_config(VideoConfig *config) {
     if (config) {
         free(config);
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,455 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/src/eis.c
+ */
+#include "eis.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GYRO_DEFAULT_CAPACITY   4096            // 20 s at 200 Hz
+#define GYRO_MAX_GAP_NS         50000000ull     // longer gaps integrate as no motion
+
+#define MAX_LOOKAHEAD           15
+#define FRAME_HISTORY           (2 * MAX_LOOKAHEAD + 2)
+
+// Bisection steps when pulling the smoothed camera back into the margin
+#define LIMIT_STEPS             8
+
+typedef struct {
+    double w, x, y, z;
+} Quat;
+
+typedef struct {
+    uint64_t t;
+    Quat q;                 // camera to world
+} GyroPose;
+
+static struct {
+    pthread_mutex_t lock;
+    GyroPose *ring;
+    unsigned capacity, head, count;
+    int axis[3];            // IMU axis feeding camera x, y, z
+    double sign[3];
+    double last_rate[3];
+    Quat q;
+    uint64_t attitude_t;    // eis_attitude_set
+    double roll, pitch;
+} gyro = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .axis = { 0, 1, 2 },
+    .sign = { 1, 1, 1 },
+};
+
+struct EisStabilizer {
+    EisParams p;
+    uint64_t times[FRAME_HISTORY];      // capture times, oldest first
+    int count;
+    double f;                           // real camera focal length (px)
+    double (*row_rot)[9];               // per mesh row rotation table
+    int cols, rows;
+};
+
+/* ---------- quaternions ---------- */
+
+static const Quat QUAT_IDENTITY = { 1, 0, 0, 0 };
+
+static Quat quat_mul(Quat a, Quat b) {
+    return (Quat){
+        a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+        a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+        a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+        a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+    };
+}
+
+static Quat quat_normalize(Quat q) {
+    double n = sqrt(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+    if (n <= 0) return QUAT_IDENTITY;
+    return (Quat){ q.w / n, q.x / n, q.y / n, q.z / n };
+}
+
+static double quat_dot(Quat a, Quat b) {
+    return a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+// Normalized lerp on the short arc; the angles involved are small enough
+// that it stays within a hair of slerp
+static Quat quat_nlerp(Quat a, Quat b, double t) {
+    if (quat_dot(a, b) < 0) {
+        b = (Quat){ -b.w, -b.x, -b.y, -b.z };
+    }
+    return quat_normalize((Quat){
+        a.w + (b.w - a.w) * t, a.x + (b.x - a.x) * t,
+        a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t,
+    });
+}
+
+// Rotation by angle |v| about v
+static Quat quat_from_rotvec(double x, double y, double z) {
+    double angle = sqrt(x * x + y * y + z * z);
+    if (angle < 1e-12) return QUAT_IDENTITY;
+    double s = sin(angle / 2) / angle;
+    return (Quat){ cos(angle / 2), x * s, y * s, z * s };
+}
+
+// Row-major rotation matrix
+static void quat_to_matrix(Quat q, double m[9]) {
+    double xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    double xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    double wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+    m[0] = 1 - 2 * (yy + zz); m[1] = 2 * (xy - wz);     m[2] = 2 * (xz + wy);
+    m[3] = 2 * (xy + wz);     m[4] = 1 - 2 * (xx + zz); m[5] = 2 * (yz - wx);
+    m[6] = 2 * (xz - wy);     m[7] = 2 * (yz + wx);     m[8] = 1 - 2 * (xx + yy);
+}
+
+/* ---------- gyro store ---------- */
+
+static void gyro_clear_locked(void) {
+    gyro.head = gyro.count = 0;
+    gyro.q = QUAT_IDENTITY;
+    memset(gyro.last_rate, 0, sizeof(gyro.last_rate));
+}
+
+void eis_gyro_reset(unsigned capacity) {
+    if (capacity < 2) capacity = GYRO_DEFAULT_CAPACITY;
+    GyroPose *ring = (GyroPose *)malloc(sizeof(GyroPose) * capacity);
+    pthread_mutex_lock(&gyro.lock);
+    free(gyro.ring);
+    gyro.ring = ring;
+    gyro.capacity = ring ? capacity : 0;
+    gyro_clear_locked();
+    pthread_mutex_unlock(&gyro.lock);
+}
+
+int eis_gyro_set_axes(const char *spec) {
+    int axis[3];
+    double sign[3];
+    int used = 0;
+    if (!spec || strlen(spec) != 6) return -1;
+    for (int i = 0; i < 3; i++) {
+        char s = spec[i * 2], a = spec[i * 2 + 1];
+        if ((s != '+' && s != '-') || a < 'x' || a > 'z' || (used & (1 << (a - 'x')))) {
+            return -1;
+        }
+        used |= 1 << (a - 'x');
+        axis[i] = a - 'x';
+        sign[i] = s == '-' ? -1 : 1;
+    }
+    pthread_mutex_lock(&gyro.lock);
+    // Orientations integrated with another mapping are meaningless
+    if (memcmp(gyro.axis, axis, sizeof(axis)) != 0 || memcmp(gyro.sign, sign, sizeof(sign)) != 0) {
+        memcpy(gyro.axis, axis, sizeof(axis));
+        memcpy(gyro.sign, sign, sizeof(sign));
+        gyro_clear_locked();
+    }
+    pthread_mutex_unlock(&gyro.lock);
+    return 0;
+}
+
+static const GyroPose* gyro_at(unsigned i) {
+    return &gyro.ring[(gyro.head + gyro.capacity - gyro.count + i) % gyro.capacity];
+}
+
+void eis_gyro_add(uint64_t mono_ns, const float rate[3]) {
+    pthread_mutex_lock(&gyro.lock);
+    if (!gyro.ring) {
+        pthread_mutex_unlock(&gyro.lock);
+        eis_gyro_reset(GYRO_DEFAULT_CAPACITY);
+        pthread_mutex_lock(&gyro.lock);
+        if (!gyro.ring) {
+            pthread_mutex_unlock(&gyro.lock);
+            return;
+        }
+    }
+    double w[3];
+    for (int i = 0; i < 3; i++) {
+        w[i] = gyro.sign[i] * rate[gyro.axis[i]];
+    }
+
+    if (gyro.count > 0) {
+        uint64_t last = gyro_at(gyro.count - 1)->t;
+        if (mono_ns <= last) {
+            pthread_mutex_unlock(&gyro.lock);
+            return;
+        }
+        // Body rates, trapezoidal: q' = q * exp(w dt / 2)
+        uint64_t dt_ns = mono_ns - last;
+        if (dt_ns <= GYRO_MAX_GAP_NS) {
+            double dt = dt_ns * 1e-9;
+            Quat dq = quat_from_rotvec((w[0] + gyro.last_rate[0]) * 0.5 * dt,
+                                       (w[1] + gyro.last_rate[1]) * 0.5 * dt,
+                                       (w[2] + gyro.last_rate[2]) * 0.5 * dt);
+            gyro.q = quat_normalize(quat_mul(gyro.q, dq));
+        }
+    }
+    memcpy(gyro.last_rate, w, sizeof(w));
+
+    gyro.ring[gyro.head] = (GyroPose){ mono_ns, gyro.q };
+    gyro.head = (gyro.head + 1) % gyro.capacity;
+    if (gyro.count < gyro.capacity) gyro.count++;
+    pthread_mutex_unlock(&gyro.lock);
+}
+
+uint64_t eis_gyro_latest(void) {
+    pthread_mutex_lock(&gyro.lock);
+    uint64_t t = gyro.count ? gyro_at(gyro.count - 1)->t : 0;
+    pthread_mutex_unlock(&gyro.lock);
+    return t;
+}
+
+void eis_attitude_set(uint64_t mono_ns, float roll, float pitch) {
+    pthread_mutex_lock(&gyro.lock);
+    gyro.attitude_t = mono_ns;
+    gyro.roll = roll;
+    gyro.pitch = pitch;
+    pthread_mutex_unlock(&gyro.lock);
+}
+
+int eis_attitude_camera(uint64_t now_ns, uint64_t max_age_ns, float *tilt, float *elevation) {
+    pthread_mutex_lock(&gyro.lock);
+    uint64_t t = gyro.attitude_t;
+    double roll = gyro.roll, pitch = gyro.pitch;
+    int axis[3];
+    double sign[3];
+    memcpy(axis, gyro.axis, sizeof(axis));
+    memcpy(sign, gyro.sign, sizeof(sign));
+    pthread_mutex_unlock(&gyro.lock);
+
+    if (t == 0 || (now_ns > t && now_ns - t > max_age_ns)) {
+        return -1;
+    }
+
+    // Up in IMU axes, as the filter's accelerometer terms define roll and
+    // pitch, then in camera axes (x right, y down, z forward)
+    double up_imu[3] = {
+        -sin(pitch),
+        sin(roll) * cos(pitch),
+        cos(roll) * cos(pitch),
+    };
+    double up[3];
+    for (int i = 0; i < 3; i++) {
+        up[i] = sign[i] * up_imu[axis[i]];
+    }
+    double z = up[2] > 1 ? 1 : (up[2] < -1 ? -1 : up[2]);
+    *tilt = (float)atan2(up[0], -up[1]);
+    *elevation = (float)asin(z);
+    return 0;
+}
+
+// Orientation at t, interpolated; 0 if t is outside what is stored
+static int gyro_pose_locked(uint64_t t, Quat *q) {
+    if (gyro.count < 2 || t < gyro_at(0)->t || t > gyro_at(gyro.count - 1)->t) {
+        return 0;
+    }
+    unsigned lo = 0, hi = gyro.count - 1;
+    while (hi - lo > 1) {
+        unsigned mid = (lo + hi) / 2;
+        if (gyro_at(mid)->t <= t) lo = mid;
+        else                      hi = mid;
+    }
+    const GyroPose *a = gyro_at(lo), *b = gyro_at(hi);
+    *q = quat_nlerp(a->q, b->q, (double)(t - a->t) / (double)(b->t - a->t));
+    return 1;
+}
+
+/* ---------- stabilizer ---------- */
+
+static void apply_params(EisStabilizer *s, const EisParams *p) {
+    int width = s->p.width, height = s->p.height;
+    s->p = *p;
+    s->p.width = width;
+    s->p.height = height;
+    if (s->p.lookahead < 0) s->p.lookahead = 0;
+    if (s->p.lookahead > MAX_LOOKAHEAD) s->p.lookahead = MAX_LOOKAHEAD;
+    if (s->p.crop < 0) s->p.crop = 0;
+    if (s->p.crop > 0.25f) s->p.crop = 0.25f;
+    if (s->p.fov_deg < 10) s->p.fov_deg = 10;
+    if (s->p.fov_deg > 170) s->p.fov_deg = 170;
+    if (s->p.readout_ms < 0) s->p.readout_ms = 0;
+    s->f = (width / 2.0) / tan(s->p.fov_deg * M_PI / 360.0);
+}
+
+EisStabilizer* eis_stabilizer_new(const EisParams *p) {
+    if (!p || p->width < 4 || p->height < 4) {
+        return NULL;
+    }
+    EisStabilizer *s = (EisStabilizer *)calloc(1, sizeof(EisStabilizer));
+    if (!s) {
+        return NULL;
+    }
+    s->p.width = p->width;
+    s->p.height = p->height;
+    apply_params(s, p);
+    s->cols = (p->width + EIS_MESH_STEP - 1) / EIS_MESH_STEP + 1;
+    s->rows = (p->height + EIS_MESH_STEP - 1) / EIS_MESH_STEP + 1;
+    s->row_rot = malloc(sizeof(*s->row_rot) * s->rows);
+    if (!s->row_rot) {
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+void eis_stabilizer_free(EisStabilizer *s) {
+    if (!s) return;
+    free(s->row_rot);
+    free(s);
+}
+
+void eis_stabilizer_set_params(EisStabilizer *s, const EisParams *p) {
+    if (s && p) apply_params(s, p);
+}
+
+void eis_stabilizer_add_frame(EisStabilizer *s, uint64_t frame_ns) {
+    if (!s) return;
+    if (s->count == FRAME_HISTORY) {
+        memmove(s->times, s->times + 1, sizeof(s->times[0]) * (FRAME_HISTORY - 1));
+        s->count--;
+    }
+    s->times[s->count++] = frame_ns;
+}
+
+void eis_stabilizer_clear(EisStabilizer *s) {
+    if (s) s->count = 0;
+}
+
+// Gyro time of a source row of the frame captured at frame_ns
+static uint64_t row_time(const EisStabilizer *s, uint64_t frame_ns, double row) {
+    double frac = row / s->p.height;
+    if (frac < 0) frac = 0;
+    if (frac > 1) frac = 1;
+    double offset_ns = (s->p.gyro_offset_ms + frac * s->p.readout_ms) * 1e6;
+    if (offset_ns < 0 && (uint64_t)(-offset_ns) > frame_ns) return 0;
+    return (uint64_t)((int64_t)frame_ns + (int64_t)offset_ns);
+}
+
+// Source position of output pixel (u, v): through the virtual camera (v)
+// into the world, back through the real camera (r) and onto the sensor
+static void project(const EisStabilizer *s, const double v[9], const double r[9],
+                    double u, double vv, double *x, double *y) {
+    double cx = s->p.width / 2.0, cy = s->p.height / 2.0;
+    double fv = s->f / (1.0 - 2.0 * s->p.crop);
+    double d[3] = { (u - cx) / fv, (vv - cy) / fv, 1.0 };
+    double w[3], c[3];
+    for (int i = 0; i < 3; i++) {
+        w[i] = v[i * 3] * d[0] + v[i * 3 + 1] * d[1] + v[i * 3 + 2] * d[2];
+    }
+    for (int i = 0; i < 3; i++) {
+        c[i] = r[i] * w[0] + r[3 + i] * w[1] + r[6 + i] * w[2];
+    }
+    if (c[2] < 1e-3) c[2] = 1e-3;
+    *x = cx + s->f * c[0] / c[2];
+    *y = cy + s->f * c[1] / c[2];
+}
+
+// Does the output frame, seen through virtual orientation v, stay on the
+// sensor of real orientation r
+static int fits(const EisStabilizer *s, const double v[9], const double r[9]) {
+    double w = s->p.width, h = s->p.height;
+    const double pts[8][2] = {
+        { 0, 0 }, { w / 2, 0 }, { w, 0 }, { w, h / 2 },
+        { w, h }, { w / 2, h }, { 0, h }, { 0, h / 2 },
+    };
+    for (int i = 0; i < 8; i++) {
+        double x, y;
+        project(s, v, r, pts[i][0], pts[i][1], &x, &y);
+        if (x < 0 || y < 0 || x > w - 1 || y > h - 1) return 0;
+    }
+    return 1;
+}
+
+int eis_stabilizer_mesh(EisStabilizer *s, uint64_t frame_ns, EisKernel *kernel) {
+    int cols, rows;
+    float *mesh = eis_kernel_mesh(kernel, &cols, &rows);
+    if (!s || !mesh || cols != s->cols || rows != s->rows) {
+        return 0;
+    }
+
+    int idx = -1;
+    for (int i = s->count - 1; i >= 0; i--) {
+        if (s->times[i] == frame_ns) {
+            idx = i;
+            break;
+        }
+    }
+    int lookahead = s->p.lookahead;
+    double sigma = lookahead > 0 ? lookahead / 2.0 : 0.5;
+    double half_readout = s->p.height / 2.0;
+
+    pthread_mutex_lock(&gyro.lock);
+    Quat real;
+    int ok = gyro_pose_locked(row_time(s, frame_ns, half_readout), &real);
+    Quat smooth = real;
+    if (ok && idx >= 0) {
+        // Gaussian-weighted mean orientation over the window; frames the
+        // gyro does not cover yet are left out
+        Quat sum = { 0, 0, 0, 0 };
+        for (int i = idx - lookahead; i <= idx + lookahead; i++) {
+            Quat q;
+            if (i < 0 || i >= s->count || !gyro_pose_locked(row_time(s, s->times[i], half_readout), &q)) {
+                continue;
+            }
+            double k = exp(-(double)(i - idx) * (i - idx) / (2 * sigma * sigma));
+            if (quat_dot(q, real) < 0) k = -k;
+            sum.w += q.w * k; sum.x += q.x * k; sum.y += q.y * k; sum.z += q.z * k;
+        }
+        smooth = quat_normalize(sum);
+    }
+    // Real orientation of each mesh row as read out (rolling shutter)
+    for (int i = 0; i < rows; i++) {
+        Quat q = QUAT_IDENTITY;
+        if (ok && !gyro_pose_locked(row_time(s, frame_ns, i * EIS_MESH_STEP), &q)) {
+            q = real;
+        }
+        quat_to_matrix(q, s->row_rot[i]);
+    }
+    pthread_mutex_unlock(&gyro.lock);
+
+    double rm[9], vm[9];
+    if (!ok) {
+        real = smooth = QUAT_IDENTITY;
+    }
+    quat_to_matrix(real, rm);
+
+    // Keep the output inside the margin: pull the virtual camera back
+    // toward the real one as little as needed
+    Quat virt = smooth;
+    quat_to_matrix(virt, vm);
+    if (!fits(s, vm, rm)) {
+        double lo = 0, hi = 1;
+        for (int i = 0; i < LIMIT_STEPS; i++) {
+            double mid = (lo + hi) / 2;
+            quat_to_matrix(quat_nlerp(real, smooth, mid), vm);
+            if (fits(s, vm, rm)) lo = mid;
+            else                 hi = mid;
+        }
+        virt = quat_nlerp(real, smooth, lo);
+        quat_to_matrix(virt, vm);
+    }
+
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            double u = j * EIS_MESH_STEP, v = i * EIS_MESH_STEP;
+            double x, y;
+            // The source row decides the readout time: start from the
+            // output row and refine once from where it lands
+            project(s, vm, s->row_rot[i], u, v, &x, &y);
+            double r = y / EIS_MESH_STEP;
+            int r0 = r < 0 ? 0 : (r >= rows - 1 ? rows - 2 : (int)r);
+            double t = r - r0;
+            if (t < 0) t = 0;
+            if (t > 1) t = 1;
+            double m[9];
+            for (int e = 0; e < 9; e++) {
+                m[e] = s->row_rot[r0][e] + (s->row_rot[r0 + 1][e] - s->row_rot[r0][e]) * t;
+            }
+            project(s, vm, m, u, v, &x, &y);
+            float *p = mesh + ((size_t)i * cols + j) * 2;
+            p[0] = (float)x;
+            p[1] = (float)y;
+        }
+    }
+    return ok;
+}
@@ -0,0 +1,520 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/src/eis_kernel.c
+ */
+#include "eis_kernel.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define EIS_HAVE_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define EIS_HAVE_SSE2 1
+#endif
+
+// Output is produced in spans of one mesh cell. Within a span the source
+// position moves linearly, so it is a 16.16 start plus a per-pixel step.
+#define SPAN EIS_MESH_STEP
+
+// Interpolation weights are 7-bit so the blend fits u8 x u8 -> u16 on NEON
+#define WEIGHT_BITS 7
+#define WEIGHT_ONE  (1 << WEIGHT_BITS)
+
+// Source positions are clamped to this many pixels around the frame so
+// the 16.16 arithmetic cannot overflow whatever the mesh holds
+#define COORD_LIMIT 16384.0f
+
+typedef struct {
+    const uint8_t *src_y, *src_uv;
+    int src_y_stride, src_uv_stride;
+    uint8_t *dst_y, *dst_uv;
+    int dst_y_stride, dst_uv_stride;
+} EisFrame;
+
+typedef struct {
+    EisKernel *kernel;
+    int band;
+} EisWorker;
+
+struct EisKernel {
+    int width, height;
+    int chroma_width, chroma_height;
+    int cols, rows;
+    float *mesh;
+    int use_simd;
+
+    // Bands 1..threads-1 run on the pool, band 0 on the caller
+    int threads;
+    pthread_t *pool;
+    EisWorker *workers;
+    int started;
+    pthread_mutex_t lock;
+    pthread_cond_t wake, done;
+    unsigned generation;
+    int pending;
+    int quit;
+    EisFrame frame;
+};
+
+// One plane as the span code sees it: bpp is 1 for Y, 2 for interleaved UV
+typedef struct {
+    const uint8_t *data;
+    int stride;
+    int bpp;
+    int max_x, max_y;       // last sample index
+} EisPlane;
+
+static inline uint8_t lerp_u8(uint8_t a, uint8_t b, int w) {
+    return (uint8_t)((a * (WEIGHT_ONE - w) + b * w + (WEIGHT_ONE >> 1)) >> WEIGHT_BITS);
+}
+
+static inline int32_t clamp32(int32_t v, int32_t lo, int32_t hi) {
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+static inline int32_t to_fixed(float v) {
+    if (v < -COORD_LIMIT) v = -COORD_LIMIT;
+    if (v > COORD_LIMIT) v = COORD_LIMIT;
+    return (int32_t)lrintf(v * 65536.0f);
+}
+
+// Source position for an output luma position, bilinear between the four
+// surrounding mesh points (extrapolated past the last row / column)
+static void mesh_eval(const EisKernel *k, float x, float y, float *sx, float *sy) {
+    float gx = x / SPAN, gy = y / SPAN;
+    int j = (int)gx, i = (int)gy;
+    if (j > k->cols - 2) j = k->cols - 2;
+    if (i > k->rows - 2) i = k->rows - 2;
+    float fx = gx - j, fy = gy - i;
+    const float *p0 = k->mesh + ((size_t)i * k->cols + j) * 2;
+    const float *p1 = p0 + k->cols * 2;
+    for (int c = 0; c < 2; c++) {
+        float top = p0[c] + (p0[c + 2] - p0[c]) * fx;
+        float bot = p1[c] + (p1[c + 2] - p1[c]) * fx;
+        float v = top + (bot - top) * fy;
+        if (c == 0) *sx = v;
+        else        *sy = v;
+    }
+}
+
+/* ---------- span coordinates: 16.16 position -> index + weight ---------- */
+
+static void coords_scalar(const EisPlane *pl, int32_t sx, int32_t sy, int32_t dx, int32_t dy,
+                          int n, int32_t *ix, int32_t *iy, uint8_t *wx, uint8_t *wy) {
+    int32_t hx = pl->max_x << 16, hy = pl->max_y << 16;
+    for (int i = 0; i < n; i++) {
+        int32_t x = clamp32(sx + dx * i, 0, hx);
+        int32_t y = clamp32(sy + dy * i, 0, hy);
+        // Index stays <= max - 1 so index + 1 is valid; the weight is
+        // then WEIGHT_ONE at the very edge
+        int32_t xi = x >> 16, yi = y >> 16;
+        if (xi > pl->max_x - 1) xi = pl->max_x - 1;
+        if (yi > pl->max_y - 1) yi = pl->max_y - 1;
+        ix[i] = xi;
+        iy[i] = yi;
+        wx[i] = (uint8_t)((x - (xi << 16)) >> (16 - WEIGHT_BITS));
+        wy[i] = (uint8_t)((y - (yi << 16)) >> (16 - WEIGHT_BITS));
+    }
+}
+
+#if defined(EIS_HAVE_SSE2)
+static inline __m128i clamp_epi32(__m128i v, __m128i lo, __m128i hi) {
+    __m128i below = _mm_cmplt_epi32(v, lo);
+    v = _mm_or_si128(_mm_and_si128(below, lo), _mm_andnot_si128(below, v));
+    __m128i above = _mm_cmpgt_epi32(v, hi);
+    return _mm_or_si128(_mm_and_si128(above, hi), _mm_andnot_si128(above, v));
+}
+#endif
+
+// Same as coords_scalar four lanes at a time; n is rounded up to a
+// multiple of 4 (the arrays hold SPAN entries)
+static void coords_simd(const EisPlane *pl, int32_t sx, int32_t sy, int32_t dx, int32_t dy,
+                        int n, int32_t *ix, int32_t *iy, uint8_t *wx, uint8_t *wy) {
+    int i = 0;
+#if defined(EIS_HAVE_NEON)
+    const int32_t lane[4] = { 0, 1, 2, 3 };
+    int32x4_t vl = vld1q_s32(lane);
+    int32x4_t x = vmlaq_n_s32(vdupq_n_s32(sx), vl, dx);
+    int32x4_t y = vmlaq_n_s32(vdupq_n_s32(sy), vl, dy);
+    int32x4_t x4 = vdupq_n_s32(dx * 4), y4 = vdupq_n_s32(dy * 4);
+    int32x4_t zero = vdupq_n_s32(0);
+    int32x4_t hx = vdupq_n_s32(pl->max_x << 16), hy = vdupq_n_s32(pl->max_y << 16);
+    int32x4_t mx = vdupq_n_s32(pl->max_x - 1), my = vdupq_n_s32(pl->max_y - 1);
+    for (; i < n; i += 4) {
+        int32x4_t cx = vminq_s32(vmaxq_s32(x, zero), hx);
+        int32x4_t cy = vminq_s32(vmaxq_s32(y, zero), hy);
+        int32x4_t xi = vminq_s32(vshrq_n_s32(cx, 16), mx);
+        int32x4_t yi = vminq_s32(vshrq_n_s32(cy, 16), my);
+        vst1q_s32(ix + i, xi);
+        vst1q_s32(iy + i, yi);
+        int32x4_t fx = vshrq_n_s32(vsubq_s32(cx, vshlq_n_s32(xi, 16)), 16 - WEIGHT_BITS);
+        int32x4_t fy = vshrq_n_s32(vsubq_s32(cy, vshlq_n_s32(yi, 16)), 16 - WEIGHT_BITS);
+        uint16x4_t px = vmovn_u32(vreinterpretq_u32_s32(fx));
+        uint16x4_t py = vmovn_u32(vreinterpretq_u32_s32(fy));
+        uint8x8_t w = vmovn_u16(vcombine_u16(px, py));
+        vst1_lane_u32((uint32_t *)(void *)(wx + i), vreinterpret_u32_u8(w), 0);
+        vst1_lane_u32((uint32_t *)(void *)(wy + i), vreinterpret_u32_u8(w), 1);
+        x = vaddq_s32(x, x4);
+        y = vaddq_s32(y, y4);
+    }
+#elif defined(EIS_HAVE_SSE2)
+    __m128i x = _mm_setr_epi32(sx, sx + dx, sx + dx * 2, sx + dx * 3);
+    __m128i y = _mm_setr_epi32(sy, sy + dy, sy + dy * 2, sy + dy * 3);
+    __m128i x4 = _mm_set1_epi32(dx * 4), y4 = _mm_set1_epi32(dy * 4);
+    __m128i zero = _mm_setzero_si128();
+    __m128i hx = _mm_set1_epi32(pl->max_x << 16), hy = _mm_set1_epi32(pl->max_y << 16);
+    __m128i mx = _mm_set1_epi32(pl->max_x - 1), my = _mm_set1_epi32(pl->max_y - 1);
+    for (; i < n; i += 4) {
+        __m128i cx = clamp_epi32(x, zero, hx);
+        __m128i cy = clamp_epi32(y, zero, hy);
+        __m128i xi = clamp_epi32(_mm_srai_epi32(cx, 16), zero, mx);
+        __m128i yi = clamp_epi32(_mm_srai_epi32(cy, 16), zero, my);
+        _mm_storeu_si128((__m128i *)(ix + i), xi);
+        _mm_storeu_si128((__m128i *)(iy + i), yi);
+        __m128i fx = _mm_srai_epi32(_mm_sub_epi32(cx, _mm_slli_epi32(xi, 16)), 16 - WEIGHT_BITS);
+        __m128i fy = _mm_srai_epi32(_mm_sub_epi32(cy, _mm_slli_epi32(yi, 16)), 16 - WEIGHT_BITS);
+        // 0..128 per lane: packs twice, then the low 4 bytes of each half
+        __m128i w = _mm_packus_epi16(_mm_packs_epi32(fx, fy), zero);
+        int32_t lo = _mm_cvtsi128_si32(w);
+        int32_t hi = _mm_cvtsi128_si32(_mm_srli_si128(w, 4));
+        memcpy(wx + i, &lo, 4);
+        memcpy(wy + i, &hi, 4);
+        x = _mm_add_epi32(x, x4);
+        y = _mm_add_epi32(y, y4);
+    }
+#endif
+    if (i < n) {
+        coords_scalar(pl, sx + dx * i, sy + dy * i, dx, dy, n - i, ix + i, iy + i, wx + i, wy + i);
+    }
+}
+
+/* ---------- 2x2 blend: lerp(lerp(a, b, wx), lerp(c, d, wx), wy) ---------- */
+
+static void blend_scalar(const uint8_t *a, const uint8_t *b, const uint8_t *c, const uint8_t *d,
+                         const uint8_t *wx, const uint8_t *wy, uint8_t *out, int len) {
+    for (int i = 0; i < len; i++) {
+        out[i] = lerp_u8(lerp_u8(a[i], b[i], wx[i]), lerp_u8(c[i], d[i], wx[i]), wy[i]);
+    }
+}
+
+static void blend_simd(const uint8_t *a, const uint8_t *b, const uint8_t *c, const uint8_t *d,
+                       const uint8_t *wx, const uint8_t *wy, uint8_t *out, int len) {
+    int i = 0;
+#if defined(EIS_HAVE_NEON)
+    const uint8x16_t one = vdupq_n_u8(WEIGHT_ONE);
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t w1 = vld1q_u8(wx + i), w0 = vsubq_u8(one, w1);
+        uint8x16_t v1 = vld1q_u8(wy + i), v0 = vsubq_u8(one, v1);
+        uint8x16_t va = vld1q_u8(a + i), vb = vld1q_u8(b + i);
+        uint8x16_t vc = vld1q_u8(c + i), vd = vld1q_u8(d + i);
+        uint8x8_t top_lo = vrshrn_n_u16(vmlal_u8(vmull_u8(vget_low_u8(va), vget_low_u8(w0)),
+                                                 vget_low_u8(vb), vget_low_u8(w1)), WEIGHT_BITS);
+        uint8x8_t top_hi = vrshrn_n_u16(vmlal_u8(vmull_u8(vget_high_u8(va), vget_high_u8(w0)),
+                                                 vget_high_u8(vb), vget_high_u8(w1)), WEIGHT_BITS);
+        uint8x8_t bot_lo = vrshrn_n_u16(vmlal_u8(vmull_u8(vget_low_u8(vc), vget_low_u8(w0)),
+                                                 vget_low_u8(vd), vget_low_u8(w1)), WEIGHT_BITS);
+        uint8x8_t bot_hi = vrshrn_n_u16(vmlal_u8(vmull_u8(vget_high_u8(vc), vget_high_u8(w0)),
+                                                 vget_high_u8(vd), vget_high_u8(w1)), WEIGHT_BITS);
+        uint8x8_t lo = vrshrn_n_u16(vmlal_u8(vmull_u8(top_lo, vget_low_u8(v0)),
+                                             bot_lo, vget_low_u8(v1)), WEIGHT_BITS);
+        uint8x8_t hi = vrshrn_n_u16(vmlal_u8(vmull_u8(top_hi, vget_high_u8(v0)),
+                                             bot_hi, vget_high_u8(v1)), WEIGHT_BITS);
+        vst1q_u8(out + i, vcombine_u8(lo, hi));
+    }
+#elif defined(EIS_HAVE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(WEIGHT_ONE);
+    const __m128i round = _mm_set1_epi16(WEIGHT_ONE >> 1);
+#define EIS_LERP16(p, q, w1) \
+    _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16((p), _mm_sub_epi16(one, (w1))), \
+                                               _mm_mullo_epi16((q), (w1))), round), WEIGHT_BITS)
+    for (; i + 16 <= len; i += 16) {
+        __m128i w = _mm_loadu_si128((const __m128i *)(wx + i));
+        __m128i v = _mm_loadu_si128((const __m128i *)(wy + i));
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        __m128i vc = _mm_loadu_si128((const __m128i *)(c + i));
+        __m128i vd = _mm_loadu_si128((const __m128i *)(d + i));
+        __m128i wl = _mm_unpacklo_epi8(w, zero), wh = _mm_unpackhi_epi8(w, zero);
+        __m128i vl = _mm_unpacklo_epi8(v, zero), vh = _mm_unpackhi_epi8(v, zero);
+        __m128i top_l = EIS_LERP16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero), wl);
+        __m128i top_h = EIS_LERP16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero), wh);
+        __m128i bot_l = EIS_LERP16(_mm_unpacklo_epi8(vc, zero), _mm_unpacklo_epi8(vd, zero), wl);
+        __m128i bot_h = EIS_LERP16(_mm_unpackhi_epi8(vc, zero), _mm_unpackhi_epi8(vd, zero), wh);
+        __m128i lo = EIS_LERP16(top_l, bot_l, vl);
+        __m128i hi = EIS_LERP16(top_h, bot_h, vh);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi16(lo, hi));
+    }
+#undef EIS_LERP16
+#endif
+    blend_scalar(a + i, b + i, c + i, d + i, wx + i, wy + i, out + i, len - i);
+}
+
+/* ---------- one span of output samples ---------- */
+
+static void remap_span_scalar(const EisPlane *pl, int32_t sx, int32_t sy, int32_t dx, int32_t dy,
+                              int n, uint8_t *out) {
+    int32_t ix[SPAN], iy[SPAN];
+    uint8_t wx[SPAN], wy[SPAN];
+    coords_scalar(pl, sx, sy, dx, dy, n, ix, iy, wx, wy);
+    int bpp = pl->bpp, stride = pl->stride;
+    for (int i = 0; i < n; i++) {
+        const uint8_t *p = pl->data + (size_t)iy[i] * stride + ix[i] * bpp;
+        for (int c = 0; c < bpp; c++) {
+            uint8_t top = lerp_u8(p[c], p[c + bpp], wx[i]);
+            uint8_t bot = lerp_u8(p[stride + c], p[stride + c + bpp], wx[i]);
+            out[i * bpp + c] = lerp_u8(top, bot, wy[i]);
+        }
+    }
+}
+
+// Vector coordinates and blend around a scalar gather of the 2x2
+// neighbourhoods (neither ISA has a byte gather worth using)
+static void remap_span_simd(const EisPlane *pl, int32_t sx, int32_t sy, int32_t dx, int32_t dy,
+                            int n, uint8_t *out) {
+    int32_t ix[SPAN], iy[SPAN];
+    uint8_t wx[SPAN], wy[SPAN];
+    uint8_t a[SPAN * 2], b[SPAN * 2], c[SPAN * 2], d[SPAN * 2];
+    uint8_t bwx[SPAN * 2], bwy[SPAN * 2];
+    coords_simd(pl, sx, sy, dx, dy, n, ix, iy, wx, wy);
+    int stride = pl->stride;
+    if (pl->bpp == 1) {
+        for (int i = 0; i < n; i++) {
+            const uint8_t *p = pl->data + (size_t)iy[i] * stride + ix[i];
+            a[i] = p[0];
+            b[i] = p[1];
+            c[i] = p[stride];
+            d[i] = p[stride + 1];
+        }
+        blend_simd(a, b, c, d, wx, wy, out, n);
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        const uint8_t *p = pl->data + (size_t)iy[i] * stride + ix[i] * 2;
+        a[i * 2] = p[0];          a[i * 2 + 1] = p[1];
+        b[i * 2] = p[2];          b[i * 2 + 1] = p[3];
+        c[i * 2] = p[stride];     c[i * 2 + 1] = p[stride + 1];
+        d[i * 2] = p[stride + 2]; d[i * 2 + 1] = p[stride + 3];
+        bwx[i * 2] = bwx[i * 2 + 1] = wx[i];
+        bwy[i * 2] = bwy[i * 2 + 1] = wy[i];
+    }
+    blend_simd(a, b, c, d, bwx, bwy, out, n * 2);
+}
+
+/* ---------- bands ---------- */
+
+// Output rows [y0, y1) of one plane. scale is output samples per luma
+// pixel (1 or 1/2) and the chroma sample centres sit on 2x + 0.5.
+static void remap_rows(const EisKernel *k, const EisPlane *pl, uint8_t *dst, int dst_stride,
+                       int out_width, int y0, int y1, int simd) {
+    int chroma = pl->bpp == 2;
+    int n_span = chroma ? SPAN / 2 : SPAN;
+    for (int y = y0; y < y1; y++) {
+        float ly = chroma ? y * 2 + 0.5f : (float)y;
+        uint8_t *out = dst + (size_t)y * dst_stride;
+        float x0s, y0s;
+        float lx = chroma ? 0.5f : 0.0f;
+        mesh_eval(k, lx, ly, &x0s, &y0s);
+        for (int x = 0; x < out_width; x += n_span) {
+            int n = out_width - x < n_span ? out_width - x : n_span;
+            float x1s, y1s;
+            mesh_eval(k, lx + SPAN, ly, &x1s, &y1s);
+            float sx = x0s, sy = y0s, dx = (x1s - x0s) / n_span, dy = (y1s - y0s) / n_span;
+            if (chroma) {
+                // Luma position q -> chroma sample (q - 0.5) / 2
+                sx = (sx - 0.5f) * 0.5f;
+                sy = (sy - 0.5f) * 0.5f;
+                dx *= 0.5f;
+                dy *= 0.5f;
+            }
+            int32_t fx = to_fixed(sx), fy = to_fixed(sy);
+            int32_t fdx = to_fixed(dx), fdy = to_fixed(dy);
+            if (simd) remap_span_simd(pl, fx, fy, fdx, fdy, n, out + x * pl->bpp);
+            else      remap_span_scalar(pl, fx, fy, fdx, fdy, n, out + x * pl->bpp);
+            lx += SPAN;
+            x0s = x1s;
+            y0s = y1s;
+        }
+    }
+}
+
+static void run_band(EisKernel *k, int band) {
+    const EisFrame *f = &k->frame;
+    // Bands split the chroma rows so each luma band is whole row pairs
+    int c0 = k->chroma_height * band / k->threads;
+    int c1 = k->chroma_height * (band + 1) / k->threads;
+    int l0 = c0 * 2;
+    int l1 = band == k->threads - 1 ? k->height : c1 * 2;
+    if (l1 > k->height) l1 = k->height;
+
+    EisPlane luma = { f->src_y, f->src_y_stride, 1, k->width - 1, k->height - 1 };
+    EisPlane uv = { f->src_uv, f->src_uv_stride, 2, k->chroma_width - 1, k->chroma_height - 1 };
+    remap_rows(k, &luma, f->dst_y, f->dst_y_stride, k->width, l0, l1, k->use_simd);
+    remap_rows(k, &uv, f->dst_uv, f->dst_uv_stride, k->chroma_width, c0, c1, k->use_simd);
+}
+
+static void* worker_main(void *arg) {
+    EisWorker *w = (EisWorker *)arg;
+    EisKernel *k = w->kernel;
+    unsigned seen = 0;
+    for (;;) {
+        pthread_mutex_lock(&k->lock);
+        while (k->generation == seen && !k->quit) {
+            pthread_cond_wait(&k->wake, &k->lock);
+        }
+        if (k->quit) {
+            pthread_mutex_unlock(&k->lock);
+            break;
+        }
+        seen = k->generation;
+        pthread_mutex_unlock(&k->lock);
+
+        run_band(k, w->band);
+
+        pthread_mutex_lock(&k->lock);
+        if (--k->pending == 0) {
+            pthread_cond_signal(&k->done);
+        }
+        pthread_mutex_unlock(&k->lock);
+    }
+    return NULL;
+}
+
+EisKernel* eis_kernel_new(int width, int height, int threads) {
+    if (width < 4 || height < 4) {
+        return NULL;
+    }
+
+    EisKernel *k = (EisKernel *)calloc(1, sizeof(EisKernel));
+    if (!k) {
+        return NULL;
+    }
+    k->width = width;
+    k->height = height;
+    k->chroma_width = (width + 1) / 2;
+    k->chroma_height = (height + 1) / 2;
+    k->cols = (width + SPAN - 1) / SPAN + 1;
+    k->rows = (height + SPAN - 1) / SPAN + 1;
+    k->use_simd = 1;
+    k->mesh = (float *)malloc(sizeof(float) * 2 * k->cols * k->rows);
+    if (!k->mesh) {
+        eis_kernel_free(k);
+        return NULL;
+    }
+    eis_kernel_set_identity(k);
+
+    if (threads < 1) threads = 1;
+    if (threads > k->chroma_height) threads = k->chroma_height;
+    k->threads = 1;
+    pthread_mutex_init(&k->lock, NULL);
+    pthread_cond_init(&k->wake, NULL);
+    pthread_cond_init(&k->done, NULL);
+    if (threads > 1) {
+        k->pool = (pthread_t *)calloc(threads - 1, sizeof(pthread_t));
+        k->workers = (EisWorker *)calloc(threads - 1, sizeof(EisWorker));
+        if (!k->pool || !k->workers) {
+            eis_kernel_free(k);
+            return NULL;
+        }
+        // Keep whatever started if the system runs out of threads
+        for (int i = 0; i < threads - 1; i++) {
+            k->workers[i].kernel = k;
+            k->workers[i].band = i + 1;
+            if (pthread_create(&k->pool[i], NULL, worker_main, &k->workers[i]) != 0) {
+                break;
+            }
+            k->started++;
+        }
+        k->threads = k->started + 1;
+    }
+    return k;
+}
+
+void eis_kernel_free(EisKernel *k) {
+    if (!k) return;
+    if (k->started) {
+        pthread_mutex_lock(&k->lock);
+        k->quit = 1;
+        pthread_cond_broadcast(&k->wake);
+        pthread_mutex_unlock(&k->lock);
+        for (int i = 0; i < k->started; i++) {
+            pthread_join(k->pool[i], NULL);
+        }
+    }
+    pthread_mutex_destroy(&k->lock);
+    pthread_cond_destroy(&k->wake);
+    pthread_cond_destroy(&k->done);
+    free(k->pool);
+    free(k->workers);
+    free(k->mesh);
+    free(k);
+}
+
+void eis_kernel_set_simd(EisKernel *k, int enable) {
+    if (k) k->use_simd = enable;
+}
+
+const char* eis_kernel_simd_name(void) {
+#if defined(EIS_HAVE_NEON)
+    return "neon";
+#elif defined(EIS_HAVE_SSE2)
+    return "sse2";
+#else
+    return "none";
+#endif
+}
+
+int eis_kernel_threads(const EisKernel *k) {
+    return k ? k->threads : 0;
+}
+
+float* eis_kernel_mesh(EisKernel *k, int *cols, int *rows) {
+    if (!k) return NULL;
+    if (cols) *cols = k->cols;
+    if (rows) *rows = k->rows;
+    return k->mesh;
+}
+
+void eis_kernel_set_identity(EisKernel *k) {
+    if (!k) return;
+    for (int i = 0; i < k->rows; i++) {
+        for (int j = 0; j < k->cols; j++) {
+            float *p = k->mesh + ((size_t)i * k->cols + j) * 2;
+            p[0] = (float)(j * SPAN);
+            p[1] = (float)(i * SPAN);
+        }
+    }
+}
+
+void eis_kernel_process(EisKernel *k,
+                        const uint8_t *src_y, int src_y_stride,
+                        const uint8_t *src_uv, int src_uv_stride,
+                        uint8_t *dst_y, int dst_y_stride,
+                        uint8_t *dst_uv, int dst_uv_stride) {
+    if (!k || !src_y || !src_uv || !dst_y || !dst_uv) return;
+
+    k->frame = (EisFrame){ src_y, src_uv, src_y_stride, src_uv_stride,
+                           dst_y, dst_uv, dst_y_stride, dst_uv_stride };
+    if (k->threads == 1) {
+        run_band(k, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&k->lock);
+    k->pending = k->threads - 1;
+    k->generation++;
+    pthread_cond_broadcast(&k->wake);
+    pthread_mutex_unlock(&k->lock);
+
+    run_band(k, 0);
+
+    pthread_mutex_lock(&k->lock);
+    while (k->pending > 0) {
+        pthread_cond_wait(&k->done, &k->lock);
+    }
+    pthread_mutex_unlock(&k->lock);
+}
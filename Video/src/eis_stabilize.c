@@ -0,0 +1,581 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/src/eis_stabilize.c
+ */
+#include "eis_stabilize.h"
+#include "eis.h"
+#include "eis_kernel.h"
+#include "timebase.h"
+#include <gst/video/video.h>
+
+// A frame waiting for its look-ahead window to fill
+typedef struct {
+    GstBuffer *buffer;      // copy of the input frame
+    guint64 frame_ns;       // capture time
+} EisPending;
+
+struct _GstEisStabilize {
+    GstElement parent;
+
+    GstPad *sinkpad;
+    GstPad *srcpad;
+
+    // Properties and counters (protected by the object lock)
+    gboolean enabled;
+    gint lookahead;
+    gdouble crop;
+    gdouble fov;
+    gdouble readout_ms;
+    gdouble gyro_offset_ms;
+    gint threads;
+    gboolean use_simd;
+    gint64 timestamp_offset;
+    EisStabilizeStats stats;
+
+    // Streaming thread only
+    GstVideoInfo info;
+    gboolean have_info;
+    GstSegment segment;
+    GstBufferPool *pool;        // ring slots and output frames
+    EisKernel *kernel;
+    gint kernel_threads;
+    EisStabilizer *stabilizer;
+    GQueue pending;             // EisPending, oldest first
+};
+
+struct _GstEisStabilizeClass {
+    GstElementClass parent_class;
+};
+
+enum {
+    PROP_0,
+    PROP_ENABLED,
+    PROP_LOOKAHEAD,
+    PROP_CROP,
+    PROP_FOV,
+    PROP_READOUT_MS,
+    PROP_GYRO_OFFSET_MS,
+    PROP_THREADS,
+    PROP_USE_SIMD,
+    PROP_TIMESTAMP_OFFSET,
+};
+
+#define DEFAULT_ENABLED          TRUE
+#define DEFAULT_LOOKAHEAD        5
+#define DEFAULT_CROP             0.1
+#define DEFAULT_FOV              80.0
+#define DEFAULT_READOUT_MS       16.0
+#define DEFAULT_GYRO_OFFSET_MS   0.0
+#define DEFAULT_THREADS          4
+#define DEFAULT_USE_SIMD         TRUE
+#define DEFAULT_TIMESTAMP_OFFSET -1
+
+#define MAX_LOOKAHEAD            15
+#define FALLBACK_FRAME_DURATION  (GST_SECOND / 30)
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE("sink",
+    GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE("NV12")));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE("src",
+    GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE("NV12")));
+
+G_DEFINE_TYPE(GstEisStabilize, gst_eis_stabilize, GST_TYPE_ELEMENT);
+
+static void pending_free(gpointer data) {
+    EisPending *p = (EisPending *)data;
+    gst_buffer_unref(p->buffer);
+    g_free(p);
+}
+
+static void pending_clear(GstEisStabilize *self) {
+    EisPending *p;
+    while ((p = g_queue_pop_head(&self->pending))) {
+        pending_free(p);
+    }
+    if (self->stabilizer) {
+        eis_stabilizer_clear(self->stabilizer);
+    }
+}
+
+static void resources_free(GstEisStabilize *self) {
+    pending_clear(self);
+    if (self->pool) {
+        gst_buffer_pool_set_active(self->pool, FALSE);
+        gst_object_unref(self->pool);
+        self->pool = NULL;
+    }
+    eis_kernel_free(self->kernel);
+    self->kernel = NULL;
+    eis_stabilizer_free(self->stabilizer);
+    self->stabilizer = NULL;
+}
+
+// Snapshot of the properties for this frame. Call with the object lock held.
+static void current_params(GstEisStabilize *self, EisParams *params) {
+    params->width = GST_VIDEO_INFO_WIDTH(&self->info);
+    params->height = GST_VIDEO_INFO_HEIGHT(&self->info);
+    params->fov_deg = (float)self->fov;
+    params->crop = (float)self->crop;
+    params->readout_ms = (float)self->readout_ms;
+    params->gyro_offset_ms = (float)self->gyro_offset_ms;
+    params->lookahead = self->lookahead;
+}
+
+static gboolean ensure_resources(GstEisStabilize *self, const EisParams *params,
+                                 gint threads, gboolean use_simd) {
+    if (!self->pool) {
+        GstCaps *caps = gst_video_info_to_caps(&self->info);
+        GstBufferPool *pool = gst_video_buffer_pool_new();
+        GstStructure *config = gst_buffer_pool_get_config(pool);
+        // Unbounded: the look-ahead ring holds lookahead + 1 frames and
+        // downstream (encoder) keeps a few more
+        gst_buffer_pool_config_set_params(config, caps, (guint)GST_VIDEO_INFO_SIZE(&self->info), 2, 0);
+        gst_caps_unref(caps);
+        if (!gst_buffer_pool_set_config(pool, config) || !gst_buffer_pool_set_active(pool, TRUE)) {
+            gst_object_unref(pool);
+            return FALSE;
+        }
+        self->pool = pool;
+    }
+    if (self->kernel && self->kernel_threads != threads) {
+        eis_kernel_free(self->kernel);
+        self->kernel = NULL;
+    }
+    if (!self->kernel) {
+        self->kernel = eis_kernel_new(params->width, params->height, threads);
+        if (!self->kernel) {
+            return FALSE;
+        }
+        self->kernel_threads = threads;
+    }
+    eis_kernel_set_simd(self->kernel, use_simd);
+    if (!self->stabilizer) {
+        self->stabilizer = eis_stabilizer_new(params);
+        return self->stabilizer != NULL;
+    }
+    eis_stabilizer_set_params(self->stabilizer, params);
+    return TRUE;
+}
+
+// CLOCK_MONOTONIC time the frame was captured at
+static guint64 capture_time(GstEisStabilize *self, GstBuffer *buffer, gint64 offset) {
+    guint64 running = gst_segment_to_running_time(&self->segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+    if (!GST_CLOCK_TIME_IS_VALID(running)) {
+        return 0;
+    }
+    if (offset < 0) {
+        offset = (gint64)gst_element_get_base_time(GST_ELEMENT(self));
+    }
+    return (guint64)offset + running;
+}
+
+static GstBuffer* copy_frame(GstEisStabilize *self, GstBuffer *buffer) {
+    GstBuffer *copy = NULL;
+    if (gst_buffer_pool_acquire_buffer(self->pool, &copy, NULL) != GST_FLOW_OK) {
+        return NULL;
+    }
+    GstVideoFrame in, out;
+    if (!gst_video_frame_map(&in, &self->info, buffer, GST_MAP_READ)) {
+        gst_buffer_unref(copy);
+        return NULL;
+    }
+    if (!gst_video_frame_map(&out, &self->info, copy, GST_MAP_WRITE)) {
+        gst_video_frame_unmap(&in);
+        gst_buffer_unref(copy);
+        return NULL;
+    }
+    gst_video_frame_copy(&out, &in);
+    gst_video_frame_unmap(&out);
+    gst_video_frame_unmap(&in);
+    gst_buffer_copy_into(copy, buffer, GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS, 0, -1);
+    return copy;
+}
+
+// Warp the oldest pending frame into a new buffer and push it
+static GstFlowReturn push_oldest(GstEisStabilize *self) {
+    EisPending *p = g_queue_pop_head(&self->pending);
+    GstBuffer *out = NULL;
+    if (gst_buffer_pool_acquire_buffer(self->pool, &out, NULL) != GST_FLOW_OK) {
+        pending_free(p);
+        return GST_FLOW_FLUSHING;
+    }
+
+    guint64 t0 = timebase_now_ns();
+    int stabilized = eis_stabilizer_mesh(self->stabilizer, p->frame_ns, self->kernel);
+    guint64 t1 = timebase_now_ns();
+
+    GstVideoFrame in, dst;
+    if (!gst_video_frame_map(&in, &self->info, p->buffer, GST_MAP_READ)) {
+        pending_free(p);
+        gst_buffer_unref(out);
+        GST_ELEMENT_ERROR(self, RESOURCE, READ, ("Failed to map frame"), (NULL));
+        return GST_FLOW_ERROR;
+    }
+    if (!gst_video_frame_map(&dst, &self->info, out, GST_MAP_WRITE)) {
+        gst_video_frame_unmap(&in);
+        pending_free(p);
+        gst_buffer_unref(out);
+        GST_ELEMENT_ERROR(self, RESOURCE, WRITE, ("Failed to map frame"), (NULL));
+        return GST_FLOW_ERROR;
+    }
+    eis_kernel_process(self->kernel,
+                       GST_VIDEO_FRAME_PLANE_DATA(&in, 0), GST_VIDEO_FRAME_PLANE_STRIDE(&in, 0),
+                       GST_VIDEO_FRAME_PLANE_DATA(&in, 1), GST_VIDEO_FRAME_PLANE_STRIDE(&in, 1),
+                       GST_VIDEO_FRAME_PLANE_DATA(&dst, 0), GST_VIDEO_FRAME_PLANE_STRIDE(&dst, 0),
+                       GST_VIDEO_FRAME_PLANE_DATA(&dst, 1), GST_VIDEO_FRAME_PLANE_STRIDE(&dst, 1));
+    gst_video_frame_unmap(&dst);
+    gst_video_frame_unmap(&in);
+    guint64 t2 = timebase_now_ns();
+
+    gst_buffer_copy_into(out, p->buffer, GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS, 0, -1);
+    pending_free(p);
+
+    GST_OBJECT_LOCK(self);
+    self->stats.frames++;
+    self->stats.stabilized += stabilized ? 1 : 0;
+    self->stats.model_ns += t1 - t0;
+    self->stats.warp_ns += t2 - t1;
+    GST_OBJECT_UNLOCK(self);
+
+    return gst_pad_push(self->srcpad, out);
+}
+
+static GstFlowReturn drain(GstEisStabilize *self) {
+    GstFlowReturn ret = GST_FLOW_OK;
+    while (ret == GST_FLOW_OK && self->pending.length > 0) {
+        ret = push_oldest(self);
+    }
+    pending_clear(self);
+    return ret;
+}
+
+static GstFlowReturn gst_eis_stabilize_chain(GstPad *pad, GstObject *parent, GstBuffer *buffer) {
+    GstEisStabilize *self = GST_EIS_STABILIZE(parent);
+
+    if (!self->have_info) {
+        gst_buffer_unref(buffer);
+        return GST_FLOW_NOT_NEGOTIATED;
+    }
+
+    EisParams params;
+    GST_OBJECT_LOCK(self);
+    gboolean enabled = self->enabled;
+    gint threads = self->threads;
+    gboolean use_simd = self->use_simd;
+    gint64 offset = self->timestamp_offset;
+    current_params(self, &params);
+    GST_OBJECT_UNLOCK(self);
+
+    // Switched off: hand over what is queued, then pass through
+    if (!enabled) {
+        GstFlowReturn ret = drain(self);
+        if (ret != GST_FLOW_OK) {
+            gst_buffer_unref(buffer);
+            return ret;
+        }
+        return gst_pad_push(self->srcpad, buffer);
+    }
+
+    if (!ensure_resources(self, &params, threads, use_simd)) {
+        gst_buffer_unref(buffer);
+        GST_ELEMENT_ERROR(self, RESOURCE, FAILED, ("Failed to set up stabilization for %dx%d",
+                          params.width, params.height), (NULL));
+        return GST_FLOW_ERROR;
+    }
+
+    // The camera buffer goes back right away; only the copy waits
+    guint64 frame_ns = capture_time(self, buffer, offset);
+    guint64 t0 = timebase_now_ns();
+    GstBuffer *copy = copy_frame(self, buffer);
+    guint64 t1 = timebase_now_ns();
+    gst_buffer_unref(buffer);
+    if (!copy) {
+        return GST_FLOW_FLUSHING;
+    }
+    GST_OBJECT_LOCK(self);
+    self->stats.copy_ns += t1 - t0;
+    GST_OBJECT_UNLOCK(self);
+
+    EisPending *p = g_new0(EisPending, 1);
+    p->buffer = copy;
+    p->frame_ns = frame_ns;
+    g_queue_push_tail(&self->pending, p);
+    eis_stabilizer_add_frame(self->stabilizer, frame_ns);
+
+    GstFlowReturn ret = GST_FLOW_OK;
+    while (ret == GST_FLOW_OK && self->pending.length > (guint)params.lookahead) {
+        ret = push_oldest(self);
+    }
+    return ret;
+}
+
+static gboolean gst_eis_stabilize_sink_event(GstPad *pad, GstObject *parent, GstEvent *event) {
+    GstEisStabilize *self = GST_EIS_STABILIZE(parent);
+
+    switch (GST_EVENT_TYPE(event)) {
+        case GST_EVENT_CAPS: {
+            GstCaps *caps;
+            GstVideoInfo info;
+            gst_event_parse_caps(event, &caps);
+            if (!gst_video_info_from_caps(&info, caps)) {
+                gst_event_unref(event);
+                return FALSE;
+            }
+            // Frames queued under the old caps leave first
+            drain(self);
+            if (!self->have_info || GST_VIDEO_INFO_WIDTH(&info) != GST_VIDEO_INFO_WIDTH(&self->info) ||
+                GST_VIDEO_INFO_HEIGHT(&info) != GST_VIDEO_INFO_HEIGHT(&self->info)) {
+                resources_free(self);
+            }
+            self->info = info;
+            self->have_info = TRUE;
+            break;
+        }
+        case GST_EVENT_SEGMENT:
+            // Queued frames belong to the previous segment
+            drain(self);
+            gst_event_copy_segment(event, &self->segment);
+            break;
+        case GST_EVENT_EOS:
+            drain(self);
+            break;
+        case GST_EVENT_FLUSH_STOP:
+            pending_clear(self);
+            gst_segment_init(&self->segment, GST_FORMAT_TIME);
+            break;
+        default:
+            break;
+    }
+    return gst_pad_event_default(pad, parent, event);
+}
+
+static gboolean gst_eis_stabilize_src_query(GstPad *pad, GstObject *parent, GstQuery *query) {
+    GstEisStabilize *self = GST_EIS_STABILIZE(parent);
+
+    if (GST_QUERY_TYPE(query) != GST_QUERY_LATENCY) {
+        return gst_pad_query_default(pad, parent, query);
+    }
+    if (!gst_pad_peer_query(self->sinkpad, query)) {
+        return FALSE;
+    }
+
+    // Each frame waits for the look-ahead frames behind it
+    gboolean live;
+    GstClockTime min, max;
+    gst_query_parse_latency(query, &live, &min, &max);
+    GST_OBJECT_LOCK(self);
+    GstClockTime frame = FALLBACK_FRAME_DURATION;
+    if (self->have_info && GST_VIDEO_INFO_FPS_N(&self->info) > 0) {
+        frame = gst_util_uint64_scale_int(GST_SECOND, GST_VIDEO_INFO_FPS_D(&self->info),
+                                          GST_VIDEO_INFO_FPS_N(&self->info));
+    }
+    GstClockTime extra = self->enabled ? frame * self->lookahead : 0;
+    GST_OBJECT_UNLOCK(self);
+    min += extra;
+    if (GST_CLOCK_TIME_IS_VALID(max)) {
+        max += extra;
+    }
+    gst_query_set_latency(query, live, min, max);
+    return TRUE;
+}
+
+static GstStateChangeReturn gst_eis_stabilize_change_state(GstElement *element, GstStateChange transition) {
+    GstEisStabilize *self = GST_EIS_STABILIZE(element);
+
+    if (transition == GST_STATE_CHANGE_READY_TO_PAUSED) {
+        gst_segment_init(&self->segment, GST_FORMAT_TIME);
+    }
+    GstStateChangeReturn ret =
+        GST_ELEMENT_CLASS(gst_eis_stabilize_parent_class)->change_state(element, transition);
+
+    if (transition == GST_STATE_CHANGE_PAUSED_TO_READY) {
+        resources_free(self);
+        self->have_info = FALSE;
+    }
+    return ret;
+}
+
+static void gst_eis_stabilize_set_property(GObject *object, guint prop_id,
+                                           const GValue *value, GParamSpec *pspec) {
+    GstEisStabilize *self = GST_EIS_STABILIZE(object);
+    gboolean latency_changed = FALSE;
+
+    GST_OBJECT_LOCK(self);
+    switch (prop_id) {
+        case PROP_ENABLED: {
+            gboolean enabled = g_value_get_boolean(value);
+            latency_changed = enabled != self->enabled;
+            self->enabled = enabled;
+            break;
+        }
+        case PROP_LOOKAHEAD: {
+            gint lookahead = g_value_get_int(value);
+            latency_changed = lookahead != self->lookahead;
+            self->lookahead = lookahead;
+            break;
+        }
+        case PROP_CROP:
+            self->crop = g_value_get_double(value);
+            break;
+        case PROP_FOV:
+            self->fov = g_value_get_double(value);
+            break;
+        case PROP_READOUT_MS:
+            self->readout_ms = g_value_get_double(value);
+            break;
+        case PROP_GYRO_OFFSET_MS:
+            self->gyro_offset_ms = g_value_get_double(value);
+            break;
+        case PROP_THREADS:
+            self->threads = g_value_get_int(value);
+            break;
+        case PROP_USE_SIMD:
+            self->use_simd = g_value_get_boolean(value);
+            break;
+        case PROP_TIMESTAMP_OFFSET:
+            self->timestamp_offset = g_value_get_int64(value);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+    GST_OBJECT_UNLOCK(self);
+
+    // The pipeline recomputes its latency (the sinks' render delay)
+    if (latency_changed) {
+        gst_element_post_message(GST_ELEMENT(self), gst_message_new_latency(GST_OBJECT(self)));
+    }
+}
+
+static void gst_eis_stabilize_get_property(GObject *object, guint prop_id,
+                                           GValue *value, GParamSpec *pspec) {
+    GstEisStabilize *self = GST_EIS_STABILIZE(object);
+
+    GST_OBJECT_LOCK(self);
+    switch (prop_id) {
+        case PROP_ENABLED:
+            g_value_set_boolean(value, self->enabled);
+            break;
+        case PROP_LOOKAHEAD:
+            g_value_set_int(value, self->lookahead);
+            break;
+        case PROP_CROP:
+            g_value_set_double(value, self->crop);
+            break;
+        case PROP_FOV:
+            g_value_set_double(value, self->fov);
+            break;
+        case PROP_READOUT_MS:
+            g_value_set_double(value, self->readout_ms);
+            break;
+        case PROP_GYRO_OFFSET_MS:
+            g_value_set_double(value, self->gyro_offset_ms);
+            break;
+        case PROP_THREADS:
+            g_value_set_int(value, self->threads);
+            break;
+        case PROP_USE_SIMD:
+            g_value_set_boolean(value, self->use_simd);
+            break;
+        case PROP_TIMESTAMP_OFFSET:
+            g_value_set_int64(value, self->timestamp_offset);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+    GST_OBJECT_UNLOCK(self);
+}
+
+static void gst_eis_stabilize_finalize(GObject *object) {
+    GstEisStabilize *self = GST_EIS_STABILIZE(object);
+
+    resources_free(self);
+
+    G_OBJECT_CLASS(gst_eis_stabilize_parent_class)->finalize(object);
+}
+
+static void gst_eis_stabilize_class_init(GstEisStabilizeClass *klass) {
+    GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+    GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+
+    gobject_class->set_property = gst_eis_stabilize_set_property;
+    gobject_class->get_property = gst_eis_stabilize_get_property;
+    gobject_class->finalize = gst_eis_stabilize_finalize;
+
+    g_object_class_install_property(gobject_class, PROP_ENABLED,
+        g_param_spec_boolean("enabled", "Enabled", "Stabilize (FALSE passes frames through)",
+                             DEFAULT_ENABLED, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_LOOKAHEAD,
+        g_param_spec_int("lookahead", "Look-ahead", "Frames of future motion used to smooth the path",
+                         0, MAX_LOOKAHEAD, DEFAULT_LOOKAHEAD, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_CROP,
+        g_param_spec_double("crop", "Crop", "Stabilization margin per side, fraction of the frame",
+                            0.0, 0.25, DEFAULT_CROP, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_FOV,
+        g_param_spec_double("fov", "Field of view", "Horizontal field of view of the lens (degrees)",
+                            10.0, 170.0, DEFAULT_FOV, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_READOUT_MS,
+        g_param_spec_double("readout-ms", "Readout time", "Rolling shutter readout, first to last row (ms)",
+                            0.0, 100.0, DEFAULT_READOUT_MS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_GYRO_OFFSET_MS,
+        g_param_spec_double("gyro-offset-ms", "Gyro offset", "Added to frame times to look up the gyro (ms)",
+                            -500.0, 500.0, DEFAULT_GYRO_OFFSET_MS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_THREADS,
+        g_param_spec_int("threads", "Threads", "Threads the warp is split over",
+                         1, 16, DEFAULT_THREADS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_USE_SIMD,
+        g_param_spec_boolean("use-simd", "Use SIMD", "Use the vectorized warp (bit-identical output)",
+                             DEFAULT_USE_SIMD, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_TIMESTAMP_OFFSET,
+        g_param_spec_int64("timestamp-offset", "Timestamp offset",
+                           "CLOCK_MONOTONIC of running time 0 (ns), -1 for the element base time",
+                           -1, G_MAXINT64, DEFAULT_TIMESTAMP_OFFSET, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+    gst_element_class_set_static_metadata(element_class,
+        "Gyro stabilizer", "Filter/Effect/Video",
+        "Warps NV12 frames along a smoothed gyro path, rolling shutter corrected",
+        "LegionMay");
+    gst_element_class_add_static_pad_template(element_class, &sink_template);
+    gst_element_class_add_static_pad_template(element_class, &src_template);
+
+    element_class->change_state = gst_eis_stabilize_change_state;
+}
+
+static void gst_eis_stabilize_init(GstEisStabilize *self) {
+    // Not proxying allocation: upstream buffers are copied, never held
+    self->sinkpad = gst_pad_new_from_static_template(&sink_template, "sink");
+    gst_pad_set_chain_function(self->sinkpad, gst_eis_stabilize_chain);
+    gst_pad_set_event_function(self->sinkpad, gst_eis_stabilize_sink_event);
+    GST_PAD_SET_PROXY_CAPS(self->sinkpad);
+    gst_element_add_pad(GST_ELEMENT(self), self->sinkpad);
+
+    self->srcpad = gst_pad_new_from_static_template(&src_template, "src");
+    gst_pad_set_query_function(self->srcpad, gst_eis_stabilize_src_query);
+    GST_PAD_SET_PROXY_CAPS(self->srcpad);
+    gst_element_add_pad(GST_ELEMENT(self), self->srcpad);
+
+    self->enabled = DEFAULT_ENABLED;
+    self->lookahead = DEFAULT_LOOKAHEAD;
+    self->crop = DEFAULT_CROP;
+    self->fov = DEFAULT_FOV;
+    self->readout_ms = DEFAULT_READOUT_MS;
+    self->gyro_offset_ms = DEFAULT_GYRO_OFFSET_MS;
+    self->threads = DEFAULT_THREADS;
+    self->use_simd = DEFAULT_USE_SIMD;
+    self->timestamp_offset = DEFAULT_TIMESTAMP_OFFSET;
+    self->have_info = FALSE;
+    gst_segment_init(&self->segment, GST_FORMAT_TIME);
+    g_queue_init(&self->pending);
+}
+
+gboolean eis_stabilize_register(void) {
+    return gst_element_register(NULL, "eisstabilize", GST_RANK_NONE, GST_TYPE_EIS_STABILIZE);
+}
+
+void eis_stabilize_get_stats(GstElement *element, EisStabilizeStats *stats) {
+    GstEisStabilize *self = GST_EIS_STABILIZE(element);
+    GST_OBJECT_LOCK(self);
+    *stats = self->stats;
+    GST_OBJECT_UNLOCK(self);
+}
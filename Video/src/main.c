@@ -5,27 +5,88 @@
 
 #include "pipeline.h"
 #include "shm_utils.h"
+#include "preview_legacy.h"
 #include "config.h"
+#include "preview_transform.h"
+#include "prerecord.h"
+#include "storage_sink.h"
+#include "eis_stabilize.h"
+#include "bench.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+void *shm_ptr = NULL;
 
 int main(int argc, char *argv[]) {
     GstElement *pipeline = NULL;
     VideoConfig *config = NULL;
     int shmid = -1;
+    int readers_shmid = -1;
+    void *readers_ptr = NULL;
 
     // 初始化GStreamer
     gst_init(&argc, &argv);
 
-    // 加载配置
-    config = load_config();
+    // 注册应用内的预览变换元素
+    if (!preview_transform_register()) {
+        fprintf(stderr, "Failed to register previewtransform element.\n");
+        return -1;
+    }
+
+    if (!prerecord_register()) {
+        fprintf(stderr, "Failed to register prerecord element.\n");
+        return -1;
+    }
+
+    if (!storage_sink_register()) {
+        fprintf(stderr, "Failed to register storagesink element.\n");
+        return -1;
+    }
+
+    if (!eis_stabilize_register()) {
+        fprintf(stderr, "Failed to register eisstabilize element.\n");
+        return -1;
+    }
+
+    // 基准测试模式：VideoProcess --bench <name>
+    if (argc >= 3 && strcmp(argv[1], "--bench") == 0) {
+        return run_benchmark(argv[2]);
+    }
+
+    // 加载配置：VideoProcess [--config <path>] [--simulate] [--input <file>]
+    // 预览分辨率按配置中的屏幕尺寸计算
+    const char *config_path = CONFIG_FILE_DEFAULT;
+    const char *sim_input = NULL;
+    int simulate = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) {
+            config_path = argv[++i];
+        } else if (strcmp(argv[i], "--simulate") == 0) {
+            simulate = 1;
+        } else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            sim_input = argv[++i];
+            simulate = 1;
+        } else {
+            fprintf(stderr, "Usage: %s [--config <path>] [--simulate] [--input <file>] | --bench <name>\n", argv[0]);
+            return -1;
+        }
+    }
+    config = load_config(config_path);
     if (!config) {
         fprintf(stderr, "Failed to load config.\n");
         return -1;
     }
 
-    // 计算预览分辨率（屏幕800x480）
-    calculate_preview_size(config, 800, 480);
+    // 仿真模式：videotestsrc/文件回放、audiotestsrc 和软件编码器，可在开发机上运行
+    if (simulate) {
+        config_set(config, "simulate", "1");
+    }
+    if (sim_input && config_set(config, "sim_input", sim_input) < 0) {
+        fprintf(stderr, "Input path too long: %s\n", sim_input);
+        free_config(config);
+        return -1;
+    }
 
     // 创建共享内存
     shmid = create_shm();
@@ -39,10 +100,31 @@ int main(int argc, char *argv[]) {
         free_config(config);
         return -1;
     }
+    if (preview_ring_init(shm_ptr, SHM_SIZE, PREVIEW_RING_SLOTS, PREVIEW_SLOT_SIZE) != 0) {
+        detach_shm(shm_ptr);
+        destroy_shm(shmid);
+        free_config(config);
+        return -1;
+    }
+
+    // 预览读者登记表，创建失败时读者仍可读取，只是不登记统计
+    readers_shmid = create_readers_shm();
+    readers_ptr = readers_shmid != -1 ? attach_shm(readers_shmid) : NULL;
+    if (readers_ptr) {
+        preview_readers_init((PreviewReaderTable *)readers_ptr);
+    }
+
+    // 旧版 UI 读取 key 1234 的单帧布局，打开失败时只影响旧版 UI
+    if (config->preview_legacy_shm && preview_legacy_open() != 0) {
+        fprintf(stderr, "Legacy preview mirror unavailable\n");
+    }
 
     // 创建并启动管道
     pipeline = create_pipeline(config);
     if (!pipeline) {
+        preview_legacy_close();
+        detach_shm(readers_ptr);
+        destroy_shm(readers_shmid);
         detach_shm(shm_ptr);
         destroy_shm(shmid);
         free_config(config);
@@ -55,6 +137,9 @@ int main(int argc, char *argv[]) {
 
     // 清理资源
     cleanup_pipeline(pipeline);
+    preview_legacy_close();
+    detach_shm(readers_ptr);
+    destroy_shm(readers_shmid);
     detach_shm(shm_ptr);
     destroy_shm(shmid);
     free_config(config);
@@ -4,12 +4,25 @@
  */
 #include "pipeline.h"
 #include "shm_utils.h"
+#include "preview_kernel.h"
 #include "utils.h"
 #include "../include/config.h"
+#include "preview_ring.h"
+#include "preview_shm_pool.h"
+#include "preview_legacy.h"
+#include "record_ctl.h"
+#include "record_session.h"
+#include "record_seek.h"
+#include "storage_sink.h"
+#include "reconfig.h"
+#include "pipeline_probes.h"
+#include "timebase.h"
+#include "telemetry_mux.h"
+#include "eis.h"
 #include <gst/app/gstappsink.h>
+#include <gst/video/video.h>
 #include <time.h>
 #include <string.h>
-#include <semaphore.h>
 #include <pthread.h>
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -17,12 +30,18 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
 
 // Shared memory pointer (defined in main.c)
 extern void *shm_ptr;
 
-// Semaphore pointer
-static sem_t *sem;
+// Preview ring state (only touched from the appsink streaming thread)
+static guint64 preview_frame_number = 0;
+static guint64 preview_size_mismatches = 0;
+static GstCaps *preview_caps = NULL;
+static GstVideoInfo preview_info;
 
 // Shared memory for recording control
 #define RECORD_SHM_KEY 5678
@@ -30,28 +49,65 @@ typedef struct {
     int is_recording;  // 0: not recording, 1: recording
 } RecordControl;
 static RecordControl *record_control = NULL;
+static int record_control_shmid = -1;
+
+// The old UI (app/lvgl) starts and stops recordings by writing is_recording
+// directly. With record_shm_flag set, the control thread checks it every
+// RECORD_SHM_POLL_MS while another process has the segment attached, and
+// looks for one attaching every RECORD_SHM_ATTACH_MS; it acts on a change
+// from the last value seen or mirrored (record_shm_state).
+#define RECORD_SHM_POLL_MS 100
+#define RECORD_SHM_ATTACH_MS 1000
+static int record_shm_state = 0;
 
 // Pipeline elements (global for access in control functions)
 static GstElement *pipeline = NULL;
-static GstElement *filesink = NULL;
-static GstElement *video_valve = NULL;
-static GstElement *audio_valve = NULL;
+static GstElement *video_prerecord = NULL;
+static GstElement *audio_prerecord = NULL;
 static gboolean is_recording = FALSE;
 
-// Record command file path
-#define RECORD_CMD_FILE "/tmp/record_cmd"
+// IMU and GNSS tracks (telemetry_mux.c); only Matroska sessions carry them
+static GstElement *imu_prerecord = NULL;
+static GstElement *gnss_prerecord = NULL;
+static gboolean record_telemetry = FALSE;
 
-// Thread control
+// Record control server (socket + eventfd used to stop the thread)
+#define RECORD_MAX_CLIENTS 8
 static pthread_t record_thread_id;
-static volatile int thread_running = 1;
+static int record_thread_started = 0;
+static int record_listen_fd = -1;
+static int record_stop_fd = -1;
 
-// Initialize named semaphore
-static void init_semaphore(void) {
-    sem = sem_open("/preview_sem", O_CREAT, 0644, 1);
-    if (sem == SEM_FAILED) {
-        perror("sem_open failed in video process");
-        exit(1);
-    }
+// Container chosen at start; the audio encoder was picked to match it
+static char record_container[8] = "mkv";
+
+// Current recording, reported in every reply
+static char record_filename[256] = "";
+static guint64 record_started_ns = 0;
+
+// splitmuxsink of the running session, added on start and removed on stop.
+// The lock also covers record_filename, which the bus handler updates.
+#define RECORD_FINALIZE_TIMEOUT_US (3 * G_USEC_PER_SEC)
+static GMutex record_sink_lock;
+static GCond record_sink_cond;
+static GstElement *record_sink = NULL;
+static RecordSession *record_session = NULL;
+static RecordSeek *record_seek = NULL;
+static gboolean record_sink_done = FALSE;
+
+// record_seek is set under both locks. The preview thread only takes
+// record_seek_lock, long enough to take a reference, so thumbnails never
+// wait on the muxer's bookkeeping or hold it up.
+static GMutex record_seek_lock;
+
+// First buffer handed to the muxer after a start (set by a pad probe)
+static volatile gint record_first_frame_armed = 0;
+static volatile guint64 record_first_frame_ns = 0;
+
+static guint64 monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (guint64)ts.tv_sec * 1000000000ull + ts.tv_nsec;
 }
 
 // Initialize recording control shared memory
@@ -61,15 +117,17 @@ static void init_record_control(void) {
         perror("shmget failed for record control in video process");
         exit(1);
     }
+    record_control_shmid = shmid;
     record_control = (RecordControl *)shmat(shmid, NULL, 0);
     if (record_control == (void *)-1) {
         perror("shmat failed for record control in video process");
         exit(1);
     }
     record_control->is_recording = 0;  // Initialize to not recording
+    record_shm_state = 0;
 }
 
-// Appsink callback to write ARGB data to shared memory
+// Appsink callback to publish the BGRA preview frame into the shared memory ring
 static GstFlowReturn on_new_sample(GstAppSink *sink, gpointer user_data) {
     GstSample *sample = gst_app_sink_pull_sample(sink);
     if (!sample) {
@@ -90,15 +148,67 @@ static GstFlowReturn on_new_sample(GstAppSink *sink, gpointer user_data) {
         return GST_FLOW_ERROR;
     }
 
+    // Re-parse geometry only when the caps change
+    GstCaps *caps = gst_sample_get_caps(sample);
+    if (caps && caps != preview_caps) {
+        if (!gst_video_info_from_caps(&preview_info, caps)) {
+            g_printerr("Failed to parse preview caps.\n");
+            gst_sample_unref(sample);
+            return GST_FLOW_ERROR;
+        }
+        gst_caps_replace(&preview_caps, caps);
+    }
+
+    PreviewRingHeader *ring = (PreviewRingHeader *)shm_ptr;
+    PreviewFrameInfo info;
+    info.width = GST_VIDEO_INFO_WIDTH(&preview_info);
+    info.height = GST_VIDEO_INFO_HEIGHT(&preview_info);
+    info.stride = GST_VIDEO_INFO_PLANE_STRIDE(&preview_info, 0);
+    info.format = PREVIEW_FORMAT_BGRA;
+    info.size = gst_buffer_get_size(buffer);
+    info.frame_number = preview_frame_number + 1;
+    // Pipeline clock is CLOCK_MONOTONIC: base time + PTS = capture time
+    info.capture_ns = GST_BUFFER_PTS_IS_VALID(buffer)
+        ? gst_element_get_base_time(GST_ELEMENT(sink)) + GST_BUFFER_PTS(buffer) : 0;
+
+    // Thumbnail for the seek sidecar, before the slot is handed to readers
+    g_mutex_lock(&record_seek_lock);
+    RecordSeek *seek = record_seek ? record_seek_ref(record_seek) : NULL;
+    g_mutex_unlock(&record_seek_lock);
+    if (seek) {
+        record_seek_preview(seek, buffer, &preview_info);
+        record_seek_unref(seek);
+    }
+
+    // Zero-copy: the frame was rendered into a ring slot, only publish it
     GstMapInfo map;
+    if (preview_shm_pool_commit(buffer, &info)) {
+        preview_frame_number++;
+        // Only this thread writes the slot, so it still holds the frame
+        if (gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+            preview_legacy_publish(map.data, &info);
+            gst_buffer_unmap(buffer, &map);
+        }
+        gst_sample_unref(sample);
+        return GST_FLOW_OK;
+    }
+
     if (gst_buffer_map(buffer, &map, GST_MAP_READ)) {
-        // Ensure data size matches (800x450 ARGB = 800 * 450 * 4 = 1,440,000 bytes)
-        if (map.size == 1440000) {
-            sem_wait(sem);
-            memcpy(shm_ptr, map.data, map.size);
-            sem_post(sem);
+        if (map.size <= ring->slot_size) {
+            // Never waits for readers: the slot being filled is not the newest one
+            uint32_t slot;
+            uint8_t *dst = preview_ring_begin_write(ring, &slot);
+            memcpy(dst, map.data, map.size);
+            info.size = map.size;
+            preview_ring_commit(ring, slot, &info);
+            preview_frame_number++;
+            preview_legacy_publish(map.data, &info);
         } else {
-            g_printerr("Buffer size mismatch: %lu (expected 1,440,000)\n", map.size);
+            // Every frame would hit this, so report the first and then every 300th
+            if (preview_size_mismatches++ % 300 == 0) {
+                g_printerr("Buffer size mismatch: %lu (slot holds %u), %" G_GUINT64_FORMAT " frames dropped\n",
+                           map.size, ring->slot_size, preview_size_mismatches);
+            }
         }
         gst_buffer_unmap(buffer, &map);
     } else {
@@ -109,296 +219,802 @@ static GstFlowReturn on_new_sample(GstAppSink *sink, gpointer user_data) {
     return GST_FLOW_OK;
 }
 
-// Start recording by opening valves and creating new file
-static void start_recording(VideoConfig *config) {
+void setup_preview_sink(GstElement *app_sink, gboolean zero_copy) {
+    GstAppSinkCallbacks callbacks = { NULL, NULL, on_new_sample };
+
+    // Rendering is synchronous with the preview transform, so at most one
+    // frame is in flight. The last-sample copy would pin a ring slot.
+    g_object_set(G_OBJECT(app_sink),
+                "emit-signals", TRUE,
+                "sync", FALSE,
+                "drop", TRUE, // Drop buffers if queue full
+                "max-buffers", 1,
+                "enable-last-sample", FALSE,
+                NULL);
+    gst_app_sink_set_callbacks(GST_APP_SINK(app_sink), &callbacks, NULL, NULL);
+
+    // Let the preview transform render straight into the ring slots
+    if (zero_copy && !preview_shm_pool_install(app_sink, (PreviewRingHeader *)shm_ptr)) {
+        g_printerr("Failed to install preview shm pool, frames will be copied\n");
+    }
+}
+
+// splitmuxsink asks for each segment's file name
+static gchar* on_format_location(GstElement *splitmux, guint fragment_id, GstSample *first_sample,
+                                 gpointer user_data) {
+    RecordSession *session = (RecordSession *)user_data;
+    char *path = record_session_location(session, fragment_id);
+    gchar *location = g_strdup(path);
+    free(path);
+    return location;
+}
+
+// Runs on the posting thread: segment bookkeeping and session end (EOS)
+static GstBusSyncReply record_bus_sync_handler(GstBus *bus, GstMessage *msg, gpointer user_data) {
+    if (GST_MESSAGE_TYPE(msg) != GST_MESSAGE_ELEMENT) {
+        return GST_BUS_PASS;
+    }
+    const GstStructure *st = gst_message_get_structure(msg);
+
+    g_mutex_lock(&record_sink_lock);
+    if (record_sink && GST_MESSAGE_SRC(msg) == GST_OBJECT(record_sink)) {
+        const gchar *location = gst_structure_get_string(st, "location");
+        GstClockTime running_time = 0;
+        gst_structure_get_clock_time(st, "running-time", &running_time);
+        if (location && gst_structure_has_name(st, "splitmuxsink-fragment-opened")) {
+            record_session_segment_opened(record_session, location, running_time);
+            record_seek_segment_opened(record_seek, location, running_time);
+            g_strlcpy(record_filename, location, sizeof(record_filename));
+            g_print("Recording segment opened: %s\n", location);
+        } else if (location && gst_structure_has_name(st, "splitmuxsink-fragment-closed")) {
+            record_session_segment_closed(record_session, location, running_time);
+        }
+    } else if (record_sink && gst_structure_has_name(st, "GstBinForwarded")) {
+        // The pipeline forwards child EOS (message-forward): the muxer is done
+        GstMessage *inner = NULL;
+        gst_structure_get(st, "message", GST_TYPE_MESSAGE, &inner, NULL);
+        if (inner && GST_MESSAGE_TYPE(inner) == GST_MESSAGE_EOS &&
+            GST_MESSAGE_SRC(inner) == GST_OBJECT(record_sink)) {
+            record_sink_done = TRUE;
+            g_cond_broadcast(&record_sink_cond);
+        }
+        if (inner) gst_message_unref(inner);
+    }
+    g_mutex_unlock(&record_sink_lock);
+
+    return GST_BUS_PASS;
+}
+
+// Encoder input thread: frames dropped ahead of the encoder left a hole
+static void on_record_gap(GstClockTime pts, guint64 frames, gpointer user_data) {
+    g_mutex_lock(&record_sink_lock);
+    if (record_session) {
+        record_session_discontinuity(record_session, pts, frames);
+    }
+    g_mutex_unlock(&record_sink_lock);
+    g_printerr("Recording gap: %" G_GUINT64_FORMAT " frames lost before %" GST_TIME_FORMAT "\n",
+               frames, GST_TIME_ARGS(pts));
+}
+
+// Link a pre-record buffer to a new request pad of the segment muxer
+static gboolean link_record_pad(GstElement *prerecord, const gchar *pad_name) {
+    GstPad *src = gst_element_get_static_pad(prerecord, "src");
+    GstPad *sink = gst_element_get_request_pad(record_sink, pad_name);
+    gboolean ok = sink && gst_pad_link(src, sink) == GST_PAD_LINK_OK;
+    if (sink) gst_object_unref(sink);
+    gst_object_unref(src);
+    return ok;
+}
+
+// End the stream into the muxer without racing the pre-record buffer's
+// streaming thread: once its stream lock is held, nothing more is pushed.
+static void send_record_eos(GstElement *prerecord) {
+    GstPad *sink = gst_element_get_static_pad(prerecord, "sink");
+    GstPad *src = gst_element_get_static_pad(prerecord, "src");
+    GstPad *peer = gst_pad_get_peer(src);
+
+    GST_PAD_STREAM_LOCK(sink);
+    if (peer) {
+        gst_pad_send_event(peer, gst_event_new_eos());
+    }
+    GST_PAD_STREAM_UNLOCK(sink);
+
+    if (peer) gst_object_unref(peer);
+    gst_object_unref(src);
+    gst_object_unref(sink);
+}
+
+static void unlink_record_pad(GstElement *prerecord) {
+    GstPad *src = gst_element_get_static_pad(prerecord, "src");
+    GstPad *peer = gst_pad_get_peer(src);
+    if (peer) {
+        gst_pad_unlink(src, peer);
+        gst_element_release_request_pad(record_sink, peer);
+        gst_object_unref(peer);
+    }
+    gst_object_unref(src);
+}
+
+// Detach the segment muxer and close the session
+static void teardown_record_sink(gboolean clean) {
+    if (video_prerecord) unlink_record_pad(video_prerecord);
+    if (audio_prerecord) unlink_record_pad(audio_prerecord);
+    if (imu_prerecord) unlink_record_pad(imu_prerecord);
+    if (gnss_prerecord) unlink_record_pad(gnss_prerecord);
+    gst_element_set_state(record_sink, GST_STATE_NULL);
+    pipeline_probes_record_stop();
+
+    GstElement *storage = NULL;
+    g_object_get(G_OBJECT(record_sink), "sink", &storage, NULL);
+    if (storage) {
+        StorageSinkStats stats;
+        storage_sink_get_stats(storage, &stats);
+        g_print("Recording storage:\n");
+        storage_sink_print_stats(&stats);
+        gst_object_unref(storage);
+    }
+
+    g_mutex_lock(&record_sink_lock);
+    GstElement *sink = record_sink;
+    RecordSession *session = record_session;
+    RecordSeek *seek = record_seek;
+    record_sink = NULL;
+    record_session = NULL;
+    g_mutex_lock(&record_seek_lock);
+    record_seek = NULL;
+    g_mutex_unlock(&record_seek_lock);
+    g_mutex_unlock(&record_sink_lock);
+
+    gst_bin_remove(GST_BIN(pipeline), sink);
+    record_seek_free(seek);
+    record_session_finish(session, clean);
+    record_session_free(session);
+}
+
+// Start recording: attach a segment muxer, then release the pre-record buffers into it
+static RecordResult start_recording(VideoConfig *config) {
     if (is_recording) {
         g_print("Already recording.\n");
-        return;
+        return RECORD_ALREADY;
     }
 
     g_print("Starting recording...\n");
 
     // Check if SD card directory exists and is writable
-    if (access("/mnt/sdcard", F_OK) != 0) {
+    if (access(config->record_dir, F_OK) != 0) {
         g_print("SD card directory does not exist, creating...\n");
-        if (mkdir("/mnt/sdcard", 0755) != 0 && errno != EEXIST) {
+        if (mkdir(config->record_dir, 0755) != 0 && errno != EEXIST) {
             g_printerr("Failed to create SD card directory: %s\n", strerror(errno));
-            return;
+            return RECORD_ERR_STORAGE;
         }
-    } else if (access("/mnt/sdcard", W_OK) != 0) {
+    } else if (access(config->record_dir, W_OK) != 0) {
         g_printerr("Cannot write to SD card directory: %s\n", strerror(errno));
-        return;
+        return RECORD_ERR_STORAGE;
     }
 
-    // Ensure pipeline is in the right state for modifying filesink
-    GstState current, pending;
-    gst_element_get_state(pipeline, &current, &pending, 0);
-    
-    // First close valves to stop data flow
-    g_object_set(G_OBJECT(video_valve), "drop", TRUE, NULL);
-    g_object_set(G_OBJECT(audio_valve), "drop", TRUE, NULL);
-    
-    // Generate filename with timestamp and resolution
-    char filename[256];
-    time_t now = time(NULL);
-    struct tm *t = localtime(&now);
-    snprintf(filename, sizeof(filename), "/mnt/sdcard/record_%04d%02d%02d_%02d%02d%02d.mkv",
-             t->tm_year + 1900, t->tm_mon + 1, t->tm_mday, 
-             t->tm_hour, t->tm_min, t->tm_sec);
-    
-    // Temporarily set pipeline to READY to safely change filesink location
-    gst_element_set_state(filesink, GST_STATE_NULL);
-    
-    // Set the filesink location to the new file
-    g_object_set(G_OBJECT(filesink), "location", filename, NULL);
-    g_print("Creating recording file: %s\n", filename);
-    
-    // Return pipeline to its original state
-    gst_element_set_state(filesink, current);
-    
-    // Open valves to allow data flow and start recording
-    g_object_set(G_OBJECT(video_valve), "drop", FALSE, NULL);
-    g_object_set(G_OBJECT(audio_valve), "drop", FALSE, NULL);
+    // NTP may have set or stepped the clock since the last publish
+    timebase_publish_system();
+
+    gboolean mp4 = strcmp(record_container, "mp4") == 0;
+    RecordSession *session = record_session_new(config->record_dir, mp4 ? "mp4" : "mkv",
+                                                config->segment_seconds, config->segment_max_mb);
+    GstElement *sink = gst_element_factory_make("splitmuxsink", "record_sink");
+    GstElement *mux = gst_element_factory_make(mp4 ? "mp4mux" : "matroskamux", NULL);
+    GstElement *storage = gst_element_factory_make("storagesink", NULL);
+    if (!session || !sink || !mux || !storage) {
+        g_printerr("Failed to create recording elements\n");
+        if (sink) gst_object_unref(sink);
+        if (mux) gst_object_unref(mux);
+        if (storage) gst_object_unref(storage);
+        record_session_free(session);
+        return RECORD_ERR_PIPELINE;
+    }
+
+    // Bound what a power loss costs: MP4 fragments are playable as soon as
+    // they are written; short Matroska clusters give record_recover a fine
+    // grained index to rebuild
+    if (mp4) {
+        g_object_set(G_OBJECT(mux), "fragment-duration", (guint)config->fragment_ms, NULL);
+    } else {
+        g_object_set(G_OBJECT(mux), "max-cluster-duration", (gint64)config->fragment_ms * GST_MSECOND, NULL);
+    }
+
+    // Large aligned writes from a writer thread, so card stalls do not
+    // back up into the (leaky) encoder queue
+    g_object_set(G_OBJECT(storage),
+                "chunk-size", (guint)config->storage_chunk_kb * 1024,
+                "max-chunks", (guint)config->storage_queue_chunks,
+                "preallocate", (guint64)config->storage_prealloc_mb * 1024 * 1024,
+                "sync-interval", (guint64)config->storage_sync_ms * GST_MSECOND,
+                NULL);
+
+    // Segments are cut on keyframes only; the encoder is asked for one at
+    // the split point so segments keep close to the requested length
+    g_object_set(G_OBJECT(sink),
+                "muxer", mux,
+                "sink", storage,
+                "max-size-time", (guint64)config->segment_seconds * GST_SECOND,
+                "max-size-bytes", (guint64)config->segment_max_mb * 1024 * 1024,
+                "send-keyframe-requests", config->segment_seconds > 0,
+                NULL);
+    g_signal_connect(sink, "format-location-full", G_CALLBACK(on_format_location), session);
+    pipeline_probes_record_start(mux, storage);
+
+    // Keyframe offsets and preview thumbnails in a sidecar per segment
+    RecordSeek *seek = record_seek_new(!mp4, config->record_thumb_seconds, config->record_thumb_width,
+                                       (PreviewRotation)(config->preview_rotation / 90));
+    record_seek_attach(seek, storage);
+
+    // Telemetry blocks line up with the clusters
+    record_telemetry = !mp4 && (imu_prerecord || gnss_prerecord);
+    if (record_telemetry) {
+        telemetry_mux_set_batch((guint)config->fragment_ms);
+    } else if (imu_prerecord || gnss_prerecord) {
+        g_print("IMU/GNSS tracks need the mkv container, not recorded\n");
+    }
+
+    char *first = record_session_location(session, 0);
+    g_mutex_lock(&record_sink_lock);
+    record_sink = sink;
+    record_session = session;
+    g_mutex_lock(&record_seek_lock);
+    record_seek = seek;
+    g_mutex_unlock(&record_seek_lock);
+    record_sink_done = FALSE;
+    g_strlcpy(record_filename, first, sizeof(record_filename));
+    g_mutex_unlock(&record_sink_lock);
+    g_print("Creating recording session %s, first segment %s\n", record_session_name(session), first);
+    free(first);
+
+    gst_bin_add(GST_BIN(pipeline), sink);
+    if (!link_record_pad(video_prerecord, "video") ||
+        (audio_prerecord && !link_record_pad(audio_prerecord, "audio_%u")) ||
+        (record_telemetry && imu_prerecord && !link_record_pad(imu_prerecord, "subtitle_%u")) ||
+        (record_telemetry && gnss_prerecord && !link_record_pad(gnss_prerecord, "subtitle_%u")) ||
+        !gst_element_sync_state_with_parent(sink)) {
+        g_printerr("Failed to attach recording sink\n");
+        teardown_record_sink(FALSE);
+        return RECORD_ERR_PIPELINE;
+    }
+
+    record_started_ns = monotonic_ns();
+    record_first_frame_ns = 0;
+    g_atomic_int_set(&record_first_frame_armed, 1);
+
+    // Buffered GOPs go out first (from a keyframe), then live data
+    g_object_set(G_OBJECT(video_prerecord), "recording", TRUE, NULL);
+    if (audio_prerecord) g_object_set(G_OBJECT(audio_prerecord), "recording", TRUE, NULL);
+    if (record_telemetry && imu_prerecord) g_object_set(G_OBJECT(imu_prerecord), "recording", TRUE, NULL);
+    if (record_telemetry && gnss_prerecord) g_object_set(G_OBJECT(gnss_prerecord), "recording", TRUE, NULL);
     
     is_recording = TRUE;
     g_print("Recording started successfully\n");
+    return RECORD_OK;
 }
 
-// Stop recording by closing valves
-static void stop_recording() {
+// Stop recording: finalize the open segment; the pre-record buffers start filling again
+static RecordResult stop_recording() {
     if (!is_recording) {
         g_print("Not recording or already stopped.\n");
-        return;
+        return RECORD_ALREADY;
     }
 
     g_print("Stopping recording...\n");
     
-    // Close valves to stop data flow
-    g_object_set(G_OBJECT(video_valve), "drop", TRUE, NULL);
-    g_object_set(G_OBJECT(audio_valve), "drop", TRUE, NULL);
+    // Stop passing data downstream, then end the muxer's streams
+    g_object_set(G_OBJECT(video_prerecord), "recording", FALSE, NULL);
+    if (audio_prerecord) g_object_set(G_OBJECT(audio_prerecord), "recording", FALSE, NULL);
+    if (record_telemetry && imu_prerecord) g_object_set(G_OBJECT(imu_prerecord), "recording", FALSE, NULL);
+    if (record_telemetry && gnss_prerecord) g_object_set(G_OBJECT(gnss_prerecord), "recording", FALSE, NULL);
+    send_record_eos(video_prerecord);
+    if (audio_prerecord) send_record_eos(audio_prerecord);
+    if (record_telemetry && imu_prerecord) send_record_eos(imu_prerecord);
+    if (record_telemetry && gnss_prerecord) send_record_eos(gnss_prerecord);
+
+    // Wait for the last segment to be written out completely
+    gint64 deadline = g_get_monotonic_time() + RECORD_FINALIZE_TIMEOUT_US;
+    g_mutex_lock(&record_sink_lock);
+    while (!record_sink_done) {
+        if (!g_cond_wait_until(&record_sink_cond, &record_sink_lock, deadline)) {
+            break;
+        }
+    }
+    gboolean clean = record_sink_done;
+    g_mutex_unlock(&record_sink_lock);
+    if (!clean) {
+        g_printerr("Timed out finalizing %s, last segment may lack its index\n", record_filename);
+    }
+    teardown_record_sink(clean);
     
+    g_atomic_int_set(&record_first_frame_armed, 0);
+    record_started_ns = 0;
     is_recording = FALSE;
     g_print("Recording stopped successfully\n");
+    return RECORD_OK;
+}
+
+// Timestamp the first buffer handed to the muxer after each start
+static GstPadProbeReturn record_first_frame_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    if (g_atomic_int_compare_and_exchange(&record_first_frame_armed, 1, 0)) {
+        record_first_frame_ns = monotonic_ns();
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+// Capture and running time of every recorded frame for the session index
+static GstPadProbeReturn record_index_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (!GST_BUFFER_PTS_IS_VALID(buffer)) {
+        return GST_PAD_PROBE_OK;
+    }
+    // Running time is the PTS: the pre-record buffer keeps the live segment
+    GstClockTime running_time = GST_BUFFER_PTS(buffer);
+    GstClockTime capture = gst_element_get_base_time(pipeline) + running_time;
+    g_mutex_lock(&record_sink_lock);
+    if (record_session) {
+        record_session_frame(record_session, running_time, capture,
+                             !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT));
+    }
+    g_mutex_unlock(&record_sink_lock);
+    return GST_PAD_PROBE_OK;
+}
+
+guint64 get_record_first_frame_ns(void) {
+    return record_first_frame_ns;
 }
 
-// Thread to monitor recording control
+// Change one setting and apply it to the running pipeline. Capture format
+// changes restart the source, which would cut the recording, so they are
+// refused while recording; so is turning the preview, which the seek
+// thumbnails are turned back from.
+static RecordResult set_config(VideoConfig *config, const char *key, const char *value, RecordReply *reply) {
+    VideoConfig updated = *config;
+    int apply = config_set(&updated, key, value);
+    if (apply < 0) {
+        g_printerr("Rejected setting %s = %s\n", key, value);
+        return RECORD_ERR_BAD_CONFIG;
+    }
+    if (is_recording && (apply == CONFIG_APPLY_RELINK ||
+                         updated.preview_rotation != config->preview_rotation)) {
+        return RECORD_ERR_BUSY;
+    }
+    *config = updated;
+    reply->apply = apply;
+    g_print("Setting %s = %s\n", key, value);
+    if (reconfig_apply(pipeline, config, (ConfigApply)apply) != 0) {
+        return RECORD_ERR_PIPELINE;
+    }
+    return RECORD_OK;
+}
+
+// Publish the recording state through the shared memory flag
+static void mirror_record_control(void) {
+    if (record_control) {
+        record_shm_state = is_recording ? 1 : 0;
+        ((volatile RecordControl *)record_control)->is_recording = record_shm_state;
+    }
+}
+
+// Edge on the shared memory flag written by a UI not yet on record_ctl_*
+static void poll_record_control(VideoConfig *config) {
+    if (!record_control) {
+        return;
+    }
+    int state = ((volatile RecordControl *)record_control)->is_recording;
+    if (state == record_shm_state) {
+        return;
+    }
+    g_print("Recording state change (SHM): %d -> %d\n", record_shm_state, state);
+    if (state) {
+        start_recording(config);
+    } else {
+        stop_recording();
+    }
+    // A failed start shows up as the flag going back to 0
+    mirror_record_control();
+}
+
+// poll() timeout for the record control thread: without the legacy flag it
+// only wakes for commands and shutdown
+static int record_control_timeout(const VideoConfig *config) {
+    struct shmid_ds ds;
+    if (!config->record_shm_flag || !record_control) {
+        return -1;
+    }
+    if (shmctl(record_control_shmid, IPC_STAT, &ds) == 0 && ds.shm_nattch > 1) {
+        return RECORD_SHM_POLL_MS;
+    }
+    return RECORD_SHM_ATTACH_MS;
+}
+
+// Execute one command from a client and send the reply.
+// Returns -1 when the client went away.
+static int handle_record_command(int fd, VideoConfig *config) {
+    RecordCommand cmd;
+    ssize_t n = recv(fd, &cmd, sizeof(cmd), 0);
+    if (n <= 0) {
+        return -1;
+    }
+
+    RecordReply reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.seq = cmd.seq;
+    if (n != (ssize_t)sizeof(cmd)) {
+        reply.result = RECORD_ERR_BAD_COMMAND;
+    } else if (cmd.op == RECORD_CMD_START) {
+        reply.result = start_recording(config);
+    } else if (cmd.op == RECORD_CMD_STOP) {
+        reply.result = stop_recording();
+    } else if (cmd.op == RECORD_CMD_STATUS) {
+        reply.result = RECORD_OK;
+    } else if (cmd.op == RECORD_CMD_CONFIG_SET || cmd.op == RECORD_CMD_CONFIG_GET) {
+        cmd.key[sizeof(cmd.key) - 1] = '\0';
+        cmd.value[sizeof(cmd.value) - 1] = '\0';
+        reply.result = cmd.op == RECORD_CMD_CONFIG_SET
+            ? set_config(config, cmd.key, cmd.value, &reply) : RECORD_OK;
+        if (config_get(config, cmd.key, reply.value, sizeof(reply.value)) != 0) {
+            reply.result = RECORD_ERR_BAD_CONFIG;
+        }
+    } else if (cmd.op == RECORD_CMD_CONFIG_SAVE) {
+        reply.result = config_save_file(config) == 0 ? RECORD_OK : RECORD_ERR_STORAGE;
+    } else {
+        reply.result = RECORD_ERR_BAD_COMMAND;
+    }
+
+    // Shared memory keeps mirroring the state for status readers
+    mirror_record_control();
+
+    reply.recording = is_recording ? 1 : 0;
+    reply.started_ns = record_started_ns;
+    g_mutex_lock(&record_sink_lock);
+    strncpy(reply.filename, record_filename, sizeof(reply.filename) - 1);
+    g_mutex_unlock(&record_sink_lock);
+    if (send(fd, &reply, sizeof(reply), MSG_NOSIGNAL) != (ssize_t)sizeof(reply)) {
+        return -1;
+    }
+    return 0;
+}
+
+// Record control server: sleeps in poll() until a command or shutdown,
+// and for the shared memory flag only when record_shm_flag asks for it
 static void* record_control_thread(void *arg) {
     VideoConfig *config = (VideoConfig *)arg;
-    
-    g_print("Record control thread started\n");
-    
-    int prev_state = 0;
-    while (thread_running) {
-        // Check shared memory control
-        if (record_control) {
-            int current_state = record_control->is_recording;
-            if (current_state != prev_state) {
-                g_print("Recording state change (SHM): %d -> %d\n", prev_state, current_state);
-                
-                if (current_state) {
-                    start_recording(config);
-                } else {
-                    stop_recording();
-                }
-                prev_state = current_state;
+    struct pollfd fds[2 + RECORD_MAX_CLIENTS];
+    int nclients = 0;
+
+    g_print("Record control listening on %s\n", RECORD_CTL_SOCKET);
+
+    fds[0].fd = record_stop_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = record_listen_fd;
+    fds[1].events = POLLIN;
+
+    for (;;) {
+        int ready = poll(fds, 2 + nclients, record_control_timeout(config));
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            perror("record control poll failed");
+            break;
+        }
+        if (fds[0].revents) {
+            break;
+        }
+        if (config->record_shm_flag) {
+            poll_record_control(config);
+        }
+        if (ready == 0) {
+            continue;
+        }
+
+        // Serve clients first so a new connection cannot reorder the array under us
+        for (int i = 2; i < 2 + nclients; i++) {
+            if (!fds[i].revents) continue;
+            if (handle_record_command(fds[i].fd, config) != 0) {
+                close(fds[i].fd);
+                fds[i] = fds[1 + nclients];
+                nclients--;
+                i--;
             }
         }
-        
-        // Check command file
-        FILE *cmd_file = fopen(RECORD_CMD_FILE, "r");
-        if (cmd_file) {
-            char cmd[32] = {0};
-            if (fgets(cmd, sizeof(cmd), cmd_file)) {
-                // Remove newline if present
-                cmd[strcspn(cmd, "\n")] = 0;
-                
-                g_print("Command received: %s\n", cmd);
-                
-                if (strcmp(cmd, "start") == 0 && !is_recording) {
-                    g_print("Command received to start recording\n");
-                    start_recording(config);
-                    record_control->is_recording = 1;  // Update shared memory too
-                } else if (strcmp(cmd, "stop") == 0 && is_recording) {
-                    g_print("Command received to stop recording\n");
-                    stop_recording();
-                    record_control->is_recording = 0;  // Update shared memory too
-                }
+
+        if (fds[1].revents & POLLIN) {
+            int fd = accept(record_listen_fd, NULL, NULL);
+            if (fd >= 0 && nclients < RECORD_MAX_CLIENTS) {
+                fds[2 + nclients].fd = fd;
+                fds[2 + nclients].events = POLLIN;
+                fds[2 + nclients].revents = 0;
+                nclients++;
+            } else if (fd >= 0) {
+                g_printerr("Too many record control clients\n");
+                close(fd);
             }
-            fclose(cmd_file);
-            
-            // Delete the command file after processing
-            remove(RECORD_CMD_FILE);
         }
-        
-        usleep(100000);  // Check every 100ms
     }
-    
+
+    for (int i = 2; i < 2 + nclients; i++) {
+        close(fds[i].fd);
+    }
     g_print("Record control thread exiting\n");
     return NULL;
 }
 
+// Capture source: the camera, or in simulation a test pattern or a file
+// decoded to raw video and replayed in real time
+static GstElement* make_video_source(const VideoConfig *config) {
+    GstElement *source;
+    if (!config->simulate) {
+        source = gst_element_factory_make("v4l2src", "source");
+        if (source) g_object_set(G_OBJECT(source), "device", "/dev/video0", NULL);
+        return source;
+    }
+    if (config->sim_input[0] == '\0') {
+        source = gst_element_factory_make("videotestsrc", "source");
+        if (source) {
+            g_object_set(G_OBJECT(source), "is-live", TRUE, NULL);
+            gst_util_set_object_arg(G_OBJECT(source), "pattern", "ball");
+        }
+        return source;
+    }
+
+    // The capture_caps filter after it picks size, rate and NV12
+    GError *err = NULL;
+    gchar *desc = g_strdup_printf("filesrc location=\"%s\" ! decodebin ! videoconvert ! videoscale ! "
+                                  "videorate ! identity sync=true", config->sim_input);
+    source = gst_parse_bin_from_description(desc, TRUE, &err);
+    g_free(desc);
+    if (!source) {
+        g_printerr("Failed to open %s for replay: %s\n", config->sim_input, err ? err->message : "unknown");
+        g_clear_error(&err);
+        return NULL;
+    }
+    gst_object_set_name(GST_OBJECT(source), "source");
+    return source;
+}
+
+// Hardware HEVC encoder, or a software encoder in simulation. *h264 tells
+// the caller which parser and stream format go after it.
+static GstElement* make_video_encoder(const VideoConfig *config, gboolean *h264) {
+    GstElement *enc;
+    *h264 = config->simulate && strcmp(config->sim_encoder, "x264") == 0;
+    if (!config->simulate) {
+        return gst_element_factory_make("mpph265enc", "encoder");
+    }
+    enc = gst_element_factory_make(*h264 ? "x264enc" : "x265enc", "encoder");
+    if (enc) {
+        gst_util_set_object_arg(G_OBJECT(enc), "speed-preset", "ultrafast");
+        gst_util_set_object_arg(G_OBJECT(enc), "tune", "zerolatency");
+    }
+    return enc;
+}
+
+// Report once per negotiation whether the sound card delivers the rate and
+// channels the encoder takes, or audioresample/audioconvert have work
+static GstPadProbeReturn audio_format_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+    if (GST_EVENT_TYPE(event) != GST_EVENT_CAPS) {
+        return GST_PAD_PROBE_OK;
+    }
+    GstCaps *caps = NULL;
+    gst_event_parse_caps(event, &caps);
+    GstElement *filter = gst_bin_get_by_name(GST_BIN(pipeline), "audio_caps");
+    GstCaps *target = NULL;
+    if (filter) {
+        g_object_get(G_OBJECT(filter), "caps", &target, NULL);
+        gst_object_unref(filter);
+    }
+    gchar *desc = gst_caps_to_string(caps);
+    if (target && gst_caps_can_intersect(caps, target)) {
+        g_print("Audio input %s, no resampling\n", desc);
+    } else {
+        g_print("Audio input %s, resampled/remixed for the encoder\n", desc);
+    }
+    g_free(desc);
+    if (target) gst_caps_unref(target);
+    return GST_PAD_PROBE_OK;
+}
+
 GstElement* create_pipeline(VideoConfig *config) {
     if (!config) {
         g_printerr("VideoConfig is NULL in create_pipeline.\n");
         return NULL;
     }
 
-    GstElement *source, *tee, *enc_queue, *enc, *parse, *mux,
-               *app_queue, *videoscale, *capsfilter_scale, *videoconvert, *capsfilter_rgba, *videoflip, *app_sink,
-               *audio_src, *audio_queue, *audio_convert, *audio_resample, *audio_enc;
-    GstAppSinkCallbacks callbacks = { NULL, NULL, on_new_sample };
+    GstElement *source, *capture_caps, *tee, *enc_queue, *eis, *enc, *parse,
+               *app_queue, *preview_xform, *app_sink,
+               *audio_src, *audio_queue, *audio_convert, *audio_resample, *audio_caps, *audio_enc;
 
     // Create the pipeline
     pipeline = gst_pipeline_new("video-pipeline");
+
+    // Capture times (base time + PTS) are CLOCK_MONOTONIC, the timebase
+    // shared with IMU and GNSS. Without this the pipeline would run on the
+    // sound card's clock that alsasrc provides.
+    if (pipeline) {
+        GstClock *clock = gst_system_clock_obtain();
+        g_object_set(G_OBJECT(clock), "clock-type", GST_CLOCK_TYPE_MONOTONIC, NULL);
+        gst_pipeline_use_clock(GST_PIPELINE(pipeline), clock);
+        gst_object_unref(clock);
+    }
     
     // Create all elements
-    source = gst_element_factory_make("v4l2src", "source");
+    source = make_video_source(config);
+    capture_caps = gst_element_factory_make("capsfilter", "capture_caps");
     tee = gst_element_factory_make("tee", "tee");
     
     // Recording branch elements
     enc_queue = gst_element_factory_make("queue", "enc_queue");
-    enc = gst_element_factory_make("mpph265enc", "encoder");
-    parse = gst_element_factory_make("h265parse", "parser");
-    mux = gst_element_factory_make("matroskamux", "muxer");
-    filesink = gst_element_factory_make("filesink", "filesink");
-    video_valve = gst_element_factory_make("valve", "video_valve");
+    // Gyro stabilization; passes frames through unless config->eis is set
+    // (reconfig_install), so it can be switched on while running
+    eis = gst_element_factory_make("eisstabilize", "eis");
+    gboolean h264;
+    enc = make_video_encoder(config, &h264);
+    parse = gst_element_factory_make(h264 ? "h264parse" : "h265parse", "parser");
+    video_prerecord = gst_element_factory_make("prerecord", "video_prerecord");
+
+    // Recording integrity: encoded data waits in time-sized, non-leaky
+    // queues while the card stalls. Raw frames cannot wait (the camera owns
+    // their buffers), so the leaky enc_queue only overflows once
+    // record_buffer_ms of encoded data is queued.
+    GstElement *record_queue = NULL, *audio_record_queue = NULL;
+    if (pipeline && config->record_integrity) {
+        record_queue = gst_element_factory_make("queue", "record_queue");
+        audio_record_queue = gst_element_factory_make("queue", "audio_record_queue");
+        if (!record_queue || !audio_record_queue) {
+            g_printerr("Failed to create recording buffer queues\n");
+            if (record_queue) gst_object_unref(record_queue);
+            if (audio_record_queue) gst_object_unref(audio_record_queue);
+            gst_object_unref(pipeline);
+            return NULL;
+        }
+        // Bounded by max-size-time only (record_buffer_ms, set live)
+        g_object_set(G_OBJECT(record_queue), "max-size-buffers", 0, "max-size-bytes", 0, NULL);
+        g_object_set(G_OBJECT(audio_record_queue), "max-size-buffers", 0, "max-size-bytes", 0, NULL);
+        gst_bin_add_many(GST_BIN(pipeline), record_queue, audio_record_queue, NULL);
+    }
     
     // Audio branch elements
-    audio_src = gst_element_factory_make("alsasrc", "audio-source");
+    audio_src = gst_element_factory_make(config->simulate ? "audiotestsrc" : "alsasrc", "audio-source");
     audio_queue = gst_element_factory_make("queue", "audio_queue");
     audio_convert = gst_element_factory_make("audioconvert", "audio-convert");
     audio_resample = gst_element_factory_make("audioresample", "audio-resample");
-    audio_enc = gst_element_factory_make("vorbisenc", "audio-encoder");
-    audio_valve = gst_element_factory_make("valve", "audio_valve");
+    audio_caps = gst_element_factory_make("capsfilter", "audio_caps");
+    audio_enc = gst_element_factory_make(reconfig_audio_encoder_factory(config), "audio-encoder");
+    audio_prerecord = gst_element_factory_make("prerecord", "audio_prerecord");
     
     // Preview branch elements
     app_queue = gst_element_factory_make("queue", "app_queue");
-    videoscale = gst_element_factory_make("videoscale", "videoscale");
-    capsfilter_scale = gst_element_factory_make("capsfilter", "scale_caps");
-    videoconvert = gst_element_factory_make("videoconvert", "converter");
-    capsfilter_rgba = gst_element_factory_make("capsfilter", "rgba_caps");
-    videoflip = gst_element_factory_make("videoflip", "videoflip");
+    preview_xform = gst_element_factory_make("previewtransform", "preview_transform");
     app_sink = gst_element_factory_make("appsink", "app_sink");
 
     // Check element creation
-    if (!pipeline || !source || !tee || 
-        !enc_queue || !enc || !parse || !mux || !filesink || !video_valve ||
-        !audio_src || !audio_queue || !audio_convert || !audio_resample || !audio_enc || !audio_valve ||
-        !app_queue || !videoscale || !capsfilter_scale || !videoconvert || !capsfilter_rgba || !videoflip || !app_sink) {
+    if (!pipeline || !source || !capture_caps || !tee || 
+        !enc_queue || !eis || !enc || !parse || !video_prerecord ||
+        !audio_src || !audio_queue || !audio_convert || !audio_resample || !audio_caps || !audio_enc ||
+        !audio_prerecord ||
+        !app_queue || !preview_xform || !app_sink) {
         g_printerr("Failed to create pipeline elements\n");
         if (pipeline) gst_object_unref(pipeline);
         return NULL;
     }
 
     // Configure elements
-    // Source configuration
-    g_object_set(G_OBJECT(source), "device", "/dev/video0", NULL);
-    
-    // Queue configuration (to prevent lockups)
+    // Queue configuration (to prevent lockups); depths come from the config
+    GstCaps *src_caps = reconfig_capture_caps(config);
+    g_object_set(G_OBJECT(capture_caps), "caps", src_caps, NULL);
+    gst_caps_unref(src_caps);
     g_object_set(G_OBJECT(enc_queue), 
-                "max-size-buffers", 3,
                 "max-size-time", 0,
                 "leaky", 2, // Downstream leaky queue
                 NULL);
     g_object_set(G_OBJECT(app_queue), 
-                "max-size-buffers", 3,
                 "max-size-time", 0,
                 "leaky", 2, // Downstream leaky queue
                 NULL);
     g_object_set(G_OBJECT(audio_queue), 
-                "max-size-buffers", 3,
                 "max-size-time", 0,
                 "leaky", 2, // Downstream leaky queue
                 NULL);
     
-    // Set valves to drop (closed) initially
-    g_object_set(G_OBJECT(video_valve), "drop", TRUE, NULL);
-    g_object_set(G_OBJECT(audio_valve), "drop", TRUE, NULL);
-    
-    // Filesink initially points to a dummy file
-    g_object_set(G_OBJECT(filesink), "location", "/tmp/dummy.mkv", NULL);
+    // The encoder runs all the time; until recording starts its output only
+    // fills the pre-record buffers. One keyframe per second (the default
+    // GOP) bounds how far past the requested pre-record time the oldest GOP
+    // reaches. Rate control, GOP, queue depths, pre-record limits and the
+    // preview geometry are set by reconfig_install() in start_pipeline.
+    reconfig_encoder(enc, config);
     
     // Audio configuration
-    g_object_set(G_OBJECT(audio_src), "device", "hw:0,0", NULL); 
+    if (config->simulate) {
+        g_object_set(G_OBJECT(audio_src), "is-live", TRUE, NULL);
+    } else {
+        g_object_set(G_OBJECT(audio_src), "device", "hw:0,0", NULL);
+    }
+    // Sample format, rate and channels the encoder gets. The source is
+    // asked for them first, so convert/resample normally pass through.
+    GstCaps *raw_audio = reconfig_audio_caps(config);
+    g_object_set(G_OBJECT(audio_caps), "caps", raw_audio, NULL);
+    gst_caps_unref(raw_audio);
     g_object_set(G_OBJECT(audio_resample), "quality", 2, NULL);
+    reconfig_audio_encoder(audio_enc, config);
+    GstPad *audio_src_pad = gst_element_get_static_pad(audio_src, "src");
+    gst_pad_add_probe(audio_src_pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, audio_format_probe, NULL, NULL);
+    gst_object_unref(audio_src_pad);
     
     // Preview branch configuration
-    g_object_set(G_OBJECT(app_sink), 
-                "emit-signals", TRUE,
-                "sync", FALSE,
-                "drop", TRUE, // Drop buffers if queue full
-                "max-buffers", 2,
-                NULL);
-    gst_app_sink_set_callbacks(GST_APP_SINK(app_sink), &callbacks, NULL, NULL);
-    g_object_set(G_OBJECT(videoflip), "method", 1, NULL);  // 90-degree clockwise rotation
-
-    // Set scale caps (NV12 -> 800x450)
-    GstCaps *scale_caps = gst_caps_new_simple("video/x-raw",
-                                             "format", G_TYPE_STRING, "NV12",
-                                             "width", G_TYPE_INT, 800,
-                                             "height", G_TYPE_INT, 450,
-                                             NULL);
-    g_object_set(capsfilter_scale, "caps", scale_caps, NULL);
-    gst_caps_unref(scale_caps);
-
-    // Set ARGB conversion caps
-    GstCaps *argb_caps = gst_caps_new_simple("video/x-raw",
-                                           "format", G_TYPE_STRING, "BGRA",
-                                           NULL);
-    g_object_set(capsfilter_rgba, "caps", argb_caps, NULL);
-    gst_caps_unref(argb_caps);
+    setup_preview_sink(app_sink, TRUE);
+
+    // Scale (NV12 -> preview size), convert to BGRA and rotate in one pass
+    // instead of videoscale ! videoconvert ! videoflip
 
     // Add all elements to pipeline
     gst_bin_add_many(GST_BIN(pipeline),
-                    source, tee, 
-                    enc_queue, video_valve, enc, parse, mux, filesink,
-                    audio_src, audio_queue, audio_valve, audio_convert, audio_resample, audio_enc,
-                    app_queue, videoscale, capsfilter_scale, videoconvert, capsfilter_rgba, videoflip, app_sink,
+                    source, capture_caps, tee, 
+                    enc_queue, eis, enc, parse, video_prerecord,
+                    audio_src, audio_queue, audio_convert, audio_resample, audio_caps, audio_enc,
+                    audio_prerecord,
+                    app_queue, preview_xform, app_sink,
                     NULL);
 
-    // Set source caps based on config
-    GstCaps *src_caps = gst_caps_new_simple("video/x-raw",
-                                           "format", G_TYPE_STRING, "NV12",
-                                           "width", G_TYPE_INT, config->record_width,
-                                           "height", G_TYPE_INT, config->record_height,
-                                           "framerate", GST_TYPE_FRACTION, config->record_framerate, 1,
-                                           NULL);
-    
-    // Link source to tee
-    if (!gst_element_link_filtered(source, tee, src_caps)) {
+    // Link source to tee through a named capsfilter, so a capture format
+    // change only has to swap its caps and restart the source
+    if (!gst_element_link_many(source, capture_caps, tee, NULL)) {
         g_printerr("Failed to link source to tee\n");
-        gst_caps_unref(src_caps);
         gst_object_unref(pipeline);
         return NULL;
     }
-    gst_caps_unref(src_caps);
     
     // Link preview branch
-    if (!gst_element_link_many(tee, app_queue, videoscale, capsfilter_scale,
-                             videoconvert, capsfilter_rgba, videoflip, app_sink, NULL)) {
+    if (!gst_element_link_many(tee, app_queue, preview_xform, app_sink, NULL)) {
         g_printerr("Failed to link preview branch\n");
         gst_object_unref(pipeline);
         return NULL;
     }
     
-    // Link recording video branch with valve
-    if (!gst_element_link_many(tee, enc_queue, video_valve, enc, parse, mux, filesink, NULL)) {
+    // Link recording video branch up to the pre-record buffer after the parser.
+    // Its output is linked to a splitmuxsink only while recording, so fix
+    // the stream format matroskamux wants here.
+    if (!gst_element_link_many(tee, enc_queue, eis, enc, parse, NULL)) {
+        g_printerr("Failed to link recording video branch\n");
+        gst_object_unref(pipeline);
+        return NULL;
+    }
+    GstCaps *enc_caps = gst_caps_new_simple(h264 ? "video/x-h264" : "video/x-h265",
+                                            "stream-format", G_TYPE_STRING, h264 ? "avc" : "hvc1",
+                                            "alignment", G_TYPE_STRING, "au",
+                                            NULL);
+    if (!gst_element_link_filtered(parse, record_queue ? record_queue : video_prerecord, enc_caps) ||
+        (record_queue && !gst_element_link(record_queue, video_prerecord))) {
         g_printerr("Failed to link recording video branch\n");
+        gst_caps_unref(enc_caps);
         gst_object_unref(pipeline);
         return NULL;
     }
+    gst_caps_unref(enc_caps);
     
-    // Link recording audio branch with valve
-    if (!gst_element_link_many(audio_src, audio_queue, audio_valve, audio_convert, audio_resample, audio_enc, mux, NULL)) {
+    // Link recording audio branch with the pre-record buffer after the encoder
+    if (!gst_element_link_many(audio_src, audio_queue, audio_convert, audio_resample, audio_caps, audio_enc, NULL) ||
+        (audio_record_queue && !gst_element_link_many(audio_enc, audio_record_queue, audio_prerecord, NULL)) ||
+        (!audio_record_queue && !gst_element_link(audio_enc, audio_prerecord))) {
         g_printerr("Failed to link recording audio branch\n");
         gst_object_unref(pipeline);
         return NULL;
     }
+
+    // IMU and GNSS samples from their processes, muxed like audio
+    if (config->telemetry_tracks && !telemetry_mux_add(pipeline)) {
+        gst_object_unref(pipeline);
+        return NULL;
+    }
     
-    g_print("Pipeline created successfully\n");
+    g_print("Pipeline created successfully%s\n", config->simulate ? " (simulation)" : "");
     return pipeline;
 }
 
+// Gyro for the stabilizer, straight from the telemetry receiver
+static void on_imu_sample(const TelemetryImu *sample, gpointer user_data) {
+    eis_gyro_add(sample->mono_ns, sample->gyro);
+    eis_attitude_set(sample->mono_ns, sample->roll, sample->pitch);
+}
+
 void start_pipeline(GstElement *pipeline_arg, VideoConfig *config) {
     if (!pipeline_arg) {
         g_printerr("Pipeline is NULL.\n");
@@ -412,21 +1028,80 @@ void start_pipeline(GstElement *pipeline_arg, VideoConfig *config) {
     // Save pipeline reference globally
     pipeline = pipeline_arg;
 
-    // Initialize semaphore and recording control
-    init_semaphore();
+    // Initialize recording control
     init_record_control();
 
+    // Publish the monotonic -> UTC offset for the session manifests (and
+    // for IMU/GNSS, whichever process starts first)
+    timebase_open();
+    if (timebase_publish_system() != 0) {
+        g_print("System clock not set, UTC offset left to GNSS\n");
+    }
+
+    // Recording elements by name, so pipelines built elsewhere (benchmarks) work too
+    if (!video_prerecord) video_prerecord = gst_bin_get_by_name(GST_BIN(pipeline), "video_prerecord");
+    if (!audio_prerecord) audio_prerecord = gst_bin_get_by_name(GST_BIN(pipeline), "audio_prerecord");
+    if (!imu_prerecord) imu_prerecord = gst_bin_get_by_name(GST_BIN(pipeline), "imu_prerecord");
+    if (!gnss_prerecord) gnss_prerecord = gst_bin_get_by_name(GST_BIN(pipeline), "gnss_prerecord");
+    // The bin keeps its children alive
+    if (video_prerecord) gst_object_unref(video_prerecord);
+    if (audio_prerecord) gst_object_unref(audio_prerecord);
+    if (imu_prerecord) gst_object_unref(imu_prerecord);
+    if (gnss_prerecord) gst_object_unref(gnss_prerecord);
+    if (!video_prerecord) {
+        g_printerr("Pipeline has no video_prerecord, recording disabled\n");
+    } else {
+        GstPad *pad = gst_element_get_static_pad(video_prerecord, "src");
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, record_first_frame_probe, NULL, NULL);
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, record_index_probe, NULL, NULL);
+        gst_object_unref(pad);
+    }
+
+    // Settings that can change while running: applied once now, and again
+    // from the control socket
+    g_strlcpy(record_container, config->record_container, sizeof(record_container));
+    reconfig_install(pipeline, config);
+
+    // Latency, drop and bitrate counters in shared memory (video_stats)
+    pipeline_probes_install(pipeline);
+    pipeline_probes_set_gap_callback(on_record_gap, NULL);
+
+    // Segment open/close messages and the end of each recording session
+    g_object_set(G_OBJECT(pipeline), "message-forward", TRUE, NULL);
+    GstBus *bus = gst_element_get_bus(pipeline);
+    gst_bus_set_sync_handler(bus, record_bus_sync_handler, NULL, NULL);
+    gst_object_unref(bus);
+
     // Start pipeline
     GstStateChangeReturn ret = gst_element_set_state(pipeline, GST_STATE_PLAYING);
     if (ret == GST_STATE_CHANGE_FAILURE) {
         g_printerr("Failed to start pipeline\n");
         return;
     }
+
+    // IMU/GNSS samples into their pre-record buffers, the gyro to the
+    // stabilizer and the attitude to the preview overlay
+    GstElement *eis = gst_bin_get_by_name(GST_BIN(pipeline), "eis");
+    gboolean stabilize = eis != NULL;
+    if (eis) {
+        eis_gyro_reset(0);
+        telemetry_mux_set_imu_callback(on_imu_sample, NULL);
+        gst_object_unref(eis);
+    }
+    if (imu_prerecord || gnss_prerecord || stabilize) {
+        telemetry_mux_start(pipeline, (guint)config->fragment_ms);
+    }
     
-    // Start monitoring thread
-    thread_running = 1;
-    if (pthread_create(&record_thread_id, NULL, record_control_thread, config) != 0) {
-        g_printerr("Failed to create record control thread\n");
+    // Start record control server
+    if (video_prerecord) {
+        record_listen_fd = record_ctl_listen();
+        record_stop_fd = eventfd(0, EFD_CLOEXEC);
+        if (record_listen_fd < 0 || record_stop_fd < 0 ||
+            pthread_create(&record_thread_id, NULL, record_control_thread, config) != 0) {
+            g_printerr("Failed to create record control thread\n");
+        } else {
+            record_thread_started = 1;
+        }
     }
     
     g_print("Pipeline started successfully\n");
@@ -463,33 +1138,51 @@ void monitor_pipeline(GstElement *pipeline_arg) {
 }
 
 void cleanup_pipeline(GstElement *pipeline_arg) {
+    // Signal thread to exit and wait for it
+    if (record_thread_started) {
+        uint64_t one = 1;
+        if (write(record_stop_fd, &one, sizeof(one)) != sizeof(one)) {
+            perror("Failed to signal record control thread");
+        }
+        pthread_join(record_thread_id, NULL);
+        record_thread_started = 0;
+    }
+    if (record_listen_fd >= 0) {
+        close(record_listen_fd);
+        unlink(RECORD_CTL_SOCKET);
+        record_listen_fd = -1;
+    }
+    if (record_stop_fd >= 0) {
+        close(record_stop_fd);
+        record_stop_fd = -1;
+    }
+
     // Stop recording if active
     if (is_recording) {
         stop_recording();
     }
-    
-    // Signal thread to exit and wait for it
-    thread_running = 0;
-    if (record_thread_id) {
-        pthread_join(record_thread_id, NULL);
-    }
+    telemetry_mux_stop();
     
     // Clean up pipeline
     if (pipeline_arg) {
         gst_element_set_state(pipeline_arg, GST_STATE_NULL);
         gst_object_unref(pipeline_arg);
     }
+    pipeline_probes_cleanup();
     
-    // Clean up semaphore
-    if (sem) {
-        sem_close(sem);
-        sem_unlink("/preview_sem");
-    }
-    
+    gst_caps_replace(&preview_caps, NULL);
+    timebase_close();
+
     // Clean up shared memory
     if (record_control) {
         shmdt(record_control);
+        record_control = NULL;
     }
+    pipeline = NULL;
+    video_prerecord = NULL;
+    audio_prerecord = NULL;
+    imu_prerecord = NULL;
+    gnss_prerecord = NULL;
     
     g_print("Pipeline cleaned up\n");
 }
\ No newline at end of file
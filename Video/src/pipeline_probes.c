@@ -0,0 +1,459 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/src/pipeline_probes.c
+ */
+#include "pipeline_probes.h"
+#include "reconfig.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#define REFRESH_INTERVAL_US     G_USEC_PER_SEC
+// How far ahead of a stray buffer a muxed frame may be matched
+#define MUX_MATCH_WINDOW        8
+
+static PipelineStatsBlock *stats = NULL;
+static PipelineStatsBlock local_stats;  // when shared memory is unavailable
+static int stats_shmid = -1;
+static GstElement *stats_pipeline = NULL;
+static GstElement *queues[PIPELINE_QUEUE_COUNT];
+static const char *queue_elements[PIPELINE_QUEUE_COUNT] = { "enc_queue", "app_queue", "audio_queue", "record_queue" };
+
+// Capture thread only
+static GstClockTime capture_last_pts = GST_CLOCK_TIME_NONE;
+static gint64 refresh_last_us = 0;
+static guint64 refresh_last_bytes = 0;
+
+// Encoder input gaps. The pending DISCONT is set by the encoder input
+// thread and taken by the first encoded frame at or past it.
+static guint64 encode_last_offset = GST_BUFFER_OFFSET_NONE;
+static GstClockTime encode_last_pts = GST_CLOCK_TIME_NONE;
+static GstClockTime gap_pending = GST_CLOCK_TIME_NONE;
+static PipelineGapFunc gap_callback = NULL;
+static gpointer gap_data = NULL;
+
+// A recorded video frame on its way to the card
+typedef struct {
+    GstClockTime capture;   // NONE for frames buffered before the start
+    gsize size;
+    guint64 end;            // offset just past it in the bytes handed to storagesink
+} RecordFrame;
+
+// Recording session being followed; all of it under record_lock
+static GMutex record_lock;
+static gboolean record_active = FALSE;
+static GstClockTime record_start = GST_CLOCK_TIME_NONE;
+static GQueue record_released = G_QUEUE_INIT;   // out of video_prerecord
+static GQueue record_muxing = G_QUEUE_INIT;     // into the muxer
+static GQueue record_writing = G_QUEUE_INIT;    // out of the muxer, not yet written
+static guint64 record_rendered = 0;             // bytes into storagesink this session
+
+static guint64 monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (guint64)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static GstClockTime clock_now(void) {
+    GstClock *clock = gst_element_get_clock(stats_pipeline);
+    if (!clock) {
+        return GST_CLOCK_TIME_NONE;
+    }
+    GstClockTime now = gst_clock_get_time(clock);
+    gst_object_unref(clock);
+    return now;
+}
+
+// Pipeline clock time the frame was captured
+static GstClockTime capture_time(GstBuffer *buffer) {
+    if (!GST_BUFFER_PTS_IS_VALID(buffer)) {
+        return GST_CLOCK_TIME_NONE;
+    }
+    return gst_element_get_base_time(stats_pipeline) + GST_BUFFER_PTS(buffer);
+}
+
+static void add_latency(PipelineLatencyHist *hist, GstClockTime capture) {
+    GstClockTime now = clock_now();
+    if (GST_CLOCK_TIME_IS_VALID(capture) && GST_CLOCK_TIME_IS_VALID(now) && now >= capture) {
+        pipeline_stats_add_latency(hist, (now - capture) / GST_USECOND);
+    }
+}
+
+// Queue levels, drops and the bitrate, once a second from the capture thread
+static void refresh(void) {
+    gint64 now = g_get_monotonic_time();
+    if (now - refresh_last_us < REFRESH_INTERVAL_US) {
+        return;
+    }
+
+    guint64 decimated = reconfig_preview_decimated();
+    PIPELINE_STATS_SET(stats->preview_decimated, decimated);
+    for (int i = 0; i < PIPELINE_QUEUE_COUNT; i++) {
+        PipelineQueueStats *q = &stats->queues[i];
+        guint level = 0;
+        if (!queues[i]) continue;
+        g_object_get(G_OBJECT(queues[i]), "current-level-buffers", &level, NULL);
+
+        // Whatever went in and neither came out nor is queued was leaked;
+        // preview_fps skips happen between the tee and the queue
+        gint64 lost = (gint64)__atomic_load_n(&q->in, __ATOMIC_RELAXED) -
+                      (gint64)__atomic_load_n(&q->out, __ATOMIC_RELAXED) - level -
+                      (i == PIPELINE_QUEUE_PREVIEW ? (gint64)decimated : 0);
+        if (lost > (gint64)q->dropped) {
+            PIPELINE_STATS_SET(q->dropped, (guint64)lost);
+        }
+        PIPELINE_STATS_SET(q->level, level);
+        if (level > q->level_max) {
+            PIPELINE_STATS_SET(q->level_max, level);
+        }
+    }
+
+    guint64 bytes = __atomic_load_n(&stats->encoded_bytes, __ATOMIC_RELAXED);
+    if (refresh_last_us > 0) {
+        PIPELINE_STATS_SET(stats->bitrate_bps,
+                           (bytes - refresh_last_bytes) * 8 * G_USEC_PER_SEC / (guint64)(now - refresh_last_us));
+    }
+    refresh_last_bytes = bytes;
+    refresh_last_us = now;
+    PIPELINE_STATS_SET(stats->updated_ns, monotonic_ns());
+}
+
+// Source thread pushing into the tee: frame count and timestamp gaps
+static GstPadProbeReturn capture_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    GstClockTime pts = GST_BUFFER_PTS(buffer);
+    GstClockTime duration = GST_BUFFER_DURATION(buffer);
+
+    PIPELINE_STATS_ADD(stats->captured, 1);
+    if (GST_CLOCK_TIME_IS_VALID(pts) && GST_CLOCK_TIME_IS_VALID(capture_last_pts) &&
+        GST_CLOCK_TIME_IS_VALID(duration) && duration > 0 && pts > capture_last_pts) {
+        guint64 frames = (pts - capture_last_pts + duration / 2) / duration;
+        if (frames > 1) {
+            PIPELINE_STATS_ADD(stats->capture_missing, frames - 1);
+        }
+    }
+    capture_last_pts = pts;
+    refresh();
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn queue_in_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    PIPELINE_STATS_ADD(((PipelineQueueStats *)user_data)->in, 1);
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn queue_out_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    PIPELINE_STATS_ADD(((PipelineQueueStats *)user_data)->out, 1);
+    return GST_PAD_PROBE_OK;
+}
+
+// Frames missing between two buffers leaving enc_queue: the source counts
+// its frames in the buffer offset, otherwise the timestamps tell
+static guint64 encode_missing(GstBuffer *buffer) {
+    guint64 offset = GST_BUFFER_OFFSET(buffer);
+    GstClockTime pts = GST_BUFFER_PTS(buffer);
+    GstClockTime duration = GST_BUFFER_DURATION(buffer);
+    guint64 missing = 0;
+
+    if (offset != GST_BUFFER_OFFSET_NONE && encode_last_offset != GST_BUFFER_OFFSET_NONE) {
+        // A smaller offset is a restarted source, not a gap
+        if (offset > encode_last_offset + 1) {
+            missing = offset - encode_last_offset - 1;
+        }
+    } else if (GST_CLOCK_TIME_IS_VALID(pts) && GST_CLOCK_TIME_IS_VALID(encode_last_pts) &&
+               GST_CLOCK_TIME_IS_VALID(duration) && duration > 0 && pts > encode_last_pts) {
+        guint64 frames = (pts - encode_last_pts + duration / 2) / duration;
+        missing = frames > 1 ? frames - 1 : 0;
+    }
+    encode_last_offset = offset;
+    encode_last_pts = pts;
+    return missing;
+}
+
+// Raw frames the leaky enc_queue let go never reach the recording
+static GstPadProbeReturn encode_input_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    guint64 missing = encode_missing(buffer);
+    if (missing == 0) {
+        return GST_PAD_PROBE_OK;
+    }
+    PIPELINE_STATS_ADD(stats->encode_missing, missing);
+
+    g_mutex_lock(&record_lock);
+    gboolean recording = record_active;
+    if (recording) {
+        gap_pending = GST_BUFFER_PTS(buffer);
+    }
+    g_mutex_unlock(&record_lock);
+    if (recording) {
+        PIPELINE_STATS_ADD(stats->record_gaps, 1);
+        PIPELINE_STATS_ADD(stats->record_lost, missing);
+        if (gap_callback) {
+            gap_callback(GST_BUFFER_PTS(buffer), missing, gap_data);
+        }
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+// Parsed encoder output on its way to video_prerecord
+static GstPadProbeReturn encoded_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+
+    // First frame after a gap: players and the index tool see the hole
+    GstClockTime gap = __atomic_load_n(&gap_pending, __ATOMIC_RELAXED);
+    if (GST_CLOCK_TIME_IS_VALID(gap) && GST_BUFFER_PTS_IS_VALID(buffer) && GST_BUFFER_PTS(buffer) >= gap) {
+        __atomic_store_n(&gap_pending, GST_CLOCK_TIME_NONE, __ATOMIC_RELAXED);
+        buffer = gst_buffer_make_writable(buffer);
+        GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DISCONT);
+        GST_PAD_PROBE_INFO_DATA(info) = buffer;
+    }
+    PIPELINE_STATS_ADD(stats->encoded, 1);
+    PIPELINE_STATS_ADD(stats->encoded_bytes, gst_buffer_get_size(buffer));
+    if (!GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+        PIPELINE_STATS_ADD(stats->keyframes, 1);
+    }
+    add_latency(&stats->capture_to_encoded, capture_time(buffer));
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn preview_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    PIPELINE_STATS_ADD(stats->preview_published, 1);
+    add_latency(&stats->capture_to_preview, capture_time(GST_PAD_PROBE_INFO_BUFFER(info)));
+    return GST_PAD_PROBE_OK;
+}
+
+/* ---------- following recorded frames to the card ---------- */
+
+static void clear_frames(GQueue *queue) {
+    RecordFrame *frame;
+    while ((frame = g_queue_pop_head(queue))) {
+        g_free(frame);
+    }
+}
+
+// video_prerecord output, in order: buffered GOPs first, then live frames
+static GstPadProbeReturn record_release_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    GstClockTime capture = capture_time(buffer);
+
+    g_mutex_lock(&record_lock);
+    if (record_active) {
+        RecordFrame *frame = g_new0(RecordFrame, 1);
+        frame->capture = GST_CLOCK_TIME_IS_VALID(capture) && GST_CLOCK_TIME_IS_VALID(record_start) &&
+                         capture >= record_start ? capture : GST_CLOCK_TIME_NONE;
+        frame->size = gst_buffer_get_size(buffer);
+        g_queue_push_tail(&record_released, frame);
+    }
+    g_mutex_unlock(&record_lock);
+    return GST_PAD_PROBE_OK;
+}
+
+// splitmuxsink holds a GOP back before the muxer sees it
+static GstPadProbeReturn record_mux_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    g_mutex_lock(&record_lock);
+    RecordFrame *frame = record_active ? g_queue_pop_head(&record_released) : NULL;
+    if (frame) {
+        frame->size = gst_buffer_get_size(GST_PAD_PROBE_INFO_BUFFER(info));
+        g_queue_push_tail(&record_muxing, frame);
+        PIPELINE_STATS_ADD(stats->record_frames, 1);
+    }
+    g_mutex_unlock(&record_lock);
+    return GST_PAD_PROBE_OK;
+}
+
+// Muxer output entering storagesink. A buffer the size of a pending frame
+// is that frame; headers, audio and index data only advance the offset.
+static void record_rendered_buffer(gsize size) {
+    record_rendered += size;
+    guint n = MIN(record_muxing.length, MUX_MATCH_WINDOW);
+    for (guint i = 0; i < n; i++) {
+        RecordFrame *frame = g_queue_peek_nth(&record_muxing, i);
+        if (frame->size != size) continue;
+        // Frames skipped over were muxed before this one
+        for (guint j = 0; j <= i; j++) {
+            RecordFrame *done = g_queue_pop_head(&record_muxing);
+            done->end = j < i ? record_rendered - size : record_rendered;
+            g_queue_push_tail(&record_writing, done);
+        }
+        break;
+    }
+}
+
+static gboolean rendered_list_item(GstBuffer **buffer, guint idx, gpointer user_data) {
+    record_rendered_buffer(gst_buffer_get_size(*buffer));
+    return TRUE;
+}
+
+static GstPadProbeReturn record_render_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    g_mutex_lock(&record_lock);
+    if (record_active) {
+        if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+            gst_buffer_list_foreach(GST_PAD_PROBE_INFO_BUFFER_LIST(info), rendered_list_item, NULL);
+        } else {
+            record_rendered_buffer(gst_buffer_get_size(GST_PAD_PROBE_INFO_BUFFER(info)));
+        }
+    }
+    g_mutex_unlock(&record_lock);
+    return GST_PAD_PROBE_OK;
+}
+
+// storagesink writer thread: bytes up to "total" are in the file
+static void on_storage_written(GstElement *storage, guint64 total, gpointer user_data) {
+    g_mutex_lock(&record_lock);
+    RecordFrame *frame;
+    while (record_active && (frame = g_queue_peek_head(&record_writing)) && frame->end <= total) {
+        g_queue_pop_head(&record_writing);
+        PIPELINE_STATS_ADD(stats->record_written, 1);
+        add_latency(&stats->capture_to_disk, frame->capture);
+        g_free(frame);
+    }
+    g_mutex_unlock(&record_lock);
+}
+
+static void on_mux_pad_added(GstElement *mux, GstPad *pad, gpointer user_data) {
+    gchar *name = gst_pad_get_name(pad);
+    if (GST_PAD_IS_SINK(pad) && g_str_has_prefix(name, "video")) {
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, record_mux_probe, NULL, NULL);
+    }
+    g_free(name);
+}
+
+void pipeline_probes_record_start(GstElement *mux, GstElement *storage) {
+    if (!stats) {
+        return;
+    }
+    g_mutex_lock(&record_lock);
+    clear_frames(&record_released);
+    clear_frames(&record_muxing);
+    clear_frames(&record_writing);
+    record_rendered = 0;
+    record_start = clock_now();
+    record_active = TRUE;
+    gap_pending = GST_CLOCK_TIME_NONE;
+    g_mutex_unlock(&record_lock);
+    PIPELINE_STATS_ADD(stats->record_sessions, 1);
+
+    // The muxer's pads are requested when splitmuxsink links up
+    g_signal_connect(mux, "pad-added", G_CALLBACK(on_mux_pad_added), NULL);
+    GstPad *pad = gst_element_get_static_pad(storage, "sink");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+                      record_render_probe, NULL, NULL);
+    gst_object_unref(pad);
+    g_signal_connect(storage, "written", G_CALLBACK(on_storage_written), NULL);
+}
+
+void pipeline_probes_record_stop(void) {
+    if (!stats) {
+        return;
+    }
+    g_mutex_lock(&record_lock);
+    guint unwritten = record_released.length + record_muxing.length + record_writing.length;
+    clear_frames(&record_released);
+    clear_frames(&record_muxing);
+    clear_frames(&record_writing);
+    record_active = FALSE;
+    g_mutex_unlock(&record_lock);
+
+    PIPELINE_STATS_ADD(stats->record_unwritten, unwritten);
+    if (unwritten > 0) {
+        g_printerr("Recording ended with %u frames not written\n", unwritten);
+    }
+}
+
+/* ---------- setup ---------- */
+
+static void add_probe(const char *element, const char *pad_name, gboolean peer,
+                      GstPadProbeCallback callback, gpointer data) {
+    GstElement *e = gst_bin_get_by_name(GST_BIN(stats_pipeline), element);
+    if (!e) {
+        return;
+    }
+    GstPad *pad = gst_element_get_static_pad(e, pad_name);
+    if (pad && peer) {
+        GstPad *other = gst_pad_get_peer(pad);
+        gst_object_unref(pad);
+        pad = other;
+    }
+    if (pad) {
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, callback, data, NULL);
+        gst_object_unref(pad);
+    }
+    gst_object_unref(e);
+}
+
+static PipelineStatsBlock* create_block(void) {
+    stats_shmid = shmget(PIPELINE_STATS_SHM_KEY, sizeof(PipelineStatsBlock), IPC_CREAT | 0666);
+    if (stats_shmid == -1 && errno == EINVAL) {
+        // Block of an older layout left behind: replace it
+        int old = shmget(PIPELINE_STATS_SHM_KEY, 0, 0);
+        if (old != -1 && shmctl(old, IPC_RMID, NULL) == 0) {
+            stats_shmid = shmget(PIPELINE_STATS_SHM_KEY, sizeof(PipelineStatsBlock), IPC_CREAT | 0666);
+        }
+    }
+    void *p = stats_shmid == -1 ? (void *)-1 : shmat(stats_shmid, NULL, 0);
+    if (p == (void *)-1) {
+        perror("Pipeline stats shared memory unavailable, keeping them local");
+        stats_shmid = -1;
+        return &local_stats;
+    }
+    return (PipelineStatsBlock *)p;
+}
+
+void pipeline_probes_install(GstElement *pipeline) {
+    stats_pipeline = pipeline;
+    if (!stats) {
+        stats = create_block();
+    }
+    pipeline_stats_init(stats, (uint32_t)getpid(), monotonic_ns());
+    capture_last_pts = GST_CLOCK_TIME_NONE;
+    refresh_last_us = 0;
+    encode_last_offset = GST_BUFFER_OFFSET_NONE;
+    encode_last_pts = GST_CLOCK_TIME_NONE;
+    gap_pending = GST_CLOCK_TIME_NONE;
+
+    add_probe("tee", "sink", FALSE, capture_probe, NULL);
+    // Queue input is counted on the tee side, ahead of the preview_fps limiter
+    for (int i = 0; i < PIPELINE_QUEUE_COUNT; i++) {
+        queues[i] = gst_bin_get_by_name(GST_BIN(pipeline), queue_elements[i]);
+        if (!queues[i]) continue;
+        gst_object_unref(queues[i]);    // the bin keeps its children alive
+        add_probe(queue_elements[i], "sink", TRUE, queue_in_probe, &stats->queues[i]);
+        add_probe(queue_elements[i], "src", FALSE, queue_out_probe, &stats->queues[i]);
+    }
+    add_probe("enc_queue", "src", FALSE, encode_input_probe, NULL);
+    // Ahead of record_queue, so the encoder latency leaves out recording backlog
+    add_probe("parser", "src", FALSE, encoded_probe, NULL);
+    add_probe("video_prerecord", "src", FALSE, record_release_probe, NULL);
+    add_probe("app_sink", "sink", FALSE, preview_probe, NULL);
+}
+
+void pipeline_probes_set_gap_callback(PipelineGapFunc func, gpointer user_data) {
+    gap_callback = func;
+    gap_data = user_data;
+}
+
+const PipelineStatsBlock* pipeline_probes_stats(void) {
+    return stats;
+}
+
+void pipeline_probes_cleanup(void) {
+    if (!stats) {
+        return;
+    }
+    g_print("Pipeline statistics:\n");
+    pipeline_stats_print(stats, stdout);
+
+    if (stats != &local_stats) {
+        shmdt(stats);
+        shmctl(stats_shmid, IPC_RMID, NULL);
+    }
+    stats = NULL;
+    stats_shmid = -1;
+    stats_pipeline = NULL;
+    gap_callback = NULL;
+    memset(queues, 0, sizeof(queues));
+}
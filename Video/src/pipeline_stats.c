@@ -0,0 +1,128 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/src/pipeline_stats.c
+ */
+#include "pipeline_stats.h"
+#include <string.h>
+#include <time.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#define LOAD_ACQ(p)      __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_REL(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+static const char *queue_names[PIPELINE_QUEUE_COUNT] = { "encoder", "preview", "audio", "record" };
+
+void pipeline_stats_init(PipelineStatsBlock *stats, uint32_t pid, uint64_t started_ns) {
+    memset(stats, 0, sizeof(*stats));
+    stats->version = PIPELINE_STATS_VERSION;
+    stats->pid = pid;
+    stats->started_ns = started_ns;
+    // Readers check the magic last
+    STORE_REL(&stats->magic, PIPELINE_STATS_MAGIC);
+}
+
+void pipeline_stats_add_latency(PipelineLatencyHist *hist, uint64_t us) {
+    unsigned bucket = 0;
+    for (uint64_t v = us; v >= 2 && bucket < PIPELINE_STATS_BUCKETS - 1; v >>= 1) {
+        bucket++;
+    }
+    PIPELINE_STATS_ADD(hist->count, 1);
+    PIPELINE_STATS_ADD(hist->sum_us, us);
+    PIPELINE_STATS_ADD(hist->buckets[bucket], 1);
+
+    uint64_t max = __atomic_load_n(&hist->max_us, __ATOMIC_RELAXED);
+    while (us > max && !__atomic_compare_exchange_n(&hist->max_us, &max, us, 1,
+                                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+const PipelineStatsBlock* pipeline_stats_attach(void) {
+    int shmid = shmget(PIPELINE_STATS_SHM_KEY, sizeof(PipelineStatsBlock), 0);
+    if (shmid == -1) {
+        return NULL;
+    }
+    void *p = shmat(shmid, NULL, SHM_RDONLY);
+    if (p == (void *)-1) {
+        return NULL;
+    }
+    const PipelineStatsBlock *stats = (const PipelineStatsBlock *)p;
+    if (LOAD_ACQ(&stats->magic) != PIPELINE_STATS_MAGIC || stats->version != PIPELINE_STATS_VERSION) {
+        shmdt(p);
+        return NULL;
+    }
+    return stats;
+}
+
+void pipeline_stats_detach(const PipelineStatsBlock *stats) {
+    if (stats) {
+        shmdt(stats);
+    }
+}
+
+uint64_t pipeline_stats_percentile(const PipelineLatencyHist *hist, double p) {
+    uint64_t total = 0;
+    for (int i = 0; i < PIPELINE_STATS_BUCKETS; i++) {
+        total += hist->buckets[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(p / 100.0 * (total - 1)) + 1, seen = 0;
+    for (int i = 0; i < PIPELINE_STATS_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            return 2ull << i;
+        }
+    }
+    return 2ull << (PIPELINE_STATS_BUCKETS - 1);
+}
+
+static void print_latency(FILE *out, const char *name, const PipelineLatencyHist *hist) {
+    if (hist->count == 0) {
+        fprintf(out, "  %-20s no samples\n", name);
+        return;
+    }
+    // Bucket bounds can exceed the largest sample
+    uint64_t p50 = pipeline_stats_percentile(hist, 50), p99 = pipeline_stats_percentile(hist, 99);
+    if (p50 > hist->max_us) p50 = hist->max_us;
+    if (p99 > hist->max_us) p99 = hist->max_us;
+    fprintf(out, "  %-20s n=%-8llu avg %7.2f ms  p50 <%7.2f ms  p99 <%7.2f ms  max %7.2f ms\n", name,
+            (unsigned long long)hist->count, hist->sum_us / 1000.0 / hist->count,
+            p50 / 1000.0, p99 / 1000.0, hist->max_us / 1000.0);
+}
+
+void pipeline_stats_print(const PipelineStatsBlock *live, FILE *out) {
+    // Work on a copy so the numbers printed belong together (mostly)
+    PipelineStatsBlock s;
+    memcpy(&s, live, sizeof(s));
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t now = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    fprintf(out, "VideoProcess %u, up %.1f s, refreshed %.1f s ago\n", s.pid,
+            s.started_ns && now > s.started_ns ? (now - s.started_ns) / 1e9 : 0.0,
+            s.updated_ns && now > s.updated_ns ? (now - s.updated_ns) / 1e9 : 0.0);
+    fprintf(out, "  capture    %llu frames, %llu missing\n",
+            (unsigned long long)s.captured, (unsigned long long)s.capture_missing);
+    fprintf(out, "  encoder    %llu frames (%llu keyframes), %llu missing, %.1f MB, %.0f kbit/s\n",
+            (unsigned long long)s.encoded, (unsigned long long)s.keyframes,
+            (unsigned long long)s.encode_missing, s.encoded_bytes / 1e6, s.bitrate_bps / 1000.0);
+    fprintf(out, "  preview    %llu published, %llu decimated\n",
+            (unsigned long long)s.preview_published, (unsigned long long)s.preview_decimated);
+    fprintf(out, "  recording  %llu sessions, %llu frames muxed, %llu written, %llu unwritten\n",
+            (unsigned long long)s.record_sessions, (unsigned long long)s.record_frames,
+            (unsigned long long)s.record_written, (unsigned long long)s.record_unwritten);
+    fprintf(out, "             %llu discontinuities, %llu frames lost\n",
+            (unsigned long long)s.record_gaps, (unsigned long long)s.record_lost);
+    fprintf(out, "  %-10s %10s %10s %10s %6s %6s\n", "queue", "in", "out", "dropped", "level", "max");
+    for (int i = 0; i < PIPELINE_QUEUE_COUNT; i++) {
+        const PipelineQueueStats *q = &s.queues[i];
+        fprintf(out, "  %-10s %10llu %10llu %10llu %6u %6u\n", queue_names[i],
+                (unsigned long long)q->in, (unsigned long long)q->out, (unsigned long long)q->dropped,
+                q->level, q->level_max);
+    }
+    print_latency(out, "capture -> preview", &s.capture_to_preview);
+    print_latency(out, "capture -> encoded", &s.capture_to_encoded);
+    print_latency(out, "capture -> disk", &s.capture_to_disk);
+}
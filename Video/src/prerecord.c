@@ -0,0 +1,345 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/src/prerecord.c
+ */
+#include "prerecord.h"
+
+// Buffers from one keyframe up to (not including) the next one
+typedef struct {
+    GstClockTime ts;        // DTS (or PTS) of the keyframe
+    guint64 bytes;
+    GQueue buffers;
+} PrerecordGop;
+
+struct _GstPrerecord {
+    GstElement parent;
+
+    GstPad *sinkpad;
+    GstPad *srcpad;
+
+    // Properties and ring state (protected by the object lock)
+    GstClockTime duration;
+    guint64 max_bytes;
+    gboolean recording;
+    gboolean started;       // ring already flushed for this recording
+
+    GQueue gops;            // PrerecordGop, oldest first
+    guint64 bytes;
+    GstClockTime newest_ts;
+};
+
+struct _GstPrerecordClass {
+    GstElementClass parent_class;
+};
+
+enum {
+    PROP_0,
+    PROP_DURATION,
+    PROP_MAX_BYTES,
+    PROP_RECORDING,
+    PROP_BUFFERED_BYTES,
+    PROP_BUFFERED_TIME,
+    PROP_BUFFERED_GOPS,
+};
+
+#define DEFAULT_DURATION   (5 * GST_SECOND)
+#define DEFAULT_MAX_BYTES  (32 * 1024 * 1024)
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE("sink",
+    GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE("src",
+    GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+G_DEFINE_TYPE(GstPrerecord, gst_prerecord, GST_TYPE_ELEMENT);
+
+static void gop_free(gpointer data) {
+    PrerecordGop *gop = (PrerecordGop *)data;
+    GstBuffer *buf;
+    while ((buf = g_queue_pop_head(&gop->buffers))) {
+        gst_buffer_unref(buf);
+    }
+    g_free(gop);
+}
+
+// Call with the object lock held
+static void ring_clear(GstPrerecord *self) {
+    PrerecordGop *gop;
+    while ((gop = g_queue_pop_head(&self->gops))) {
+        gop_free(gop);
+    }
+    self->bytes = 0;
+    self->newest_ts = GST_CLOCK_TIME_NONE;
+}
+
+static GstClockTime ring_time(GstPrerecord *self) {
+    PrerecordGop *oldest = g_queue_peek_head(&self->gops);
+    if (!oldest || !GST_CLOCK_TIME_IS_VALID(oldest->ts) || !GST_CLOCK_TIME_IS_VALID(self->newest_ts) ||
+        self->newest_ts < oldest->ts) {
+        return 0;
+    }
+    return self->newest_ts - oldest->ts;
+}
+
+// Drop whole GOPs from the front while the rest still covers "duration",
+// or while over the byte budget. Call with the object lock held.
+static void ring_trim(GstPrerecord *self) {
+    while (self->gops.length > 1) {
+        PrerecordGop *oldest = g_queue_peek_head(&self->gops);
+        PrerecordGop *next = g_queue_peek_nth(&self->gops, 1);
+        gboolean covered = GST_CLOCK_TIME_IS_VALID(next->ts) && GST_CLOCK_TIME_IS_VALID(self->newest_ts) &&
+                           self->newest_ts >= next->ts && self->newest_ts - next->ts >= self->duration;
+        if (!covered && self->bytes <= self->max_bytes) {
+            break;
+        }
+        g_queue_pop_head(&self->gops);
+        self->bytes -= oldest->bytes;
+        gop_free(oldest);
+    }
+
+    // A single GOP larger than the budget cannot be kept at all
+    if (self->bytes > self->max_bytes) {
+        ring_clear(self);
+    }
+}
+
+static GstFlowReturn gst_prerecord_chain(GstPad *pad, GstObject *parent, GstBuffer *buffer) {
+    GstPrerecord *self = GST_PRERECORD(parent);
+    gboolean keyframe = !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+    GstClockTime ts = GST_BUFFER_DTS_OR_PTS(buffer);
+
+    GST_OBJECT_LOCK(self);
+    if (!self->recording) {
+        if (keyframe) {
+            PrerecordGop *gop = g_new0(PrerecordGop, 1);
+            gop->ts = ts;
+            g_queue_init(&gop->buffers);
+            g_queue_push_tail(&self->gops, gop);
+        }
+        PrerecordGop *tail = g_queue_peek_tail(&self->gops);
+        if (!tail) {
+            // Nothing to decode this frame against
+            GST_OBJECT_UNLOCK(self);
+            gst_buffer_unref(buffer);
+            return GST_FLOW_OK;
+        }
+        gsize size = gst_buffer_get_size(buffer);
+        g_queue_push_tail(&tail->buffers, buffer);
+        tail->bytes += size;
+        self->bytes += size;
+        if (GST_CLOCK_TIME_IS_VALID(ts)) {
+            self->newest_ts = ts;
+        }
+        ring_trim(self);
+        GST_OBJECT_UNLOCK(self);
+        return GST_FLOW_OK;
+    }
+
+    // First buffer of a recording: hand over the ring, or wait for a keyframe
+    GQueue pending = G_QUEUE_INIT;
+    if (!self->started) {
+        if (self->gops.length == 0 && !keyframe) {
+            GST_OBJECT_UNLOCK(self);
+            gst_buffer_unref(buffer);
+            return GST_FLOW_OK;
+        }
+        pending = self->gops;
+        g_queue_init(&self->gops);
+        self->bytes = 0;
+        self->newest_ts = GST_CLOCK_TIME_NONE;
+        self->started = TRUE;
+    }
+    GST_OBJECT_UNLOCK(self);
+
+    GstFlowReturn ret = GST_FLOW_OK;
+    gboolean first = TRUE;
+    PrerecordGop *gop;
+    while ((gop = g_queue_pop_head(&pending))) {
+        GstBuffer *buf;
+        while (ret == GST_FLOW_OK && (buf = g_queue_pop_head(&gop->buffers))) {
+            if (first) {
+                buf = gst_buffer_make_writable(buf);
+                GST_BUFFER_FLAG_SET(buf, GST_BUFFER_FLAG_DISCONT);
+                first = FALSE;
+            }
+            ret = gst_pad_push(self->srcpad, buf);
+        }
+        gop_free(gop);
+    }
+    if (ret != GST_FLOW_OK) {
+        gst_buffer_unref(buffer);
+        return ret;
+    }
+    if (first) {
+        buffer = gst_buffer_make_writable(buffer);
+        GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DISCONT);
+    }
+    return gst_pad_push(self->srcpad, buffer);
+}
+
+static gboolean gst_prerecord_sink_event(GstPad *pad, GstObject *parent, GstEvent *event) {
+    GstPrerecord *self = GST_PRERECORD(parent);
+
+    if (GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_STOP) {
+        GST_OBJECT_LOCK(self);
+        ring_clear(self);
+        GST_OBJECT_UNLOCK(self);
+    } else if (GST_EVENT_TYPE(event) == GST_EVENT_CAPS) {
+        // Buffered GOPs cannot be replayed under new caps (capture format
+        // change), the muxer would only see the latest sticky caps
+        GstCaps *caps, *current = gst_pad_get_current_caps(pad);
+        gst_event_parse_caps(event, &caps);
+        if (current && !gst_caps_is_equal(caps, current)) {
+            GST_OBJECT_LOCK(self);
+            ring_clear(self);
+            GST_OBJECT_UNLOCK(self);
+        }
+        if (current) gst_caps_unref(current);
+    }
+    return gst_pad_event_default(pad, parent, event);
+}
+
+static GstStateChangeReturn gst_prerecord_change_state(GstElement *element, GstStateChange transition) {
+    GstPrerecord *self = GST_PRERECORD(element);
+    GstStateChangeReturn ret =
+        GST_ELEMENT_CLASS(gst_prerecord_parent_class)->change_state(element, transition);
+
+    if (transition == GST_STATE_CHANGE_PAUSED_TO_READY) {
+        GST_OBJECT_LOCK(self);
+        ring_clear(self);
+        self->started = FALSE;
+        GST_OBJECT_UNLOCK(self);
+    }
+    return ret;
+}
+
+static void gst_prerecord_set_property(GObject *object, guint prop_id,
+                                       const GValue *value, GParamSpec *pspec) {
+    GstPrerecord *self = GST_PRERECORD(object);
+
+    GST_OBJECT_LOCK(self);
+    switch (prop_id) {
+        case PROP_DURATION:
+            self->duration = g_value_get_uint64(value);
+            ring_trim(self);
+            break;
+        case PROP_MAX_BYTES:
+            self->max_bytes = g_value_get_uint64(value);
+            ring_trim(self);
+            break;
+        case PROP_RECORDING: {
+            gboolean recording = g_value_get_boolean(value);
+            if (recording != self->recording) {
+                // The ring is handed over by the streaming thread on the next buffer
+                self->recording = recording;
+                self->started = FALSE;
+            }
+            break;
+        }
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+    GST_OBJECT_UNLOCK(self);
+}
+
+static void gst_prerecord_get_property(GObject *object, guint prop_id,
+                                       GValue *value, GParamSpec *pspec) {
+    GstPrerecord *self = GST_PRERECORD(object);
+
+    GST_OBJECT_LOCK(self);
+    switch (prop_id) {
+        case PROP_DURATION:
+            g_value_set_uint64(value, self->duration);
+            break;
+        case PROP_MAX_BYTES:
+            g_value_set_uint64(value, self->max_bytes);
+            break;
+        case PROP_RECORDING:
+            g_value_set_boolean(value, self->recording);
+            break;
+        case PROP_BUFFERED_BYTES:
+            g_value_set_uint64(value, self->bytes);
+            break;
+        case PROP_BUFFERED_TIME:
+            g_value_set_uint64(value, ring_time(self));
+            break;
+        case PROP_BUFFERED_GOPS:
+            g_value_set_uint(value, self->gops.length);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+    GST_OBJECT_UNLOCK(self);
+}
+
+static void gst_prerecord_finalize(GObject *object) {
+    GstPrerecord *self = GST_PRERECORD(object);
+
+    ring_clear(self);
+
+    G_OBJECT_CLASS(gst_prerecord_parent_class)->finalize(object);
+}
+
+static void gst_prerecord_class_init(GstPrerecordClass *klass) {
+    GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+    GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+
+    gobject_class->set_property = gst_prerecord_set_property;
+    gobject_class->get_property = gst_prerecord_get_property;
+    gobject_class->finalize = gst_prerecord_finalize;
+
+    g_object_class_install_property(gobject_class, PROP_DURATION,
+        g_param_spec_uint64("duration", "Duration", "Encoded time to keep before recording starts (ns)",
+                            0, G_MAXUINT64, DEFAULT_DURATION, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_MAX_BYTES,
+        g_param_spec_uint64("max-bytes", "Max bytes", "Memory limit of the pre-record ring",
+                            0, G_MAXUINT64, DEFAULT_MAX_BYTES, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_RECORDING,
+        g_param_spec_boolean("recording", "Recording", "Pass data downstream (after flushing the ring)",
+                             FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_BUFFERED_BYTES,
+        g_param_spec_uint64("buffered-bytes", "Buffered bytes", "Bytes currently held",
+                            0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_BUFFERED_TIME,
+        g_param_spec_uint64("buffered-time", "Buffered time", "Time span currently held (ns)",
+                            0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_BUFFERED_GOPS,
+        g_param_spec_uint("buffered-gops", "Buffered GOPs", "Keyframes currently held",
+                          0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+    gst_element_class_set_static_metadata(element_class,
+        "Pre-record buffer", "Generic",
+        "Keeps the last seconds of encoded data and releases them when recording starts",
+        "LegionMay");
+    gst_element_class_add_static_pad_template(element_class, &sink_template);
+    gst_element_class_add_static_pad_template(element_class, &src_template);
+
+    element_class->change_state = gst_prerecord_change_state;
+}
+
+static void gst_prerecord_init(GstPrerecord *self) {
+    self->sinkpad = gst_pad_new_from_static_template(&sink_template, "sink");
+    gst_pad_set_chain_function(self->sinkpad, gst_prerecord_chain);
+    gst_pad_set_event_function(self->sinkpad, gst_prerecord_sink_event);
+    GST_PAD_SET_PROXY_CAPS(self->sinkpad);
+    GST_PAD_SET_PROXY_ALLOCATION(self->sinkpad);
+    gst_element_add_pad(GST_ELEMENT(self), self->sinkpad);
+
+    self->srcpad = gst_pad_new_from_static_template(&src_template, "src");
+    GST_PAD_SET_PROXY_CAPS(self->srcpad);
+    gst_element_add_pad(GST_ELEMENT(self), self->srcpad);
+
+    self->duration = DEFAULT_DURATION;
+    self->max_bytes = DEFAULT_MAX_BYTES;
+    self->recording = FALSE;
+    self->started = FALSE;
+    g_queue_init(&self->gops);
+    self->bytes = 0;
+    self->newest_ts = GST_CLOCK_TIME_NONE;
+}
+
+gboolean prerecord_register(void) {
+    return gst_element_register(NULL, "prerecord", GST_RANK_NONE, GST_TYPE_PRERECORD);
+}
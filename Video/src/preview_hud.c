@@ -0,0 +1,280 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/src/preview_hud.c
+ */
+#include "preview_hud.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define HUD_HAVE_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define HUD_HAVE_SSE2 1
+#endif
+
+#define DEG                 (M_PI / 180.0)
+#define LADDER_STEP_DEG     10
+#define LADDER_RUNGS        2           // each side of the horizon
+#define LADDER_MAX_DEG      75          // rungs further off the axis are not drawn
+
+// Premultiplied BGRA, as stored in memory on a little-endian CPU
+#define PREMUL(r, g, b, a) \
+    ((uint32_t)((b) * (a) / 255) | (uint32_t)((g) * (a) / 255) << 8 | \
+     (uint32_t)((r) * (a) / 255) << 16 | (uint32_t)(a) << 24)
+
+#define COLOR_HORIZON   PREMUL(255, 255, 255, 224)
+#define COLOR_LADDER    PREMUL(96, 255, 96, 208)
+#define COLOR_CENTRE    PREMUL(255, 208, 0, 255)
+
+struct PreviewHud {
+    int scaled_width, scaled_height;
+    int width, height;              // destination (rotated)
+    PreviewRotation rotation;
+    int use_simd;
+
+    uint32_t *layer;                // width x height, premultiplied
+    int *x0, *x1;                   // drawn extent per row, empty if x0 >= x1
+};
+
+PreviewHud* preview_hud_new(int scaled_width, int scaled_height, PreviewRotation rotation) {
+    if (scaled_width < 1 || scaled_height < 1) {
+        return NULL;
+    }
+
+    PreviewHud *hud = (PreviewHud *)calloc(1, sizeof(PreviewHud));
+    if (!hud) {
+        return NULL;
+    }
+
+    hud->scaled_width = scaled_width;
+    hud->scaled_height = scaled_height;
+    hud->rotation = rotation;
+    if (rotation == PREVIEW_ROTATE_90CW || rotation == PREVIEW_ROTATE_90CCW) {
+        hud->width = scaled_height;
+        hud->height = scaled_width;
+    } else {
+        hud->width = scaled_width;
+        hud->height = scaled_height;
+    }
+    hud->use_simd = 1;
+
+    hud->layer = (uint32_t *)calloc((size_t)hud->width * hud->height, sizeof(uint32_t));
+    hud->x0 = (int *)malloc(sizeof(int) * hud->height);
+    hud->x1 = (int *)malloc(sizeof(int) * hud->height);
+    if (!hud->layer || !hud->x0 || !hud->x1) {
+        preview_hud_free(hud);
+        return NULL;
+    }
+    for (int y = 0; y < hud->height; y++) {
+        hud->x0[y] = hud->width;
+        hud->x1[y] = 0;
+    }
+    return hud;
+}
+
+void preview_hud_free(PreviewHud *hud) {
+    if (!hud) return;
+    free(hud->layer);
+    free(hud->x0);
+    free(hud->x1);
+    free(hud);
+}
+
+void preview_hud_set_simd(PreviewHud *hud, int enable) {
+    if (hud) hud->use_simd = enable;
+}
+
+void preview_hud_clear(PreviewHud *hud) {
+    if (!hud) return;
+    for (int y = 0; y < hud->height; y++) {
+        if (hud->x0[y] < hud->x1[y]) {
+            memset(hud->layer + (size_t)y * hud->width + hud->x0[y], 0,
+                   sizeof(uint32_t) * (hud->x1[y] - hud->x0[y]));
+            hud->x0[y] = hud->width;
+            hud->x1[y] = 0;
+        }
+    }
+}
+
+/* ---------- drawing ---------- */
+
+// (2r+1)^2 square centred on a destination pixel
+static void stamp(PreviewHud *hud, int cx, int cy, int r, uint32_t color) {
+    int xa = cx - r < 0 ? 0 : cx - r;
+    int xb = cx + r + 1 > hud->width ? hud->width : cx + r + 1;
+    int ya = cy - r < 0 ? 0 : cy - r;
+    int yb = cy + r + 1 > hud->height ? hud->height : cy + r + 1;
+    if (xa >= xb) return;
+
+    for (int y = ya; y < yb; y++) {
+        uint32_t *row = hud->layer + (size_t)y * hud->width;
+        for (int x = xa; x < xb; x++) {
+            row[x] = color;
+        }
+        if (xa < hud->x0[y]) hud->x0[y] = xa;
+        if (xb > hud->x1[y]) hud->x1[y] = xb;
+    }
+}
+
+// Scaled-image point to destination, following store_tile's rotation
+static void to_dst(const PreviewHud *hud, double x, double y, double *dx, double *dy) {
+    switch (hud->rotation) {
+    case PREVIEW_ROTATE_90CW:  *dx = hud->scaled_height - y; *dy = x; break;
+    case PREVIEW_ROTATE_180:   *dx = hud->scaled_width - x;  *dy = hud->scaled_height - y; break;
+    case PREVIEW_ROTATE_90CCW: *dx = y; *dy = hud->scaled_width - x; break;
+    default:                   *dx = x; *dy = y; break;
+    }
+}
+
+// Line between two scaled-image points; `dash` > 0 draws only every other
+// dash-pixel run
+static void line(PreviewHud *hud, double ax, double ay, double bx, double by,
+                 int r, uint32_t color, int dash) {
+    double x0, y0, x1, y1;
+    to_dst(hud, ax, ay, &x0, &y0);
+    to_dst(hud, bx, by, &x1, &y1);
+
+    // Clip to the frame (plus the pen) so off-screen lengths cost nothing
+    double t0 = 0, t1 = 1;
+    double dx = x1 - x0, dy = y1 - y0;
+    double p[4] = { -dx, dx, -dy, dy };
+    double q[4] = { x0 + r, hud->width + r - x0, y0 + r, hud->height + r - y0 };
+    for (int i = 0; i < 4; i++) {
+        if (p[i] == 0) {
+            if (q[i] < 0) return;
+            continue;
+        }
+        double t = q[i] / p[i];
+        if (p[i] < 0) { if (t > t0) t0 = t; }
+        else          { if (t < t1) t1 = t; }
+    }
+    if (t0 > t1) return;
+
+    double len = fabs(dx) > fabs(dy) ? fabs(dx) : fabs(dy);
+    int first = (int)floor(t0 * len), last = (int)ceil(t1 * len);
+    for (int i = first; i <= last; i++) {
+        if (dash > 0 && (i / dash) % 2) continue;
+        double t = len > 0 ? i / len : 0;
+        stamp(hud, (int)floor(x0 + dx * t), (int)floor(y0 + dy * t), r, color);
+    }
+}
+
+void preview_hud_draw(PreviewHud *hud, float tilt, float elevation, float focal) {
+    if (!hud) return;
+    preview_hud_clear(hud);
+
+    double w = hud->scaled_width, h = hud->scaled_height;
+    double cx = w / 2, cy = h / 2;
+    double ux = sin(tilt), uy = -cos(tilt);     // up in the picture
+    double hx = cos(tilt), hy = sin(tilt);      // along the horizon
+    int pen = w >= 640 ? 1 : 0;
+
+    for (int k = -LADDER_RUNGS; k <= LADDER_RUNGS; k++) {
+        double above = k * LADDER_STEP_DEG * DEG;
+        if (fabs(elevation - above) > LADDER_MAX_DEG * DEG) continue;
+
+        // Where the line `above` radians over the horizon crosses the picture
+        double off = focal * tan(elevation - above);
+        double px = cx - ux * off, py = cy - uy * off;
+
+        double gap, half;
+        uint32_t color;
+        if (k == 0) {
+            gap = w * 0.06;
+            half = w + h;
+            color = COLOR_HORIZON;
+        } else {
+            gap = w * 0.05;
+            half = w * 0.12;
+            color = COLOR_LADDER;
+        }
+        int dash = k < 0 ? 6 : 0;
+        for (int side = -1; side <= 1; side += 2) {
+            double ax = px + side * hx * gap, ay = py + side * hy * gap;
+            double bx = px + side * hx * half, by = py + side * hy * half;
+            line(hud, ax, ay, bx, by, pen, color, dash);
+            if (k != 0) {
+                // End tick pointing at the horizon
+                double tick = w * 0.02 * (k > 0 ? -1 : 1);
+                line(hud, bx, by, bx + ux * tick, by + uy * tick, pen, color, 0);
+            }
+        }
+    }
+
+    // Boresight, fixed to the camera
+    line(hud, cx - w * 0.08, cy, cx - w * 0.03, cy, pen + 1, COLOR_CENTRE, 0);
+    line(hud, cx + w * 0.03, cy, cx + w * 0.08, cy, pen + 1, COLOR_CENTRE, 0);
+    line(hud, cx, cy, cx, cy, pen + 1, COLOR_CENTRE, 0);
+}
+
+/* ---------- blend: dst = overlay + dst * (255 - alpha) / 255 ---------- */
+
+// Exact rounded v / 255 for v <= 255 * 255
+static inline uint8_t div255(int v) {
+    v += 128;
+    return (uint8_t)((v + (v >> 8)) >> 8);
+}
+
+static void blend_span_scalar(uint8_t *d, const uint8_t *o, int pixels) {
+    for (int i = 0; i < pixels; i++, d += 4, o += 4) {
+        int inv = 255 - o[3];
+        d[0] = (uint8_t)(o[0] + div255(d[0] * inv));
+        d[1] = (uint8_t)(o[1] + div255(d[1] * inv));
+        d[2] = (uint8_t)(o[2] + div255(d[2] * inv));
+        d[3] = (uint8_t)(o[3] + div255(d[3] * inv));
+    }
+}
+
+static void blend_span_simd(uint8_t *d, const uint8_t *o, int pixels) {
+    int i = 0;
+#if defined(HUD_HAVE_NEON)
+    const uint16x8_t round = vdupq_n_u16(128);
+    for (; i + 8 <= pixels; i += 8) {
+        uint8x8x4_t ov = vld4_u8(o + i * 4);
+        // Transparent runs are the common case inside a span
+        if (vget_lane_u64(vreinterpret_u64_u8(ov.val[3]), 0) == 0) continue;
+        uint8x8x4_t dv = vld4_u8(d + i * 4);
+        uint8x8_t inv = vmvn_u8(ov.val[3]);
+        for (int c = 0; c < 4; c++) {
+            uint16x8_t t = vaddq_u16(vmull_u8(dv.val[c], inv), round);
+            dv.val[c] = vadd_u8(ov.val[c], vaddhn_u16(t, vshrq_n_u16(t, 8)));
+        }
+        vst4_u8(d + i * 4, dv);
+    }
+#elif defined(HUD_HAVE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16(255);
+    const __m128i round = _mm_set1_epi16(128);
+    for (; i + 4 <= pixels; i += 4) {
+        __m128i ov = _mm_loadu_si128((const __m128i *)(o + i * 4));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(ov, zero)) == 0xFFFF) continue;
+        __m128i dv = _mm_loadu_si128((const __m128i *)(d + i * 4));
+        __m128i res[2];
+        for (int half = 0; half < 2; half++) {
+            __m128i o16 = half ? _mm_unpackhi_epi8(ov, zero) : _mm_unpacklo_epi8(ov, zero);
+            __m128i d16 = half ? _mm_unpackhi_epi8(dv, zero) : _mm_unpacklo_epi8(dv, zero);
+            __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(o16, 0xFF), 0xFF);
+            __m128i t = _mm_add_epi16(_mm_mullo_epi16(d16, _mm_sub_epi16(full, alpha)), round);
+            t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+            res[half] = _mm_add_epi16(t, o16);
+        }
+        _mm_storeu_si128((__m128i *)(d + i * 4), _mm_packus_epi16(res[0], res[1]));
+    }
+#endif
+    blend_span_scalar(d + i * 4, o + i * 4, pixels - i);
+}
+
+void preview_hud_blend(const PreviewHud *hud, uint8_t *dst, int dst_stride) {
+    if (!hud || !dst) return;
+    for (int y = 0; y < hud->height; y++) {
+        int x0 = hud->x0[y], x1 = hud->x1[y];
+        if (x0 >= x1) continue;
+        uint8_t *d = dst + (size_t)y * dst_stride + x0 * 4;
+        const uint8_t *o = (const uint8_t *)(hud->layer + (size_t)y * hud->width + x0);
+        if (hud->use_simd) blend_span_simd(d, o, x1 - x0);
+        else               blend_span_scalar(d, o, x1 - x0);
+    }
+}
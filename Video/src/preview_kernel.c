@@ -0,0 +1,630 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/src/preview_kernel.c
+ */
+#include "preview_kernel.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PREVIEW_HAVE_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define PREVIEW_HAVE_SSE2 1
+#endif
+
+// The frame is processed in TILE x TILE blocks of the scaled image. One
+// block reads roughly 2.4*TILE source rows and writes TILE destination rows,
+// so both sides stay in L1 even for the 90-degree rotations.
+#define TILE 32
+
+// Interpolation weights are 7-bit so the blend fits u8 x u8 -> u16 on NEON
+#define WEIGHT_BITS 7
+#define WEIGHT_ONE  (1 << WEIGHT_BITS)
+
+struct PreviewKernel {
+    int src_width, src_height;
+    int scaled_width, scaled_height;
+    int dst_width, dst_height;
+    PreviewRotation rotation;
+    int use_simd;
+
+    // Q6 colour coefficients: y, v->r, u->g, v->g, u->b
+    int16_t cy, crv, cgu, cgv, cbu;
+
+    // Per scaled column / row source positions and weights
+    int *luma_x;     uint8_t *luma_wx;
+    int *chroma_x;   uint8_t *chroma_wx;
+    int *luma_y;     uint8_t *luma_wy;
+    int *chroma_y;   uint8_t *chroma_wy;
+
+    // Levelled sampling (set_level): source luma position of scaled pixel
+    // (0, 0) and its steps along scaled x and y
+    int level;
+    double level_x0, level_y0;
+    double level_dx[2], level_dy[2];
+
+    // Scratch: vertically blended source spans and the BGRA tile
+    uint8_t *luma_row;
+    uint8_t *chroma_row;
+    uint32_t *tile;
+};
+
+static inline int16_t sat16(int v) {
+    if (v > 32767) return 32767;
+    if (v < -32768) return -32768;
+    return (int16_t)v;
+}
+
+static inline uint8_t clamp_u8(int v) {
+    if (v < 0) return 0;
+    if (v > 255) return 255;
+    return (uint8_t)v;
+}
+
+static inline uint8_t lerp_u8(uint8_t a, uint8_t b, int w) {
+    return (uint8_t)((a * (WEIGHT_ONE - w) + b * w + (WEIGHT_ONE >> 1)) >> WEIGHT_BITS);
+}
+
+// Map every destination index to a source index + weight (pixel centres
+// aligned). The returned index is always <= src_len - 2 so idx + 1 is valid.
+static void build_axis(int src_len, int dst_len, int *idx, uint8_t *weight) {
+    double scale = (double)src_len / dst_len;
+    for (int i = 0; i < dst_len; i++) {
+        double pos = (i + 0.5) * scale - 0.5;
+        if (pos < 0) pos = 0;
+        int i0 = (int)pos;
+        int w = (int)((pos - i0) * WEIGHT_ONE + 0.5);
+        if (src_len < 2) {
+            i0 = 0;
+            w = 0;
+        } else if (i0 >= src_len - 1) {
+            i0 = src_len - 2;
+            w = WEIGHT_ONE;
+        }
+        if (w > WEIGHT_ONE) w = WEIGHT_ONE;
+        idx[i] = i0;
+        weight[i] = (uint8_t)w;
+    }
+}
+
+PreviewKernel* preview_kernel_new(int src_width, int src_height,
+                                  int scaled_width, int scaled_height,
+                                  PreviewRotation rotation, PreviewMatrix matrix) {
+    if (src_width < 2 || src_height < 2 || scaled_width < 1 || scaled_height < 1) {
+        return NULL;
+    }
+
+    PreviewKernel *k = (PreviewKernel *)calloc(1, sizeof(PreviewKernel));
+    if (!k) {
+        return NULL;
+    }
+
+    k->src_width = src_width;
+    k->src_height = src_height;
+    k->scaled_width = scaled_width;
+    k->scaled_height = scaled_height;
+    k->rotation = rotation;
+    if (rotation == PREVIEW_ROTATE_90CW || rotation == PREVIEW_ROTATE_90CCW) {
+        k->dst_width = scaled_height;
+        k->dst_height = scaled_width;
+    } else {
+        k->dst_width = scaled_width;
+        k->dst_height = scaled_height;
+    }
+    k->use_simd = 1;
+
+    if (matrix == PREVIEW_MATRIX_BT709) {
+        k->cy = 75; k->crv = 115; k->cgu = 14; k->cgv = 34; k->cbu = 135;
+    } else {
+        k->cy = 75; k->crv = 102; k->cgu = 25; k->cgv = 52; k->cbu = 129;
+    }
+
+    int chroma_width = (src_width + 1) / 2;
+    int chroma_height = (src_height + 1) / 2;
+
+    k->luma_x = (int *)malloc(sizeof(int) * scaled_width);
+    k->luma_wx = (uint8_t *)malloc(scaled_width);
+    k->chroma_x = (int *)malloc(sizeof(int) * scaled_width);
+    k->chroma_wx = (uint8_t *)malloc(scaled_width);
+    k->luma_y = (int *)malloc(sizeof(int) * scaled_height);
+    k->luma_wy = (uint8_t *)malloc(scaled_height);
+    k->chroma_y = (int *)malloc(sizeof(int) * scaled_height);
+    k->chroma_wy = (uint8_t *)malloc(scaled_height);
+    k->luma_row = (uint8_t *)malloc(src_width);
+    k->chroma_row = (uint8_t *)malloc(chroma_width * 2);
+    k->tile = (uint32_t *)malloc(sizeof(uint32_t) * TILE * TILE);
+
+    if (!k->luma_x || !k->luma_wx || !k->chroma_x || !k->chroma_wx ||
+        !k->luma_y || !k->luma_wy || !k->chroma_y || !k->chroma_wy ||
+        !k->luma_row || !k->chroma_row || !k->tile) {
+        preview_kernel_free(k);
+        return NULL;
+    }
+
+    build_axis(src_width, scaled_width, k->luma_x, k->luma_wx);
+    build_axis(chroma_width, scaled_width, k->chroma_x, k->chroma_wx);
+    build_axis(src_height, scaled_height, k->luma_y, k->luma_wy);
+    build_axis(chroma_height, scaled_height, k->chroma_y, k->chroma_wy);
+
+    return k;
+}
+
+void preview_kernel_free(PreviewKernel *k) {
+    if (!k) return;
+    free(k->luma_x);
+    free(k->luma_wx);
+    free(k->chroma_x);
+    free(k->chroma_wx);
+    free(k->luma_y);
+    free(k->luma_wy);
+    free(k->chroma_y);
+    free(k->chroma_wy);
+    free(k->luma_row);
+    free(k->chroma_row);
+    free(k->tile);
+    free(k);
+}
+
+void preview_kernel_set_simd(PreviewKernel *k, int enable) {
+    if (k) k->use_simd = enable;
+}
+
+const char* preview_kernel_simd_name(void) {
+#if defined(PREVIEW_HAVE_NEON)
+    return "neon";
+#elif defined(PREVIEW_HAVE_SSE2)
+    return "sse2";
+#else
+    return "none";
+#endif
+}
+
+void preview_kernel_set_level(PreviewKernel *k, float angle, float zoom) {
+    if (!k) return;
+    if (zoom < 1.0f) zoom = 1.0f;
+    if (angle == 0.0f && zoom == 1.0f) {
+        k->level = 0;
+        return;
+    }
+
+    // Scaled pixel q (centre-relative) shows R(angle) q / zoom; convert that
+    // to source luma coordinates the same way build_axis does
+    double c = cos(angle) / zoom, s = sin(angle) / zoom;
+    double sx = (double)k->src_width / k->scaled_width;
+    double sy = (double)k->src_height / k->scaled_height;
+    double qx = 0.5 - k->scaled_width / 2.0, qy = 0.5 - k->scaled_height / 2.0;
+    k->level_x0 = (k->scaled_width / 2.0 + c * qx - s * qy) * sx - 0.5;
+    k->level_y0 = (k->scaled_height / 2.0 + s * qx + c * qy) * sy - 0.5;
+    k->level_dx[0] = c * sx;
+    k->level_dx[1] = s * sy;
+    k->level_dy[0] = -s * sx;
+    k->level_dy[1] = c * sy;
+    k->level = 1;
+}
+
+float preview_kernel_level_zoom(const PreviewKernel *k, float angle) {
+    if (!k) return 1.0f;
+    double a = fabs(angle);
+    double w = k->scaled_width, h = k->scaled_height;
+    double aspect = w > h ? w / h : h / w;
+    return (float)(cos(a) + aspect * sin(a));
+}
+
+int preview_kernel_dst_width(const PreviewKernel *k) {
+    return k ? k->dst_width : 0;
+}
+
+int preview_kernel_dst_height(const PreviewKernel *k) {
+    return k ? k->dst_height : 0;
+}
+
+/* ---------- vertical blend: out = a*(1-w) + b*w ---------- */
+
+static void blend_rows_scalar(const uint8_t *a, const uint8_t *b, int w, uint8_t *out, int len) {
+    for (int i = 0; i < len; i++) {
+        out[i] = lerp_u8(a[i], b[i], w);
+    }
+}
+
+static void blend_rows_simd(const uint8_t *a, const uint8_t *b, int w, uint8_t *out, int len) {
+    int i = 0;
+#if defined(PREVIEW_HAVE_NEON)
+    uint8x8_t wa = vdup_n_u8((uint8_t)(WEIGHT_ONE - w));
+    uint8x8_t wb = vdup_n_u8((uint8_t)w);
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t va = vld1q_u8(a + i);
+        uint8x16_t vb = vld1q_u8(b + i);
+        uint16x8_t lo = vmlal_u8(vmull_u8(vget_low_u8(va), wa), vget_low_u8(vb), wb);
+        uint16x8_t hi = vmlal_u8(vmull_u8(vget_high_u8(va), wa), vget_high_u8(vb), wb);
+        vst1q_u8(out + i, vcombine_u8(vrshrn_n_u16(lo, WEIGHT_BITS), vrshrn_n_u16(hi, WEIGHT_BITS)));
+    }
+#elif defined(PREVIEW_HAVE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i wa = _mm_set1_epi16((short)(WEIGHT_ONE - w));
+    const __m128i wb = _mm_set1_epi16((short)w);
+    const __m128i round = _mm_set1_epi16(WEIGHT_ONE >> 1);
+    for (; i + 16 <= len; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va, zero), wa),
+                                   _mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), wb));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va, zero), wa),
+                                   _mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), wb));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, round), WEIGHT_BITS);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, round), WEIGHT_BITS);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    blend_rows_scalar(a + i, b + i, w, out + i, len - i);
+}
+
+/* ---------- 2D blend: lerp(lerp(a, b, wx), lerp(c, d, wx), wy) per lane ---------- */
+
+static void blend_quad_scalar(const uint8_t *a, const uint8_t *b, const uint8_t *c, const uint8_t *d,
+                              const uint8_t *wx, const uint8_t *wy, uint8_t *out, int len) {
+    for (int i = 0; i < len; i++) {
+        out[i] = lerp_u8(lerp_u8(a[i], b[i], wx[i]), lerp_u8(c[i], d[i], wx[i]), wy[i]);
+    }
+}
+
+static void blend_quad_simd(const uint8_t *a, const uint8_t *b, const uint8_t *c, const uint8_t *d,
+                            const uint8_t *wx, const uint8_t *wy, uint8_t *out, int len) {
+    int i = 0;
+#if defined(PREVIEW_HAVE_NEON)
+    const uint8x8_t one = vdup_n_u8(WEIGHT_ONE);
+    for (; i + 8 <= len; i += 8) {
+        uint8x8_t vwx = vld1_u8(wx + i), vwy = vld1_u8(wy + i);
+        uint8x8_t nwx = vsub_u8(one, vwx);
+        uint8x8_t top = vrshrn_n_u16(vmlal_u8(vmull_u8(vld1_u8(a + i), nwx), vld1_u8(b + i), vwx), WEIGHT_BITS);
+        uint8x8_t bot = vrshrn_n_u16(vmlal_u8(vmull_u8(vld1_u8(c + i), nwx), vld1_u8(d + i), vwx), WEIGHT_BITS);
+        vst1_u8(out + i, vrshrn_n_u16(vmlal_u8(vmull_u8(top, vsub_u8(one, vwy)), bot, vwy), WEIGHT_BITS));
+    }
+#elif defined(PREVIEW_HAVE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(WEIGHT_ONE);
+    const __m128i round = _mm_set1_epi16(WEIGHT_ONE >> 1);
+    for (; i + 8 <= len; i += 8) {
+#define LOAD8(p) _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)((p) + i)), zero)
+        __m128i vwx = LOAD8(wx), vwy = LOAD8(wy);
+        __m128i nwx = _mm_sub_epi16(one, vwx);
+        __m128i top = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(LOAD8(a), nwx),
+                                                                 _mm_mullo_epi16(LOAD8(b), vwx)), round), WEIGHT_BITS);
+        __m128i bot = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(LOAD8(c), nwx),
+                                                                 _mm_mullo_epi16(LOAD8(d), vwx)), round), WEIGHT_BITS);
+        __m128i res = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(top, _mm_sub_epi16(one, vwy)),
+                                                                 _mm_mullo_epi16(bot, vwy)), round), WEIGHT_BITS);
+        _mm_storel_epi64((__m128i *)(out + i), _mm_packus_epi16(res, res));
+#undef LOAD8
+    }
+#endif
+    blend_quad_scalar(a + i, b + i, c + i, d + i, wx + i, wy + i, out + i, len - i);
+}
+
+/* ---------- colour conversion: Y/U/V rows -> BGRA ---------- */
+
+static void yuv_to_bgra_scalar(const PreviewKernel *k, const uint8_t *ys, const uint8_t *us,
+                               const uint8_t *vs, uint32_t *out, int len) {
+    uint8_t *o = (uint8_t *)out;
+    for (int i = 0; i < len; i++) {
+        int c = (ys[i] - 16) * k->cy;
+        int d = us[i] - 128;
+        int e = vs[i] - 128;
+        int r = sat16(c + k->crv * e);
+        int g = sat16(sat16(c - k->cgu * d) - k->cgv * e);
+        int b = sat16(c + k->cbu * d);
+        o[i * 4 + 0] = clamp_u8(sat16(b + 32) >> 6);
+        o[i * 4 + 1] = clamp_u8(sat16(g + 32) >> 6);
+        o[i * 4 + 2] = clamp_u8(sat16(r + 32) >> 6);
+        o[i * 4 + 3] = 0xFF;
+    }
+}
+
+static void yuv_to_bgra_simd(const PreviewKernel *k, const uint8_t *ys, const uint8_t *us,
+                             const uint8_t *vs, uint32_t *out, int len) {
+    int i = 0;
+#if defined(PREVIEW_HAVE_NEON)
+    const int16x8_t off16 = vdupq_n_s16(16);
+    const int16x8_t off128 = vdupq_n_s16(128);
+    const int16x8_t round = vdupq_n_s16(32);
+    const int16x8_t cy = vdupq_n_s16(k->cy);
+    const int16x8_t crv = vdupq_n_s16(k->crv);
+    const int16x8_t cgu = vdupq_n_s16(k->cgu);
+    const int16x8_t cgv = vdupq_n_s16(k->cgv);
+    const int16x8_t cbu = vdupq_n_s16(k->cbu);
+    for (; i + 8 <= len; i += 8) {
+        int16x8_t y = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(ys + i)));
+        int16x8_t d = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(us + i))), off128);
+        int16x8_t e = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(vs + i))), off128);
+        int16x8_t c = vmulq_s16(vsubq_s16(y, off16), cy);
+        int16x8_t r = vqaddq_s16(c, vmulq_s16(e, crv));
+        int16x8_t g = vqsubq_s16(vqsubq_s16(c, vmulq_s16(d, cgu)), vmulq_s16(e, cgv));
+        int16x8_t b = vqaddq_s16(c, vmulq_s16(d, cbu));
+        uint8x8x4_t px;
+        px.val[0] = vqshrun_n_s16(vqaddq_s16(b, round), 6);
+        px.val[1] = vqshrun_n_s16(vqaddq_s16(g, round), 6);
+        px.val[2] = vqshrun_n_s16(vqaddq_s16(r, round), 6);
+        px.val[3] = vdup_n_u8(0xFF);
+        vst4_u8((uint8_t *)(out + i), px);
+    }
+#elif defined(PREVIEW_HAVE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i off16 = _mm_set1_epi16(16);
+    const __m128i off128 = _mm_set1_epi16(128);
+    const __m128i round = _mm_set1_epi16(32);
+    const __m128i alpha = _mm_set1_epi8((char)0xFF);
+    const __m128i cy = _mm_set1_epi16(k->cy);
+    const __m128i crv = _mm_set1_epi16(k->crv);
+    const __m128i cgu = _mm_set1_epi16(k->cgu);
+    const __m128i cgv = _mm_set1_epi16(k->cgv);
+    const __m128i cbu = _mm_set1_epi16(k->cbu);
+    for (; i + 8 <= len; i += 8) {
+        __m128i y = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(ys + i)), zero);
+        __m128i d = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(us + i)), zero), off128);
+        __m128i e = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(vs + i)), zero), off128);
+        __m128i c = _mm_mullo_epi16(_mm_sub_epi16(y, off16), cy);
+        __m128i r = _mm_adds_epi16(c, _mm_mullo_epi16(e, crv));
+        __m128i g = _mm_subs_epi16(_mm_subs_epi16(c, _mm_mullo_epi16(d, cgu)), _mm_mullo_epi16(e, cgv));
+        __m128i b = _mm_adds_epi16(c, _mm_mullo_epi16(d, cbu));
+        r = _mm_srai_epi16(_mm_adds_epi16(r, round), 6);
+        g = _mm_srai_epi16(_mm_adds_epi16(g, round), 6);
+        b = _mm_srai_epi16(_mm_adds_epi16(b, round), 6);
+        __m128i bg = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), _mm_packus_epi16(g, g));
+        __m128i ra = _mm_unpacklo_epi8(_mm_packus_epi16(r, r), alpha);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128((__m128i *)(out + i + 4), _mm_unpackhi_epi16(bg, ra));
+    }
+#endif
+    yuv_to_bgra_scalar(k, ys + i, us + i, vs + i, out + i, len - i);
+}
+
+/* ---------- tile store with rotation ---------- */
+
+#if defined(PREVIEW_HAVE_NEON)
+static inline void transpose4_store(const uint32_t *r0, const uint32_t *r1, const uint32_t *r2,
+                                    const uint32_t *r3, uint32_t *d0, uint32_t *d1,
+                                    uint32_t *d2, uint32_t *d3) {
+    uint32x4x2_t p01 = vtrnq_u32(vld1q_u32(r0), vld1q_u32(r1));
+    uint32x4x2_t p23 = vtrnq_u32(vld1q_u32(r2), vld1q_u32(r3));
+    vst1q_u32(d0, vcombine_u32(vget_low_u32(p01.val[0]), vget_low_u32(p23.val[0])));
+    vst1q_u32(d1, vcombine_u32(vget_low_u32(p01.val[1]), vget_low_u32(p23.val[1])));
+    vst1q_u32(d2, vcombine_u32(vget_high_u32(p01.val[0]), vget_high_u32(p23.val[0])));
+    vst1q_u32(d3, vcombine_u32(vget_high_u32(p01.val[1]), vget_high_u32(p23.val[1])));
+}
+#elif defined(PREVIEW_HAVE_SSE2)
+static inline void transpose4_store(const uint32_t *r0, const uint32_t *r1, const uint32_t *r2,
+                                    const uint32_t *r3, uint32_t *d0, uint32_t *d1,
+                                    uint32_t *d2, uint32_t *d3) {
+    __m128i a = _mm_loadu_si128((const __m128i *)r0);
+    __m128i b = _mm_loadu_si128((const __m128i *)r1);
+    __m128i c = _mm_loadu_si128((const __m128i *)r2);
+    __m128i d = _mm_loadu_si128((const __m128i *)r3);
+    __m128i t0 = _mm_unpacklo_epi32(a, b);
+    __m128i t1 = _mm_unpacklo_epi32(c, d);
+    __m128i t2 = _mm_unpackhi_epi32(a, b);
+    __m128i t3 = _mm_unpackhi_epi32(c, d);
+    _mm_storeu_si128((__m128i *)d0, _mm_unpacklo_epi64(t0, t1));
+    _mm_storeu_si128((__m128i *)d1, _mm_unpackhi_epi64(t0, t1));
+    _mm_storeu_si128((__m128i *)d2, _mm_unpacklo_epi64(t2, t3));
+    _mm_storeu_si128((__m128i *)d3, _mm_unpackhi_epi64(t2, t3));
+}
+#endif
+
+/* ---------- levelled sampling ---------- */
+
+// One tile row of the levelled picture: luma is gathered bilinearly along
+// the rotated grid and blended in one vector pass, chroma (already half
+// resolution) is taken from the nearest sample
+static void sample_level_row(const PreviewKernel *k, const uint8_t *y_plane, int y_stride,
+                             const uint8_t *uv_plane, int uv_stride, int tx, int sy, int tw,
+                             uint8_t *ys, uint8_t *us, uint8_t *vs, int simd) {
+    uint8_t a[TILE], b[TILE], c[TILE], d[TILE], wx[TILE], wy[TILE];
+    int32_t max_x = (k->src_width - 1) << 16, max_y = (k->src_height - 1) << 16;
+    int cw = (k->src_width + 1) / 2, ch = (k->src_height + 1) / 2;
+
+    int32_t fx = (int32_t)lrint((k->level_x0 + tx * k->level_dx[0] + sy * k->level_dy[0]) * 65536.0);
+    int32_t fy = (int32_t)lrint((k->level_y0 + tx * k->level_dx[1] + sy * k->level_dy[1]) * 65536.0);
+    int32_t dx = (int32_t)lrint(k->level_dx[0] * 65536.0);
+    int32_t dy = (int32_t)lrint(k->level_dx[1] * 65536.0);
+
+    for (int j = 0; j < tw; j++, fx += dx, fy += dy) {
+        int32_t x = fx < 0 ? 0 : (fx > max_x ? max_x : fx);
+        int32_t y = fy < 0 ? 0 : (fy > max_y ? max_y : fy);
+        int ix = x >> 16, iy = y >> 16;
+        int wxj = (x & 0xFFFF) >> (16 - WEIGHT_BITS), wyj = (y & 0xFFFF) >> (16 - WEIGHT_BITS);
+        if (ix == k->src_width - 1) { ix--; wxj = WEIGHT_ONE; }
+        if (iy == k->src_height - 1) { iy--; wyj = WEIGHT_ONE; }
+        const uint8_t *p = y_plane + (size_t)iy * y_stride + ix;
+        a[j] = p[0];
+        b[j] = p[1];
+        c[j] = p[y_stride];
+        d[j] = p[y_stride + 1];
+        wx[j] = (uint8_t)wxj;
+        wy[j] = (uint8_t)wyj;
+
+        // Chroma sample n sits at luma 2n + 0.5
+        int cx = (x + 32768) >> 17, cy = (y + 32768) >> 17;
+        if (cx >= cw) cx = cw - 1;
+        if (cy >= ch) cy = ch - 1;
+        const uint8_t *q = uv_plane + (size_t)cy * uv_stride + cx * 2;
+        us[j] = q[0];
+        vs[j] = q[1];
+    }
+
+    if (simd) blend_quad_simd(a, b, c, d, wx, wy, ys, tw);
+    else      blend_quad_scalar(a, b, c, d, wx, wy, ys, tw);
+}
+
+#define DST_ROW(dst, stride, y) ((uint32_t *)((dst) + (size_t)(y) * (stride)))
+
+// Write a tw x th tile whose top-left corner is (tx, ty) in scaled space
+static void store_tile(const PreviewKernel *k, const uint32_t *tile, int tx, int ty,
+                       int tw, int th, uint8_t *dst, int dst_stride, int simd) {
+    int sw = k->scaled_width;
+    int sh = k->scaled_height;
+
+    switch (k->rotation) {
+    case PREVIEW_ROTATE_NONE:
+        for (int i = 0; i < th; i++) {
+            memcpy(DST_ROW(dst, dst_stride, ty + i) + tx, tile + i * TILE, tw * 4);
+        }
+        break;
+
+    case PREVIEW_ROTATE_180:
+        for (int i = 0; i < th; i++) {
+            uint32_t *row = DST_ROW(dst, dst_stride, sh - 1 - ty - i) + (sw - tx - tw);
+            const uint32_t *src = tile + i * TILE;
+            for (int j = 0; j < tw; j++) {
+                row[tw - 1 - j] = src[j];
+            }
+        }
+        break;
+
+    case PREVIEW_ROTATE_90CW: {
+        // scaled (x, y) -> dst (sh - 1 - y, x): tile column j becomes dst
+        // row tx + j, read bottom-up
+        int base_x = sh - ty - th;
+        int j = 0;
+#if defined(PREVIEW_HAVE_NEON) || defined(PREVIEW_HAVE_SSE2)
+        if (simd) {
+            for (; j + 4 <= tw; j += 4) {
+                uint32_t *d0 = DST_ROW(dst, dst_stride, tx + j) + base_x;
+                uint32_t *d1 = DST_ROW(dst, dst_stride, tx + j + 1) + base_x;
+                uint32_t *d2 = DST_ROW(dst, dst_stride, tx + j + 2) + base_x;
+                uint32_t *d3 = DST_ROW(dst, dst_stride, tx + j + 3) + base_x;
+                int q = 0;
+                for (; q + 4 <= th; q += 4) {
+                    const uint32_t *r0 = tile + (th - 1 - q) * TILE + j;
+                    transpose4_store(r0, r0 - TILE, r0 - 2 * TILE, r0 - 3 * TILE,
+                                     d0 + q, d1 + q, d2 + q, d3 + q);
+                }
+                for (; q < th; q++) {
+                    const uint32_t *r = tile + (th - 1 - q) * TILE + j;
+                    d0[q] = r[0];
+                    d1[q] = r[1];
+                    d2[q] = r[2];
+                    d3[q] = r[3];
+                }
+            }
+        }
+#endif
+        for (; j < tw; j++) {
+            uint32_t *row = DST_ROW(dst, dst_stride, tx + j) + base_x;
+            for (int q = 0; q < th; q++) {
+                row[q] = tile[(th - 1 - q) * TILE + j];
+            }
+        }
+        break;
+    }
+
+    case PREVIEW_ROTATE_90CCW: {
+        // scaled (x, y) -> dst (y, sw - 1 - x): tile column j becomes dst
+        // row sw - 1 - (tx + j), read top-down
+        int j = 0;
+#if defined(PREVIEW_HAVE_NEON) || defined(PREVIEW_HAVE_SSE2)
+        if (simd) {
+            for (; j + 4 <= tw; j += 4) {
+                uint32_t *d0 = DST_ROW(dst, dst_stride, sw - 1 - tx - j) + ty;
+                uint32_t *d1 = DST_ROW(dst, dst_stride, sw - 2 - tx - j) + ty;
+                uint32_t *d2 = DST_ROW(dst, dst_stride, sw - 3 - tx - j) + ty;
+                uint32_t *d3 = DST_ROW(dst, dst_stride, sw - 4 - tx - j) + ty;
+                int q = 0;
+                for (; q + 4 <= th; q += 4) {
+                    const uint32_t *r0 = tile + q * TILE + j;
+                    transpose4_store(r0, r0 + TILE, r0 + 2 * TILE, r0 + 3 * TILE,
+                                     d0 + q, d1 + q, d2 + q, d3 + q);
+                }
+                for (; q < th; q++) {
+                    const uint32_t *r = tile + q * TILE + j;
+                    d0[q] = r[0];
+                    d1[q] = r[1];
+                    d2[q] = r[2];
+                    d3[q] = r[3];
+                }
+            }
+        }
+#endif
+        for (; j < tw; j++) {
+            uint32_t *row = DST_ROW(dst, dst_stride, sw - 1 - tx - j) + ty;
+            for (int q = 0; q < th; q++) {
+                row[q] = tile[q * TILE + j];
+            }
+        }
+        break;
+    }
+    }
+}
+
+void preview_kernel_process(PreviewKernel *k,
+                            const uint8_t *y_plane, int y_stride,
+                            const uint8_t *uv_plane, int uv_stride,
+                            uint8_t *dst, int dst_stride) {
+    if (!k || !y_plane || !uv_plane || !dst) return;
+
+    int simd = k->use_simd;
+    uint8_t ys[TILE], us[TILE], vs[TILE];
+
+    for (int ty = 0; ty < k->scaled_height; ty += TILE) {
+        int th = k->scaled_height - ty < TILE ? k->scaled_height - ty : TILE;
+
+        for (int tx = 0; tx < k->scaled_width; tx += TILE) {
+            int tw = k->scaled_width - tx < TILE ? k->scaled_width - tx : TILE;
+
+            if (k->level) {
+                for (int i = 0; i < th; i++) {
+                    sample_level_row(k, y_plane, y_stride, uv_plane, uv_stride, tx, ty + i, tw,
+                                     ys, us, vs, simd);
+                    if (simd) yuv_to_bgra_simd(k, ys, us, vs, k->tile + i * TILE, tw);
+                    else      yuv_to_bgra_scalar(k, ys, us, vs, k->tile + i * TILE, tw);
+                }
+                store_tile(k, k->tile, tx, ty, tw, th, dst, dst_stride, simd);
+                continue;
+            }
+
+            // Source spans touched by this tile column
+            int lx0 = k->luma_x[tx];
+            int llen = k->luma_x[tx + tw - 1] + 2 - lx0;
+            int cx0 = k->chroma_x[tx];
+            int clen = (k->chroma_x[tx + tw - 1] + 2 - cx0) * 2;
+
+            for (int i = 0; i < th; i++) {
+                int sy = ty + i;
+
+                // Vertical pass over the luma span (skipped when w == 0)
+                const uint8_t *la = y_plane + (size_t)k->luma_y[sy] * y_stride + lx0;
+                const uint8_t *lrow = la;
+                if (k->luma_wy[sy]) {
+                    if (simd) blend_rows_simd(la, la + y_stride, k->luma_wy[sy], k->luma_row, llen);
+                    else      blend_rows_scalar(la, la + y_stride, k->luma_wy[sy], k->luma_row, llen);
+                    lrow = k->luma_row;
+                }
+
+                // Same for the interleaved UV span
+                const uint8_t *ca = uv_plane + (size_t)k->chroma_y[sy] * uv_stride + cx0 * 2;
+                const uint8_t *crow = ca;
+                if (k->chroma_wy[sy]) {
+                    if (simd) blend_rows_simd(ca, ca + uv_stride, k->chroma_wy[sy], k->chroma_row, clen);
+                    else      blend_rows_scalar(ca, ca + uv_stride, k->chroma_wy[sy], k->chroma_row, clen);
+                    crow = k->chroma_row;
+                }
+
+                // Horizontal pass: 2-tap gather per output pixel
+                for (int j = 0; j < tw; j++) {
+                    int sx = tx + j;
+                    const uint8_t *lp = lrow + (k->luma_x[sx] - lx0);
+                    ys[j] = lerp_u8(lp[0], lp[1], k->luma_wx[sx]);
+                    const uint8_t *cp = crow + (k->chroma_x[sx] - cx0) * 2;
+                    us[j] = lerp_u8(cp[0], cp[2], k->chroma_wx[sx]);
+                    vs[j] = lerp_u8(cp[1], cp[3], k->chroma_wx[sx]);
+                }
+
+                if (simd) yuv_to_bgra_simd(k, ys, us, vs, k->tile + i * TILE, tw);
+                else      yuv_to_bgra_scalar(k, ys, us, vs, k->tile + i * TILE, tw);
+            }
+
+            store_tile(k, k->tile, tx, ty, tw, th, dst, dst_stride, simd);
+        }
+    }
+}
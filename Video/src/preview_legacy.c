@@ -0,0 +1,75 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/src/preview_legacy.c
+ */
+#include "preview_legacy.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <semaphore.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+static uint8_t *legacy_shm = NULL;
+static sem_t *legacy_sem = SEM_FAILED;
+static uint64_t legacy_skipped = 0;     // frames a reader's lock made us skip
+
+int preview_legacy_open(void) {
+    int shmid = shmget(PREVIEW_LEGACY_SHM_KEY, PREVIEW_LEGACY_SIZE, IPC_CREAT | 0666);
+    if (shmid == -1) {
+        perror("shmget failed for legacy preview");
+        return -1;
+    }
+    void *ptr = shmat(shmid, NULL, 0);
+    if (ptr == (void *)-1) {
+        perror("shmat failed for legacy preview");
+        return -1;
+    }
+    // Same name, mode and initial value as the semaphore the UI expects
+    legacy_sem = sem_open(PREVIEW_LEGACY_SEM, O_CREAT, 0644, 1);
+    if (legacy_sem == SEM_FAILED) {
+        perror("sem_open failed for legacy preview");
+        shmdt(ptr);
+        return -1;
+    }
+    legacy_shm = (uint8_t *)ptr;
+    printf("Legacy preview mirror at shm key %d, semaphore %s\n", PREVIEW_LEGACY_SHM_KEY, PREVIEW_LEGACY_SEM);
+    return 0;
+}
+
+void preview_legacy_publish(const uint8_t *data, const PreviewFrameInfo *info) {
+    if (!legacy_shm || info->format != PREVIEW_FORMAT_BGRA) {
+        return;
+    }
+    size_t row = (size_t)info->width * 4;
+    if (row * info->height > PREVIEW_LEGACY_SIZE || info->stride < row) {
+        return;
+    }
+    // The UI holds it for the length of one copy; this frame is skipped
+    if (sem_trywait(legacy_sem) != 0) {
+        legacy_skipped++;
+        return;
+    }
+    if (info->stride == row) {
+        memcpy(legacy_shm, data, row * info->height);
+    } else {
+        for (uint32_t y = 0; y < info->height; y++) {
+            memcpy(legacy_shm + y * row, data + (size_t)y * info->stride, row);
+        }
+    }
+    sem_post(legacy_sem);
+}
+
+void preview_legacy_close(void) {
+    if (legacy_sem != SEM_FAILED) {
+        sem_close(legacy_sem);
+        sem_unlink(PREVIEW_LEGACY_SEM);
+        legacy_sem = SEM_FAILED;
+    }
+    if (legacy_shm) {
+        shmdt(legacy_shm);
+        legacy_shm = NULL;
+        printf("Legacy preview mirror closed, %llu frames skipped while the UI held the semaphore\n",
+               (unsigned long long)legacy_skipped);
+    }
+}
@@ -0,0 +1,415 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/src/preview_ring.c
+ */
+#define _GNU_SOURCE     // program_invocation_short_name
+#include "preview_ring.h"
+#include "shm_utils.h"
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+// Reader gives up after this many torn copies in a row
+#define READ_MAX_ATTEMPTS 4
+
+#define LOAD_ACQ(p)      __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define LOAD_RLX(p)      __atomic_load_n((p), __ATOMIC_RELAXED)
+#define STORE_REL(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define STORE_RLX(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+
+int preview_ring_init(void *shm, size_t shm_size, uint32_t slot_count, uint32_t slot_size) {
+    if (!shm || slot_count < 2 || slot_count > PREVIEW_RING_MAX_SLOTS ||
+        PREVIEW_RING_SHM_SIZE(slot_count, slot_size) > shm_size) {
+        fprintf(stderr, "preview_ring_init: invalid ring geometry\n");
+        return -1;
+    }
+
+    PreviewRingHeader *ring = (PreviewRingHeader *)shm;
+    memset(ring, 0, sizeof(PreviewRingHeader));
+    ring->version = PREVIEW_RING_VERSION;
+    ring->slot_count = slot_count;
+    ring->slot_size = slot_size;
+    ring->data_offset = sizeof(PreviewRingHeader);
+    ring->latest = PREVIEW_RING_NONE;
+    // Readers check the magic last
+    STORE_REL(&ring->magic, PREVIEW_RING_MAGIC);
+    return 0;
+}
+
+uint8_t* preview_ring_slot_data(PreviewRingHeader *ring, uint32_t slot) {
+    return (uint8_t *)ring + ring->data_offset + (size_t)slot * ring->slot_size;
+}
+
+uint8_t* preview_ring_begin_write(PreviewRingHeader *ring, uint32_t *slot) {
+    // Single producer: the slot after the newest one is the oldest frame
+    uint32_t latest = LOAD_RLX(&ring->latest);
+    uint32_t next = (latest == PREVIEW_RING_NONE) ? 0 : (latest + 1) % ring->slot_count;
+
+    *slot = next;
+    return preview_ring_begin_write_slot(ring, next);
+}
+
+uint8_t* preview_ring_begin_write_slot(PreviewRingHeader *ring, uint32_t slot) {
+    PreviewSlotHeader *s = &ring->slots[slot];
+
+    // Odd sequence: readers treat the slot as being written
+    STORE_RLX(&s->seq, s->seq + 1);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    return preview_ring_slot_data(ring, slot);
+}
+
+uint32_t preview_ring_latest(const PreviewRingHeader *ring) {
+    return LOAD_ACQ(&ring->latest);
+}
+
+void preview_ring_commit(PreviewRingHeader *ring, uint32_t slot, const PreviewFrameInfo *info) {
+    PreviewSlotHeader *s = &ring->slots[slot];
+
+    s->width = info->width;
+    s->height = info->height;
+    s->stride = info->stride;
+    s->format = info->format;
+    s->size = info->size;
+    s->frame_number = info->frame_number;
+    s->capture_ns = info->capture_ns;
+
+    STORE_REL(&s->seq, s->seq + 1);
+    STORE_REL(&ring->latest, slot);
+    STORE_RLX(&ring->published, ring->published + 1);
+}
+
+void preview_ring_abort(PreviewRingHeader *ring, uint32_t slot) {
+    PreviewSlotHeader *s = &ring->slots[slot];
+    STORE_REL(&s->seq, s->seq + 1);
+}
+
+void preview_readers_init(PreviewReaderTable *table) {
+    memset(table, 0, sizeof(PreviewReaderTable));
+    table->version = PREVIEW_READERS_VERSION;
+    table->max_readers = PREVIEW_RING_MAX_READERS;
+    STORE_REL(&table->magic, PREVIEW_READERS_MAGIC);
+}
+
+// Copy a slot whose even sequence seq0 the caller read. 1 when the copy is
+// consistent, 0 when the producer overwrote it meanwhile, -1 if too large.
+static int copy_slot(const PreviewRingHeader *ring, uint32_t slot, uint32_t seq0,
+                     void *dst, size_t dst_size, PreviewFrameInfo *info) {
+    const PreviewSlotHeader *s = &ring->slots[slot];
+    PreviewFrameInfo meta;
+    meta.width = s->width;
+    meta.height = s->height;
+    meta.stride = s->stride;
+    meta.format = s->format;
+    meta.size = s->size;
+    meta.frame_number = s->frame_number;
+    meta.capture_ns = s->capture_ns;
+    if (meta.size > dst_size || meta.size > ring->slot_size) {
+        // Possibly a torn header: only trust the size if nothing changed
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        return LOAD_RLX(&s->seq) == seq0 ? -1 : 0;
+    }
+
+    const uint8_t *data = (const uint8_t *)ring + ring->data_offset + (size_t)slot * ring->slot_size;
+    memcpy(dst, data, meta.size);
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (LOAD_RLX(&s->seq) != seq0) {
+        return 0;
+    }
+    if (info) *info = meta;
+    return 1;
+}
+
+int preview_ring_read_latest(const PreviewRingHeader *ring, void *dst, size_t dst_size,
+                             PreviewFrameInfo *info, uint64_t *retries) {
+    if (!ring || LOAD_ACQ(&ring->magic) != PREVIEW_RING_MAGIC) {
+        return -1;
+    }
+
+    for (int attempt = 0; attempt < READ_MAX_ATTEMPTS; attempt++) {
+        uint32_t slot = LOAD_ACQ(&ring->latest);
+        if (slot == PREVIEW_RING_NONE || slot >= ring->slot_count) {
+            return 0;
+        }
+
+        uint32_t seq0 = LOAD_ACQ(&ring->slots[slot].seq);
+        int ret = (seq0 & 1) ? 0 : copy_slot(ring, slot, seq0, dst, dst_size, info);
+        if (ret != 0) {
+            return ret;
+        }
+        if (retries) (*retries)++;
+    }
+    return -1;
+}
+
+int preview_ring_read_next(const PreviewRingHeader *ring, uint64_t after, void *dst, size_t dst_size,
+                           PreviewFrameInfo *info, uint64_t *retries) {
+    if (!ring || LOAD_ACQ(&ring->magic) != PREVIEW_RING_MAGIC) {
+        return -1;
+    }
+
+    for (int attempt = 0; attempt < READ_MAX_ATTEMPTS; attempt++) {
+        // Oldest complete frame past the cursor; checked again after the copy
+        uint32_t best = PREVIEW_RING_NONE, best_seq = 0;
+        uint64_t best_frame = 0;
+        for (uint32_t slot = 0; slot < ring->slot_count; slot++) {
+            uint32_t seq = LOAD_ACQ(&ring->slots[slot].seq);
+            uint64_t frame = LOAD_RLX(&ring->slots[slot].frame_number);
+            if (!(seq & 1) && seq != 0 && frame > after && (best == PREVIEW_RING_NONE || frame < best_frame)) {
+                best = slot;
+                best_seq = seq;
+                best_frame = frame;
+            }
+        }
+        if (best == PREVIEW_RING_NONE) {
+            return 0;
+        }
+
+        int ret = copy_slot(ring, best, best_seq, dst, dst_size, info);
+        if (ret != 0) {
+            return ret;
+        }
+        if (retries) (*retries)++;
+    }
+    return -1;
+}
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Claim a free entry, or one left behind by a process that is gone
+static PreviewReaderStats* claim_entry(PreviewReaderTable *table, const char *name) {
+    int32_t pid = (int32_t)getpid();
+    for (int pass = 0; pass < 2; pass++) {
+        for (uint32_t i = 0; i < PREVIEW_RING_MAX_READERS; i++) {
+            PreviewReaderStats *e = &table->readers[i];
+            int32_t owner = LOAD_ACQ(&e->pid);
+            if (pass == 1 && (owner == 0 || owner == pid || kill(owner, 0) == 0 || errno != ESRCH)) {
+                continue;
+            }
+            if (pass == 0 && owner != 0) {
+                continue;
+            }
+            if (__atomic_compare_exchange_n(&e->pid, &owner, pid, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                memset((uint8_t *)e + sizeof(e->pid), 0, sizeof(*e) - sizeof(e->pid));
+                snprintf(e->name, sizeof(e->name), "%s", name);
+                STORE_REL(&e->updated_ns, monotonic_ns());
+                return e;
+            }
+        }
+    }
+    return NULL;
+}
+
+int preview_reader_attach(PreviewReader *reader, PreviewRingHeader *ring,
+                          PreviewReaderTable *table, const char *name) {
+    memset(reader, 0, sizeof(PreviewReader));
+    reader->shmid = -1;
+    reader->readers_shmid = -1;
+    if (!ring || LOAD_ACQ(&ring->magic) != PREVIEW_RING_MAGIC || ring->version != PREVIEW_RING_VERSION) {
+        fprintf(stderr, "preview_reader_attach: not a preview ring\n");
+        return -1;
+    }
+    reader->ring = ring;
+    if (table && LOAD_ACQ(&table->magic) == PREVIEW_READERS_MAGIC &&
+        table->version == PREVIEW_READERS_VERSION) {
+        reader->table = table;
+        reader->entry = claim_entry(table, name ? name : "reader");
+        if (!reader->entry) {
+            fprintf(stderr, "preview_reader_attach: reader table full, %s not listed\n", name ? name : "reader");
+        }
+    }
+    return 0;
+}
+
+int preview_reader_open(PreviewReader *reader) {
+    return preview_reader_open_named(reader, NULL);
+}
+
+int preview_reader_open_named(PreviewReader *reader, const char *name) {
+    memset(reader, 0, sizeof(PreviewReader));
+    reader->readers_shmid = -1;
+    reader->shmid = shmget(SHM_KEY, 0, 0);
+    if (reader->shmid == -1) {
+        perror("preview_reader_open: shmget failed");
+        return -1;
+    }
+    void *ptr = shmat(reader->shmid, NULL, SHM_RDONLY);
+    if (ptr == (void *)-1) {
+        perror("preview_reader_open: shmat failed");
+        return -1;
+    }
+
+    // The table is optional: older producers do not create it
+    PreviewReaderTable *table = NULL;
+    int readers_shmid = shmget(PREVIEW_READERS_SHM_KEY, 0, 0);
+    if (readers_shmid != -1) {
+        table = (PreviewReaderTable *)shmat(readers_shmid, NULL, 0);
+        if (table == (void *)-1) {
+            table = NULL;
+        }
+    }
+
+    int shmid = reader->shmid;
+    if (preview_reader_attach(reader, (PreviewRingHeader *)ptr, table,
+                              name ? name : program_invocation_short_name) != 0) {
+        fprintf(stderr, "preview_reader_open: shared memory is not a preview ring\n");
+        shmdt(ptr);
+        if (table) shmdt(table);
+        return -1;
+    }
+    reader->shmid = shmid;
+    if (reader->table) {
+        reader->readers_shmid = readers_shmid;
+    } else if (table) {
+        shmdt(table);
+    }
+    return 0;
+}
+
+void preview_reader_close(PreviewReader *reader) {
+    if (!reader) {
+        return;
+    }
+    if (reader->entry) {
+        STORE_REL(&reader->entry->pid, 0);
+        reader->entry = NULL;
+    }
+    if (reader->table && reader->readers_shmid != -1) {
+        shmdt(reader->table);
+    }
+    reader->table = NULL;
+    if (reader->ring && reader->shmid != -1) {
+        shmdt(reader->ring);
+    }
+    reader->ring = NULL;
+}
+
+// Frame handed out: move the cursor and publish the counters
+static void reader_delivered(PreviewReader *reader, const PreviewFrameInfo *meta) {
+    if (reader->last_frame != 0 && meta->frame_number > reader->last_frame + 1) {
+        reader->skipped += meta->frame_number - reader->last_frame - 1;
+    }
+    reader->last_frame = meta->frame_number;
+    reader->delivered++;
+
+    PreviewReaderStats *e = reader->entry;
+    if (!e) {
+        return;
+    }
+    uint64_t now = monotonic_ns();
+    uint32_t latest = LOAD_ACQ(&reader->ring->latest);
+    uint64_t newest = latest < reader->ring->slot_count
+        ? LOAD_RLX(&reader->ring->slots[latest].frame_number) : meta->frame_number;
+    STORE_RLX(&e->cursor, meta->frame_number);
+    STORE_RLX(&e->delivered, reader->delivered);
+    STORE_RLX(&e->skipped, reader->skipped);
+    STORE_RLX(&e->retries, reader->retries);
+    STORE_RLX(&e->lag_frames, newest > meta->frame_number ? newest - meta->frame_number : 0);
+    STORE_RLX(&e->latency_ns, meta->capture_ns && now > meta->capture_ns ? now - meta->capture_ns : 0);
+    STORE_RLX(&e->updated_ns, now);
+}
+
+int preview_reader_copy_latest(PreviewReader *reader, void *dst, size_t dst_size, PreviewFrameInfo *info) {
+    if (!reader || !reader->ring) {
+        return -1;
+    }
+
+    // Skip the copy entirely if nothing new was published
+    uint32_t slot = LOAD_ACQ(&reader->ring->latest);
+    if (slot == PREVIEW_RING_NONE) {
+        return 0;
+    }
+    if (slot < reader->ring->slot_count && reader->last_frame != 0 &&
+        LOAD_ACQ(&reader->ring->slots[slot].frame_number) == reader->last_frame) {
+        return 0;
+    }
+
+    PreviewFrameInfo meta;
+    int ret = preview_ring_read_latest(reader->ring, dst, dst_size, &meta, &reader->retries);
+    if (ret != 1) {
+        return ret;
+    }
+    if (meta.frame_number <= reader->last_frame) {
+        return 0;
+    }
+    reader_delivered(reader, &meta);
+    if (info) *info = meta;
+    return 1;
+}
+
+int preview_reader_copy_next(PreviewReader *reader, void *dst, size_t dst_size, PreviewFrameInfo *info) {
+    if (!reader || !reader->ring) {
+        return -1;
+    }
+
+    PreviewFrameInfo meta;
+    int ret = preview_ring_read_next(reader->ring, reader->last_frame, dst, dst_size, &meta, &reader->retries);
+    if (ret != 1) {
+        return ret;
+    }
+    reader_delivered(reader, &meta);
+    if (info) *info = meta;
+    return 1;
+}
+
+const PreviewReaderTable* preview_readers_attach(void) {
+    int shmid = shmget(PREVIEW_READERS_SHM_KEY, 0, 0);
+    if (shmid == -1) {
+        return NULL;
+    }
+    void *ptr = shmat(shmid, NULL, SHM_RDONLY);
+    if (ptr == (void *)-1) {
+        return NULL;
+    }
+    const PreviewReaderTable *table = (const PreviewReaderTable *)ptr;
+    if (LOAD_ACQ(&table->magic) != PREVIEW_READERS_MAGIC || table->version != PREVIEW_READERS_VERSION) {
+        shmdt(ptr);
+        return NULL;
+    }
+    return table;
+}
+
+void preview_readers_detach(const PreviewReaderTable *table) {
+    if (table) {
+        shmdt(table);
+    }
+}
+
+void preview_readers_print(const PreviewReaderTable *table, uint64_t published, FILE *out) {
+    uint64_t now = monotonic_ns();
+    fprintf(out, "Preview readers (%llu frames published):\n", (unsigned long long)published);
+    fprintf(out, "  %-20s %7s %10s %10s %10s %8s %5s %9s %8s\n",
+            "name", "pid", "cursor", "delivered", "skipped", "retries", "lag", "latency", "idle");
+    int listed = 0;
+    for (uint32_t i = 0; i < PREVIEW_RING_MAX_READERS; i++) {
+        const PreviewReaderStats *e = &table->readers[i];
+        int32_t pid = LOAD_ACQ(&e->pid);
+        if (pid == 0) {
+            continue;
+        }
+        uint64_t updated = LOAD_RLX(&e->updated_ns);
+        fprintf(out, "  %-20.20s %7d %10llu %10llu %10llu %8llu %5llu %6.1f ms %5.1f s\n",
+                e->name, (int)pid,
+                (unsigned long long)LOAD_RLX(&e->cursor),
+                (unsigned long long)LOAD_RLX(&e->delivered),
+                (unsigned long long)LOAD_RLX(&e->skipped),
+                (unsigned long long)LOAD_RLX(&e->retries),
+                (unsigned long long)LOAD_RLX(&e->lag_frames),
+                LOAD_RLX(&e->latency_ns) / 1e6,
+                now > updated ? (now - updated) / 1e9 : 0.0);
+        listed++;
+    }
+    if (!listed) {
+        fprintf(out, "  (none)\n");
+    }
+}
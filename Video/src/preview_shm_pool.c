@@ -0,0 +1,267 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/src/preview_shm_pool.c
+ */
+#include "preview_shm_pool.h"
+#include <gst/video/video.h>
+
+struct _GstPreviewShmPool {
+    GstBufferPool parent;
+
+    PreviewRingHeader *ring;
+    guint size;             // bytes per buffer, from the pool config
+
+    // Slot bookkeeping (protected by the object lock)
+    guint32 allocated;      // slots wrapped by a live GstBuffer
+    guint32 pending;        // slots opened for writing but not committed
+};
+
+struct _GstPreviewShmPoolClass {
+    GstBufferPoolClass parent_class;
+};
+
+G_DEFINE_TYPE(GstPreviewShmPool, gst_preview_shm_pool, GST_TYPE_BUFFER_POOL);
+
+// Slot index + 1 is attached to every buffer the pool allocates
+static GQuark slot_quark;
+
+static gboolean buffer_slot(GstBuffer *buffer, uint32_t *slot) {
+    guint v = GPOINTER_TO_UINT(gst_mini_object_get_qdata(GST_MINI_OBJECT(buffer), slot_quark));
+    if (v == 0) {
+        return FALSE;
+    }
+    *slot = v - 1;
+    return TRUE;
+}
+
+static gboolean gst_preview_shm_pool_set_config(GstBufferPool *pool, GstStructure *config) {
+    GstPreviewShmPool *self = GST_PREVIEW_SHM_POOL(pool);
+    GstCaps *caps;
+    guint size, min, max;
+
+    if (!gst_buffer_pool_config_get_params(config, &caps, &size, &min, &max)) {
+        return FALSE;
+    }
+    if (size == 0 || size > self->ring->slot_size) {
+        g_printerr("preview shm pool: %u byte buffers do not fit a %u byte slot\n",
+                   size, self->ring->slot_size);
+        return FALSE;
+    }
+
+    // One buffer per slot, never more
+    if (max == 0 || max > self->ring->slot_count) {
+        max = self->ring->slot_count;
+    }
+    if (min > max) {
+        min = max;
+    }
+    gst_buffer_pool_config_set_params(config, caps, size, min, max);
+    self->size = size;
+
+    return GST_BUFFER_POOL_CLASS(gst_preview_shm_pool_parent_class)->set_config(pool, config);
+}
+
+static GstFlowReturn gst_preview_shm_pool_alloc_buffer(GstBufferPool *pool, GstBuffer **buffer,
+                                                       GstBufferPoolAcquireParams *params) {
+    GstPreviewShmPool *self = GST_PREVIEW_SHM_POOL(pool);
+    uint32_t slot;
+
+    GST_OBJECT_LOCK(self);
+    for (slot = 0; slot < self->ring->slot_count; slot++) {
+        if (!(self->allocated & (1u << slot))) {
+            break;
+        }
+    }
+    if (slot == self->ring->slot_count) {
+        GST_OBJECT_UNLOCK(self);
+        return GST_FLOW_ERROR;
+    }
+    self->allocated |= 1u << slot;
+    GST_OBJECT_UNLOCK(self);
+
+    // The segment outlives the pipeline, nothing to free
+    GstMemory *mem = gst_memory_new_wrapped(GST_MEMORY_FLAG_NO_SHARE,
+                                            preview_ring_slot_data(self->ring, slot),
+                                            self->ring->slot_size, 0, self->size, NULL, NULL);
+    GstBuffer *buf = gst_buffer_new();
+    gst_buffer_append_memory(buf, mem);
+    gst_mini_object_set_qdata(GST_MINI_OBJECT(buf), slot_quark, GUINT_TO_POINTER(slot + 1), NULL);
+
+    *buffer = buf;
+    return GST_FLOW_OK;
+}
+
+static void gst_preview_shm_pool_free_buffer(GstBufferPool *pool, GstBuffer *buffer) {
+    GstPreviewShmPool *self = GST_PREVIEW_SHM_POOL(pool);
+    uint32_t slot;
+
+    if (buffer_slot(buffer, &slot)) {
+        GST_OBJECT_LOCK(self);
+        self->allocated &= ~(1u << slot);
+        GST_OBJECT_UNLOCK(self);
+    }
+    GST_BUFFER_POOL_CLASS(gst_preview_shm_pool_parent_class)->free_buffer(pool, buffer);
+}
+
+static GstFlowReturn gst_preview_shm_pool_acquire_buffer(GstBufferPool *pool, GstBuffer **buffer,
+                                                         GstBufferPoolAcquireParams *params) {
+    GstPreviewShmPool *self = GST_PREVIEW_SHM_POOL(pool);
+    GstBufferPoolClass *parent = GST_BUFFER_POOL_CLASS(gst_preview_shm_pool_parent_class);
+    GstBuffer *buf = NULL;
+    uint32_t slot;
+
+    GstFlowReturn ret = parent->acquire_buffer(pool, &buf, params);
+    if (ret != GST_FLOW_OK) {
+        return ret;
+    }
+    buffer_slot(buf, &slot);
+
+    // Readers are copying the newest slot: take another one if any is free
+    if (slot == preview_ring_latest(self->ring)) {
+        GstBufferPoolAcquireParams dontwait = { 0 };
+        GstBuffer *other = NULL;
+        if (params) {
+            dontwait = *params;
+        }
+        dontwait.flags |= GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+        if (parent->acquire_buffer(pool, &other, &dontwait) == GST_FLOW_OK) {
+            parent->release_buffer(pool, buf);
+            buf = other;
+            buffer_slot(buf, &slot);
+        }
+    }
+
+    GST_OBJECT_LOCK(self);
+    self->pending |= 1u << slot;
+    GST_OBJECT_UNLOCK(self);
+    preview_ring_begin_write_slot(self->ring, slot);
+
+    *buffer = buf;
+    return GST_FLOW_OK;
+}
+
+static void gst_preview_shm_pool_release_buffer(GstBufferPool *pool, GstBuffer *buffer) {
+    GstPreviewShmPool *self = GST_PREVIEW_SHM_POOL(pool);
+    uint32_t slot;
+    gboolean drop = FALSE;
+
+    // Dropped before reaching the appsink (leaky queue, flush, error)
+    if (buffer_slot(buffer, &slot)) {
+        GST_OBJECT_LOCK(self);
+        drop = (self->pending & (1u << slot)) != 0;
+        self->pending &= ~(1u << slot);
+        GST_OBJECT_UNLOCK(self);
+    }
+    if (drop) {
+        preview_ring_abort(self->ring, slot);
+    }
+    GST_BUFFER_POOL_CLASS(gst_preview_shm_pool_parent_class)->release_buffer(pool, buffer);
+}
+
+static void gst_preview_shm_pool_class_init(GstPreviewShmPoolClass *klass) {
+    GstBufferPoolClass *pool_class = GST_BUFFER_POOL_CLASS(klass);
+
+    pool_class->set_config = gst_preview_shm_pool_set_config;
+    pool_class->alloc_buffer = gst_preview_shm_pool_alloc_buffer;
+    pool_class->free_buffer = gst_preview_shm_pool_free_buffer;
+    pool_class->acquire_buffer = gst_preview_shm_pool_acquire_buffer;
+    pool_class->release_buffer = gst_preview_shm_pool_release_buffer;
+
+    slot_quark = g_quark_from_static_string("preview-shm-slot");
+}
+
+static void gst_preview_shm_pool_init(GstPreviewShmPool *self) {
+    self->ring = NULL;
+    self->size = 0;
+    self->allocated = 0;
+    self->pending = 0;
+}
+
+GstBufferPool* preview_shm_pool_new(PreviewRingHeader *ring) {
+    GstPreviewShmPool *self = g_object_new(GST_TYPE_PREVIEW_SHM_POOL, NULL);
+    self->ring = ring;
+    return GST_BUFFER_POOL(self);
+}
+
+gboolean preview_shm_pool_commit(GstBuffer *buffer, const PreviewFrameInfo *info) {
+    uint32_t slot;
+
+    if (!buffer->pool || !GST_IS_PREVIEW_SHM_POOL(buffer->pool) || !buffer_slot(buffer, &slot)) {
+        return FALSE;
+    }
+    GstPreviewShmPool *self = GST_PREVIEW_SHM_POOL(buffer->pool);
+
+    // Memory replaced somewhere downstream: the slot does not hold the frame
+    if (gst_buffer_n_memory(buffer) != 1) {
+        return FALSE;
+    }
+    GstMapInfo map;
+    if (!gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+        return FALSE;
+    }
+    gboolean in_slot = map.data == preview_ring_slot_data(self->ring, slot);
+    gst_buffer_unmap(buffer, &map);
+    if (!in_slot) {
+        return FALSE;
+    }
+
+    GST_OBJECT_LOCK(self);
+    gboolean pending = (self->pending & (1u << slot)) != 0;
+    self->pending &= ~(1u << slot);
+    GST_OBJECT_UNLOCK(self);
+    if (!pending) {
+        // Already published (the same buffer pushed twice)
+        return TRUE;
+    }
+
+    preview_ring_commit(self->ring, slot, info);
+    return TRUE;
+}
+
+static GstPadProbeReturn allocation_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    PreviewRingHeader *ring = (PreviewRingHeader *)user_data;
+    GstQuery *query = GST_PAD_PROBE_INFO_QUERY(info);
+
+    if (GST_QUERY_TYPE(query) != GST_QUERY_ALLOCATION) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    GstCaps *caps = NULL;
+    gboolean need_pool;
+    GstVideoInfo vinfo;
+    gst_query_parse_allocation(query, &caps, &need_pool);
+    if (!caps || !gst_video_info_from_caps(&vinfo, caps)) {
+        return GST_PAD_PROBE_OK;
+    }
+    guint size = GST_VIDEO_INFO_SIZE(&vinfo);
+    if (size > ring->slot_size) {
+        g_printerr("Preview frame (%u bytes) does not fit a shm slot, copying instead\n", size);
+        return GST_PAD_PROBE_OK;
+    }
+
+    // A fresh pool per negotiation: the query only comes from the streaming
+    // thread before the next frame, so the old pool holds no slot by then.
+    // No GstVideoMeta is offered, which keeps the default (tight) stride
+    // readers expect.
+    GstBufferPool *pool = preview_shm_pool_new(ring);
+    GstStructure *config = gst_buffer_pool_get_config(pool);
+    gst_buffer_pool_config_set_params(config, caps, size, ring->slot_count, ring->slot_count);
+    if (!gst_buffer_pool_set_config(pool, config)) {
+        gst_object_unref(pool);
+        return GST_PAD_PROBE_OK;
+    }
+    gst_query_add_allocation_pool(query, pool, size, ring->slot_count, ring->slot_count);
+    gst_object_unref(pool);
+
+    return GST_PAD_PROBE_HANDLED;
+}
+
+gboolean preview_shm_pool_install(GstElement *appsink, PreviewRingHeader *ring) {
+    GstPad *pad = gst_element_get_static_pad(appsink, "sink");
+    if (!pad) {
+        return FALSE;
+    }
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM, allocation_probe, ring, NULL);
+    gst_object_unref(pad);
+    return TRUE;
+}
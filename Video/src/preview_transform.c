@@ -0,0 +1,361 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/src/preview_transform.c
+ */
+#include "preview_transform.h"
+#include "preview_kernel.h"
+#include "preview_hud.h"
+#include "eis.h"
+#include <gst/video/video.h>
+#include <math.h>
+
+struct _GstPreviewTransform {
+    GstVideoFilter parent;
+
+    // Properties (protected by the object lock)
+    gint width;
+    gint height;
+    gint method;
+    gboolean use_simd;
+    gboolean level;
+    gboolean hud;
+    gdouble fov;
+    gdouble level_max;
+
+    PreviewKernel *kernel;
+    PreviewHud *overlay;
+    gint scaled_width;          // of the current kernel
+};
+
+struct _GstPreviewTransformClass {
+    GstVideoFilterClass parent_class;
+};
+
+enum {
+    PROP_0,
+    PROP_WIDTH,
+    PROP_HEIGHT,
+    PROP_METHOD,
+    PROP_USE_SIMD,
+    PROP_LEVEL,
+    PROP_HUD,
+    PROP_FOV,
+    PROP_LEVEL_MAX,
+};
+
+#define DEFAULT_WIDTH     800
+#define DEFAULT_HEIGHT    450
+#define DEFAULT_METHOD    PREVIEW_ROTATE_90CW
+#define DEFAULT_USE_SIMD  TRUE
+#define DEFAULT_LEVEL     FALSE
+#define DEFAULT_HUD       FALSE
+#define DEFAULT_FOV       80.0
+#define DEFAULT_LEVEL_MAX 20.0
+
+// Older IMU attitude is not drawn or levelled against
+#define ATTITUDE_MAX_AGE_NS (500 * GST_MSECOND)
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE("sink",
+    GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE("NV12")));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE("src",
+    GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE("BGRA")));
+
+G_DEFINE_TYPE(GstPreviewTransform, gst_preview_transform, GST_TYPE_VIDEO_FILTER);
+
+static void gst_preview_transform_set_property(GObject *object, guint prop_id,
+                                               const GValue *value, GParamSpec *pspec) {
+    GstPreviewTransform *self = GST_PREVIEW_TRANSFORM(object);
+
+    GST_OBJECT_LOCK(self);
+    switch (prop_id) {
+        case PROP_WIDTH:
+            self->width = g_value_get_int(value);
+            break;
+        case PROP_HEIGHT:
+            self->height = g_value_get_int(value);
+            break;
+        case PROP_METHOD:
+            self->method = g_value_get_int(value);
+            break;
+        case PROP_USE_SIMD:
+            self->use_simd = g_value_get_boolean(value);
+            if (self->kernel) {
+                preview_kernel_set_simd(self->kernel, self->use_simd);
+            }
+            if (self->overlay) {
+                preview_hud_set_simd(self->overlay, self->use_simd);
+            }
+            break;
+        case PROP_LEVEL:
+            self->level = g_value_get_boolean(value);
+            break;
+        case PROP_HUD:
+            self->hud = g_value_get_boolean(value);
+            break;
+        case PROP_FOV:
+            self->fov = g_value_get_double(value);
+            break;
+        case PROP_LEVEL_MAX:
+            self->level_max = g_value_get_double(value);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+    GST_OBJECT_UNLOCK(self);
+
+    // Geometry changes need new output caps
+    if (prop_id == PROP_WIDTH || prop_id == PROP_HEIGHT || prop_id == PROP_METHOD) {
+        gst_base_transform_reconfigure_src(GST_BASE_TRANSFORM(self));
+    }
+}
+
+static void gst_preview_transform_get_property(GObject *object, guint prop_id,
+                                               GValue *value, GParamSpec *pspec) {
+    GstPreviewTransform *self = GST_PREVIEW_TRANSFORM(object);
+
+    GST_OBJECT_LOCK(self);
+    switch (prop_id) {
+        case PROP_WIDTH:
+            g_value_set_int(value, self->width);
+            break;
+        case PROP_HEIGHT:
+            g_value_set_int(value, self->height);
+            break;
+        case PROP_METHOD:
+            g_value_set_int(value, self->method);
+            break;
+        case PROP_USE_SIMD:
+            g_value_set_boolean(value, self->use_simd);
+            break;
+        case PROP_LEVEL:
+            g_value_set_boolean(value, self->level);
+            break;
+        case PROP_HUD:
+            g_value_set_boolean(value, self->hud);
+            break;
+        case PROP_FOV:
+            g_value_set_double(value, self->fov);
+            break;
+        case PROP_LEVEL_MAX:
+            g_value_set_double(value, self->level_max);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+    GST_OBJECT_UNLOCK(self);
+}
+
+static void gst_preview_transform_finalize(GObject *object) {
+    GstPreviewTransform *self = GST_PREVIEW_TRANSFORM(object);
+
+    preview_kernel_free(self->kernel);
+    self->kernel = NULL;
+    preview_hud_free(self->overlay);
+    self->overlay = NULL;
+
+    G_OBJECT_CLASS(gst_preview_transform_parent_class)->finalize(object);
+}
+
+static GstCaps* gst_preview_transform_transform_caps(GstBaseTransform *trans, GstPadDirection direction,
+                                                     GstCaps *caps, GstCaps *filter) {
+    GstPreviewTransform *self = GST_PREVIEW_TRANSFORM(trans);
+    GstCaps *result = gst_caps_new_empty();
+    gint out_width, out_height;
+
+    GST_OBJECT_LOCK(self);
+    if (self->method == PREVIEW_ROTATE_90CW || self->method == PREVIEW_ROTATE_90CCW) {
+        out_width = self->height;
+        out_height = self->width;
+    } else {
+        out_width = self->width;
+        out_height = self->height;
+    }
+    GST_OBJECT_UNLOCK(self);
+
+    for (guint i = 0; i < gst_caps_get_size(caps); i++) {
+        GstStructure *s = gst_structure_copy(gst_caps_get_structure(caps, i));
+
+        gst_structure_remove_fields(s, "colorimetry", "chroma-site", NULL);
+        if (direction == GST_PAD_SINK) {
+            // NV12 any size -> BGRA at the configured (rotated) size
+            gst_structure_set(s,
+                              "format", G_TYPE_STRING, "BGRA",
+                              "width", G_TYPE_INT, out_width,
+                              "height", G_TYPE_INT, out_height,
+                              "pixel-aspect-ratio", GST_TYPE_FRACTION, 1, 1,
+                              NULL);
+        } else {
+            // BGRA -> NV12 of whatever size the source delivers
+            gst_structure_set(s, "format", G_TYPE_STRING, "NV12", NULL);
+            gst_structure_remove_fields(s, "width", "height", "pixel-aspect-ratio", NULL);
+        }
+        result = gst_caps_merge_structure(result, s);
+    }
+
+    if (filter) {
+        GstCaps *tmp = gst_caps_intersect_full(filter, result, GST_CAPS_INTERSECT_FIRST);
+        gst_caps_unref(result);
+        result = tmp;
+    }
+    return result;
+}
+
+static gboolean gst_preview_transform_set_info(GstVideoFilter *filter, GstCaps *incaps, GstVideoInfo *in_info,
+                                               GstCaps *outcaps, GstVideoInfo *out_info) {
+    GstPreviewTransform *self = GST_PREVIEW_TRANSFORM(filter);
+    PreviewMatrix matrix = PREVIEW_MATRIX_BT709;
+    gint width, height, method;
+    gboolean use_simd;
+
+    GST_OBJECT_LOCK(self);
+    width = self->width;
+    height = self->height;
+    method = self->method;
+    use_simd = self->use_simd;
+    GST_OBJECT_UNLOCK(self);
+
+    if (in_info->colorimetry.matrix == GST_VIDEO_COLOR_MATRIX_BT601) {
+        matrix = PREVIEW_MATRIX_BT601;
+    }
+
+    PreviewKernel *kernel = preview_kernel_new(GST_VIDEO_INFO_WIDTH(in_info), GST_VIDEO_INFO_HEIGHT(in_info),
+                                               width, height, (PreviewRotation)method, matrix);
+    if (!kernel) {
+        g_printerr("previewtransform: cannot handle %dx%d -> %dx%d\n",
+                   GST_VIDEO_INFO_WIDTH(in_info), GST_VIDEO_INFO_HEIGHT(in_info), width, height);
+        return FALSE;
+    }
+    if (preview_kernel_dst_width(kernel) != GST_VIDEO_INFO_WIDTH(out_info) ||
+        preview_kernel_dst_height(kernel) != GST_VIDEO_INFO_HEIGHT(out_info)) {
+        g_printerr("previewtransform: output caps %dx%d do not match configuration\n",
+                   GST_VIDEO_INFO_WIDTH(out_info), GST_VIDEO_INFO_HEIGHT(out_info));
+        preview_kernel_free(kernel);
+        return FALSE;
+    }
+    preview_kernel_set_simd(kernel, use_simd);
+
+    PreviewHud *overlay = preview_hud_new(width, height, (PreviewRotation)method);
+    if (!overlay) {
+        preview_kernel_free(kernel);
+        return FALSE;
+    }
+    preview_hud_set_simd(overlay, use_simd);
+
+    GST_OBJECT_LOCK(self);
+    preview_kernel_free(self->kernel);
+    self->kernel = kernel;
+    preview_hud_free(self->overlay);
+    self->overlay = overlay;
+    self->scaled_width = width;
+    GST_OBJECT_UNLOCK(self);
+
+    return TRUE;
+}
+
+static GstFlowReturn gst_preview_transform_transform_frame(GstVideoFilter *filter, GstVideoFrame *in_frame,
+                                                           GstVideoFrame *out_frame) {
+    GstPreviewTransform *self = GST_PREVIEW_TRANSFORM(filter);
+    gboolean level, hud;
+    gdouble fov, level_max;
+
+    GST_OBJECT_LOCK(self);
+    level = self->level;
+    hud = self->hud;
+    fov = self->fov;
+    level_max = self->level_max;
+    GST_OBJECT_UNLOCK(self);
+
+    // Horizon from the IMU attitude; without a recent one the preview is
+    // shown as captured and the overlay left out
+    float tilt = 0, elevation = 0, angle = 0, zoom = 1;
+    gboolean attitude = (level || hud) &&
+        eis_attitude_camera((uint64_t)g_get_monotonic_time() * 1000, ATTITUDE_MAX_AGE_NS, &tilt, &elevation) == 0;
+    if (level && attitude) {
+        float max = (float)(level_max * M_PI / 180.0);
+        angle = CLAMP(tilt, -max, max);
+        zoom = preview_kernel_level_zoom(self->kernel, angle);
+    }
+    preview_kernel_set_level(self->kernel, angle, zoom);
+
+    guint8 *dst = GST_VIDEO_FRAME_PLANE_DATA(out_frame, 0);
+    gint dst_stride = GST_VIDEO_FRAME_PLANE_STRIDE(out_frame, 0);
+    preview_kernel_process(self->kernel,
+                           GST_VIDEO_FRAME_PLANE_DATA(in_frame, 0), GST_VIDEO_FRAME_PLANE_STRIDE(in_frame, 0),
+                           GST_VIDEO_FRAME_PLANE_DATA(in_frame, 1), GST_VIDEO_FRAME_PLANE_STRIDE(in_frame, 1),
+                           dst, dst_stride);
+
+    if (hud && attitude) {
+        // What is left of the tilt after levelling, on the zoomed picture
+        float focal = (float)(self->scaled_width / 2.0 / tan(fov * M_PI / 360.0)) * zoom;
+        preview_hud_draw(self->overlay, tilt - angle, elevation, focal);
+        preview_hud_blend(self->overlay, dst, dst_stride);
+    }
+    return GST_FLOW_OK;
+}
+
+static void gst_preview_transform_class_init(GstPreviewTransformClass *klass) {
+    GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+    GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+    GstBaseTransformClass *trans_class = GST_BASE_TRANSFORM_CLASS(klass);
+    GstVideoFilterClass *filter_class = GST_VIDEO_FILTER_CLASS(klass);
+
+    gobject_class->set_property = gst_preview_transform_set_property;
+    gobject_class->get_property = gst_preview_transform_get_property;
+    gobject_class->finalize = gst_preview_transform_finalize;
+
+    g_object_class_install_property(gobject_class, PROP_WIDTH,
+        g_param_spec_int("width", "Width", "Scaled width before rotation",
+                         2, 4096, DEFAULT_WIDTH, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_HEIGHT,
+        g_param_spec_int("height", "Height", "Scaled height before rotation",
+                         2, 4096, DEFAULT_HEIGHT, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_METHOD,
+        g_param_spec_int("method", "Method", "Rotation: 0 none, 1 90cw, 2 180, 3 90ccw",
+                         0, 3, DEFAULT_METHOD, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_USE_SIMD,
+        g_param_spec_boolean("use-simd", "Use SIMD", "Use the NEON/SSE2 path instead of the scalar reference",
+                             DEFAULT_USE_SIMD, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_LEVEL,
+        g_param_spec_boolean("level", "Level", "Counter-rotate the picture by the IMU roll",
+                             DEFAULT_LEVEL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_HUD,
+        g_param_spec_boolean("hud", "HUD", "Draw the horizon and pitch ladder",
+                             DEFAULT_HUD, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_FOV,
+        g_param_spec_double("fov", "Field of view", "Horizontal field of view of the picture (degrees)",
+                            10.0, 170.0, DEFAULT_FOV, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_LEVEL_MAX,
+        g_param_spec_double("level-max", "Level max", "Largest roll levelled out (degrees)",
+                            0.0, 45.0, DEFAULT_LEVEL_MAX, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+    gst_element_class_set_static_metadata(element_class,
+        "Preview transform", "Filter/Converter/Video/Scaler",
+        "Fused NV12 scale + BGRA conversion + rotation for the preview branch",
+        "LegionMay");
+    gst_element_class_add_static_pad_template(element_class, &sink_template);
+    gst_element_class_add_static_pad_template(element_class, &src_template);
+
+    trans_class->transform_caps = gst_preview_transform_transform_caps;
+    filter_class->set_info = gst_preview_transform_set_info;
+    filter_class->transform_frame = gst_preview_transform_transform_frame;
+}
+
+static void gst_preview_transform_init(GstPreviewTransform *self) {
+    self->width = DEFAULT_WIDTH;
+    self->height = DEFAULT_HEIGHT;
+    self->method = DEFAULT_METHOD;
+    self->use_simd = DEFAULT_USE_SIMD;
+    self->level = DEFAULT_LEVEL;
+    self->hud = DEFAULT_HUD;
+    self->fov = DEFAULT_FOV;
+    self->level_max = DEFAULT_LEVEL_MAX;
+    self->kernel = NULL;
+    self->overlay = NULL;
+}
+
+gboolean preview_transform_register(void) {
+    return gst_element_register(NULL, "previewtransform", GST_RANK_NONE, GST_TYPE_PREVIEW_TRANSFORM);
+}
@@ -0,0 +1,444 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/src/reconfig.c
+ */
+#include "reconfig.h"
+#include "preview_kernel.h"
+#include "eis.h"
+#include <string.h>
+#include <time.h>
+
+// Preview frames pass at most every preview_interval ns (0 = all of them)
+static volatile gint preview_interval = 0;
+static GstClockTime preview_next = GST_CLOCK_TIME_NONE;
+static volatile gint preview_decimated = 0;
+
+// Adaptive preview rate: once a window the capture thread weighs the
+// process CPU load and the encoder queue, and steps the preview down to
+// one in `preview_divisor` of the frames preview_fps lets through, or
+// back up once the load has stayed low for a few windows
+#define ADAPT_WINDOW_NS         GST_SECOND
+#define ADAPT_CALM_WINDOWS      2   // calm windows before stepping back up
+#define ADAPT_SETTLE_WINDOWS    1   // skipped after a step: half old, half new rate
+
+static volatile gint adapt_generation = 0;     // bumped by every apply
+static volatile gint adapt_enabled = 0;
+static volatile gint adapt_ceiling_fps = 0;    // preview_fps, or the capture rate
+static volatile gint adapt_min_fps = 1;
+static volatile gint adapt_cpu_high = 100;     // % of all cores
+static volatile gint adapt_cpu_low = 0;
+static volatile gint preview_divisor = 1;
+static GstElement *adapt_queue = NULL;
+
+// Capture thread only
+typedef struct {
+    gint generation;
+    guint64 window_start;       // CLOCK_MONOTONIC ns, 0 before the first frame
+    guint64 cpu_start;          // CLOCK_PROCESS_CPUTIME_ID ns
+    guint queue_peak;
+    gint calm;
+    gint settle;
+    // Last step, measured once the new rate has settled
+    gint from_divisor;          // 0: nothing to measure
+    gdouble from_cpu_ms;        // CPU ms per second before it
+    gchar reason[48];
+} AdaptState;
+static AdaptState adapt;
+
+// Recording integrity: preview frames give way while the encoder input
+// backs up, so the CPU goes to the recording branch first
+static GstElement *shed_queue = NULL;
+
+// Borrowed reference: the bin keeps its children alive
+static GstElement* find(GstElement *pipeline, const char *name) {
+    GstElement *element = gst_bin_get_by_name(GST_BIN(pipeline), name);
+    if (element) {
+        gst_object_unref(element);
+    }
+    return element;
+}
+
+static gboolean has_property(GstElement *element, const char *name) {
+    return g_object_class_find_property(G_OBJECT_GET_CLASS(element), name) != NULL;
+}
+
+void reconfig_encoder(GstElement *encoder, const VideoConfig *config) {
+    int gop = config->encoder_gop > 0 ? config->encoder_gop : config->record_framerate;
+
+    // mpph265enc picks changes up on the next frame
+    if (has_property(encoder, "bps")) {
+        g_object_set(G_OBJECT(encoder), "bps", (guint)config->encoder_bitrate_kbps * 1000, NULL);
+    } else if (has_property(encoder, "bitrate")) {
+        g_object_set(G_OBJECT(encoder), "bitrate", (guint)config->encoder_bitrate_kbps, NULL);
+    }
+    if (has_property(encoder, "gop")) {
+        g_object_set(G_OBJECT(encoder), "gop", gop, NULL);
+    } else if (has_property(encoder, "key-int-max")) {
+        g_object_set(G_OBJECT(encoder), "key-int-max", gop, NULL);
+    }
+    if (has_property(encoder, "rc-mode")) {
+        gst_util_set_object_arg(G_OBJECT(encoder), "rc-mode", config->encoder_rc);
+    }
+}
+
+GstCaps* reconfig_capture_caps(const VideoConfig *config) {
+    return gst_caps_new_simple("video/x-raw",
+                               "format", G_TYPE_STRING, "NV12",
+                               "width", G_TYPE_INT, config->record_width,
+                               "height", G_TYPE_INT, config->record_height,
+                               "framerate", GST_TYPE_FRACTION, config->record_framerate, 1,
+                               NULL);
+}
+
+const char* reconfig_audio_codec(const VideoConfig *config) {
+    // mp4mux takes neither Vorbis nor raw samples
+    if (strcmp(config->record_container, "mp4") == 0 &&
+        (strcmp(config->audio_codec, "vorbis") == 0 || strcmp(config->audio_codec, "pcm") == 0)) {
+        return "aac";
+    }
+    return config->audio_codec;
+}
+
+const char* reconfig_audio_encoder_factory(const VideoConfig *config) {
+    const char *codec = reconfig_audio_codec(config);
+    if (strcmp(codec, "opus") == 0) return "opusenc";
+    if (strcmp(codec, "aac") == 0) return "avenc_aac";
+    if (strcmp(codec, "vorbis") == 0) return "vorbisenc";
+    return "identity";  // pcm: samples go to the muxer as they are
+}
+
+// Rates libopus runs at natively; anything else would be resampled inside
+static int opus_rate(int rate) {
+    static const int rates[] = { 8000, 12000, 16000, 24000, 48000 };
+    for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+        if (rate <= rates[i]) return rates[i];
+    }
+    return 48000;
+}
+
+GstCaps* reconfig_audio_caps(const VideoConfig *config) {
+    const char *codec = reconfig_audio_codec(config);
+    int rate = config->audio_rate;
+    if (strcmp(codec, "opus") == 0 && opus_rate(rate) != rate) {
+        g_printerr("Opus has no %d Hz mode, using %d Hz\n", rate, opus_rate(rate));
+        rate = opus_rate(rate);
+    }
+    GstCaps *caps = gst_caps_new_simple("audio/x-raw",
+                                        "rate", G_TYPE_INT, rate,
+                                        "channels", G_TYPE_INT, config->audio_channels,
+                                        NULL);
+    // Opus and PCM take 16-bit samples, the format sound cards deliver, so
+    // audioconvert passes them through; AAC and Vorbis pick their own
+    if (strcmp(codec, "opus") == 0 || strcmp(codec, "pcm") == 0) {
+        gst_caps_set_simple(caps,
+                            "format", G_TYPE_STRING, "S16LE",
+                            "layout", G_TYPE_STRING, "interleaved",
+                            NULL);
+    }
+    return caps;
+}
+
+void reconfig_audio_encoder(GstElement *encoder, const VideoConfig *config) {
+    // opusenc picks both up on the next frame; avenc_aac only when it starts
+    if (has_property(encoder, "bitrate")) {
+        g_object_set(G_OBJECT(encoder), "bitrate", config->audio_bitrate_kbps * 1000, NULL);
+    }
+    if (has_property(encoder, "complexity")) {
+        g_object_set(G_OBJECT(encoder), "complexity", config->audio_complexity, NULL);
+    }
+}
+
+static PreviewRotation rotation_method(int degrees) {
+    switch (degrees) {
+        case 90:  return PREVIEW_ROTATE_90CW;
+        case 180: return PREVIEW_ROTATE_180;
+        case 270: return PREVIEW_ROTATE_90CCW;
+        default:  return PREVIEW_ROTATE_NONE;
+    }
+}
+
+static gboolean encoder_backlogged(void) {
+    guint level = 0, max = 0;
+    g_object_get(G_OBJECT(shed_queue), "current-level-buffers", &level, "max-size-buffers", &max, NULL);
+    return max > 1 && level + 1 >= max;
+}
+
+static guint64 clock_ns(clockid_t id) {
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return (guint64)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static gdouble divided_fps(gint divisor) {
+    return (gdouble)g_atomic_int_get(&adapt_ceiling_fps) / divisor;
+}
+
+static void adapt_step(gint divisor, gdouble cpu_ms, const char *reason) {
+    adapt.from_divisor = g_atomic_int_get(&preview_divisor);
+    adapt.from_cpu_ms = cpu_ms;
+    g_strlcpy(adapt.reason, reason, sizeof(adapt.reason));
+    adapt.settle = ADAPT_SETTLE_WINDOWS;
+    adapt.calm = 0;
+    g_atomic_int_set(&preview_divisor, divisor);
+}
+
+// End of a window: report the last step once settled, then decide the next
+static void adapt_window(guint64 now, guint64 cpu) {
+    gdouble cpu_ms = (gdouble)(cpu - adapt.cpu_start) * 1000.0 / (gdouble)(now - adapt.window_start);
+    gint load = (gint)(cpu_ms / (10.0 * g_get_num_processors()) + 0.5);
+    guint queue_max = 0;
+    if (adapt_queue) {
+        g_object_get(G_OBJECT(adapt_queue), "max-size-buffers", &queue_max, NULL);
+    }
+    guint queue_peak = adapt.queue_peak;
+    adapt.window_start = now;
+    adapt.cpu_start = cpu;
+    adapt.queue_peak = 0;
+
+    if (adapt.settle > 0) {
+        adapt.settle--;
+        return;
+    }
+    gint divisor = g_atomic_int_get(&preview_divisor);
+    if (adapt.from_divisor) {
+        g_print("Preview %.1f -> %.1f fps (%s): %.0f -> %.0f ms CPU/s, %.0f saved\n",
+                divided_fps(adapt.from_divisor), divided_fps(divisor), adapt.reason,
+                adapt.from_cpu_ms, cpu_ms, adapt.from_cpu_ms - cpu_ms);
+        adapt.from_divisor = 0;
+    }
+
+    gchar reason[48];
+    gboolean queue_full = queue_max > 1 && queue_peak + 1 >= queue_max;
+    if ((load > g_atomic_int_get(&adapt_cpu_high) || queue_full) &&
+        divided_fps(divisor + 1) >= g_atomic_int_get(&adapt_min_fps)) {
+        if (queue_full) {
+            g_snprintf(reason, sizeof(reason), "encoder queue %u/%u", queue_peak, queue_max);
+        } else {
+            g_snprintf(reason, sizeof(reason), "CPU %d%%", load);
+        }
+        adapt_step(divisor + 1, cpu_ms, reason);
+    } else if (load < g_atomic_int_get(&adapt_cpu_low) && queue_peak <= 1 && divisor > 1) {
+        if (++adapt.calm >= ADAPT_CALM_WINDOWS) {
+            g_snprintf(reason, sizeof(reason), "CPU %d%%", load);
+            adapt_step(divisor - 1, cpu_ms, reason);
+        }
+    } else {
+        adapt.calm = 0;
+    }
+}
+
+static void adapt_frame(void) {
+    guint64 now = clock_ns(CLOCK_MONOTONIC);
+    gint generation = g_atomic_int_get(&adapt_generation);
+    if (adapt.generation != generation || adapt.window_start == 0) {
+        // New settings: start over from the full rate
+        memset(&adapt, 0, sizeof(adapt));
+        adapt.generation = generation;
+        adapt.window_start = now;
+        adapt.cpu_start = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+        g_atomic_int_set(&preview_divisor, 1);
+        return;
+    }
+    if (adapt_queue) {
+        guint level = 0;
+        g_object_get(G_OBJECT(adapt_queue), "current-level-buffers", &level, NULL);
+        adapt.queue_peak = MAX(adapt.queue_peak, level);
+    }
+    if (now - adapt.window_start >= ADAPT_WINDOW_NS) {
+        adapt_window(now, clock_ns(CLOCK_PROCESS_CPUTIME_ID));
+    }
+}
+
+// Drop preview frames above preview_fps before they reach the transform
+static GstPadProbeReturn preview_rate_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    GstClockTime interval = (GstClockTime)g_atomic_int_get(&preview_interval);
+    GstClockTime ts = GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info));
+
+    if (g_atomic_int_get(&adapt_enabled)) {
+        adapt_frame();
+        gint divisor = g_atomic_int_get(&preview_divisor);
+        if (divisor > 1) {
+            interval = GST_SECOND * divisor / g_atomic_int_get(&adapt_ceiling_fps);
+        }
+    }
+
+    if (shed_queue && encoder_backlogged()) {
+        g_atomic_int_inc(&preview_decimated);
+        return GST_PAD_PROBE_DROP;
+    }
+
+    if (interval == 0 || !GST_CLOCK_TIME_IS_VALID(ts)) {
+        preview_next = GST_CLOCK_TIME_NONE;
+        return GST_PAD_PROBE_OK;
+    }
+    // A little slack so capture jitter does not drop frames on the boundary
+    if (GST_CLOCK_TIME_IS_VALID(preview_next) && ts + interval / 8 < preview_next) {
+        g_atomic_int_inc(&preview_decimated);
+        return GST_PAD_PROBE_DROP;
+    }
+    if (GST_CLOCK_TIME_IS_VALID(preview_next) && ts < preview_next + interval) {
+        preview_next += interval;
+    } else {
+        preview_next = ts + interval;
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static void apply_live(GstElement *pipeline, const VideoConfig *config) {
+    GstElement *element;
+
+    if ((element = find(pipeline, "encoder"))) {
+        reconfig_encoder(element, config);
+    }
+    if ((element = find(pipeline, "audio-encoder"))) {
+        reconfig_audio_encoder(element, config);
+    }
+    if ((element = find(pipeline, "enc_queue"))) {
+        g_object_set(G_OBJECT(element), "max-size-buffers", (guint)config->enc_queue_buffers, NULL);
+    }
+    if ((element = find(pipeline, "app_queue"))) {
+        g_object_set(G_OBJECT(element), "max-size-buffers", (guint)config->preview_queue_buffers, NULL);
+    }
+    if ((element = find(pipeline, "audio_queue"))) {
+        g_object_set(G_OBJECT(element), "max-size-buffers", (guint)config->audio_queue_buffers, NULL);
+    }
+    if ((element = find(pipeline, "video_prerecord"))) {
+        g_object_set(G_OBJECT(element),
+                    "duration", (guint64)config->prerecord_seconds * GST_SECOND,
+                    "max-bytes", (guint64)config->prerecord_max_bytes,
+                    NULL);
+    }
+    if ((element = find(pipeline, "audio_prerecord"))) {
+        g_object_set(G_OBJECT(element), "duration", (guint64)config->prerecord_seconds * GST_SECOND, NULL);
+    }
+    if ((element = find(pipeline, "imu_prerecord"))) {
+        g_object_set(G_OBJECT(element), "duration", (guint64)config->prerecord_seconds * GST_SECOND, NULL);
+    }
+    if ((element = find(pipeline, "gnss_prerecord"))) {
+        g_object_set(G_OBJECT(element), "duration", (guint64)config->prerecord_seconds * GST_SECOND, NULL);
+    }
+    if ((element = find(pipeline, "record_queue"))) {
+        g_object_set(G_OBJECT(element), "max-size-time", (guint64)config->record_buffer_ms * GST_MSECOND, NULL);
+    }
+    if ((element = find(pipeline, "audio_record_queue"))) {
+        g_object_set(G_OBJECT(element), "max-size-time", (guint64)config->record_buffer_ms * GST_MSECOND, NULL);
+    }
+
+    if ((element = find(pipeline, "eis"))) {
+        g_object_set(G_OBJECT(element),
+                    "enabled", config->eis != 0,
+                    "lookahead", config->eis_lookahead,
+                    "crop", config->eis_crop_pct / 100.0,
+                    "fov", (gdouble)config->eis_fov_deg,
+                    "readout-ms", config->eis_readout_us / 1000.0,
+                    "gyro-offset-ms", config->eis_gyro_offset_us / 1000.0,
+                    "threads", config->eis_threads,
+                    NULL);
+        eis_gyro_set_axes(config->eis_gyro_axes);
+    }
+
+    if ((element = find(pipeline, "preview_transform"))) {
+        // Levelling and the overlay switch from the next frame
+        g_object_set(G_OBJECT(element),
+                    "level", config->preview_level != 0,
+                    "hud", config->preview_hud != 0,
+                    "fov", (gdouble)config->eis_fov_deg,
+                    NULL);
+
+        // Geometry changes make the transform renegotiate, so only touch
+        // it when something differs
+        gint width, height, method;
+        g_object_get(G_OBJECT(element), "width", &width, "height", &height, "method", &method, NULL);
+        if (width != config->preview_width || height != config->preview_height ||
+            method != (gint)rotation_method(config->preview_rotation)) {
+            g_object_set(G_OBJECT(element),
+                        "width", config->preview_width,
+                        "height", config->preview_height,
+                        "method", rotation_method(config->preview_rotation),
+                        NULL);
+        }
+    }
+    gint interval = config->preview_fps > 0 && config->preview_fps < config->record_framerate
+        ? (gint)(GST_SECOND / config->preview_fps) : 0;
+    g_atomic_int_set(&preview_interval, interval);
+
+    // A new ceiling or switching the mode on makes the capture thread start
+    // over from the top; thresholds apply from the next window
+    gint ceiling = interval ? config->preview_fps : config->record_framerate;
+    if (ceiling != g_atomic_int_get(&adapt_ceiling_fps) ||
+        (config->preview_fps_adaptive != 0) != (g_atomic_int_get(&adapt_enabled) != 0)) {
+        g_atomic_int_set(&adapt_ceiling_fps, ceiling);
+        g_atomic_int_inc(&adapt_generation);
+        g_atomic_int_set(&preview_divisor, 1);
+    }
+    g_atomic_int_set(&adapt_min_fps, config->preview_fps_min);
+    g_atomic_int_set(&adapt_cpu_high, config->preview_cpu_high);
+    g_atomic_int_set(&adapt_cpu_low, config->preview_cpu_low);
+    g_atomic_int_set(&adapt_enabled, config->preview_fps_adaptive != 0);
+}
+
+void reconfig_install(GstElement *pipeline, const VideoConfig *config) {
+    GstElement *queue = find(pipeline, "app_queue");
+    if (queue) {
+        GstPad *pad = gst_element_get_static_pad(queue, "sink");
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, preview_rate_probe, NULL, NULL);
+        gst_object_unref(pad);
+    }
+    preview_next = GST_CLOCK_TIME_NONE;
+    shed_queue = config->record_integrity ? find(pipeline, "enc_queue") : NULL;
+    adapt_queue = find(pipeline, "enc_queue");
+    apply_live(pipeline, config);
+}
+
+guint reconfig_preview_decimated(void) {
+    return (guint)g_atomic_int_get(&preview_decimated);
+}
+
+gdouble reconfig_preview_fps(void) {
+    return divided_fps(g_atomic_int_get(&preview_divisor));
+}
+
+// Only the source stops: it releases its buffers in READY, so the device
+// can take the new format, while encoder and preview wait for new caps.
+static int relink_capture(GstElement *pipeline, const VideoConfig *config) {
+    GstElement *source = find(pipeline, "source");
+    GstElement *filter = find(pipeline, "capture_caps");
+    if (!source || !filter) {
+        g_printerr("Pipeline has no source/capture_caps to reconfigure\n");
+        return -1;
+    }
+
+    if (gst_element_set_state(source, GST_STATE_READY) == GST_STATE_CHANGE_FAILURE) {
+        g_printerr("Failed to stop capture source\n");
+        return -1;
+    }
+    GstCaps *caps = reconfig_capture_caps(config);
+    g_object_set(G_OBJECT(filter), "caps", caps, NULL);
+    gst_caps_unref(caps);
+
+    if (!gst_element_sync_state_with_parent(source)) {
+        g_printerr("Failed to restart capture source\n");
+        return -1;
+    }
+    g_print("Capture reconfigured to %dx%d@%d\n",
+            config->record_width, config->record_height, config->record_framerate);
+    return 0;
+}
+
+int reconfig_apply(GstElement *pipeline, const VideoConfig *config, ConfigApply apply) {
+    switch (apply) {
+        case CONFIG_APPLY_RELINK:
+            if (relink_capture(pipeline, config) != 0) {
+                return -1;
+            }
+            // The GOP may follow the frame rate, the preview size the aspect ratio
+            apply_live(pipeline, config);
+            return 0;
+        case CONFIG_APPLY_LIVE:
+            apply_live(pipeline, config);
+            return 0;
+        default:
+            // Picked up by the next recording or the next start
+            return 0;
+    }
+}
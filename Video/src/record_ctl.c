@@ -0,0 +1,112 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/src/record_ctl.c
+ */
+#include "record_ctl.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static void fill_addr(struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strncpy(addr->sun_path, RECORD_CTL_SOCKET, sizeof(addr->sun_path) - 1);
+}
+
+int record_ctl_connect(void) {
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("record_ctl_connect: socket failed");
+        return -1;
+    }
+    fill_addr(&addr);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        perror("record_ctl_connect: connect failed");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void record_ctl_close(int fd) {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+static int send_command(int fd, RecordCommand *cmd, RecordReply *reply) {
+    static uint32_t next_seq = 0;
+    cmd->seq = ++next_seq;
+
+    if (send(fd, cmd, sizeof(*cmd), MSG_NOSIGNAL) != (ssize_t)sizeof(*cmd)) {
+        perror("record_ctl_request: send failed");
+        return -1;
+    }
+    // Seqpacket keeps message boundaries; skip stale replies, if any
+    for (;;) {
+        ssize_t n = recv(fd, reply, sizeof(*reply), 0);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n != (ssize_t)sizeof(*reply)) {
+            fprintf(stderr, "record_ctl_request: connection closed\n");
+            return -1;
+        }
+        if (reply->seq == cmd->seq) {
+            reply->filename[sizeof(reply->filename) - 1] = '\0';
+            reply->value[sizeof(reply->value) - 1] = '\0';
+            return 0;
+        }
+    }
+}
+
+int record_ctl_request(int fd, RecordCommandOp op, RecordReply *reply) {
+    RecordCommand cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.op = op;
+    return send_command(fd, &cmd, reply);
+}
+
+int record_ctl_config(int fd, RecordCommandOp op, const char *key, const char *value,
+                      RecordReply *reply) {
+    RecordCommand cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.op = op;
+    if (key) strncpy(cmd.key, key, sizeof(cmd.key) - 1);
+    if (value) strncpy(cmd.value, value, sizeof(cmd.value) - 1);
+    return send_command(fd, &cmd, reply);
+}
+
+const char* record_result_str(int32_t result) {
+    switch (result) {
+        case RECORD_OK:              return "ok";
+        case RECORD_ALREADY:         return "no change";
+        case RECORD_ERR_STORAGE:     return "storage not writable";
+        case RECORD_ERR_PIPELINE:    return "pipeline error";
+        case RECORD_ERR_BAD_COMMAND: return "bad command";
+        case RECORD_ERR_BAD_CONFIG:  return "invalid setting";
+        case RECORD_ERR_BUSY:        return "not while recording";
+        default:                     return "unknown";
+    }
+}
+
+int record_ctl_listen(void) {
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd == -1) {
+        perror("record_ctl_listen: socket failed");
+        return -1;
+    }
+    fill_addr(&addr);
+    unlink(RECORD_CTL_SOCKET);  // stale socket from a previous run
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, 4) == -1) {
+        perror("record_ctl_listen: bind/listen failed");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
@@ -0,0 +1,1327 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/src/record_recover.c
+ */
+// record_recover: make recordings cut short by a power loss seekable again.
+//
+// Matroska: the file is read once, front to back. Cluster positions and the
+// first video keyframe of each cluster are collected, the unfinished tail
+// (a partly written block) is cut off, and the missing index is written in
+// place: Cues appended at the end, Segment size, Info/Duration and the
+// SeekHead entries matroskamux left as placeholders patched.
+//
+// Fragmented MP4 (record_container = mp4): fragments are already playable;
+// a partial trailing fragment is cut off and a fragment index (mfra) is
+// appended.
+//
+// Memory use is one entry per cluster/fragment, never the media itself.
+#define _FILE_OFFSET_BITS 64
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define READ_BUFFER     (1 << 20)
+#define EBML_UNKNOWN    UINT64_MAX
+#define NOT_FOUND       UINT64_MAX
+
+#define ID_EBML             0x1A45DFA3
+#define ID_SEGMENT          0x18538067
+#define ID_SEEKHEAD         0x114D9B74
+#define ID_SEEK             0x4DBB
+#define ID_SEEKID           0x53AB
+#define ID_SEEKPOSITION     0x53AC
+#define ID_INFO             0x1549A966
+#define ID_TIMECODESCALE    0x2AD7B1
+#define ID_DURATION         0x4489
+#define ID_TRACKS           0x1654AE6B
+#define ID_TRACKENTRY       0xAE
+#define ID_TRACKNUMBER      0xD7
+#define ID_TRACKTYPE        0x83
+#define ID_CLUSTER          0x1F43B675
+#define ID_TIMECODE         0xE7
+#define ID_SIMPLEBLOCK      0xA3
+#define ID_BLOCKGROUP       0xA0
+#define ID_BLOCK            0xA1
+#define ID_REFERENCEBLOCK   0xFB
+#define ID_CUES             0x1C53BB6B
+#define ID_CUEPOINT         0xBB
+#define ID_CUETIME          0xB3
+#define ID_CUETRACKPOSITIONS 0xB7
+#define ID_CUETRACK         0xF7
+#define ID_CUECLUSTERPOSITION 0xF1
+#define ID_TAGS             0x1254C367
+#define ID_CHAPTERS         0x1043A770
+#define ID_ATTACHMENTS      0x1941A469
+#define ID_VOID             0xEC
+
+/* ---------- sequential reader ---------- */
+
+typedef struct {
+    FILE *fp;
+    uint64_t pos;
+    uint64_t size;
+    uint8_t scratch[64 * 1024];
+} Reader;
+
+static int rd_bytes(Reader *r, void *buf, size_t len) {
+    if (r->pos + len > r->size || fread(buf, 1, len, r->fp) != len) {
+        return -1;
+    }
+    r->pos += len;
+    return 0;
+}
+
+static int rd_seek(Reader *r, uint64_t pos) {
+    if (fseeko(r->fp, (off_t)pos, SEEK_SET) != 0) {
+        return -1;
+    }
+    r->pos = pos;
+    return 0;
+}
+
+// Short skips are read through so the stream stays sequential
+static int rd_skip(Reader *r, uint64_t len) {
+    if (r->pos + len > r->size) {
+        return -1;
+    }
+    if (len > READ_BUFFER) {
+        return rd_seek(r, r->pos + len);
+    }
+    while (len > 0) {
+        size_t n = len > sizeof(r->scratch) ? sizeof(r->scratch) : (size_t)len;
+        if (rd_bytes(r, r->scratch, n) != 0) {
+            return -1;
+        }
+        len -= n;
+    }
+    return 0;
+}
+
+static uint64_t get_be(const uint8_t *p, int len) {
+    uint64_t v = 0;
+    for (int i = 0; i < len; i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static void put_be(uint8_t *p, uint64_t v, int len) {
+    for (int i = len - 1; i >= 0; i--) {
+        p[i] = (uint8_t)v;
+        v >>= 8;
+    }
+}
+
+/* ---------- EBML ---------- */
+
+// Element ID with its length marker, as the IDs above are written
+static int ebml_read_id(Reader *r, uint32_t *id) {
+    uint8_t b[4];
+    if (rd_bytes(r, b, 1) != 0) {
+        return -1;
+    }
+    int len = 1;
+    while (len <= 4 && !(b[0] & (0x80 >> (len - 1)))) {
+        len++;
+    }
+    if (len > 4 || (len > 1 && rd_bytes(r, b + 1, len - 1) != 0)) {
+        return -1;
+    }
+    *id = (uint32_t)get_be(b, len);
+    return len;
+}
+
+static int ebml_read_size(Reader *r, uint64_t *size) {
+    uint8_t b[8];
+    if (rd_bytes(r, b, 1) != 0) {
+        return -1;
+    }
+    int len = 1;
+    while (len <= 8 && !(b[0] & (0x80 >> (len - 1)))) {
+        len++;
+    }
+    if (len > 8 || (len > 1 && rd_bytes(r, b + 1, len - 1) != 0)) {
+        return -1;
+    }
+    uint64_t marker = 0x80 >> (len - 1);
+    b[0] &= (uint8_t)(marker - 1);
+    uint64_t v = get_be(b, len);
+    *size = v == (((uint64_t)1 << (7 * len)) - 1) ? EBML_UNKNOWN : v;
+    return len;
+}
+
+static int ebml_read_uint(Reader *r, uint64_t size, uint64_t *value) {
+    uint8_t b[8];
+    if (size > 8 || rd_bytes(r, b, (size_t)size) != 0) {
+        return -1;
+    }
+    *value = get_be(b, (int)size);
+    return 0;
+}
+
+// Size field of exactly "len" bytes; FALSE if the value does not fit
+static int ebml_put_size(uint8_t *p, uint64_t size, int len) {
+    if (size >= ((uint64_t)1 << (7 * len)) - 1) {
+        return 0;
+    }
+    put_be(p, size | ((uint64_t)1 << (7 * len)), len);
+    return 1;
+}
+
+static int id_len(uint32_t id) {
+    return id > 0xFFFFFF ? 4 : id > 0xFFFF ? 3 : id > 0xFF ? 2 : 1;
+}
+
+static int uint_len(uint64_t v) {
+    int len = 1;
+    while (len < 8 && (v >> (8 * len))) {
+        len++;
+    }
+    return len;
+}
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+} Out;
+
+static uint8_t* out_reserve(Out *o, size_t n) {
+    if (o->len + n > o->cap) {
+        size_t cap = o->cap ? o->cap * 2 : 4096;
+        while (cap < o->len + n) cap *= 2;
+        uint8_t *data = (uint8_t *)realloc(o->data, cap);
+        if (!data) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+        o->data = data;
+        o->cap = cap;
+    }
+    uint8_t *p = o->data + o->len;
+    o->len += n;
+    return p;
+}
+
+static void out_id(Out *o, uint32_t id) {
+    int len = id_len(id);
+    put_be(out_reserve(o, len), id, len);
+}
+
+static void out_uint(Out *o, uint32_t id, uint64_t v) {
+    int len = uint_len(v);
+    out_id(o, id);
+    ebml_put_size(out_reserve(o, 1), len, 1);
+    put_be(out_reserve(o, len), v, len);
+}
+
+// Master element with an 8-byte size, patched by out_master_end
+static size_t out_master(Out *o, uint32_t id) {
+    out_id(o, id);
+    out_reserve(o, 8);
+    return o->len;
+}
+
+static void out_master_end(Out *o, size_t start) {
+    ebml_put_size(o->data + start - 8, o->len - start, 8);
+}
+
+/* ---------- Matroska ---------- */
+
+typedef struct {
+    uint64_t time;          // timecode scale units
+    uint64_t cluster;       // relative to the segment data
+} CuePoint;
+
+typedef struct {
+    uint64_t start;         // SeekEntry element
+    int size_len;
+    uint64_t payload;
+    uint32_t target;
+    uint64_t pos_at;        // SeekPosition payload
+    int pos_len;
+} SeekEntry;
+
+typedef struct {
+    uint64_t seg_size_at;
+    int seg_size_len;
+    uint64_t seg_start;
+    uint64_t timecode_scale;
+    uint64_t duration_at;
+    int duration_len;
+    uint64_t info_pos, tracks_pos, tags_pos, cues_pos;  // relative, or NOT_FOUND
+    SeekEntry seeks[16];
+    int n_seeks;
+    uint64_t void_at, void_len;     // first Void before the clusters
+    uint64_t video_track;
+    CuePoint *cues;
+    size_t n_cues, cap_cues;
+    int64_t max_time;       // newest block timestamp
+    int64_t frame_time;     // last timestamp step, added to the duration
+    uint64_t clusters;
+    uint64_t cluster_size_at;       // last cluster's size field, if it needs patching
+    int cluster_size_len;
+    uint64_t cluster_size;
+    uint64_t valid_end;
+    int truncated;
+} MkvScan;
+
+static int is_level1(uint32_t id) {
+    return id == ID_CLUSTER || id == ID_CUES || id == ID_TAGS || id == ID_SEEKHEAD ||
+           id == ID_INFO || id == ID_TRACKS || id == ID_CHAPTERS || id == ID_ATTACHMENTS;
+}
+
+static void add_cue(MkvScan *s, uint64_t time, uint64_t cluster) {
+    if (s->n_cues == s->cap_cues) {
+        s->cap_cues = s->cap_cues ? s->cap_cues * 2 : 1024;
+        s->cues = (CuePoint *)realloc(s->cues, s->cap_cues * sizeof(CuePoint));
+        if (!s->cues) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+    }
+    s->cues[s->n_cues].time = time;
+    s->cues[s->n_cues].cluster = cluster;
+    s->n_cues++;
+}
+
+static int parse_seekhead(Reader *r, MkvScan *s, uint64_t end) {
+    while (r->pos < end) {
+        uint64_t start = r->pos, size;
+        uint32_t id;
+        if (ebml_read_id(r, &id) < 0) return -1;
+        int size_len = ebml_read_size(r, &size);
+        if (size_len < 0 || size == EBML_UNKNOWN) return -1;
+        uint64_t child_end = r->pos + size;
+        if (id != ID_SEEK || s->n_seeks == (int)(sizeof(s->seeks) / sizeof(s->seeks[0]))) {
+            if (rd_skip(r, size) != 0) return -1;
+            continue;
+        }
+        SeekEntry *e = &s->seeks[s->n_seeks++];
+        memset(e, 0, sizeof(*e));
+        e->start = start;
+        e->size_len = size_len;
+        e->payload = size;
+        while (r->pos < child_end) {
+            uint64_t csize, v;
+            uint32_t cid;
+            if (ebml_read_id(r, &cid) < 0 || ebml_read_size(r, &csize) < 0 || csize == EBML_UNKNOWN) return -1;
+            if (cid == ID_SEEKID && csize <= 4) {
+                if (ebml_read_uint(r, csize, &v) != 0) return -1;
+                e->target = (uint32_t)v;
+            } else if (cid == ID_SEEKPOSITION && csize <= 8) {
+                e->pos_at = r->pos;
+                e->pos_len = (int)csize;
+                if (rd_skip(r, csize) != 0) return -1;
+            } else if (rd_skip(r, csize) != 0) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int parse_info(Reader *r, MkvScan *s, uint64_t end) {
+    while (r->pos < end) {
+        uint64_t size;
+        uint32_t id;
+        if (ebml_read_id(r, &id) < 0 || ebml_read_size(r, &size) < 0 || size == EBML_UNKNOWN) return -1;
+        if (id == ID_TIMECODESCALE) {
+            if (ebml_read_uint(r, size, &s->timecode_scale) != 0) return -1;
+        } else if (id == ID_DURATION && (size == 4 || size == 8)) {
+            s->duration_at = r->pos;
+            s->duration_len = (int)size;
+            if (rd_skip(r, size) != 0) return -1;
+        } else if (rd_skip(r, size) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int parse_tracks(Reader *r, MkvScan *s, uint64_t end) {
+    while (r->pos < end) {
+        uint64_t size;
+        uint32_t id;
+        if (ebml_read_id(r, &id) < 0 || ebml_read_size(r, &size) < 0 || size == EBML_UNKNOWN) return -1;
+        if (id != ID_TRACKENTRY) {
+            if (rd_skip(r, size) != 0) return -1;
+            continue;
+        }
+        uint64_t entry_end = r->pos + size, number = 0, type = 0;
+        while (r->pos < entry_end) {
+            uint64_t csize;
+            uint32_t cid;
+            if (ebml_read_id(r, &cid) < 0 || ebml_read_size(r, &csize) < 0 || csize == EBML_UNKNOWN) return -1;
+            if (cid == ID_TRACKNUMBER) {
+                if (ebml_read_uint(r, csize, &number) != 0) return -1;
+            } else if (cid == ID_TRACKTYPE) {
+                if (ebml_read_uint(r, csize, &type) != 0) return -1;
+            } else if (rd_skip(r, csize) != 0) {
+                return -1;
+            }
+        }
+        if (type == 1 && s->video_track == 0) {
+            s->video_track = number;
+        }
+    }
+    return 0;
+}
+
+// Track number, relative timecode and keyframe flag from a (Simple)Block header
+static int read_block_header(Reader *r, uint64_t size, uint64_t *track, int16_t *rel, int *flags) {
+    uint8_t b[11];
+    uint64_t track_num;
+    uint64_t start = r->pos;
+    int len = ebml_read_size(r, &track_num);
+    if (len < 0 || r->pos - start + 3 > size || rd_bytes(r, b, 3) != 0) {
+        return -1;
+    }
+    *track = track_num;
+    *rel = (int16_t)get_be(b, 2);
+    *flags = b[2];
+    return rd_skip(r, size - (r->pos - start));
+}
+
+static void on_block(MkvScan *s, uint64_t cluster_rel, uint64_t cluster_tc, uint64_t track,
+                     int16_t rel, int keyframe, int *cued) {
+    int64_t t = (int64_t)cluster_tc + rel;
+    uint64_t cue_track = s->video_track ? s->video_track : track;
+
+    if (track == cue_track) {
+        if (t > s->max_time) {
+            s->frame_time = t - s->max_time;
+            s->max_time = t;
+        }
+        if (keyframe && !*cued && t >= 0) {
+            add_cue(s, (uint64_t)t, cluster_rel);
+            *cued = 1;
+        }
+    }
+}
+
+// Returns the end of the complete data in the cluster
+static uint64_t parse_cluster(Reader *r, MkvScan *s, uint64_t start, int size_len, uint64_t size) {
+    uint64_t data = r->pos;
+    uint64_t end = size == EBML_UNKNOWN ? r->size : data + size;
+    uint64_t valid = data, tc = 0;
+    int cued = 0, truncated = 0;
+
+    if (end > r->size) {
+        end = r->size;
+        truncated = 1;
+    }
+    s->clusters++;
+
+    while (r->pos < end) {
+        uint64_t el = r->pos, csize;
+        uint32_t id;
+        if (ebml_read_id(r, &id) < 0 || ebml_read_size(r, &csize) < 0) {
+            truncated = 1;
+            break;
+        }
+        // An unknown-size cluster ends where the next top-level element starts
+        if (size == EBML_UNKNOWN && is_level1(id)) {
+            rd_seek(r, el);
+            break;
+        }
+        if (csize == EBML_UNKNOWN || r->pos + csize > end) {
+            truncated = 1;
+            break;
+        }
+        uint64_t child_end = r->pos + csize;
+        uint64_t track;
+        int16_t rel;
+        int flags;
+        int ok = 0;
+
+        if (id == ID_TIMECODE) {
+            ok = ebml_read_uint(r, csize, &tc) == 0;
+        } else if (id == ID_SIMPLEBLOCK) {
+            ok = read_block_header(r, csize, &track, &rel, &flags) == 0;
+            if (ok) on_block(s, start - s->seg_start, tc, track, rel, flags & 0x80, &cued);
+        } else if (id == ID_BLOCKGROUP) {
+            int have_block = 0, referenced = 0;
+            ok = 1;
+            while (ok && r->pos < child_end) {
+                uint64_t gsize;
+                uint32_t gid;
+                if (ebml_read_id(r, &gid) < 0 || ebml_read_size(r, &gsize) < 0 ||
+                    gsize == EBML_UNKNOWN || r->pos + gsize > child_end) {
+                    ok = 0;
+                } else if (gid == ID_BLOCK) {
+                    ok = read_block_header(r, gsize, &track, &rel, &flags) == 0;
+                    have_block = ok;
+                } else {
+                    referenced |= gid == ID_REFERENCEBLOCK;
+                    ok = rd_skip(r, gsize) == 0;
+                }
+            }
+            if (ok && have_block) on_block(s, start - s->seg_start, tc, track, rel, !referenced, &cued);
+        } else {
+            ok = rd_skip(r, csize) == 0;
+        }
+        if (!ok) {
+            truncated = 1;
+            break;
+        }
+        valid = child_end;
+    }
+
+    if (truncated) {
+        s->truncated = 1;
+        if (valid == data) {
+            // Nothing usable: drop the cluster, and a cue pointing at it
+            s->clusters--;
+            if (cued) s->n_cues--;
+            return start;
+        }
+    }
+    // matroskamux patches cluster sizes when it closes them; the last one
+    // was never closed
+    if (truncated || size == EBML_UNKNOWN) {
+        s->cluster_size_at = data - size_len;
+        s->cluster_size_len = size_len;
+        s->cluster_size = valid - data;
+    }
+    return valid;
+}
+
+static int scan_mkv(Reader *r, MkvScan *s) {
+    uint64_t size;
+    uint32_t id;
+
+    memset(s, 0, sizeof(*s));
+    s->timecode_scale = 1000000;
+    s->info_pos = s->tracks_pos = s->tags_pos = s->cues_pos = NOT_FOUND;
+    s->void_at = NOT_FOUND;
+    s->max_time = -1;
+
+    // EBML header, then the segment
+    if (ebml_read_id(r, &id) < 0 || id != ID_EBML || ebml_read_size(r, &size) < 0 || rd_skip(r, size) != 0) {
+        fprintf(stderr, "Not a Matroska file\n");
+        return -1;
+    }
+    if (ebml_read_id(r, &id) < 0 || id != ID_SEGMENT) {
+        fprintf(stderr, "No segment found\n");
+        return -1;
+    }
+    s->seg_size_at = r->pos;
+    s->seg_size_len = ebml_read_size(r, &size);
+    if (s->seg_size_len < 0) {
+        return -1;
+    }
+    s->seg_start = r->pos;
+    uint64_t seg_end = size == EBML_UNKNOWN || s->seg_start + size > r->size ? r->size : s->seg_start + size;
+    s->valid_end = s->seg_start;
+
+    while (r->pos < seg_end) {
+        uint64_t start = r->pos;
+        int size_len;
+        if (ebml_read_id(r, &id) < 0 || (size_len = ebml_read_size(r, &size)) < 0) {
+            s->truncated = 1;
+            break;
+        }
+        uint64_t rel = start - s->seg_start;
+        if (id == ID_CLUSTER) {
+            s->valid_end = parse_cluster(r, s, start, size_len, size);
+            if (s->truncated) break;
+            continue;
+        }
+        if (size == EBML_UNKNOWN || r->pos + size > r->size) {
+            s->truncated = 1;
+            break;
+        }
+        uint64_t end = r->pos + size;
+        int ret = 0;
+        switch (id) {
+            case ID_SEEKHEAD:
+                ret = parse_seekhead(r, s, end);
+                break;
+            case ID_INFO:
+                s->info_pos = rel;
+                ret = parse_info(r, s, end);
+                break;
+            case ID_TRACKS:
+                s->tracks_pos = rel;
+                ret = parse_tracks(r, s, end);
+                break;
+            case ID_TAGS:
+                s->tags_pos = rel;
+                ret = rd_skip(r, size);
+                break;
+            case ID_CUES:
+                s->cues_pos = rel;
+                ret = rd_skip(r, size);
+                break;
+            case ID_VOID:
+                if (s->void_at == NOT_FOUND && s->clusters == 0) {
+                    s->void_at = start;
+                    s->void_len = end - start;
+                }
+                ret = rd_skip(r, size);
+                break;
+            default:
+                ret = rd_skip(r, size);
+                break;
+        }
+        if (ret != 0) {
+            s->truncated = 1;
+            break;
+        }
+        s->valid_end = end;
+    }
+    return 0;
+}
+
+static int pwrite_all(int fd, const void *buf, size_t len, uint64_t offset) {
+    const uint8_t *p = (const uint8_t *)buf;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, (off_t)offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+// Point a placeholder SeekEntry at "pos", or blank it out as a Void
+static int patch_seek(int fd, const SeekEntry *e, uint64_t pos) {
+    uint8_t b[16];
+    if (pos != NOT_FOUND && e->pos_len > 0 && (e->pos_len == 8 || pos < ((uint64_t)1 << (8 * e->pos_len)))) {
+        put_be(b, pos, e->pos_len);
+        return pwrite_all(fd, b, e->pos_len, e->pos_at);
+    }
+    // Seek (2-byte ID) becomes Void (1-byte ID) with a one byte longer size
+    if (e->size_len >= 8) {
+        return 0;
+    }
+    b[0] = ID_VOID;
+    ebml_put_size(b + 1, e->payload, e->size_len + 1);
+    return pwrite_all(fd, b, 2 + e->size_len, e->start);
+}
+
+static int recover_mkv(Reader *r, int fd, int dry_run) {
+    MkvScan s;
+    if (scan_mkv(r, &s) != 0) {
+        return -1;
+    }
+
+    double duration = s.max_time >= 0 ? (double)(s.max_time + s.frame_time) : 0;
+    printf("  %llu clusters, %zu cue points, %.3f s, data ends at %llu of %llu bytes%s\n",
+           (unsigned long long)s.clusters, s.n_cues, duration * s.timecode_scale / 1e9,
+           (unsigned long long)s.valid_end, (unsigned long long)r->size,
+           s.truncated ? " (truncated)" : "");
+    if (s.cues_pos != NOT_FOUND && !s.truncated) {
+        printf("  already indexed\n");
+        free(s.cues);
+        return 1;
+    }
+    if (s.n_cues == 0) {
+        fprintf(stderr, "  no keyframes found, nothing to index\n");
+        free(s.cues);
+        return -1;
+    }
+
+    Out cues = {0};
+    size_t master = out_master(&cues, ID_CUES);
+    uint64_t track = s.video_track ? s.video_track : 1;
+    for (size_t i = 0; i < s.n_cues; i++) {
+        size_t point = out_master(&cues, ID_CUEPOINT);
+        out_uint(&cues, ID_CUETIME, s.cues[i].time);
+        size_t pos = out_master(&cues, ID_CUETRACKPOSITIONS);
+        out_uint(&cues, ID_CUETRACK, track);
+        out_uint(&cues, ID_CUECLUSTERPOSITION, s.cues[i].cluster);
+        out_master_end(&cues, pos);
+        out_master_end(&cues, point);
+    }
+    out_master_end(&cues, master);
+    free(s.cues);
+
+    uint64_t cues_at = s.valid_end;
+    uint64_t new_end = cues_at + cues.len;
+    printf("  %s %zu bytes of cues at %llu\n", dry_run ? "would write" : "writing",
+           cues.len, (unsigned long long)cues_at);
+    if (dry_run) {
+        free(cues.data);
+        return 0;
+    }
+
+    uint8_t b[8];
+    int ret = 0;
+    // Cut the unfinished tail and append the index; headers only change
+    // once the index is on disk
+    if (s.cluster_size_len > 0 && ebml_put_size(b, s.cluster_size, s.cluster_size_len)) {
+        ret |= pwrite_all(fd, b, s.cluster_size_len, s.cluster_size_at);
+    }
+    ret |= ftruncate(fd, (off_t)cues_at);
+    ret |= pwrite_all(fd, cues.data, cues.len, cues_at);
+    ret |= fsync(fd);
+    free(cues.data);
+    if (ret != 0) {
+        perror("  writing cues failed");
+        return -1;
+    }
+
+    if (!ebml_put_size(b, new_end - s.seg_start, s.seg_size_len)) {
+        memset(b, 0xFF, sizeof(b));
+        b[0] = (uint8_t)(0xFF >> (s.seg_size_len - 1));
+    }
+    ret |= pwrite_all(fd, b, s.seg_size_len, s.seg_size_at);
+
+    if (s.duration_len == 8) {
+        union { double d; uint64_t u; } v = { .d = duration };
+        put_be(b, v.u, 8);
+        ret |= pwrite_all(fd, b, 8, s.duration_at);
+    } else if (s.duration_len == 4) {
+        union { float f; uint32_t u; } v = { .f = (float)duration };
+        put_be(b, v.u, 4);
+        ret |= pwrite_all(fd, b, 4, s.duration_at);
+    }
+
+    int cues_entry = 0;
+    for (int i = 0; i < s.n_seeks; i++) {
+        const SeekEntry *e = &s.seeks[i];
+        uint64_t pos = e->target == ID_INFO ? s.info_pos : e->target == ID_TRACKS ? s.tracks_pos :
+                       e->target == ID_TAGS ? s.tags_pos : e->target == ID_CUES ? cues_at - s.seg_start : NOT_FOUND;
+        cues_entry |= e->target == ID_CUES;
+        ret |= patch_seek(fd, e, pos);
+    }
+    // No placeholder to fill: put a SeekHead into the reserved Void
+    if (!cues_entry && s.void_at != NOT_FOUND) {
+        Out head = {0};
+        size_t sh = out_master(&head, ID_SEEKHEAD);
+        size_t entry = out_master(&head, ID_SEEK);
+        out_id(&head, ID_SEEKID);
+        ebml_put_size(out_reserve(&head, 1), 4, 1);
+        put_be(out_reserve(&head, 4), ID_CUES, 4);
+        out_id(&head, ID_SEEKPOSITION);
+        ebml_put_size(out_reserve(&head, 1), 8, 1);
+        put_be(out_reserve(&head, 8), cues_at - s.seg_start, 8);
+        out_master_end(&head, entry);
+        out_master_end(&head, sh);
+        uint64_t rest = s.void_len - head.len;
+        if (head.len <= s.void_len && rest != 1) {
+            // The rest of the reserved space stays a Void
+            if (rest >= 9) {
+                uint8_t *v = out_reserve(&head, 9);
+                v[0] = ID_VOID;
+                ebml_put_size(v + 1, rest - 9, 8);
+            } else if (rest >= 2) {
+                uint8_t *v = out_reserve(&head, 2);
+                v[0] = ID_VOID;
+                ebml_put_size(v + 1, rest - 2, 1);
+            }
+            ret |= pwrite_all(fd, head.data, head.len, s.void_at);
+        } else {
+            fprintf(stderr, "  no room for a SeekHead, players have to find the cues themselves\n");
+        }
+        free(head.data);
+    }
+    ret |= fsync(fd);
+    if (ret != 0) {
+        perror("  patching headers failed");
+        return -1;
+    }
+    return 0;
+}
+
+/* ---------- fragmented MP4 ---------- */
+
+typedef struct {
+    uint32_t track;
+    uint64_t time;          // baseMediaDecodeTime of the fragment
+    uint64_t moof;
+} FragmentEntry;
+
+#define FOURCC(a, b, c, d) (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+
+static int read_box(Reader *r, uint32_t *type, uint64_t *size, int *header) {
+    uint8_t b[16];
+    if (rd_bytes(r, b, 8) != 0) {
+        return -1;
+    }
+    *size = get_be(b, 4);
+    *type = (uint32_t)get_be(b + 4, 4);
+    *header = 8;
+    if (*size == 1) {
+        if (rd_bytes(r, b + 8, 8) != 0) return -1;
+        *size = get_be(b + 8, 8);
+        *header = 16;
+    } else if (*size == 0) {
+        *size = r->size - (r->pos - 8);
+    }
+    return *size < (uint64_t)*header ? -1 : 0;
+}
+
+// track_ID and baseMediaDecodeTime of each traf
+static int parse_moof(Reader *r, uint64_t end, uint64_t moof, FragmentEntry **entries, size_t *count, size_t *cap) {
+    while (r->pos < end) {
+        uint32_t type;
+        uint64_t size;
+        int header;
+        if (read_box(r, &type, &size, &header) != 0) return -1;
+        uint64_t box_end = r->pos - header + size;
+        if (type != FOURCC('t', 'r', 'a', 'f')) {
+            if (rd_skip(r, box_end - r->pos) != 0) return -1;
+            continue;
+        }
+        FragmentEntry e = { 0, 0, moof };
+        while (r->pos < box_end) {
+            uint8_t b[16];
+            if (read_box(r, &type, &size, &header) != 0) return -1;
+            uint64_t child_end = r->pos - header + size;
+            if (type == FOURCC('t', 'f', 'h', 'd') && size >= (uint64_t)header + 8) {
+                if (rd_bytes(r, b, 8) != 0) return -1;
+                e.track = (uint32_t)get_be(b + 4, 4);
+            } else if (type == FOURCC('t', 'f', 'd', 't') && size >= (uint64_t)header + 8) {
+                if (rd_bytes(r, b, 4) != 0) return -1;
+                int v1 = b[0] == 1;
+                if (rd_bytes(r, b, v1 ? 8 : 4) != 0) return -1;
+                e.time = get_be(b, v1 ? 8 : 4);
+            }
+            if (rd_skip(r, child_end - r->pos) != 0) return -1;
+        }
+        if (*count == *cap) {
+            *cap = *cap ? *cap * 2 : 1024;
+            *entries = (FragmentEntry *)realloc(*entries, *cap * sizeof(FragmentEntry));
+            if (!*entries) {
+                fprintf(stderr, "Out of memory\n");
+                exit(1);
+            }
+        }
+        (*entries)[(*count)++] = e;
+    }
+    return 0;
+}
+
+static int recover_mp4(Reader *r, int fd, int dry_run) {
+    FragmentEntry *entries = NULL;
+    size_t count = 0, cap = 0, committed = 0;
+    uint64_t valid_end = 0, fragments = 0;
+    int fragmented = 0, has_mfra = 0, truncated = 0;
+
+    while (r->pos < r->size) {
+        uint64_t start = r->pos, size;
+        uint32_t type;
+        int header;
+        if (read_box(r, &type, &size, &header) != 0 || start + size > r->size) {
+            truncated = 1;
+            break;
+        }
+        uint64_t end = start + size;
+        int ret = 0;
+        if (type == FOURCC('m', 'o', 'o', 'v')) {
+            // mvex marks a fragmented file
+            while (ret == 0 && r->pos < end) {
+                uint32_t child;
+                uint64_t csize;
+                int cheader;
+                if (read_box(r, &child, &csize, &cheader) != 0) {
+                    ret = -1;
+                    break;
+                }
+                fragmented |= child == FOURCC('m', 'v', 'e', 'x');
+                ret = rd_skip(r, csize - cheader);
+            }
+        } else if (type == FOURCC('m', 'o', 'o', 'f')) {
+            ret = parse_moof(r, end, start, &entries, &count, &cap);
+        } else {
+            has_mfra |= type == FOURCC('m', 'f', 'r', 'a');
+            ret = rd_skip(r, end - r->pos);
+        }
+        if (ret != 0) {
+            truncated = 1;
+            break;
+        }
+        // A fragment counts once its media data is complete
+        if (type != FOURCC('m', 'o', 'o', 'f')) {
+            if (type == FOURCC('m', 'd', 'a', 't') && count > committed) fragments++;
+            committed = count;
+            valid_end = end;
+        }
+    }
+    count = committed;
+
+    printf("  %llu fragments, data ends at %llu of %llu bytes%s\n",
+           (unsigned long long)fragments, (unsigned long long)valid_end,
+           (unsigned long long)r->size, truncated ? " (truncated)" : "");
+    if (!fragmented) {
+        fprintf(stderr, "  not a fragmented MP4, cannot be recovered\n");
+        free(entries);
+        return -1;
+    }
+    if (has_mfra && !truncated) {
+        printf("  already indexed\n");
+        free(entries);
+        return 1;
+    }
+
+    // mfra: one tfra per track, then mfro with the total size
+    uint32_t tracks[16];
+    int n_tracks = 0;
+    for (size_t i = 0; i < count; i++) {
+        int known = 0;
+        for (int t = 0; t < n_tracks; t++) known |= tracks[t] == entries[i].track;
+        if (!known && n_tracks < 16) tracks[n_tracks++] = entries[i].track;
+    }
+    Out mfra = {0};
+    put_be(out_reserve(&mfra, 8), FOURCC('m', 'f', 'r', 'a'), 8);
+    for (int t = 0; t < n_tracks; t++) {
+        size_t start = mfra.len;
+        uint32_t n = 0;
+        out_reserve(&mfra, 24);
+        for (size_t i = 0; i < count; i++) {
+            if (entries[i].track != tracks[t]) continue;
+            uint8_t *p = out_reserve(&mfra, 19);
+            put_be(p, entries[i].time, 8);
+            put_be(p + 8, entries[i].moof, 8);
+            p[16] = 1;      // traf, trun and sample number, 1-based
+            p[17] = 1;
+            p[18] = 1;
+            n++;
+        }
+        uint8_t *h = mfra.data + start;
+        put_be(h, mfra.len - start, 4);
+        put_be(h + 4, FOURCC('t', 'f', 'r', 'a'), 4);
+        put_be(h + 8, 0x01000000, 4);   // version 1: 64-bit time and offset
+        put_be(h + 12, tracks[t], 4);
+        put_be(h + 16, 0, 4);           // 1-byte traf/trun/sample numbers
+        put_be(h + 20, n, 4);
+    }
+    uint8_t *mfro = out_reserve(&mfra, 16);
+    put_be(mfro, 16, 4);
+    put_be(mfro + 4, FOURCC('m', 'f', 'r', 'o'), 4);
+    put_be(mfro + 8, 0, 4);
+    put_be(mfro + 12, mfra.len, 4);
+    put_be(mfra.data, mfra.len, 4);
+    put_be(mfra.data + 4, FOURCC('m', 'f', 'r', 'a'), 4);
+    free(entries);
+
+    printf("  %s %zu bytes of fragment index at %llu\n", dry_run ? "would write" : "writing",
+           mfra.len, (unsigned long long)valid_end);
+    int ret = 0;
+    if (!dry_run) {
+        ret |= ftruncate(fd, (off_t)valid_end);
+        ret |= pwrite_all(fd, mfra.data, mfra.len, valid_end);
+        ret |= fsync(fd);
+        if (ret != 0) perror("  writing index failed");
+    }
+    free(mfra.data);
+    return ret ? -1 : 0;
+}
+
+/* ---------- main ---------- */
+
+// Returns 1 if the file already had its index, -1 on failure
+static int recover_file(const char *path, int dry_run) {
+    int fd = open(path, dry_run ? O_RDONLY : O_RDWR);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    struct stat st;
+    Reader *r = (Reader *)calloc(1, sizeof(Reader));
+    FILE *fp = fdopen(dup(fd), "rb");
+    if (!r || !fp || fstat(fd, &st) != 0) {
+        perror(path);
+        if (fp) fclose(fp);
+        free(r);
+        close(fd);
+        return -1;
+    }
+    setvbuf(fp, NULL, _IOFBF, READ_BUFFER);
+    r->fp = fp;
+    r->size = (uint64_t)st.st_size;
+
+    uint8_t magic[8];
+    int ret = -1;
+    printf("%s:\n", path);
+    if (rd_bytes(r, magic, 8) == 0) {
+        rd_seek(r, 0);
+        if (get_be(magic, 4) == ID_EBML) {
+            ret = recover_mkv(r, fd, dry_run);
+        } else if (get_be(magic + 4, 4) == FOURCC('f', 't', 'y', 'p')) {
+            ret = recover_mp4(r, fd, dry_run);
+        } else {
+            fprintf(stderr, "  unknown format\n");
+        }
+    }
+
+    fclose(fp);
+    free(r);
+    close(fd);
+    return ret;
+}
+
+/* ---------- self-test ---------- */
+
+// Small files laid out the way matroskamux and mp4mux (fragmented) write
+// them, cut in the middle of the last cluster/fragment
+#define TEST_CLUSTERS   4
+#define TEST_FRAGMENTS  4
+#define TEST_PAYLOAD    64
+
+static int check(int ok, const char *what) {
+    if (!ok) {
+        printf("  FAILED: %s\n", what);
+    }
+    return ok;
+}
+
+static int write_prefix(const char *path, const Out *o, size_t len) {
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    int ret = fwrite(o->data, 1, len, fp) == len ? 0 : -1;
+    ret |= fclose(fp);
+    return ret;
+}
+
+static Reader* open_reader(const char *path) {
+    Reader *r = (Reader *)calloc(1, sizeof(Reader));
+    struct stat st;
+    if (!r || stat(path, &st) != 0 || !(r->fp = fopen(path, "rb"))) {
+        free(r);
+        return NULL;
+    }
+    r->size = (uint64_t)st.st_size;
+    return r;
+}
+
+static void close_reader(Reader *r) {
+    if (r) {
+        fclose(r->fp);
+        free(r);
+    }
+}
+
+static void test_block(Out *o, int track, int16_t rel, int keyframe) {
+    out_id(o, ID_SIMPLEBLOCK);
+    ebml_put_size(out_reserve(o, 1), 4 + TEST_PAYLOAD, 1);
+    uint8_t *p = out_reserve(o, 4 + TEST_PAYLOAD);
+    p[0] = (uint8_t)(0x80 | track);
+    put_be(p + 1, (uint16_t)rel, 2);
+    p[3] = keyframe ? 0x80 : 0;
+    memset(p + 4, 0x55, TEST_PAYLOAD);
+}
+
+// Seek entry with a 1-byte size and an 8-byte placeholder position
+static void test_seek(Out *o, uint32_t target) {
+    out_id(o, ID_SEEK);
+    ebml_put_size(out_reserve(o, 1), 18, 1);
+    out_id(o, ID_SEEKID);
+    ebml_put_size(out_reserve(o, 1), 4, 1);
+    put_be(out_reserve(o, 4), target, 4);
+    out_id(o, ID_SEEKPOSITION);
+    ebml_put_size(out_reserve(o, 1), 8, 1);
+    put_be(out_reserve(o, 8), 0, 8);
+}
+
+static int read_uint_at(Reader *r, uint64_t pos, int len, uint64_t *value) {
+    uint8_t b[8];
+    if (len > 8 || rd_seek(r, pos) != 0 || rd_bytes(r, b, len) != 0) {
+        return -1;
+    }
+    *value = get_be(b, len);
+    return 0;
+}
+
+static int id_at(Reader *r, uint64_t pos, uint32_t id) {
+    uint32_t found;
+    return rd_seek(r, pos) == 0 && ebml_read_id(r, &found) > 0 && found == id;
+}
+
+static int test_mkv(const char *path) {
+    uint64_t clusters[TEST_CLUSTERS];
+    uint64_t cut = 0;
+    Out o = {0};
+    int ok = 1;
+
+    size_t ebml = out_master(&o, ID_EBML);
+    out_uint(&o, 0x4286, 1);        // EBMLVersion
+    out_master_end(&o, ebml);
+    out_id(&o, ID_SEGMENT);
+    put_be(out_reserve(&o, 8), 0x01FFFFFFFFFFFFFFull, 8);     // unknown size until finished
+    uint64_t seg_start = o.len;
+
+    size_t head = out_master(&o, ID_SEEKHEAD);
+    test_seek(&o, ID_INFO);
+    test_seek(&o, ID_TRACKS);
+    test_seek(&o, ID_TAGS);         // never written, has to become a Void
+    test_seek(&o, ID_CUES);
+    out_master_end(&o, head);
+
+    size_t info = out_master(&o, ID_INFO);
+    out_uint(&o, ID_TIMECODESCALE, 1000000);
+    out_id(&o, ID_DURATION);
+    ebml_put_size(out_reserve(&o, 1), 8, 1);
+    put_be(out_reserve(&o, 8), 0, 8);
+    out_master_end(&o, info);
+
+    size_t tracks = out_master(&o, ID_TRACKS);
+    for (int t = 1; t <= 2; t++) {
+        size_t entry = out_master(&o, ID_TRACKENTRY);
+        out_uint(&o, ID_TRACKNUMBER, t);
+        out_uint(&o, ID_TRACKTYPE, t);      // 1 video, 2 audio
+        out_master_end(&o, entry);
+    }
+    out_master_end(&o, tracks);
+
+    // Video keyframe, audio, video; the last cluster is cut in a fourth block
+    for (int k = 0; k < TEST_CLUSTERS; k++) {
+        clusters[k] = o.len - seg_start;
+        size_t cluster = out_master(&o, ID_CLUSTER);
+        out_uint(&o, ID_TIMECODE, k * 1000);
+        test_block(&o, 1, 0, 1);
+        test_block(&o, 2, 10, 1);
+        test_block(&o, 1, 40, 0);
+        if (k == TEST_CLUSTERS - 1) {
+            cut = o.len + 10;
+            test_block(&o, 1, 80, 0);
+        }
+        out_master_end(&o, cluster);
+    }
+    ok &= check(write_prefix(path, &o, cut) == 0, "writing the Matroska file");
+    free(o.data);
+    if (!ok) {
+        return 0;
+    }
+
+    ok &= check(recover_file(path, 0) == 0, "recovering the Matroska file");
+
+    Reader *r = open_reader(path);
+    MkvScan s;
+    uint64_t v;
+    if (!check(r && scan_mkv(r, &s) == 0, "reading the recovered Matroska file")) {
+        close_reader(r);
+        return 0;
+    }
+    ok &= check(!s.truncated && s.clusters == TEST_CLUSTERS, "recovered file ends after its last cluster");
+    ok &= check(read_uint_at(r, s.seg_size_at, s.seg_size_len, &v) == 0 &&
+                (v & ~((uint64_t)1 << (7 * s.seg_size_len))) == r->size - s.seg_start, "Segment size patched");
+    union { double d; uint64_t u; } duration = { .d = 0 };
+    ok &= check(s.duration_len == 8 && read_uint_at(r, s.duration_at, 8, &duration.u) == 0 &&
+                duration.d == (TEST_CLUSTERS - 1) * 1000 + 80, "Duration patched");
+
+    // Tags has no position, so its entry is a Void now and three remain
+    ok &= check(s.n_seeks == 3, "SeekHead entry without a target voided");
+    for (int i = 0; i < s.n_seeks; i++) {
+        ok &= check(read_uint_at(r, s.seeks[i].pos_at, s.seeks[i].pos_len, &v) == 0 &&
+                    id_at(r, s.seg_start + v, s.seeks[i].target), "SeekHead entry points at its element");
+    }
+
+    // One cue per cluster, at its keyframe
+    int cues = 0;
+    uint64_t size, end = 0;
+    uint32_t id;
+    ok &= check(s.cues_pos != NOT_FOUND && rd_seek(r, s.seg_start + s.cues_pos) == 0 &&
+                ebml_read_id(r, &id) > 0 && id == ID_CUES && ebml_read_size(r, &size) > 0 &&
+                (end = r->pos + size) == r->size, "Cues at the end of the file");
+    while (ok && r->pos < end) {
+        uint64_t point_end, time = NOT_FOUND, cluster = NOT_FOUND;
+        if (ebml_read_id(r, &id) < 0 || ebml_read_size(r, &size) < 0) break;
+        point_end = r->pos + size;
+        while (r->pos < point_end && ebml_read_id(r, &id) > 0 && ebml_read_size(r, &size) > 0) {
+            if (id == ID_CUETRACKPOSITIONS) continue;       // descend
+            if (ebml_read_uint(r, size, &v) != 0) break;
+            if (id == ID_CUETIME) time = v;
+            if (id == ID_CUECLUSTERPOSITION) cluster = v;
+        }
+        uint64_t next = r->pos;
+        ok &= check(cues < TEST_CLUSTERS && time == (uint64_t)cues * 1000 && cluster == clusters[cues] &&
+                    id_at(r, s.seg_start + cluster, ID_CLUSTER), "cue points at its cluster");
+        rd_seek(r, next);
+        cues++;
+    }
+    ok &= check(cues == TEST_CLUSTERS, "one cue per cluster");
+    free(s.cues);
+
+    uint64_t recovered = r->size;
+    close_reader(r);
+    ok &= check(recover_file(path, 0) == 1, "second run reports the file as already indexed");
+    r = open_reader(path);
+    ok &= check(r && r->size == recovered, "second run leaves the file alone");
+    close_reader(r);
+    return ok;
+}
+
+static size_t box_start(Out *o, uint32_t type) {
+    size_t start = o->len;
+    put_be(out_reserve(o, 8), type, 8);
+    return start;
+}
+
+static void box_end(Out *o, size_t start) {
+    put_be(o->data + start, o->len - start, 4);
+}
+
+static void full_box(Out *o, uint32_t type, uint32_t version_flags, uint64_t value, int len) {
+    size_t box = box_start(o, type);
+    put_be(out_reserve(o, 4), version_flags, 4);
+    put_be(out_reserve(o, len), value, len);
+    box_end(o, box);
+}
+
+static int test_mp4(const char *path) {
+    uint64_t moofs[TEST_FRAGMENTS];
+    uint64_t valid_end = 0, cut = 0;
+    Out o = {0};
+    int ok = 1;
+
+    size_t ftyp = box_start(&o, FOURCC('f', 't', 'y', 'p'));
+    put_be(out_reserve(&o, 4), FOURCC('i', 's', 'o', '6'), 4);     // major brand
+    put_be(out_reserve(&o, 4), 0, 4);
+    put_be(out_reserve(&o, 4), FOURCC('i', 's', 'o', '6'), 4);     // compatible brands
+    box_end(&o, ftyp);
+    size_t moov = box_start(&o, FOURCC('m', 'o', 'o', 'v'));
+    full_box(&o, FOURCC('m', 'v', 'h', 'd'), 0, 0, 8);
+    size_t mvex = box_start(&o, FOURCC('m', 'v', 'e', 'x'));
+    full_box(&o, FOURCC('t', 'r', 'e', 'x'), 0, 1, 4);
+    box_end(&o, mvex);
+    box_end(&o, moov);
+
+    // Video (track 1, 90 kHz) and audio (track 2, 48 kHz) in every fragment;
+    // the last one is cut in its mdat
+    for (int k = 0; k < TEST_FRAGMENTS; k++) {
+        moofs[k] = o.len;
+        size_t moof = box_start(&o, FOURCC('m', 'o', 'o', 'f'));
+        full_box(&o, FOURCC('m', 'f', 'h', 'd'), 0, k + 1, 4);
+        for (uint32_t t = 1; t <= 2; t++) {
+            size_t traf = box_start(&o, FOURCC('t', 'r', 'a', 'f'));
+            full_box(&o, FOURCC('t', 'f', 'h', 'd'), 0, t, 4);
+            full_box(&o, FOURCC('t', 'f', 'd', 't'), 0x01000000, (uint64_t)k * (t == 1 ? 90000 : 48000), 8);
+            full_box(&o, FOURCC('t', 'r', 'u', 'n'), 0, 0, 4);
+            box_end(&o, traf);
+        }
+        box_end(&o, moof);
+        size_t mdat = box_start(&o, FOURCC('m', 'd', 'a', 't'));
+        memset(out_reserve(&o, 4 * TEST_PAYLOAD), 0x55, 4 * TEST_PAYLOAD);
+        box_end(&o, mdat);
+        if (k == TEST_FRAGMENTS - 2) {
+            valid_end = o.len;
+        }
+    }
+    cut = o.len - 2 * TEST_PAYLOAD;
+    ok &= check(write_prefix(path, &o, cut) == 0, "writing the MP4 file");
+    free(o.data);
+    if (!ok) {
+        return 0;
+    }
+
+    ok &= check(recover_file(path, 0) == 0, "recovering the MP4 file");
+
+    // mfro at the very end gives the size of the mfra written at valid_end
+    Reader *r = open_reader(path);
+    uint64_t v, mfra_size = 0;
+    if (!check(r && read_uint_at(r, r->size - 16, 4, &v) == 0 && v == 16 &&
+               read_uint_at(r, r->size - 4, 4, &mfra_size) == 0 &&
+               r->size == valid_end + mfra_size &&
+               read_uint_at(r, valid_end + 4, 4, &v) == 0 && v == FOURCC('m', 'f', 'r', 'a'),
+               "mfra appended after the last complete fragment")) {
+        close_reader(r);
+        return 0;
+    }
+
+    int tfras = 0;
+    rd_seek(r, valid_end + 8);
+    while (r->pos < r->size - 16) {
+        uint32_t type;
+        uint64_t size;
+        int header;
+        uint8_t b[24];
+        if (!check(read_box(r, &type, &size, &header) == 0 && type == FOURCC('t', 'f', 'r', 'a') &&
+                   rd_bytes(r, b, 16) == 0, "tfra box")) {
+            ok = 0;
+            break;
+        }
+        uint32_t track = (uint32_t)get_be(b + 4, 4);
+        uint32_t count = (uint32_t)get_be(b + 12, 4);
+        ok &= check(count == TEST_FRAGMENTS - 1, "one tfra entry per complete fragment");
+        for (uint32_t i = 0; ok && i < count; i++) {
+            uint64_t next = r->pos + 19;
+            if (rd_bytes(r, b, 19) != 0) {
+                ok = 0;
+                break;
+            }
+            uint64_t time = get_be(b, 8), moof = get_be(b + 8, 8);
+            ok &= check(time == i * (track == 1 ? 90000ull : 48000ull) && moof == moofs[i] &&
+                        read_uint_at(r, moof + 4, 4, &v) == 0 && v == FOURCC('m', 'o', 'o', 'f'),
+                        "tfra entry points at its moof");
+            rd_seek(r, next);
+        }
+        tfras++;
+    }
+    ok &= check(tfras == 2, "one tfra per track");
+
+    uint64_t recovered = r->size;
+    close_reader(r);
+    ok &= check(recover_file(path, 0) == 1, "second run reports the file as already indexed");
+    r = open_reader(path);
+    ok &= check(r && r->size == recovered, "second run leaves the file alone");
+    close_reader(r);
+    return ok;
+}
+
+// --self-test: recover synthetic recordings in a temporary directory
+static int self_test(void) {
+    char dir[] = "/tmp/record_recover.XXXXXX";
+    char mkv[64], mp4[64];
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(mkv, sizeof(mkv), "%s/cut.mkv", dir);
+    snprintf(mp4, sizeof(mp4), "%s/cut.mp4", dir);
+
+    int mkv_ok = test_mkv(mkv);
+    printf("Matroska cut mid-cluster: %s\n", mkv_ok ? "ok" : "FAILED");
+    int mp4_ok = test_mp4(mp4);
+    printf("Fragmented MP4 cut mid-fragment: %s\n", mp4_ok ? "ok" : "FAILED");
+
+    unlink(mkv);
+    unlink(mp4);
+    rmdir(dir);
+    return mkv_ok && mp4_ok ? 0 : 1;
+}
+
+static void print_usage(void) {
+    printf("Usage: record_recover [-n] <file>... | --self-test\n");
+    printf("  Rebuild the index of recordings (.mkv, fragmented .mp4) cut short by a power loss.\n");
+    printf("  -n  only report what would be done\n");
+    printf("  --self-test  recover cut test files and check the rebuilt index\n");
+}
+
+int main(int argc, char *argv[]) {
+    int dry_run = 0, failed = 0, files = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0) {
+            dry_run = 1;
+        } else if (strcmp(argv[i], "--self-test") == 0) {
+            return self_test();
+        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            print_usage();
+            return 0;
+        } else {
+            failed |= recover_file(argv[i], dry_run) < 0;
+            files++;
+        }
+    }
+    if (files == 0) {
+        print_usage();
+        return 1;
+    }
+    return failed ? 1 : 0;
+}
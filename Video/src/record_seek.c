@@ -0,0 +1,457 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/src/record_seek.c
+ */
+#include "record_seek.h"
+#include <gst/app/gstappsrc.h>
+#include <gst/app/gstappsink.h>
+#include <stdio.h>
+#include <string.h>
+
+// Keyframe records are handed to the writer once this much is pending
+#define FLUSH_BYTES         4096
+
+// Thumbnails waiting for the JPEG encoder; more are skipped, not queued
+#define MAX_THUMBS_PENDING  2
+
+#define JPEG_QUALITY        75
+
+struct RecordSeek {
+    GMutex lock;
+    GCond idle;                         // users dropped to 0
+    gint users;                         // record_seek_ref, atomic
+    gboolean keyframes;
+    GstClockTime thumb_interval;        // 0: no thumbnails
+    gint thumb_width;
+    PreviewRotation rotation;
+
+    // Sidecar of the file storagesink is writing
+    gchar *path;                        // NULL before the first file
+    GByteArray *pending;                // records not yet handed to the writer
+    guint64 position;                   // muxer output byte offset
+    GstClockTime first_pts;             // mux time of the first keyframe
+    GstClockTime start;                 // running time the segment starts at
+    guint64 last_keyframe;              // offset of the newest keyframe
+    GstClockTime last_keyframe_pts;
+
+    // splitmuxsink-fragment-opened may come before or after the file's
+    // stream-start reaches storagesink
+    gchar *opened_location;
+    GstClockTime opened_start;
+
+    GstClockTime next_thumb;            // running time the next one is due
+    GstElement *encoder;                // appsrc ! videoconvert ! jpegenc ! appsink
+    GstElement *thumb_src;
+    gint encoder_width, encoder_height; // caps of the encoder input
+    gint thumbs_pending;
+
+    GThreadPool *writer;                // one thread, appends in order
+};
+
+typedef struct {
+    gchar *path;
+    GByteArray *data;
+    gboolean create;                    // truncate and write the header first
+} WriteTask;
+
+/* ---------- writer thread ---------- */
+
+static void write_task(gpointer data, gpointer user_data) {
+    WriteTask *task = (WriteTask *)data;
+    FILE *fp = fopen(task->path, task->create ? "wb" : "ab");
+    if (!fp) {
+        g_printerr("Failed to write seek sidecar %s\n", task->path);
+    } else {
+        if (task->create) {
+            RecordSeekHeader header = { RECORD_SEEK_MAGIC, RECORD_SEEK_VERSION, sizeof(RecordSeekRecord), 0 };
+            fwrite(&header, sizeof(header), 1, fp);
+        }
+        if (task->data && task->data->len > 0 &&
+            fwrite(task->data->data, 1, task->data->len, fp) != task->data->len) {
+            g_printerr("Short write to seek sidecar %s\n", task->path);
+        }
+        fclose(fp);
+    }
+    if (task->data) g_byte_array_unref(task->data);
+    g_free(task->path);
+    g_free(task);
+}
+
+// Call with the lock held
+static void queue_write(RecordSeek *s, gboolean create) {
+    if (!s->path || (!create && s->pending->len == 0)) {
+        return;
+    }
+    WriteTask *task = g_new0(WriteTask, 1);
+    task->path = g_strdup(s->path);
+    task->create = create;
+    if (s->pending->len > 0) {
+        task->data = s->pending;
+        s->pending = g_byte_array_new();
+    }
+    g_thread_pool_push(s->writer, task, NULL);
+}
+
+static void append_record(RecordSeek *s, RecordSeekType type, GstClockTime time, guint64 offset,
+                          const guint8 *payload, guint size) {
+    RecordSeekRecord record = { type, size, time, offset };
+    g_byte_array_append(s->pending, (const guint8 *)&record, sizeof(record));
+    if (size > 0) {
+        g_byte_array_append(s->pending, payload, size);
+    }
+}
+
+/* ---------- muxer output ---------- */
+
+// Call with the lock held: storagesink starts a new file
+static void open_sidecar(RecordSeek *s, const gchar *location) {
+    queue_write(s, FALSE);
+    g_free(s->path);
+    s->path = NULL;
+    if (location) {
+        const char *dot = strrchr(location, '.');
+        const char *slash = strrchr(location, '/');
+        gsize stem = dot && (!slash || dot > slash) ? (gsize)(dot - location) : strlen(location);
+        s->path = g_strdup_printf("%.*s%s", (int)stem, location, RECORD_SEEK_EXTENSION);
+    }
+    s->position = 0;
+    s->first_pts = GST_CLOCK_TIME_NONE;
+    s->last_keyframe = 0;
+    s->last_keyframe_pts = GST_CLOCK_TIME_NONE;
+    s->start = location && g_strcmp0(location, s->opened_location) == 0 ? s->opened_start : GST_CLOCK_TIME_NONE;
+    // Every segment starts with a thumbnail
+    s->next_thumb = 0;
+    queue_write(s, TRUE);
+}
+
+// Call with the lock held. matroskamux pushes a cluster start and the
+// block of a video keyframe without DELTA_UNIT and with its timestamp;
+// everything else (audio, telemetry, index rewrites) is delta or untimed.
+static void muxer_buffer(RecordSeek *s, GstBuffer *buffer) {
+    gsize size = gst_buffer_get_size(buffer);
+    if (s->keyframes && s->path && GST_BUFFER_PTS_IS_VALID(buffer) &&
+        !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT) &&
+        !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_HEADER) &&
+        GST_BUFFER_PTS(buffer) != s->last_keyframe_pts) {
+        GstClockTime pts = GST_BUFFER_PTS(buffer);
+        if (!GST_CLOCK_TIME_IS_VALID(s->first_pts)) {
+            s->first_pts = pts;
+        }
+        if (pts >= s->first_pts) {
+            s->last_keyframe = s->position;
+            s->last_keyframe_pts = pts;
+            append_record(s, RECORD_SEEK_KEYFRAME, pts - s->first_pts, s->position, NULL, 0);
+            if (s->pending->len >= FLUSH_BYTES) {
+                queue_write(s, FALSE);
+            }
+        }
+    }
+    s->position += size;
+}
+
+static GstPadProbeReturn muxer_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    RecordSeek *s = (RecordSeek *)user_data;
+
+    g_mutex_lock(&s->lock);
+    if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+        muxer_buffer(s, GST_PAD_PROBE_INFO_BUFFER(info));
+    } else if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+        GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+        for (guint i = 0; i < gst_buffer_list_length(list); i++) {
+            muxer_buffer(s, gst_buffer_list_get(list, i));
+        }
+    } else if (info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+        GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+        if (GST_EVENT_TYPE(event) == GST_EVENT_STREAM_START) {
+            // splitmuxsink sets the location before restarting the sink
+            gchar *location = NULL;
+            GstObject *storage = gst_pad_get_parent(pad);
+            if (storage) {
+                g_object_get(G_OBJECT(storage), "location", &location, NULL);
+                gst_object_unref(storage);
+            }
+            open_sidecar(s, location);
+            g_free(location);
+        } else if (GST_EVENT_TYPE(event) == GST_EVENT_SEGMENT) {
+            // Muxers seek back this way to rewrite their headers
+            const GstSegment *segment;
+            gst_event_parse_segment(event, &segment);
+            if (segment->format == GST_FORMAT_BYTES) {
+                s->position = segment->start;
+            }
+        } else if (GST_EVENT_TYPE(event) == GST_EVENT_EOS) {
+            queue_write(s, FALSE);
+        }
+    }
+    g_mutex_unlock(&s->lock);
+    return GST_PAD_PROBE_OK;
+}
+
+void record_seek_attach(RecordSeek *s, GstElement *storage) {
+    if (!s || !storage) return;
+    GstPad *pad = gst_element_get_static_pad(storage, "sink");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST |
+                      GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, muxer_probe, s, NULL);
+    gst_object_unref(pad);
+}
+
+void record_seek_segment_opened(RecordSeek *s, const char *location, uint64_t running_time) {
+    if (!s || !location) return;
+    g_mutex_lock(&s->lock);
+    g_free(s->opened_location);
+    s->opened_location = g_strdup(location);
+    s->opened_start = running_time;
+    if (s->path && !GST_CLOCK_TIME_IS_VALID(s->start)) {
+        gchar *sidecar = NULL;
+        const char *dot = strrchr(location, '.');
+        gsize stem = dot ? (gsize)(dot - location) : strlen(location);
+        sidecar = g_strdup_printf("%.*s%s", (int)stem, location, RECORD_SEEK_EXTENSION);
+        if (strcmp(sidecar, s->path) == 0) {
+            s->start = running_time;
+        }
+        g_free(sidecar);
+    }
+    g_mutex_unlock(&s->lock);
+}
+
+/* ---------- thumbnails ---------- */
+
+// JPEG out of the encoder; the PTS is the preview frame's running time
+static GstFlowReturn on_thumbnail(GstAppSink *sink, gpointer user_data) {
+    RecordSeek *s = (RecordSeek *)user_data;
+    GstSample *sample = gst_app_sink_pull_sample(sink);
+    if (!sample) {
+        return GST_FLOW_ERROR;
+    }
+    GstBuffer *buffer = gst_sample_get_buffer(sample);
+    GstMapInfo map;
+
+    g_mutex_lock(&s->lock);
+    s->thumbs_pending--;
+    GstClockTime pts = buffer ? GST_BUFFER_PTS(buffer) : GST_CLOCK_TIME_NONE;
+    if (s->path && GST_CLOCK_TIME_IS_VALID(s->start) && GST_CLOCK_TIME_IS_VALID(pts) && pts >= s->start &&
+        gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+        append_record(s, RECORD_SEEK_THUMBNAIL, pts - s->start, s->last_keyframe, map.data, (guint)map.size);
+        gst_buffer_unmap(buffer, &map);
+        queue_write(s, FALSE);
+    }
+    g_mutex_unlock(&s->lock);
+
+    gst_sample_unref(sample);
+    return GST_FLOW_OK;
+}
+
+static GstElement* create_encoder(RecordSeek *s, gint width, gint height) {
+    GstElement *pipeline = gst_pipeline_new("thumbnail_encoder");
+    GstElement *src = gst_element_factory_make("appsrc", NULL);
+    GstElement *convert = gst_element_factory_make("videoconvert", NULL);
+    GstElement *jpeg = gst_element_factory_make("jpegenc", NULL);
+    GstElement *sink = gst_element_factory_make("appsink", NULL);
+    if (!pipeline || !src || !convert || !jpeg || !sink) {
+        g_printerr("Failed to create thumbnail encoder elements\n");
+        if (pipeline) gst_object_unref(pipeline);
+        if (src) gst_object_unref(src);
+        if (convert) gst_object_unref(convert);
+        if (jpeg) gst_object_unref(jpeg);
+        if (sink) gst_object_unref(sink);
+        return NULL;
+    }
+
+    GstCaps *caps = gst_caps_new_simple("video/x-raw",
+                                        "format", G_TYPE_STRING, "BGRx",
+                                        "width", G_TYPE_INT, width,
+                                        "height", G_TYPE_INT, height,
+                                        "framerate", GST_TYPE_FRACTION, 0, 1,
+                                        NULL);
+    g_object_set(G_OBJECT(src),
+                "caps", caps,
+                "format", GST_FORMAT_TIME,
+                "do-timestamp", FALSE,
+                NULL);
+    gst_caps_unref(caps);
+    g_object_set(G_OBJECT(jpeg), "quality", JPEG_QUALITY, NULL);
+    g_object_set(G_OBJECT(sink), "sync", FALSE, "emit-signals", FALSE, NULL);
+    GstAppSinkCallbacks callbacks = { NULL, NULL, on_thumbnail };
+    gst_app_sink_set_callbacks(GST_APP_SINK(sink), &callbacks, s, NULL);
+
+    gst_bin_add_many(GST_BIN(pipeline), src, convert, jpeg, sink, NULL);
+    if (!gst_element_link_many(src, convert, jpeg, sink, NULL) ||
+        gst_element_set_state(pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        g_printerr("Failed to start thumbnail encoder\n");
+        gst_element_set_state(pipeline, GST_STATE_NULL);
+        gst_object_unref(pipeline);
+        return NULL;
+    }
+    s->thumb_src = src;
+    return pipeline;
+}
+
+// Box-filtered, turned back to the camera's orientation
+static void shrink_preview(const RecordSeek *s, const guint8 *data, gint stride, gint width, gint height,
+                           guint8 *out, gint out_width, gint out_height) {
+    gboolean quarter = s->rotation == PREVIEW_ROTATE_90CW || s->rotation == PREVIEW_ROTATE_90CCW;
+    gint sw = quarter ? height : width;
+    gint sh = quarter ? width : height;
+
+    for (gint ty = 0; ty < out_height; ty++) {
+        gint y0 = ty * sh / out_height, y1 = MAX((ty + 1) * sh / out_height, y0 + 1);
+        for (gint tx = 0; tx < out_width; tx++) {
+            gint x0 = tx * sw / out_width, x1 = MAX((tx + 1) * sw / out_width, x0 + 1);
+            guint sum[3] = { 0, 0, 0 };
+            for (gint y = y0; y < y1; y++) {
+                for (gint x = x0; x < x1; x++) {
+                    gint dx, dy;
+                    switch (s->rotation) {
+                    case PREVIEW_ROTATE_90CW:  dx = sh - 1 - y; dy = x; break;
+                    case PREVIEW_ROTATE_180:   dx = sw - 1 - x; dy = sh - 1 - y; break;
+                    case PREVIEW_ROTATE_90CCW: dx = y; dy = sw - 1 - x; break;
+                    default:                   dx = x; dy = y; break;
+                    }
+                    const guint8 *p = data + (gsize)dy * stride + dx * 4;
+                    sum[0] += p[0];
+                    sum[1] += p[1];
+                    sum[2] += p[2];
+                }
+            }
+            guint n = (guint)((y1 - y0) * (x1 - x0));
+            guint8 *o = out + ((gsize)ty * out_width + tx) * 4;
+            o[0] = (guint8)((sum[0] + n / 2) / n);
+            o[1] = (guint8)((sum[1] + n / 2) / n);
+            o[2] = (guint8)((sum[2] + n / 2) / n);
+            o[3] = 0xFF;
+        }
+    }
+}
+
+void record_seek_preview(RecordSeek *s, GstBuffer *buffer, const GstVideoInfo *info) {
+    if (!s || !s->thumb_interval || !buffer || !GST_BUFFER_PTS_IS_VALID(buffer)) {
+        return;
+    }
+    // Running time is the PTS: the preview branch keeps the live segment
+    GstClockTime pts = GST_BUFFER_PTS(buffer);
+
+    g_mutex_lock(&s->lock);
+    gboolean due = s->path && GST_CLOCK_TIME_IS_VALID(s->start) && pts >= s->start &&
+                   pts >= s->next_thumb && s->thumbs_pending < MAX_THUMBS_PENDING;
+    if (due) {
+        s->next_thumb = pts + s->thumb_interval;
+        s->thumbs_pending++;
+    }
+    g_mutex_unlock(&s->lock);
+    if (!due) {
+        return;
+    }
+
+    gint width = GST_VIDEO_INFO_WIDTH(info), height = GST_VIDEO_INFO_HEIGHT(info);
+    gboolean quarter = s->rotation == PREVIEW_ROTATE_90CW || s->rotation == PREVIEW_ROTATE_90CCW;
+    gint sw = quarter ? height : width, sh = quarter ? width : height;
+    gint out_width = MIN(s->thumb_width, sw) & ~1;
+    gint out_height = MAX((gint)((gint64)out_width * sh / sw) & ~1, 2);
+
+    // The preview size may change while recording (screen size): the
+    // encoder is rebuilt for it, dropping the thumbnails still inside
+    if (s->encoder && (out_width != s->encoder_width || out_height != s->encoder_height)) {
+        gst_element_set_state(s->encoder, GST_STATE_NULL);
+        gst_object_unref(s->encoder);
+        s->encoder = NULL;
+        g_mutex_lock(&s->lock);
+        s->thumbs_pending = 1;
+        g_mutex_unlock(&s->lock);
+    }
+    if (!s->encoder) {
+        s->encoder = create_encoder(s, out_width, out_height);
+        s->encoder_width = out_width;
+        s->encoder_height = out_height;
+    }
+    GstBuffer *thumb = s->encoder ? gst_buffer_new_allocate(NULL, (gsize)out_width * out_height * 4, NULL) : NULL;
+    GstMapInfo in, out;
+    if (thumb && gst_buffer_map(buffer, &in, GST_MAP_READ)) {
+        if (gst_buffer_map(thumb, &out, GST_MAP_WRITE)) {
+            shrink_preview(s, in.data, GST_VIDEO_INFO_PLANE_STRIDE(info, 0), width, height,
+                           out.data, out_width, out_height);
+            gst_buffer_unmap(thumb, &out);
+        }
+        gst_buffer_unmap(buffer, &in);
+        GST_BUFFER_PTS(thumb) = pts;
+        if (gst_app_src_push_buffer(GST_APP_SRC(s->thumb_src), thumb) == GST_FLOW_OK) {
+            return;
+        }
+    } else if (thumb) {
+        gst_buffer_unref(thumb);
+    }
+
+    g_mutex_lock(&s->lock);
+    s->thumbs_pending--;
+    g_mutex_unlock(&s->lock);
+}
+
+/* ---------- lifetime ---------- */
+
+RecordSeek* record_seek_new(int keyframes, int thumb_seconds, int thumb_width, PreviewRotation rotation) {
+    RecordSeek *s = g_new0(RecordSeek, 1);
+    g_mutex_init(&s->lock);
+    g_cond_init(&s->idle);
+    s->keyframes = keyframes != 0;
+    s->thumb_interval = thumb_seconds > 0 ? (GstClockTime)thumb_seconds * GST_SECOND : 0;
+    s->thumb_width = MAX(thumb_width, 16);
+    s->rotation = rotation;
+    s->pending = g_byte_array_new();
+    s->first_pts = GST_CLOCK_TIME_NONE;
+    s->start = GST_CLOCK_TIME_NONE;
+    s->last_keyframe_pts = GST_CLOCK_TIME_NONE;
+    s->opened_start = GST_CLOCK_TIME_NONE;
+
+    // Exclusive single thread: sidecar writes stay in order and never run
+    // on a streaming thread
+    s->writer = g_thread_pool_new(write_task, NULL, 1, TRUE, NULL);
+    if (!s->writer) {
+        g_byte_array_unref(s->pending);
+        g_cond_clear(&s->idle);
+        g_mutex_clear(&s->lock);
+        g_free(s);
+        return NULL;
+    }
+    return s;
+}
+
+RecordSeek* record_seek_ref(RecordSeek *s) {
+    g_atomic_int_inc(&s->users);
+    return s;
+}
+
+void record_seek_unref(RecordSeek *s) {
+    if (g_atomic_int_dec_and_test(&s->users)) {
+        g_mutex_lock(&s->lock);
+        g_cond_broadcast(&s->idle);
+        g_mutex_unlock(&s->lock);
+    }
+}
+
+void record_seek_free(RecordSeek *s) {
+    if (!s) return;
+
+    // A preview frame may still be taking a thumbnail
+    g_mutex_lock(&s->lock);
+    while (g_atomic_int_get(&s->users) > 0) {
+        g_cond_wait(&s->idle, &s->lock);
+    }
+    g_mutex_unlock(&s->lock);
+
+    // Thumbnails still in the encoder are dropped
+    if (s->encoder) {
+        gst_element_set_state(s->encoder, GST_STATE_NULL);
+        gst_object_unref(s->encoder);
+    }
+
+    g_mutex_lock(&s->lock);
+    queue_write(s, FALSE);
+    g_mutex_unlock(&s->lock);
+    g_thread_pool_free(s->writer, FALSE, TRUE);
+
+    g_byte_array_unref(s->pending);
+    g_free(s->path);
+    g_free(s->opened_location);
+    g_cond_clear(&s->idle);
+    g_mutex_clear(&s->lock);
+    g_free(s);
+}
@@ -0,0 +1,438 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/src/record_session.c
+ */
+#include "record_session.h"
+#include "timebase.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+typedef struct {
+    char path[256];
+    uint64_t start;         // running time of the first buffer
+    uint64_t end;
+    uint64_t bytes;
+    int closed;
+} RecordSegment;
+
+// Manifest lists at most this many gaps; lost_frames keeps counting
+#define MAX_GAPS 256
+
+// Frames reach the index at least this often, segment boundaries or not
+#define INDEX_FLUSH_MS 1000
+
+typedef struct {
+    uint64_t pts;           // running time of the first frame after the gap
+    uint64_t frames;
+} RecordGap;
+
+// What the writer thread copies out under the lock to write the manifest
+typedef struct {
+    RecordSegment *segments;
+    unsigned count;
+    unsigned capacity;
+    RecordGap gaps[MAX_GAPS];
+    unsigned gap_count;
+    uint64_t lost_frames;
+    int complete;
+    int clean;
+} ManifestState;
+
+struct RecordSession {
+    pthread_mutex_t lock;   // segment messages arrive on streaming threads
+    pthread_cond_t wake;
+    pthread_t writer;       // the only thread that touches the card
+    int writer_started;
+    int dirty;              // the manifest needs rewriting
+    int stopping;
+    char dir[128];
+    char name[32];          // YYYYMMDD_HHMMSS of the start
+    char manifest[256];
+    char index[256];        // per-frame timestamps
+    char extension[8];      // of the segment files
+    time_t started;
+    int segment_seconds;
+    int segment_max_mb;
+    int complete;
+    int clean;              // every segment was closed by the muxer
+
+    RecordSegment *segments;
+    unsigned count;
+    unsigned capacity;
+
+    RecordGap gaps[MAX_GAPS];
+    unsigned gap_count;
+    uint64_t lost_frames;
+
+    RecordIndexEntry *frames;   // not yet handed to the writer
+    unsigned frame_count;
+    unsigned frame_capacity;
+
+    // Writer thread only
+    RecordIndexEntry *spare;    // swapped with frames on every write
+    unsigned spare_capacity;
+    uint64_t frames_indexed;
+    ManifestState state;
+};
+
+static void format_stamp(time_t when, char *buf, size_t size) {
+    struct tm *t = localtime(&when);
+    snprintf(buf, size, "%04d%02d%02d_%02d%02d%02d",
+             t->tm_year + 1900, t->tm_mon + 1, t->tm_mday,
+             t->tm_hour, t->tm_min, t->tm_sec);
+}
+
+static const char* base_name(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+// Writer thread: append frames to the index file, synced so that a power
+// cut loses at most the last INDEX_FLUSH_MS of entries
+static void flush_index(RecordSession *s, const RecordIndexEntry *frames, unsigned count, int sync) {
+    if (count == 0 && !sync) {
+        return;
+    }
+    FILE *fp = fopen(s->index, "ab");
+    if (!fp) {
+        perror("Failed to append to frame index");
+        return;
+    }
+    if (fwrite(frames, sizeof(RecordIndexEntry), count, fp) != count) {
+        perror("Failed to append to frame index");
+    } else {
+        s->frames_indexed += count;
+    }
+    fflush(fp);
+    if (count > 0 || sync) {
+        fsync(fileno(fp));
+    }
+    fclose(fp);
+}
+
+// Writer thread: rewrite the manifest from the copied state
+static void write_manifest(RecordSession *s, const ManifestState *m) {
+    int64_t utc_offset;
+    uint64_t utc_uncertainty;
+    TimebaseSource utc_source = timebase_utc_offset(&utc_offset, &utc_uncertainty);
+
+    char tmp[272];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", s->manifest);
+
+    FILE *fp = fopen(tmp, "w");
+    if (!fp) {
+        perror("Failed to write session manifest");
+        return;
+    }
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"session\": \"%s\",\n", s->name);
+    fprintf(fp, "  \"segment_seconds\": %d,\n", s->segment_seconds);
+    fprintf(fp, "  \"segment_max_mb\": %d,\n", s->segment_max_mb);
+    fprintf(fp, "  \"complete\": %s,\n", m->complete ? "true" : "false");
+    fprintf(fp, "  \"clean\": %s,\n", m->clean ? "true" : "false");
+    fprintf(fp, "  \"index\": \"%s\",\n", base_name(s->index));
+    fprintf(fp, "  \"indexed_frames\": %llu,\n", (unsigned long long)s->frames_indexed);
+    fprintf(fp, "  \"utc_source\": \"%s\",\n", timebase_source_name(utc_source));
+    fprintf(fp, "  \"utc_offset_ns\": %lld,\n", (long long)utc_offset);
+    fprintf(fp, "  \"utc_uncertainty_ns\": %llu,\n", (unsigned long long)utc_uncertainty);
+    fprintf(fp, "  \"lost_frames\": %llu,\n", (unsigned long long)m->lost_frames);
+    fprintf(fp, "  \"gaps\": [\n");
+    for (unsigned i = 0; i < m->gap_count; i++) {
+        fprintf(fp, "    { \"pts_ns\": %llu, \"frames\": %llu }%s\n",
+                (unsigned long long)m->gaps[i].pts, (unsigned long long)m->gaps[i].frames,
+                i + 1 < m->gap_count ? "," : "");
+    }
+    fprintf(fp, "  ],\n");
+    fprintf(fp, "  \"segments\": [\n");
+    for (unsigned i = 0; i < m->count; i++) {
+        const RecordSegment *seg = &m->segments[i];
+        fprintf(fp, "    { \"file\": \"%s\", \"start_ns\": %llu, \"duration_ns\": %llu, \"bytes\": %llu, \"closed\": %s }%s\n",
+                base_name(seg->path), (unsigned long long)seg->start,
+                (unsigned long long)(seg->end > seg->start ? seg->end - seg->start : 0),
+                (unsigned long long)seg->bytes, seg->closed ? "true" : "false",
+                i + 1 < m->count ? "," : "");
+    }
+    fprintf(fp, "  ]\n");
+    fprintf(fp, "}\n");
+    fflush(fp);
+    fsync(fileno(fp));
+    fclose(fp);
+
+    if (rename(tmp, s->manifest) != 0) {
+        perror("Failed to replace session manifest");
+    }
+}
+
+// Writer thread: take what the streaming threads left under the lock, then
+// write it out without holding it
+static void write_pending(RecordSession *s, int sync) {
+    ManifestState *m = &s->state;
+
+    pthread_mutex_lock(&s->lock);
+    RecordIndexEntry *frames = s->frames;
+    unsigned frame_count = s->frame_count;
+    unsigned frame_capacity = s->frame_capacity;
+    s->frames = s->spare;
+    s->frame_capacity = s->spare_capacity;
+    s->frame_count = 0;
+
+    int manifest = s->dirty || sync;
+    s->dirty = 0;
+    if (manifest && m->capacity < s->count) {
+        RecordSegment *segments = (RecordSegment *)realloc(m->segments, s->capacity * sizeof(RecordSegment));
+        if (segments) {
+            m->segments = segments;
+            m->capacity = s->capacity;
+        }
+    }
+    if (manifest) {
+        m->count = s->count <= m->capacity ? s->count : m->capacity;
+        if (m->count > 0) {
+            memcpy(m->segments, s->segments, m->count * sizeof(RecordSegment));
+        }
+        memcpy(m->gaps, s->gaps, s->gap_count * sizeof(RecordGap));
+        m->gap_count = s->gap_count;
+        m->lost_frames = s->lost_frames;
+        m->complete = s->complete;
+        m->clean = s->clean;
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    flush_index(s, frames, frame_count, sync);
+    if (manifest) {
+        // Closed segments get their size once; stat() is I/O on the card too
+        for (unsigned i = 0; i < m->count; i++) {
+            RecordSegment *seg = &m->segments[i];
+            struct stat st;
+            if (seg->closed && seg->bytes == 0 && stat(seg->path, &st) == 0) {
+                seg->bytes = (uint64_t)st.st_size;
+            }
+        }
+        write_manifest(s, m);
+    }
+
+    pthread_mutex_lock(&s->lock);
+    for (unsigned i = 0; manifest && i < m->count && i < s->count; i++) {
+        if (s->segments[i].closed && s->segments[i].bytes == 0) {
+            s->segments[i].bytes = m->segments[i].bytes;
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+    s->spare = frames;
+    s->spare_capacity = frame_capacity;
+}
+
+static void* session_writer(void *arg) {
+    RecordSession *s = (RecordSession *)arg;
+
+    pthread_mutex_lock(&s->lock);
+    for (;;) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += INDEX_FLUSH_MS / 1000;
+        deadline.tv_nsec += (INDEX_FLUSH_MS % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        // Woken for the manifest, or on the timeout for the frames so far
+        int timed_out = 0;
+        while (!s->dirty && !s->stopping && !timed_out) {
+            timed_out = pthread_cond_timedwait(&s->wake, &s->lock, &deadline) != 0;
+        }
+        if (s->stopping) {
+            break;
+        }
+        pthread_mutex_unlock(&s->lock);
+        write_pending(s, 0);
+        pthread_mutex_lock(&s->lock);
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    // Final manifest, index synced
+    write_pending(s, 1);
+    return NULL;
+}
+
+// Call with the lock held: have the writer rewrite the manifest
+static void manifest_changed(RecordSession *s) {
+    s->dirty = 1;
+    pthread_cond_signal(&s->wake);
+}
+
+RecordSession* record_session_new(const char *dir, const char *extension,
+                                  int segment_seconds, int segment_max_mb) {
+    RecordSession *s = (RecordSession *)calloc(1, sizeof(RecordSession));
+    if (!s) {
+        return NULL;
+    }
+    pthread_mutex_init(&s->lock, NULL);
+    s->dirty = 1;
+    strncpy(s->dir, dir, sizeof(s->dir) - 1);
+    strncpy(s->extension, extension, sizeof(s->extension) - 1);
+    s->started = time(NULL);
+    format_stamp(s->started, s->name, sizeof(s->name));
+    snprintf(s->manifest, sizeof(s->manifest), "%s/session_%s.json", s->dir, s->name);
+    snprintf(s->index, sizeof(s->index), "%s/session_%s.tsidx", s->dir, s->name);
+    s->segment_seconds = segment_seconds;
+    s->segment_max_mb = segment_max_mb;
+    s->clean = 1;
+
+    RecordIndexHeader header = { RECORD_INDEX_MAGIC, RECORD_INDEX_VERSION, sizeof(RecordIndexEntry), 0 };
+    FILE *fp = fopen(s->index, "wb");
+    if (!fp || fwrite(&header, sizeof(header), 1, fp) != 1) {
+        perror("Failed to create frame index");
+    }
+    if (fp) fclose(fp);
+
+    // First manifest before any segment, then the writer takes over
+    write_pending(s, 0);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&s->wake, &attr);
+    pthread_condattr_destroy(&attr);
+    s->writer_started = pthread_create(&s->writer, NULL, session_writer, s) == 0;
+    if (!s->writer_started) {
+        perror("Failed to start session writer, manifest written at the end only");
+    }
+    return s;
+}
+
+void record_session_free(RecordSession *session) {
+    if (!session) {
+        return;
+    }
+    if (session->writer_started) {
+        // record_session_finish was not called
+        pthread_mutex_lock(&session->lock);
+        session->stopping = 1;
+        pthread_cond_signal(&session->wake);
+        pthread_mutex_unlock(&session->lock);
+        pthread_join(session->writer, NULL);
+    }
+    pthread_cond_destroy(&session->wake);
+    pthread_mutex_destroy(&session->lock);
+    free(session->segments);
+    free(session->frames);
+    free(session->spare);
+    free(session->state.segments);
+    free(session);
+}
+
+const char* record_session_name(const RecordSession *session) {
+    return session->name;
+}
+
+char* record_session_location(RecordSession *session, unsigned index) {
+    char stamp[32];
+    char *path = (char *)malloc(256);
+    if (!path) {
+        return NULL;
+    }
+
+    // First segment carries the session time; later ones their own start
+    if (index == 0) {
+        strncpy(stamp, session->name, sizeof(stamp));
+    } else {
+        format_stamp(time(NULL), stamp, sizeof(stamp));
+    }
+    snprintf(path, 256, "%s/record_%s.%s", session->dir, stamp, session->extension);
+
+    // Two segments opened within the same second: never overwrite
+    if (access(path, F_OK) == 0) {
+        snprintf(path, 256, "%s/record_%s_%03u.%s", session->dir, stamp, index, session->extension);
+    }
+    return path;
+}
+
+void record_session_segment_opened(RecordSession *session, const char *location, uint64_t running_time) {
+    pthread_mutex_lock(&session->lock);
+    if (session->count == session->capacity) {
+        unsigned capacity = session->capacity ? session->capacity * 2 : 16;
+        RecordSegment *segments = (RecordSegment *)realloc(session->segments, capacity * sizeof(RecordSegment));
+        if (!segments) {
+            pthread_mutex_unlock(&session->lock);
+            return;
+        }
+        session->segments = segments;
+        session->capacity = capacity;
+    }
+    RecordSegment *seg = &session->segments[session->count++];
+    memset(seg, 0, sizeof(*seg));
+    strncpy(seg->path, location, sizeof(seg->path) - 1);
+    seg->start = running_time;
+    seg->end = running_time;
+    manifest_changed(session);
+    pthread_mutex_unlock(&session->lock);
+}
+
+void record_session_segment_closed(RecordSession *session, const char *location, uint64_t running_time) {
+    pthread_mutex_lock(&session->lock);
+    for (unsigned i = session->count; i-- > 0;) {
+        RecordSegment *seg = &session->segments[i];
+        if (strcmp(seg->path, location) == 0) {
+            seg->end = running_time;
+            seg->closed = 1;
+            break;
+        }
+    }
+    manifest_changed(session);
+    pthread_mutex_unlock(&session->lock);
+}
+
+void record_session_discontinuity(RecordSession *session, uint64_t pts, uint64_t frames) {
+    pthread_mutex_lock(&session->lock);
+    if (session->gap_count < MAX_GAPS) {
+        session->gaps[session->gap_count].pts = pts;
+        session->gaps[session->gap_count].frames = frames;
+        session->gap_count++;
+    }
+    session->lost_frames += frames;
+    pthread_mutex_unlock(&session->lock);
+}
+
+void record_session_frame(RecordSession *session, uint64_t running_time, uint64_t capture_ns, int keyframe) {
+    pthread_mutex_lock(&session->lock);
+    if (session->frame_count == session->frame_capacity) {
+        unsigned capacity = session->frame_capacity ? session->frame_capacity * 2 : 256;
+        RecordIndexEntry *frames = (RecordIndexEntry *)realloc(session->frames, capacity * sizeof(RecordIndexEntry));
+        if (!frames) {
+            pthread_mutex_unlock(&session->lock);
+            return;
+        }
+        session->frames = frames;
+        session->frame_capacity = capacity;
+    }
+    RecordIndexEntry *entry = &session->frames[session->frame_count++];
+    entry->capture_ns = capture_ns;
+    entry->running_time = running_time | (keyframe ? RECORD_INDEX_KEYFRAME : 0);
+    pthread_mutex_unlock(&session->lock);
+}
+
+void record_session_finish(RecordSession *session, int clean) {
+    pthread_mutex_lock(&session->lock);
+    session->complete = 1;
+    for (unsigned i = 0; i < session->count; i++) {
+        if (!session->segments[i].closed) {
+            clean = 0;
+        }
+    }
+    session->clean = clean;
+    session->stopping = 1;
+    pthread_cond_signal(&session->wake);
+    pthread_mutex_unlock(&session->lock);
+
+    // The writer leaves after the final manifest
+    if (session->writer_started) {
+        pthread_join(session->writer, NULL);
+        session->writer_started = 0;
+    } else {
+        write_pending(session, 1);
+    }
+}
@@ -5,9 +5,17 @@
 #include "shm_utils.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
 
 int create_shm(void) {
     int shmid = shmget(SHM_KEY, SHM_SIZE, IPC_CREAT | 0666);
+    if (shmid == -1 && errno == EINVAL) {
+        // A smaller segment left over from an older build: replace it
+        int old = shmget(SHM_KEY, 0, 0);
+        if (old != -1 && shmctl(old, IPC_RMID, NULL) == 0) {
+            shmid = shmget(SHM_KEY, SHM_SIZE, IPC_CREAT | 0666);
+        }
+    }
     if (shmid == -1) {
         perror("shmget failed");
         return -1;
@@ -15,6 +23,20 @@ int create_shm(void) {
     return shmid;
 }
 
+int create_readers_shm(void) {
+    int shmid = shmget(PREVIEW_READERS_SHM_KEY, READERS_SHM_SIZE, IPC_CREAT | 0666);
+    if (shmid == -1 && errno == EINVAL) {
+        int old = shmget(PREVIEW_READERS_SHM_KEY, 0, 0);
+        if (old != -1 && shmctl(old, IPC_RMID, NULL) == 0) {
+            shmid = shmget(PREVIEW_READERS_SHM_KEY, READERS_SHM_SIZE, IPC_CREAT | 0666);
+        }
+    }
+    if (shmid == -1) {
+        perror("shmget failed for preview readers");
+    }
+    return shmid;
+}
+
 void* attach_shm(int shmid) {
     void *shm_ptr = shmat(shmid, NULL, 0);
     if (shm_ptr == (void *)-1) {
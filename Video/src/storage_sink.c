@@ -0,0 +1,670 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/src/storage_sink.c
+ */
+#define _GNU_SOURCE
+#include "storage_sink.h"
+#include <gst/base/gstbasesink.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define STORAGE_ALIGN 4096
+
+// Staging buffer for the file range [offset, offset + size)
+typedef struct {
+    guint8 *data;
+    gsize size;
+    guint64 offset;
+    gboolean sync;          // sync the file once this chunk is written
+} StorageChunk;
+
+struct _GstStorageSink {
+    GstBaseSink parent;
+
+    // Properties (protected by the object lock, applied on start)
+    gchar *location;
+    guint chunk_size;
+    guint max_chunks;
+    guint64 preallocate;
+    GstClockTime sync_interval;
+
+    // Everything below is protected by "lock"
+    GMutex lock;
+    GCond cond;
+    int fd;
+    GThread *writer;
+    gboolean quit;
+    gboolean flushing;
+    int error;              // errno of the first failed write
+
+    StorageChunk *chunks;
+    guint n_chunks;
+    gsize size;             // chunk size of the open file
+    GQueue free_chunks;
+    GQueue pending;         // oldest first; the head is being written
+    StorageChunk *current;  // filled by render
+    gint64 current_since;   // when current got its first byte (us)
+    guint64 position;       // stream offset of the next byte
+
+    StorageSinkStats stats;
+
+    // Writer thread only
+    guint64 allocated;      // preallocated up to this offset
+    guint64 end;            // highest offset written
+    gint64 last_sync;
+    gboolean can_preallocate;
+    guint64 prealloc_step;
+    gint64 sync_interval_us;
+};
+
+struct _GstStorageSinkClass {
+    GstBaseSinkClass parent_class;
+};
+
+enum {
+    PROP_0,
+    PROP_LOCATION,
+    PROP_CHUNK_SIZE,
+    PROP_MAX_CHUNKS,
+    PROP_PREALLOCATE,
+    PROP_SYNC_INTERVAL,
+};
+
+enum {
+    SIGNAL_WRITTEN,
+    LAST_SIGNAL,
+};
+
+static guint storage_sink_signals[LAST_SIGNAL];
+
+#define DEFAULT_CHUNK_SIZE     (1024 * 1024)
+#define DEFAULT_MAX_CHUNKS     8
+#define DEFAULT_PREALLOCATE    (64 * 1024 * 1024)
+#define DEFAULT_SYNC_INTERVAL  GST_SECOND
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE("sink",
+    GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+G_DEFINE_TYPE(GstStorageSink, gst_storage_sink, GST_TYPE_BASE_SINK);
+
+static guint hist_bucket(gint64 us) {
+    guint bucket = 0;
+    while (us >= 2 && bucket < STORAGE_SINK_HIST_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+// Make a file range durable: preallocate ahead, write, sync on cadence.
+// Runs on the writer thread without the lock; returns 0 or an errno.
+static int write_chunk(GstStorageSink *self, StorageChunk *chunk, gint64 *write_us, gint64 *sync_us) {
+    guint64 chunk_end = chunk->offset + chunk->size;
+
+    // Extents reserved in large steps keep the file contiguous on the card
+    if (self->can_preallocate && chunk_end > self->allocated) {
+        guint64 target = chunk_end + self->prealloc_step;
+        if (fallocate(self->fd, FALLOC_FL_KEEP_SIZE, (off_t)self->allocated,
+                      (off_t)(target - self->allocated)) == 0) {
+            self->allocated = target;
+        } else {
+            GST_WARNING_OBJECT(self, "fallocate failed (%s), writing without preallocation",
+                               strerror(errno));
+            self->can_preallocate = FALSE;
+        }
+    }
+
+    gint64 t0 = g_get_monotonic_time();
+    gsize done = 0;
+    while (done < chunk->size) {
+        ssize_t n = pwrite(self->fd, chunk->data + done, chunk->size - done, (off_t)(chunk->offset + done));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+        done += n;
+    }
+    gint64 t1 = g_get_monotonic_time();
+    *write_us = t1 - t0;
+    *sync_us = -1;
+    if (chunk_end > self->end) {
+        self->end = chunk_end;
+    }
+
+    if (chunk->sync || (self->sync_interval_us > 0 && t1 - self->last_sync >= self->sync_interval_us)) {
+        if (fdatasync(self->fd) != 0) {
+            return errno;
+        }
+        self->last_sync = g_get_monotonic_time();
+        *sync_us = self->last_sync - t1;
+        // Synced pages are not read back; keep the page cache for others
+        posix_fadvise(self->fd, 0, (off_t)self->end, POSIX_FADV_DONTNEED);
+    }
+    return 0;
+}
+
+static gpointer writer_thread(gpointer data) {
+    GstStorageSink *self = (GstStorageSink *)data;
+
+    g_mutex_lock(&self->lock);
+    for (;;) {
+        while (!self->quit && g_queue_is_empty(&self->pending)) {
+            g_cond_wait(&self->cond, &self->lock);
+        }
+        StorageChunk *chunk = g_queue_peek_head(&self->pending);
+        if (!chunk) {
+            break;
+        }
+
+        // After a failure the remaining data is dropped
+        int err = self->error;
+        gint64 write_us = -1, sync_us = -1;
+        if (!err) {
+            g_mutex_unlock(&self->lock);
+            err = write_chunk(self, chunk, &write_us, &sync_us);
+            g_mutex_lock(&self->lock);
+        }
+
+        if (err && !self->error) {
+            self->error = err;
+            GST_ELEMENT_ERROR(self, RESOURCE, WRITE, ("Error writing %s", self->location),
+                              ("%s", g_strerror(err)));
+        }
+        gboolean written = write_us >= 0 && chunk->size > 0;
+        if (written) {
+            self->stats.bytes += chunk->size;
+            self->stats.writes++;
+            self->stats.write_us[hist_bucket(write_us)]++;
+        }
+        if (sync_us >= 0) {
+            self->stats.syncs++;
+            self->stats.sync_us[hist_bucket(sync_us)]++;
+        }
+        guint64 total = self->stats.bytes;
+        g_queue_pop_head(&self->pending);
+        chunk->size = 0;
+        chunk->sync = FALSE;
+        g_queue_push_tail(&self->free_chunks, chunk);
+        g_cond_broadcast(&self->cond);
+
+        // Handlers may query the stats, so not under the lock
+        if (written) {
+            g_mutex_unlock(&self->lock);
+            g_signal_emit(self, storage_sink_signals[SIGNAL_WRITTEN], 0, total);
+            g_mutex_lock(&self->lock);
+        }
+    }
+    g_mutex_unlock(&self->lock);
+    return NULL;
+}
+
+// Queue the staging chunk for writing. Call with the lock held.
+static void submit_current(GstStorageSink *self, gboolean sync) {
+    StorageChunk *chunk = self->current;
+    if (!chunk) {
+        if (!sync) {
+            return;
+        }
+        // Nothing staged, but a sync was asked for: queue an empty write.
+        // The writer always returns chunks, even after an error.
+        while (g_queue_is_empty(&self->free_chunks)) {
+            g_cond_wait(&self->cond, &self->lock);
+        }
+        chunk = g_queue_pop_head(&self->free_chunks);
+        chunk->offset = self->position;
+        chunk->size = 0;
+    }
+    self->current = NULL;
+    chunk->sync = sync;
+
+    guint depth = self->pending.length;
+    self->stats.queue_depth[MIN(depth, STORAGE_SINK_MAX_CHUNKS)]++;
+    if (depth + 1 > self->stats.queue_max) {
+        self->stats.queue_max = depth + 1;
+    }
+    g_queue_push_tail(&self->pending, chunk);
+    g_cond_broadcast(&self->cond);
+}
+
+// Wait until everything queued has been written. Call with the lock held.
+static void drain(GstStorageSink *self) {
+    while (!g_queue_is_empty(&self->pending) && !self->flushing) {
+        g_cond_wait(&self->cond, &self->lock);
+    }
+}
+
+static GstFlowReturn gst_storage_sink_render(GstBaseSink *sink, GstBuffer *buffer) {
+    GstStorageSink *self = GST_STORAGE_SINK(sink);
+    GstMapInfo map;
+    GstFlowReturn ret = GST_FLOW_OK;
+
+    if (!gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+        GST_ELEMENT_ERROR(self, RESOURCE, READ, ("Failed to map buffer"), (NULL));
+        return GST_FLOW_ERROR;
+    }
+    const guint8 *data = map.data;
+    gsize left = map.size;
+
+    g_mutex_lock(&self->lock);
+    while (left > 0) {
+        if (self->error) {
+            ret = GST_FLOW_ERROR;
+            break;
+        }
+        if (!self->current) {
+            if (g_queue_is_empty(&self->free_chunks)) {
+                // The card is behind by max-chunks: now upstream has to wait
+                gint64 t0 = g_get_monotonic_time();
+                while (g_queue_is_empty(&self->free_chunks) && !self->flushing && !self->error) {
+                    g_cond_wait(&self->cond, &self->lock);
+                }
+                self->stats.waits++;
+                self->stats.wait_us[hist_bucket(g_get_monotonic_time() - t0)]++;
+                if (self->flushing) {
+                    ret = GST_FLOW_FLUSHING;
+                    break;
+                }
+                continue;
+            }
+            self->current = g_queue_pop_head(&self->free_chunks);
+            self->current->offset = self->position;
+            self->current->size = 0;
+            self->current_since = g_get_monotonic_time();
+        }
+
+        // A chunk ends on the next chunk-aligned file offset
+        StorageChunk *chunk = self->current;
+        gsize limit = self->size - (gsize)(chunk->offset % self->size);
+        gsize n = MIN(limit - chunk->size, left);
+        memcpy(chunk->data + chunk->size, data, n);
+        chunk->size += n;
+        self->position += n;
+        data += n;
+        left -= n;
+        if (chunk->size == limit) {
+            submit_current(self, FALSE);
+        }
+    }
+
+    // Low bitrates fill chunks slowly; never hold data longer than a sync period
+    if (ret == GST_FLOW_OK && self->current && self->sync_interval_us > 0 &&
+        g_get_monotonic_time() - self->current_since >= self->sync_interval_us) {
+        submit_current(self, FALSE);
+    }
+    g_mutex_unlock(&self->lock);
+
+    gst_buffer_unmap(buffer, &map);
+    return ret;
+}
+
+static gboolean gst_storage_sink_event(GstBaseSink *sink, GstEvent *event) {
+    GstStorageSink *self = GST_STORAGE_SINK(sink);
+
+    switch (GST_EVENT_TYPE(event)) {
+        case GST_EVENT_SEGMENT: {
+            const GstSegment *segment;
+            gst_event_parse_segment(event, &segment);
+            // Muxers seek back to patch headers and indexes
+            if (segment->format == GST_FORMAT_BYTES) {
+                g_mutex_lock(&self->lock);
+                if (segment->start != self->position) {
+                    submit_current(self, FALSE);
+                    self->position = segment->start;
+                }
+                g_mutex_unlock(&self->lock);
+            }
+            break;
+        }
+        case GST_EVENT_EOS:
+            // The file is complete on disk once EOS is posted
+            g_mutex_lock(&self->lock);
+            submit_current(self, TRUE);
+            drain(self);
+            g_mutex_unlock(&self->lock);
+            break;
+        default:
+            break;
+    }
+    return GST_BASE_SINK_CLASS(gst_storage_sink_parent_class)->event(sink, event);
+}
+
+static gboolean gst_storage_sink_query(GstBaseSink *sink, GstQuery *query) {
+    GstStorageSink *self = GST_STORAGE_SINK(sink);
+
+    switch (GST_QUERY_TYPE(query)) {
+        case GST_QUERY_POSITION: {
+            GstFormat format;
+            gst_query_parse_position(query, &format, NULL);
+            if (format != GST_FORMAT_BYTES && format != GST_FORMAT_DEFAULT) {
+                return FALSE;
+            }
+            g_mutex_lock(&self->lock);
+            gst_query_set_position(query, GST_FORMAT_BYTES, (gint64)self->position);
+            g_mutex_unlock(&self->lock);
+            return TRUE;
+        }
+        case GST_QUERY_SEEKING: {
+            GstFormat format;
+            gst_query_parse_seeking(query, &format, NULL, NULL, NULL);
+            gst_query_set_seeking(query, format,
+                                  format == GST_FORMAT_BYTES || format == GST_FORMAT_DEFAULT, 0, -1);
+            return TRUE;
+        }
+        case GST_QUERY_FORMATS:
+            gst_query_set_formats(query, 2, GST_FORMAT_DEFAULT, GST_FORMAT_BYTES);
+            return TRUE;
+        default:
+            return GST_BASE_SINK_CLASS(gst_storage_sink_parent_class)->query(sink, query);
+    }
+}
+
+static void free_chunks(GstStorageSink *self) {
+    for (guint i = 0; i < self->n_chunks; i++) {
+        free(self->chunks[i].data);
+    }
+    g_free(self->chunks);
+    self->chunks = NULL;
+    self->n_chunks = 0;
+    g_queue_clear(&self->free_chunks);
+    g_queue_clear(&self->pending);
+    self->current = NULL;
+}
+
+static gboolean gst_storage_sink_start(GstBaseSink *sink) {
+    GstStorageSink *self = GST_STORAGE_SINK(sink);
+
+    GST_OBJECT_LOCK(self);
+    gchar *location = g_strdup(self->location);
+    gsize size = self->chunk_size;
+    guint n_chunks = self->max_chunks;
+    guint64 preallocate = self->preallocate;
+    GstClockTime sync_interval = self->sync_interval;
+    GST_OBJECT_UNLOCK(self);
+
+    if (!location) {
+        GST_ELEMENT_ERROR(self, RESOURCE, NOT_FOUND, ("No file name specified for writing"), (NULL));
+        return FALSE;
+    }
+    int fd = open(location, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        GST_ELEMENT_ERROR(self, RESOURCE, OPEN_WRITE, ("Could not open %s for writing", location),
+                          ("%s", g_strerror(errno)));
+        g_free(location);
+        return FALSE;
+    }
+    g_free(location);
+
+    g_mutex_lock(&self->lock);
+    self->chunks = g_new0(StorageChunk, n_chunks);
+    self->n_chunks = n_chunks;
+    for (guint i = 0; i < n_chunks; i++) {
+        if (posix_memalign((void **)&self->chunks[i].data, STORAGE_ALIGN, size) != 0) {
+            g_mutex_unlock(&self->lock);
+            GST_ELEMENT_ERROR(self, RESOURCE, NO_SPACE_LEFT, ("Failed to allocate write buffers"), (NULL));
+            g_mutex_lock(&self->lock);
+            free_chunks(self);
+            g_mutex_unlock(&self->lock);
+            close(fd);
+            return FALSE;
+        }
+        g_queue_push_tail(&self->free_chunks, &self->chunks[i]);
+    }
+    self->fd = fd;
+    self->size = size;
+    self->position = 0;
+    self->quit = FALSE;
+    self->flushing = FALSE;
+    self->error = 0;
+    self->allocated = 0;
+    self->end = 0;
+    self->last_sync = g_get_monotonic_time();
+    self->can_preallocate = preallocate > 0;
+    self->prealloc_step = preallocate;
+    self->sync_interval_us = (gint64)(sync_interval / 1000);
+    g_mutex_unlock(&self->lock);
+
+    self->writer = g_thread_new("storage-writer", writer_thread, self);
+    return TRUE;
+}
+
+static gboolean gst_storage_sink_stop(GstBaseSink *sink) {
+    GstStorageSink *self = GST_STORAGE_SINK(sink);
+
+    if (!self->writer) {
+        return TRUE;
+    }
+
+    // Whatever is staged still goes out before the file is closed
+    g_mutex_lock(&self->lock);
+    self->flushing = FALSE;
+    submit_current(self, TRUE);
+    self->quit = TRUE;
+    g_cond_broadcast(&self->cond);
+    g_mutex_unlock(&self->lock);
+    g_thread_join(self->writer);
+    self->writer = NULL;
+
+    // Give back the preallocated extents past the data
+    if (self->allocated > self->end && ftruncate(self->fd, (off_t)self->end) != 0) {
+        GST_WARNING_OBJECT(self, "ftruncate failed: %s", strerror(errno));
+    }
+    close(self->fd);
+    self->fd = -1;
+
+    g_mutex_lock(&self->lock);
+    free_chunks(self);
+    g_mutex_unlock(&self->lock);
+    return TRUE;
+}
+
+static gboolean gst_storage_sink_unlock(GstBaseSink *sink) {
+    GstStorageSink *self = GST_STORAGE_SINK(sink);
+
+    g_mutex_lock(&self->lock);
+    self->flushing = TRUE;
+    g_cond_broadcast(&self->cond);
+    g_mutex_unlock(&self->lock);
+    return TRUE;
+}
+
+static gboolean gst_storage_sink_unlock_stop(GstBaseSink *sink) {
+    GstStorageSink *self = GST_STORAGE_SINK(sink);
+
+    g_mutex_lock(&self->lock);
+    self->flushing = FALSE;
+    g_mutex_unlock(&self->lock);
+    return TRUE;
+}
+
+static void gst_storage_sink_set_property(GObject *object, guint prop_id,
+                                          const GValue *value, GParamSpec *pspec) {
+    GstStorageSink *self = GST_STORAGE_SINK(object);
+
+    GST_OBJECT_LOCK(self);
+    switch (prop_id) {
+        case PROP_LOCATION:
+            g_free(self->location);
+            self->location = g_value_dup_string(value);
+            break;
+        case PROP_CHUNK_SIZE:
+            // Whole pages, so chunk boundaries stay page aligned
+            self->chunk_size = GST_ROUND_UP_N(g_value_get_uint(value), STORAGE_ALIGN);
+            break;
+        case PROP_MAX_CHUNKS:
+            self->max_chunks = g_value_get_uint(value);
+            break;
+        case PROP_PREALLOCATE:
+            self->preallocate = g_value_get_uint64(value);
+            break;
+        case PROP_SYNC_INTERVAL:
+            self->sync_interval = g_value_get_uint64(value);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+    GST_OBJECT_UNLOCK(self);
+}
+
+static void gst_storage_sink_get_property(GObject *object, guint prop_id,
+                                          GValue *value, GParamSpec *pspec) {
+    GstStorageSink *self = GST_STORAGE_SINK(object);
+
+    GST_OBJECT_LOCK(self);
+    switch (prop_id) {
+        case PROP_LOCATION:
+            g_value_set_string(value, self->location);
+            break;
+        case PROP_CHUNK_SIZE:
+            g_value_set_uint(value, self->chunk_size);
+            break;
+        case PROP_MAX_CHUNKS:
+            g_value_set_uint(value, self->max_chunks);
+            break;
+        case PROP_PREALLOCATE:
+            g_value_set_uint64(value, self->preallocate);
+            break;
+        case PROP_SYNC_INTERVAL:
+            g_value_set_uint64(value, self->sync_interval);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+    GST_OBJECT_UNLOCK(self);
+}
+
+static void gst_storage_sink_finalize(GObject *object) {
+    GstStorageSink *self = GST_STORAGE_SINK(object);
+
+    g_free(self->location);
+    g_mutex_clear(&self->lock);
+    g_cond_clear(&self->cond);
+
+    G_OBJECT_CLASS(gst_storage_sink_parent_class)->finalize(object);
+}
+
+static void gst_storage_sink_class_init(GstStorageSinkClass *klass) {
+    GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+    GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+    GstBaseSinkClass *base_class = GST_BASE_SINK_CLASS(klass);
+
+    gobject_class->set_property = gst_storage_sink_set_property;
+    gobject_class->get_property = gst_storage_sink_get_property;
+    gobject_class->finalize = gst_storage_sink_finalize;
+
+    g_object_class_install_property(gobject_class, PROP_LOCATION,
+        g_param_spec_string("location", "Location", "File to write",
+                            NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_CHUNK_SIZE,
+        g_param_spec_uint("chunk-size", "Chunk size", "Bytes per write, rounded up to whole pages",
+                          STORAGE_ALIGN, 64 * 1024 * 1024, DEFAULT_CHUNK_SIZE,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_MAX_CHUNKS,
+        g_param_spec_uint("max-chunks", "Max chunks", "Chunks in flight before render blocks",
+                          2, STORAGE_SINK_MAX_CHUNKS, DEFAULT_MAX_CHUNKS,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_PREALLOCATE,
+        g_param_spec_uint64("preallocate", "Preallocate", "Bytes reserved ahead of the data (0 = off)",
+                            0, G_MAXUINT64, DEFAULT_PREALLOCATE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_SYNC_INTERVAL,
+        g_param_spec_uint64("sync-interval", "Sync interval", "Time between fdatasync calls (ns, 0 = on close only)",
+                            0, G_MAXUINT64, DEFAULT_SYNC_INTERVAL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+    // Emitted from the writer thread with the total bytes written so far,
+    // in the order the data was rendered
+    storage_sink_signals[SIGNAL_WRITTEN] = g_signal_new("written", G_TYPE_FROM_CLASS(klass),
+        G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL, G_TYPE_NONE, 1, G_TYPE_UINT64);
+
+    gst_element_class_set_static_metadata(element_class,
+        "Storage sink", "Sink/File",
+        "Writes to flash media in large aligned chunks from a writer thread",
+        "LegionMay");
+    gst_element_class_add_static_pad_template(element_class, &sink_template);
+
+    base_class->start = gst_storage_sink_start;
+    base_class->stop = gst_storage_sink_stop;
+    base_class->render = gst_storage_sink_render;
+    base_class->event = gst_storage_sink_event;
+    base_class->query = gst_storage_sink_query;
+    base_class->unlock = gst_storage_sink_unlock;
+    base_class->unlock_stop = gst_storage_sink_unlock_stop;
+}
+
+static void gst_storage_sink_init(GstStorageSink *self) {
+    self->location = NULL;
+    self->chunk_size = DEFAULT_CHUNK_SIZE;
+    self->max_chunks = DEFAULT_MAX_CHUNKS;
+    self->preallocate = DEFAULT_PREALLOCATE;
+    self->sync_interval = DEFAULT_SYNC_INTERVAL;
+
+    g_mutex_init(&self->lock);
+    g_cond_init(&self->cond);
+    self->fd = -1;
+    g_queue_init(&self->free_chunks);
+    g_queue_init(&self->pending);
+    memset(&self->stats, 0, sizeof(self->stats));
+
+    // Like filesink: write as fast as data arrives
+    gst_base_sink_set_sync(GST_BASE_SINK(self), FALSE);
+}
+
+gboolean storage_sink_register(void) {
+    return gst_element_register(NULL, "storagesink", GST_RANK_NONE, GST_TYPE_STORAGE_SINK);
+}
+
+void storage_sink_get_stats(GstElement *sink, StorageSinkStats *stats) {
+    GstStorageSink *self = GST_STORAGE_SINK(sink);
+
+    g_mutex_lock(&self->lock);
+    *stats = self->stats;
+    g_mutex_unlock(&self->lock);
+}
+
+guint64 storage_sink_hist_percentile(const guint64 *hist, double p) {
+    guint64 total = 0, seen = 0;
+    for (int i = 0; i < STORAGE_SINK_HIST_BUCKETS; i++) {
+        total += hist[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    guint64 rank = (guint64)(p / 100.0 * (total - 1)) + 1;
+    for (int i = 0; i < STORAGE_SINK_HIST_BUCKETS; i++) {
+        seen += hist[i];
+        if (seen >= rank) {
+            return (guint64)2 << i;
+        }
+    }
+    return (guint64)2 << (STORAGE_SINK_HIST_BUCKETS - 1);
+}
+
+static void print_hist(const char *name, const guint64 *hist) {
+    guint64 total = 0;
+    for (int i = 0; i < STORAGE_SINK_HIST_BUCKETS; i++) {
+        total += hist[i];
+    }
+    g_print("  %-6s %8" G_GUINT64_FORMAT "  p50 <%7" G_GUINT64_FORMAT " us  p99 <%7" G_GUINT64_FORMAT
+            " us  max <%7" G_GUINT64_FORMAT " us\n",
+            name, total, storage_sink_hist_percentile(hist, 50), storage_sink_hist_percentile(hist, 99),
+            storage_sink_hist_percentile(hist, 100));
+}
+
+void storage_sink_print_stats(const StorageSinkStats *stats) {
+    g_print("  %.1f MB in %" G_GUINT64_FORMAT " writes, %" G_GUINT64_FORMAT " syncs, render waited %"
+            G_GUINT64_FORMAT " times, queue max %u\n",
+            stats->bytes / 1e6, stats->writes, stats->syncs, stats->waits, stats->queue_max);
+    print_hist("write", stats->write_us);
+    print_hist("sync", stats->sync_us);
+    print_hist("wait", stats->wait_us);
+    g_print("  queue depth:");
+    for (int i = 0; i <= STORAGE_SINK_MAX_CHUNKS; i++) {
+        if (stats->queue_depth[i]) {
+            g_print(" %d:%" G_GUINT64_FORMAT, i, stats->queue_depth[i]);
+        }
+    }
+    g_print("\n");
+}
@@ -0,0 +1,45 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/src/telemetry.c
+ */
+#include "telemetry.h"
+#include <errno.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/msg.h>
+
+#define MSG_SIZE    (sizeof(TelemetryMsg) - sizeof(long))
+
+int telemetry_open(void) {
+    return msgget(TELEMETRY_MSG_KEY, IPC_CREAT | 0666);
+}
+
+uint16_t telemetry_record_size(TelemetryType type) {
+    switch (type) {
+        case TELEMETRY_IMU:  return sizeof(TelemetryImu);
+        case TELEMETRY_GNSS: return sizeof(TelemetryGnss);
+        default:             return 0;
+    }
+}
+
+int telemetry_send(int msqid, TelemetryType type, const void *record) {
+    uint16_t size = telemetry_record_size(type);
+    if (msqid < 0 || size == 0) {
+        return -1;
+    }
+    TelemetryMsg msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.mtype = type;
+    memcpy(&msg.u, record, size);
+    return msgsnd(msqid, &msg, MSG_SIZE, IPC_NOWAIT) == 0 ? 0 : -1;
+}
+
+int telemetry_receive(int msqid, TelemetryMsg *msg) {
+    for (;;) {
+        if (msgrcv(msqid, msg, MSG_SIZE, 0, IPC_NOWAIT | MSG_NOERROR) >= 0) {
+            return 1;
+        }
+        if (errno == EINTR) continue;
+        return errno == ENOMSG ? 0 : -1;
+    }
+}
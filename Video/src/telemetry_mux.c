@@ -0,0 +1,260 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/src/telemetry_mux.c
+ */
+#include "telemetry_mux.h"
+#include "telemetry.h"
+#include "timebase.h"
+#include <gst/app/gstappsrc.h>
+#include <stdio.h>
+#include <string.h>
+
+// The queue is not pollable; IMU samples arrive every 10 ms anyway
+#define RECEIVE_POLL_US         (20 * 1000)
+#define REOPEN_INTERVAL_US      G_USEC_PER_SEC
+
+typedef struct {
+    TelemetryType type;
+    const char *name;
+    GstElement *src;
+    GByteArray *records;        // block being filled
+    guint32 count;
+    guint32 dropped;            // since the last block
+    guint32 next_seq;
+    gboolean have_seq;
+    GstClockTime slot;          // running time of the block being filled
+    guint64 received, lost, blocks;
+} TelemetryTrack;
+
+static TelemetryTrack tracks[] = {
+    { .type = TELEMETRY_IMU, .name = "imu" },
+    { .type = TELEMETRY_GNSS, .name = "gnss" },
+};
+#define TRACK_COUNT G_N_ELEMENTS(tracks)
+
+static GstElement *mux_pipeline = NULL;
+static TelemetryImuFunc imu_callback = NULL;
+static gpointer imu_callback_data = NULL;
+static GThread *receiver = NULL;
+static volatile gint receiver_stop = 0;
+static volatile gint batch_ms = 1000;
+
+gboolean telemetry_mux_add(GstElement *pipeline) {
+    GstCaps *caps = gst_caps_new_empty_simple("application/x-subtitle-unknown");
+    for (guint i = 0; i < TRACK_COUNT; i++) {
+        gchar src_name[32], pre_name[32];
+        snprintf(src_name, sizeof(src_name), "%s_telemetry", tracks[i].name);
+        snprintf(pre_name, sizeof(pre_name), "%s_prerecord", tracks[i].name);
+        GstElement *src = gst_element_factory_make("appsrc", src_name);
+        GstElement *prerecord = gst_element_factory_make("prerecord", pre_name);
+        if (!src || !prerecord) {
+            g_printerr("Failed to create %s telemetry elements\n", tracks[i].name);
+            if (src) gst_object_unref(src);
+            if (prerecord) gst_object_unref(prerecord);
+            gst_caps_unref(caps);
+            return FALSE;
+        }
+        // Timestamps are set from the samples, as running time
+        g_object_set(G_OBJECT(src),
+                    "caps", caps,
+                    "is-live", TRUE,
+                    "format", GST_FORMAT_TIME,
+                    "do-timestamp", FALSE,
+                    NULL);
+        gst_bin_add_many(GST_BIN(pipeline), src, prerecord, NULL);
+        if (!gst_element_link(src, prerecord)) {
+            g_printerr("Failed to link %s telemetry\n", tracks[i].name);
+            gst_caps_unref(caps);
+            return FALSE;
+        }
+        tracks[i].src = src;
+    }
+    gst_caps_unref(caps);
+    return TRUE;
+}
+
+void telemetry_mux_set_batch(guint ms) {
+    g_atomic_int_set(&batch_ms, (gint)MAX(ms, 1u));
+}
+
+void telemetry_mux_set_imu_callback(TelemetryImuFunc func, gpointer user_data) {
+    imu_callback = func;
+    imu_callback_data = user_data;
+}
+
+static TelemetryTrack* track_for(long type) {
+    for (guint i = 0; i < TRACK_COUNT; i++) {
+        if (tracks[i].type == type) {
+            return tracks[i].src ? &tracks[i] : NULL;
+        }
+    }
+    return NULL;
+}
+
+static void add_record(const TelemetryMsg *msg, GstClockTime base) {
+    if (msg->mtype == TELEMETRY_IMU && imu_callback) {
+        imu_callback(&msg->u.imu, imu_callback_data);
+    }
+    TelemetryTrack *t = track_for(msg->mtype);
+    if (!t) {
+        return;
+    }
+    guint64 mono_ns = msg->mtype == TELEMETRY_IMU ? msg->u.imu.mono_ns : msg->u.gnss.mono_ns;
+    guint32 seq = msg->mtype == TELEMETRY_IMU ? msg->u.imu.seq : msg->u.gnss.seq;
+
+    // A sender that restarted counts from 0 again: not a loss
+    t->received++;
+    guint32 lost = seq - t->next_seq;
+    if (t->have_seq && lost != 0 && lost < 0x80000000u) {
+        t->dropped += lost;
+        t->lost += lost;
+    }
+    t->next_seq = seq + 1;
+    t->have_seq = TRUE;
+
+    // Left in the queue from before this pipeline started
+    if (base == 0 || mono_ns < base) {
+        return;
+    }
+    g_byte_array_append(t->records, (const guint8 *)&msg->u, telemetry_record_size(t->type));
+    t->count++;
+}
+
+static void push_block(TelemetryTrack *t, GstClockTime base, GstClockTime batch) {
+    TelemetryBlockHeader header = {
+        .magic = TELEMETRY_BLOCK_MAGIC,
+        .type = (uint16_t)t->type,
+        .record_size = telemetry_record_size(t->type),
+        .count = t->count,
+        .dropped = t->dropped,
+        .base_ns = base + t->slot,
+    };
+    GstBuffer *buffer = gst_buffer_new_allocate(NULL, sizeof(header) + t->records->len, NULL);
+    gst_buffer_fill(buffer, 0, &header, sizeof(header));
+    gst_buffer_fill(buffer, sizeof(header), t->records->data, t->records->len);
+    GST_BUFFER_PTS(buffer) = t->slot;
+    GST_BUFFER_DURATION(buffer) = batch;
+    gst_app_src_push_buffer(GST_APP_SRC(t->src), buffer);
+
+    g_byte_array_set_size(t->records, 0);
+    t->count = 0;
+    t->dropped = 0;
+    t->blocks++;
+}
+
+// Close every block whose period is over, empty or not
+static void flush_due(GstClockTime base, guint64 now_ns) {
+    if (base == 0 || now_ns < base) {
+        return;
+    }
+    GstClockTime running = now_ns - base;
+    GstClockTime batch = (GstClockTime)g_atomic_int_get(&batch_ms) * GST_MSECOND;
+    for (guint i = 0; i < TRACK_COUNT; i++) {
+        TelemetryTrack *t = &tracks[i];
+        if (!t->src) continue;
+        if (!GST_CLOCK_TIME_IS_VALID(t->slot)) {
+            t->slot = running - running % batch;
+            continue;
+        }
+        if (running < t->slot + batch) continue;
+        push_block(t, base, batch);
+        t->slot += batch;
+        // Fell behind (stalled thread, batch changed): resume at the
+        // current period rather than push a burst of empty blocks
+        if (t->slot + batch <= running) {
+            t->slot = running - running % batch;
+        }
+    }
+}
+
+static gpointer receiver_thread(gpointer data) {
+    int msqid = telemetry_open();
+    gint64 reopen_at = 0;
+    GstClockTime last_base = 0;
+    if (msqid < 0) {
+        perror("Telemetry queue unavailable");
+    }
+
+    while (!g_atomic_int_get(&receiver_stop)) {
+        // Someone removed the queue (ipcrm, an old imu_logger): attach again
+        if (msqid < 0 && g_get_monotonic_time() >= reopen_at) {
+            msqid = telemetry_open();
+            reopen_at = g_get_monotonic_time() + REOPEN_INTERVAL_US;
+        }
+        TelemetryMsg msg;
+        int got = msqid >= 0 ? telemetry_receive(msqid, &msg) : 0;
+        if (got < 0) {
+            msqid = -1;
+            got = 0;
+        }
+
+        // Base time is set once the pipeline reaches PLAYING, and again
+        // if it is ever restarted: start the blocks over
+        GstClockTime base = gst_element_get_base_time(mux_pipeline);
+        if (base != last_base) {
+            for (guint i = 0; i < TRACK_COUNT; i++) {
+                tracks[i].slot = GST_CLOCK_TIME_NONE;
+            }
+            last_base = base;
+        }
+        if (got) {
+            add_record(&msg, base);
+        }
+        flush_due(base, timebase_now_ns());
+        if (!got) {
+            g_usleep(RECEIVE_POLL_US);
+        }
+    }
+    return NULL;
+}
+
+void telemetry_mux_start(GstElement *pipeline, guint ms) {
+    mux_pipeline = pipeline;
+    telemetry_mux_set_batch(ms);
+    gboolean any = FALSE;
+    for (guint i = 0; i < TRACK_COUNT; i++) {
+        TelemetryTrack *t = &tracks[i];
+        if (!t->src) {
+            gchar name[32];
+            snprintf(name, sizeof(name), "%s_telemetry", t->name);
+            t->src = gst_bin_get_by_name(GST_BIN(pipeline), name);
+            // The bin keeps it alive
+            if (t->src) gst_object_unref(t->src);
+        }
+        t->records = g_byte_array_new();
+        t->count = t->dropped = t->next_seq = 0;
+        t->have_seq = FALSE;
+        t->slot = GST_CLOCK_TIME_NONE;
+        t->received = t->lost = t->blocks = 0;
+        any |= t->src != NULL;
+    }
+    if (!any && !imu_callback) {
+        return;
+    }
+    g_atomic_int_set(&receiver_stop, 0);
+    receiver = g_thread_new("telemetry", receiver_thread, NULL);
+}
+
+void telemetry_mux_stop(void) {
+    if (receiver) {
+        g_atomic_int_set(&receiver_stop, 1);
+        g_thread_join(receiver);
+        receiver = NULL;
+        for (guint i = 0; i < TRACK_COUNT; i++) {
+            TelemetryTrack *t = &tracks[i];
+            if (!t->src) continue;
+            g_print("Telemetry %s: %" G_GUINT64_FORMAT " samples, %" G_GUINT64_FORMAT " lost, %"
+                    G_GUINT64_FORMAT " blocks\n", t->name, t->received, t->lost, t->blocks);
+        }
+    }
+    for (guint i = 0; i < TRACK_COUNT; i++) {
+        if (tracks[i].records) {
+            g_byte_array_free(tracks[i].records, TRUE);
+            tracks[i].records = NULL;
+        }
+        tracks[i].src = NULL;
+    }
+    mux_pipeline = NULL;
+    imu_callback = NULL;
+    imu_callback_data = NULL;
+}
@@ -0,0 +1,172 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/src/timebase.c
+ */
+#include "timebase.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+// Anything before 2020 is a clock that was never set
+#define SYSTEM_CLOCK_VALID_S    1577836800ll
+#define MEASURE_TRIES           5
+// A publisher killed mid-write leaves seq odd; after this long it is ignored
+#define WRITER_WAIT_SPINS       1000
+
+static TimebaseBlock *block = NULL;
+static TimebaseBlock local_block;   // when shared memory is unavailable
+
+static uint64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+uint64_t timebase_now_ns(void) {
+    return clock_ns(CLOCK_MONOTONIC);
+}
+
+static void init_block(TimebaseBlock *b) {
+    // First one in sets the block up; the others see the magic
+    uint32_t expected = 0;
+    if (__atomic_compare_exchange_n(&b->magic, &expected, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        b->version = TIMEBASE_VERSION;
+        b->source = TIMEBASE_SOURCE_NONE;
+        __atomic_store_n(&b->magic, TIMEBASE_MAGIC, __ATOMIC_RELEASE);
+    }
+}
+
+int timebase_open(void) {
+    if (block) {
+        return block == &local_block ? -1 : 0;
+    }
+    int shmid = shmget(TIMEBASE_SHM_KEY, sizeof(TimebaseBlock), IPC_CREAT | 0666);
+    void *p = shmid == -1 ? (void *)-1 : shmat(shmid, NULL, 0);
+    if (p == (void *)-1) {
+        perror("Timebase shared memory unavailable, keeping it local");
+        block = &local_block;
+        init_block(block);
+        return -1;
+    }
+    block = (TimebaseBlock *)p;
+    init_block(block);
+    // Left behind by another layout: start over
+    if (__atomic_load_n(&block->magic, __ATOMIC_ACQUIRE) == TIMEBASE_MAGIC &&
+        block->version != TIMEBASE_VERSION) {
+        fprintf(stderr, "Timebase block version %u, expected %u\n", block->version, TIMEBASE_VERSION);
+        shmdt(block);
+        block = &local_block;
+        init_block(block);
+        return -1;
+    }
+    return 0;
+}
+
+void timebase_close(void) {
+    if (block && block != &local_block) {
+        shmdt(block);
+    }
+    block = NULL;
+}
+
+static TimebaseBlock* get_block(void) {
+    if (!block) {
+        timebase_open();
+    }
+    return block;
+}
+
+int timebase_publish(int64_t utc_offset_ns, TimebaseSource source, uint64_t uncertainty_ns) {
+    TimebaseBlock *b = get_block();
+
+    // Writers from several processes: take the odd sequence number
+    uint32_t seq = __atomic_load_n(&b->seq, __ATOMIC_RELAXED), odd;
+    for (int spins = 0;; spins++) {
+        if ((seq & 1) && spins < WRITER_WAIT_SPINS) {
+            usleep(10);
+            seq = __atomic_load_n(&b->seq, __ATOMIC_RELAXED);
+            continue;
+        }
+        odd = seq | 1;
+        if (odd == seq || __atomic_compare_exchange_n(&b->seq, &seq, odd, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    int replaced = b->source == TIMEBASE_SOURCE_NONE || b->source == (uint32_t)source ||
+                   uncertainty_ns <= b->uncertainty_ns;
+    if (replaced) {
+        b->source = source;
+        b->utc_offset_ns = utc_offset_ns;
+        b->uncertainty_ns = uncertainty_ns;
+        b->updated_ns = timebase_now_ns();
+        b->publisher_pid = (uint32_t)getpid();
+    }
+    __atomic_store_n(&b->seq, odd + 1, __ATOMIC_RELEASE);
+    return replaced;
+}
+
+int timebase_publish_system(void) {
+    // Bracket the realtime read between two monotonic reads and keep the
+    // tightest of a few tries
+    uint64_t best_width = UINT64_MAX;
+    int64_t offset = 0;
+    uint64_t realtime = 0;
+    for (int i = 0; i < MEASURE_TRIES; i++) {
+        uint64_t m0 = clock_ns(CLOCK_MONOTONIC);
+        uint64_t r = clock_ns(CLOCK_REALTIME);
+        uint64_t m1 = clock_ns(CLOCK_MONOTONIC);
+        if (m1 - m0 < best_width) {
+            best_width = m1 - m0;
+            offset = (int64_t)(r - (m0 + (m1 - m0) / 2));
+            realtime = r;
+        }
+    }
+    if (realtime / 1000000000ull < (uint64_t)SYSTEM_CLOCK_VALID_S) {
+        return -1;
+    }
+    return timebase_publish(offset, TIMEBASE_SOURCE_SYSTEM, best_width / 2 + 1);
+}
+
+TimebaseSource timebase_utc_offset(int64_t *utc_offset_ns, uint64_t *uncertainty_ns) {
+    TimebaseBlock *b = get_block();
+    uint32_t seq, source;
+    int64_t offset;
+    uint64_t uncertainty;
+    int tries = 0;
+    do {
+        seq = __atomic_load_n(&b->seq, __ATOMIC_ACQUIRE);
+        source = b->source;
+        offset = b->utc_offset_ns;
+        uncertainty = b->uncertainty_ns;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (((seq & 1) || seq != __atomic_load_n(&b->seq, __ATOMIC_RELAXED)) &&
+             ++tries < WRITER_WAIT_SPINS);
+
+    if (source == TIMEBASE_SOURCE_NONE) {
+        offset = 0;
+        uncertainty = 0;
+    }
+    if (utc_offset_ns) *utc_offset_ns = offset;
+    if (uncertainty_ns) *uncertainty_ns = uncertainty;
+    return (TimebaseSource)source;
+}
+
+uint64_t timebase_to_utc_ns(uint64_t monotonic_ns) {
+    int64_t offset;
+    if (timebase_utc_offset(&offset, NULL) == TIMEBASE_SOURCE_NONE) {
+        return 0;
+    }
+    return (uint64_t)((int64_t)monotonic_ns + offset);
+}
+
+const char* timebase_source_name(TimebaseSource source) {
+    switch (source) {
+        case TIMEBASE_SOURCE_SYSTEM: return "system";
+        case TIMEBASE_SOURCE_GNSS:   return "gnss";
+        default:                     return "none";
+    }
+}
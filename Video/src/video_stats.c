@@ -0,0 +1,53 @@
+/*
+ * @Author: LegionMay
+ * @FilePath: /TSPi_Action/Video/src/video_stats.c
+ */
+#include "pipeline_stats.h"
+#include "preview_ring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Dump the statistics block of a running VideoProcess
+static void print_usage(void) {
+    printf("Usage: video_stats [-w <seconds>]\n");
+    printf("  Print the pipeline statistics and preview readers of the running VideoProcess.\n");
+    printf("  -w  repeat every <seconds> until interrupted\n");
+}
+
+int main(int argc, char *argv[]) {
+    int interval = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            interval = atoi(argv[++i]);
+        } else {
+            print_usage();
+            return strcmp(argv[i], "-h") == 0 ? 0 : 1;
+        }
+    }
+
+    const PipelineStatsBlock *stats = pipeline_stats_attach();
+    if (!stats) {
+        fprintf(stderr, "No pipeline statistics (is VideoProcess running?)\n");
+        return 1;
+    }
+    // Readers are listed only if VideoProcess created the table
+    const PreviewReaderTable *readers = preview_readers_attach();
+    for (;;) {
+        pipeline_stats_print(stats, stdout);
+        if (readers) {
+            preview_readers_print(readers, stats->preview_published, stdout);
+        }
+        fflush(stdout);
+        if (interval <= 0) {
+            break;
+        }
+        sleep(interval);
+        printf("\n");
+    }
+    preview_readers_detach(readers);
+    pipeline_stats_detach(stats);
+    return 0;
+}